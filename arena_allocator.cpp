@@ -32,565 +32,393 @@
 */
 
 #include "arena_allocator.h"
-#include <limits>
-#include <thread>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <stdexcept>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
 
-// TODO: Understand the impact and significance of alignment.
-// Well be going the route of mmap for this one: https://stackoverflow.com/questions/45972/mmap-vs-reading-blocks
-// Since the buffer_pool would live for as long as the DB instance does, and we'll be accessing randomly, that seems
-// to make more sense. I'll benchmark the difference b/w malloc and mmap once I'm done with the initialization.
-// Arena will default to a 20MB region with a page size of 4KB.
-//
-// The capacity will be adjusted so that it is an exact multiple of page_size.
-// Ideally the page_size will be a power of 2 for good memory alignment.
-// For the bitmap implementation the number of slots in the arena need to be a multiple of 64.
-Arena::Arena(size_t capacity, size_t page_size) {
+size_t arena_slot_count(size_t capacity, size_t slot_size) {
     // Calculate initial number of slots that would fit
-    size_t num_slots = (capacity + page_size - 1) / page_size;
+    size_t num_slots = (capacity + slot_size - 1) / slot_size;
 
     // Ensure minimum of 64 slots; round up to next multiple of 64
     if (num_slots < Bitmap::WORD_LENGTH) {
         num_slots = Bitmap::WORD_LENGTH;
     }
     // Round up to next multiple of 64 without magic numbers
-    num_slots = ((num_slots + Bitmap::WORD_LENGTH - 1) / Bitmap::WORD_LENGTH) * Bitmap::WORD_LENGTH;
-
-    // Capacity is adjusted to be an exact multiple of page_size and slot count
-    this->capacity = num_slots * page_size;
-    this->slot_size = page_size;
-
-    // For the buffer pool we'll have to read and write the pages, the memory is not backed by a file, and it's
-    // private to our process.
-    void* arena_start = mmap(NULL, this->capacity, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-
-    if (arena_start == MAP_FAILED) {
-        throw std::runtime_error("mmap failed");
-    }
-
-    this->bitmap = new Bitmap(num_slots);
-    this->base = (char*)arena_start;
-    this->slots_in_use.store(0);
+    return ((num_slots + Bitmap::WORD_LENGTH - 1) / Bitmap::WORD_LENGTH) * Bitmap::WORD_LENGTH;
 }
 
-Arena::~Arena() {
-    int unmapped = munmap(base, capacity);
-
-    if (unmapped == -1) {
-        std::perror("munmap failed");
-    }
+static constexpr size_t HUGE_PAGE_2MB = 2ULL << 20;
+static constexpr size_t HUGE_PAGE_1GB = 1ULL << 30;
 
-    delete bitmap;
+static size_t round_up(size_t bytes, size_t alignment) {
+    return (bytes + alignment - 1) / alignment * alignment;
 }
 
-char* Arena::allocate(size_t size) {
-    if (size == 0) {
+// Plain mapping whose start is aligned to `alignment`: over-map by one alignment and trim both ends. THP can only use
+// huge pages for 2 MB aligned stretches, a 4 KB aligned mapping would lose the first and last one.
+static char* map_aligned(size_t bytes, size_t alignment, int prot, int extra_flags) {
+    size_t padded = bytes + alignment;
+    void* raw = mmap(NULL, padded, prot, MAP_ANONYMOUS | MAP_PRIVATE | extra_flags, -1, 0);
+    if (raw == MAP_FAILED) {
         return NULL;
     }
-    // TODO: Add overflow check for (size + slot_size - 1) if this moves beyond prototype
-    size_t slots_required = (size + slot_size - 1) / slot_size;
-    char* allocation_base = NULL;
-
-    std::lock_guard<std::mutex> lock(bitmap_mutex);
-
-    if (slots_required == 1) {
-        int slot_idx = bitmap->allocate_one();
-        if (slot_idx != -1) {
-            allocation_base = base + slot_size * slot_idx;
-            slots_in_use.fetch_add(1, std::memory_order_relaxed);
-        }
+    uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t aligned = round_up(start, alignment);
+    if (aligned != start) {
+        munmap(raw, aligned - start);
     }
-
-    return allocation_base;
-}
-
-void Arena::free(char* ptr, size_t size) {
-    if (ptr == NULL || size == 0) {
-        return;
+    size_t tail = start + padded - (aligned + bytes);
+    if (tail != 0) {
+        munmap(reinterpret_cast<char*>(aligned + bytes), tail);
     }
-
-    if (ptr < base || ptr >= base + capacity) {
-        return;
-    }
-
-    // Alignment check
-    ptrdiff_t offset = ptr - base;
-    if (static_cast<size_t>(offset) % slot_size != 0) {
-        return; // not aligned to slot
-    }
-    // TODO: Add overflow check for (size + slot_size - 1) if this moves beyond prototype
-    size_t start_slot = static_cast<size_t>(offset) / slot_size;
-    size_t slots_to_free = (size + slot_size - 1) / slot_size;
-    if (slots_to_free != 1) {
-        return; // single-slot only
-    }
-
-    std::lock_guard<std::mutex> lock(bitmap_mutex);
-
-    if (start_slot >= bitmap->num_slots) {
-        return;
-    }
-    auto [word_idx, bit_idx] = bitmap->get_word_and_bit_index_from_slot_index(static_cast<uint32_t>(start_slot));
-    // If bit is 1, slot is already free -> double free
-    if (bitmap->words[word_idx] & (1ULL << bit_idx)) {
-        return;
-    }
-    bitmap->free_slot(static_cast<uint32_t>(start_slot));
-
-    // If I use a lock free implementation would this work?
-    // Likely yes since even if this is not mutex protected, the operation is still atomic. But I'll need to think
-    // if there is a scenario where there can be inconsistencies in the snapshot in time.
-    slots_in_use.fetch_sub(1, std::memory_order_relaxed);
+    return reinterpret_cast<char*>(aligned);
 }
 
-// ArenaSpinLock constructor - same as Arena but uses spin-lock
-ArenaSpinLock::ArenaSpinLock(size_t capacity, size_t page_size) {
-    size_t num_slots = (capacity + page_size - 1) / page_size;
-
-    if (num_slots < Bitmap::WORD_LENGTH) {
-        num_slots = Bitmap::WORD_LENGTH;
-    }
-    num_slots = ((num_slots + Bitmap::WORD_LENGTH - 1) / Bitmap::WORD_LENGTH) * Bitmap::WORD_LENGTH;
-
-    this->capacity = num_slots * page_size;
-    this->slot_size = page_size;
-    this->bitmap_spinlock.clear(std::memory_order_release);
-
-    void* arena_start = mmap(NULL, this->capacity, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-
-    if (arena_start == MAP_FAILED) {
-        throw std::runtime_error("mmap failed");
-    }
-
-    this->bitmap = new Bitmap(num_slots);
-    this->base = (char*)arena_start;
-    this->slots_in_use.store(0);
+// MAP_HUGETLB with an explicit page size. Fails (NULL) whenever the pool for that size has nothing left, which on a
+// box nobody configured is always.
+static char* map_hugetlb(size_t bytes, size_t huge_page_size, int extra_flags) {
+#if defined(__linux__) && defined(MAP_HUGETLB)
+    int flags = MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB | extra_flags;
+#if defined(MAP_HUGE_SHIFT)
+    flags |= std::countr_zero(huge_page_size) << MAP_HUGE_SHIFT;
+#endif
+    void* region = mmap(NULL, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+    return region == MAP_FAILED ? NULL : static_cast<char*>(region);
+#else
+    (void)bytes;
+    (void)huge_page_size;
+    (void)extra_flags;
+    return NULL;
+#endif
 }
 
-ArenaSpinLock::~ArenaSpinLock() {
-    int unmapped = munmap(base, capacity);
-
-    if (unmapped == -1) {
-        std::perror("munmap failed");
-    }
-
-    delete bitmap;
-}
-
-char* ArenaSpinLock::allocate(size_t size) {
-    if (size == 0) {
-        return NULL;
-    }
-    // TODO: Add overflow check for (size + slot_size - 1) if this moves beyond prototype
-    size_t slots_required = (size + slot_size - 1) / slot_size;
-    char* allocation_base = NULL;
-
-    if (slots_required == 1) {
-        while (bitmap_spinlock.test_and_set(std::memory_order_acquire)) {
-            std::this_thread::yield();
-        }
-        int slot_idx = bitmap->allocate_one();
-        if (slot_idx != -1) {
-            allocation_base = base + slot_size * slot_idx;
-            slots_in_use.fetch_add(1, std::memory_order_relaxed);
+// NUMA placement via the raw syscall so we don't pull in libnuma for two constants. Has to happen before anything
+// touches the pages, after that the policy only applies to pages faulted in later.
+static bool apply_numa_policy(char* base, size_t bytes, const ArenaOptions& options) {
+#if defined(__linux__) && defined(SYS_mbind)
+    constexpr int MPOL_BIND_MODE = 2;       // MPOL_BIND in <linux/mempolicy.h>
+    constexpr int MPOL_INTERLEAVE_MODE = 3; // MPOL_INTERLEAVE
+    constexpr int MAX_NODES = 64;
+
+    if (options.numa == NumaPolicy::None) {
+        return true;
+    }
+    unsigned long nodemask;
+    int mode;
+    if (options.numa == NumaPolicy::Bind) {
+        if (options.numa_node < 0 || options.numa_node >= MAX_NODES) {
+            return false;
         }
-        bitmap_spinlock.clear(std::memory_order_release);
-    }
-
-    return allocation_base;
+        nodemask = 1UL << options.numa_node;
+        mode = MPOL_BIND_MODE;
+    } else {
+        // The kernel masks out nodes we aren't allowed on (or that don't exist), so "all" can just be all ones.
+        nodemask = options.interleave_nodes == 0 ? ~0UL : static_cast<unsigned long>(options.interleave_nodes);
+        mode = MPOL_INTERLEAVE_MODE;
+    }
+    // maxnode is one more than the number of bits, the kernel has been off by one here forever and libnuma does this.
+    return syscall(SYS_mbind, base, bytes, mode, &nodemask, MAX_NODES + 1, 0) == 0;
+#else
+    (void)base;
+    (void)bytes;
+    (void)options;
+    return true;
+#endif
 }
 
-void ArenaSpinLock::free(char* ptr, size_t size) {
-    if (ptr == NULL || size == 0) {
+// THP only collapses ranges that asked for it.
+static void advise_huge_pages(ArenaRegion& region) {
+    if (region.pages != PageBacking::TransparentHuge) {
         return;
     }
-
-    if (ptr < base || ptr >= base + capacity) {
-        return;
+#if defined(MADV_HUGEPAGE)
+    // Fails when THP is compiled out or set to "never", the mapping is still perfectly usable then.
+    if (madvise(region.base, region.mapped_bytes, MADV_HUGEPAGE) != 0) {
+        region.pages = PageBacking::Default;
     }
+#else
+    region.pages = PageBacking::Default;
+#endif
+}
 
-    ptrdiff_t offset = ptr - base;
-    if (static_cast<size_t>(offset) % slot_size != 0) {
-        return;
-    }
-    // TODO: Add overflow check for (size + slot_size - 1) if this moves beyond prototype
-    size_t start_slot = static_cast<size_t>(offset) / slot_size;
-    size_t slots_to_free = (size + slot_size - 1) / slot_size;
-    if (slots_to_free != 1) {
+// Prefault for mappings that are already placed and advised, where MAP_POPULATE is too early.
+static void prefault_after_setup(ArenaRegion& region, const ArenaOptions& options) {
+    if (options.prefault == Prefault::None) {
         return;
     }
-
-    while (bitmap_spinlock.test_and_set(std::memory_order_acquire)) {
-        std::this_thread::yield();
-    }
-    if (start_slot < bitmap->num_slots) {
-        auto [word_idx, bit_idx] = bitmap->get_word_and_bit_index_from_slot_index(static_cast<uint32_t>(start_slot));
-        if ((bitmap->words[word_idx] & (1ULL << bit_idx)) == 0) {
-            // bit 0 -> allocated, safe to free
-            bitmap->free_slot(static_cast<uint32_t>(start_slot));
-            slots_in_use.fetch_sub(1, std::memory_order_relaxed);
-        }
-        // else double-free detected; ignore
-    }
-    bitmap_spinlock.clear(std::memory_order_release);
-
-    // decrement already done conditionally above
-}
-
-// Lock-free arena allocator using BitmapLockFree for thread-safe allocation without mutexes.
-// This implementation uses atomic operations and compare-and-swap for all bitmap operations.
-// Single-slot allocation only (same as Arena for now).
-// Lock-free arena constructor - same initialization as Arena but uses BitmapLockFree.
-// The capacity will be adjusted so that it is an exact multiple of page_size.
-// Ideally the page_size will be a power of 2 for good memory alignment.
-// For the bitmap implementation the number of slots in the arena need to be a multiple of 64.
-ArenaLockFree::ArenaLockFree(size_t capacity, size_t page_size) {
-    // Calculate initial number of slots that would fit
-    size_t num_slots = (capacity + page_size - 1) / page_size;
-
-    if (num_slots < BitmapLockFree::WORD_LENGTH) {
-        num_slots = BitmapLockFree::WORD_LENGTH;
+    auto start = std::chrono::steady_clock::now();
+    region.prefault = Prefault::Touch;
+#if defined(MADV_POPULATE_WRITE)
+    // 5.14+, same as MAP_POPULATE but after the THP and NUMA setup. Older kernels say EINVAL.
+    if (options.prefault == Prefault::Populate && madvise(region.base, region.mapped_bytes, MADV_POPULATE_WRITE) == 0) {
+        region.prefault = Prefault::Populate;
     }
-    num_slots = ((num_slots + BitmapLockFree::WORD_LENGTH - 1) / BitmapLockFree::WORD_LENGTH) * BitmapLockFree::WORD_LENGTH;
-
-    // Capacity is adjusted to be an exact multiple of page_size and slot count
-    this->capacity = num_slots * page_size;
-    this->slot_size = page_size;
-
-    // For the buffer pool we'll have to read and write the pages, the memory is not backed by a file, and it's
-    // private to our process.
-    void* arena_start = mmap(NULL, this->capacity, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-
-    if (arena_start == MAP_FAILED) {
-        throw std::runtime_error("mmap failed");
+#endif
+    if (region.prefault == Prefault::Touch) {
+        arena_prefault_region(region, options.prefault_threads);
     }
-
-    this->bitmap = new BitmapLockFree(num_slots);
-    this->base = (char*)arena_start;
-    this->slots_in_use.store(0);
+    auto end = std::chrono::steady_clock::now();
+    region.prefault_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
 }
 
-ArenaLockFree::~ArenaLockFree() {
-    int unmapped = munmap(base, capacity);
-
-    if (unmapped == -1) {
-        std::perror("munmap failed");
-    }
-
-    delete bitmap;
+// Page size the region is faulted and released in.
+static size_t region_granule(const ArenaRegion& region) {
+    return region.pages == PageBacking::Huge1GB   ? HUGE_PAGE_1GB
+           : region.pages == PageBacking::Huge2MB ? HUGE_PAGE_2MB
+                                                  : static_cast<size_t>(sysconf(_SC_PAGESIZE));
 }
 
-// Lock-free single-slot allocation.
-// Uses BitmapLockFree::allocate_one() which performs atomic CAS operations.
-// Currently only supports single-slot allocations (slots_required == 1).
-char* ArenaLockFree::allocate(size_t size) {
-    char* allocation_base = NULL;
-
-    if (size == 0) {
-        return allocation_base;
-    }
-    // TODO: Add overflow check for (size + slot_size - 1) if this moves beyond prototype
-    size_t slots_required = (size + slot_size - 1) / slot_size;
-
-    // No mutex needed - bitmap operations are lock-free with atomic CAS
-    if (slots_required == 1) {
-        int slot_idx = bitmap->allocate_one();
-        if (slot_idx != -1) {
-            allocation_base = base + slot_size * slot_idx;
-            // Atomic increment without mutex - safe because it's atomic
-            slots_in_use.fetch_add(1, std::memory_order_relaxed);
+ArenaRegion arena_map_region(size_t bytes, const ArenaOptions& options) {
+    ArenaRegion region{NULL, bytes, options.pages};
+
+    // MAP_POPULATE faults everything in inside mmap, which is only right when nothing has to be set up on the mapping
+    // before the first fault: THP wants its madvise first and mbind only moves pages faulted in after it.
+    int populate_flags = 0;
+#if defined(MAP_POPULATE)
+    if (options.prefault == Prefault::Populate && options.pages != PageBacking::TransparentHuge &&
+        options.numa == NumaPolicy::None) {
+        populate_flags = MAP_POPULATE;
+    }
+#endif
+    auto populate_start = std::chrono::steady_clock::now();
+
+    if (options.pages == PageBacking::Huge1GB || options.pages == PageBacking::Huge2MB) {
+        size_t huge_page_size = options.pages == PageBacking::Huge1GB ? HUGE_PAGE_1GB : HUGE_PAGE_2MB;
+        region.mapped_bytes = round_up(bytes, huge_page_size);
+        region.base = map_hugetlb(region.mapped_bytes, huge_page_size, populate_flags);
+        if (region.base == NULL) {
+            // No reserved huge pages, get what we can through THP instead.
+            region.mapped_bytes = bytes;
+            region.pages = PageBacking::TransparentHuge;
+            populate_flags = 0;
         }
     }
 
-    return allocation_base;
-}
-
-// Lock-free deallocation.
-// Uses BitmapLockFree::free_slot() which performs atomic fetch_or operations.
-void ArenaLockFree::free(char* ptr, size_t size) {
-    if (ptr == NULL || size == 0) {
-        return;
-    }
-
-    if (ptr < base || ptr >= base + capacity) {
-        return;
+    if (region.base == NULL) {
+        // For the buffer pool we'll have to read and write the pages, the memory is not backed by a file, and it's
+        // private to our process.
+        region.base = region.pages == PageBacking::TransparentHuge
+                          ? map_aligned(bytes, HUGE_PAGE_2MB, PROT_READ | PROT_WRITE, 0)
+                          : map_aligned(bytes, 1, PROT_READ | PROT_WRITE, populate_flags);
+        if (region.base == NULL) {
+            throw std::runtime_error("mmap failed");
+        }
     }
 
-    ptrdiff_t offset = ptr - base;
-    if (static_cast<size_t>(offset) % slot_size != 0) {
-        return;
-    }
-    // TODO: Add overflow check for (size + slot_size - 1) if this moves beyond prototype
-    size_t start_slot = static_cast<size_t>(offset) / slot_size;
-    size_t slots_to_free = (size + slot_size - 1) / slot_size;
-    if (slots_to_free != 1) {
-        return;
+    advise_huge_pages(region);
+    if (!apply_numa_policy(region.base, region.mapped_bytes, options)) {
+        arena_unmap_region(region);
+        throw std::runtime_error("mbind failed");
     }
 
-    // No mutex needed - all operations are lock-free
-    if (start_slot < bitmap->num_slots) {
-        int rc = bitmap->free_slot(static_cast<uint32_t>(start_slot));
-        if (rc == 0) {
-            slots_in_use.fetch_sub(1, std::memory_order_relaxed);
-        } else {
-            // rc == 1 double-free; rc == -1 OOB -> ignore
-        }
+    if (populate_flags != 0) {
+        region.prefault = Prefault::Populate;
+        auto populate_end = std::chrono::steady_clock::now();
+        region.prefault_ms =
+            std::chrono::duration_cast<std::chrono::microseconds>(populate_end - populate_start).count() / 1000.0;
+    } else {
+        prefault_after_setup(region, options);
     }
-
-    // decrement done conditionally above
+    return region;
 }
 
-// ArenaLockFreeHint constructor - uses BitmapLockFreeHint (lock-free with hint)
-ArenaLockFreeHint::ArenaLockFreeHint(size_t capacity, size_t page_size) {
-    size_t num_slots = (capacity + page_size - 1) / page_size;
-
-    if (num_slots < BitmapLockFreeHint::WORD_LENGTH) {
-        num_slots = BitmapLockFreeHint::WORD_LENGTH;
-    }
-    num_slots = ((num_slots + BitmapLockFreeHint::WORD_LENGTH - 1) / BitmapLockFreeHint::WORD_LENGTH) * BitmapLockFreeHint::WORD_LENGTH;
-
-    this->capacity = num_slots * page_size;
-    this->slot_size = page_size;
-
-    base = static_cast<char*>(mmap(NULL, this->capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
-    if (base == MAP_FAILED) {
+ArenaRegion arena_reserve_region(size_t bytes, const ArenaOptions& options) {
+    ArenaRegion region{NULL, bytes, options.pages};
+    if (region.pages == PageBacking::Huge2MB || region.pages == PageBacking::Huge1GB) {
+        region.pages = PageBacking::TransparentHuge;
+    }
+    int noreserve = 0;
+#if defined(MAP_NORESERVE)
+    noreserve = MAP_NORESERVE;
+#endif
+    region.base = map_aligned(bytes, region.pages == PageBacking::TransparentHuge ? HUGE_PAGE_2MB : 1, PROT_NONE,
+                              noreserve);
+    if (region.base == NULL) {
         throw std::runtime_error("mmap failed");
     }
-
-    bitmap = new BitmapLockFreeHint(num_slots);
-    slots_in_use.store(0, std::memory_order_relaxed);
-}
-
-ArenaLockFreeHint::~ArenaLockFreeHint() {
-    int unmapped = munmap(base, capacity);
-
-    if (unmapped == -1) {
-        std::perror("munmap failed");
+    // Both stick to the VMA, the pieces mprotect splits off later keep them.
+    advise_huge_pages(region);
+    if (!apply_numa_policy(region.base, region.mapped_bytes, options)) {
+        arena_unmap_region(region);
+        throw std::runtime_error("mbind failed");
     }
-
-    delete bitmap;
+    return region;
 }
 
-char* ArenaLockFreeHint::allocate(size_t size) {
-    char* allocation_base = NULL;
-
-    if (size == 0) {
-        return allocation_base;
-    }
-    // TODO: Add overflow check for (size + slot_size - 1) if this moves beyond prototype
-    size_t slots_required = (size + slot_size - 1) / slot_size;
-
-    if (slots_required == 1) {
-        int slot_idx = bitmap->allocate_one();
-        if (slot_idx != -1) {
-            allocation_base = base + slot_size * slot_idx;
-            slots_in_use.fetch_add(1, std::memory_order_relaxed);
-        }
-    }
-
-    return allocation_base;
+ArenaRegion arena_commit_region(const ArenaRegion& reservation, size_t offset, size_t bytes,
+                                const ArenaOptions& options) {
+    ArenaRegion piece{reservation.base + offset, bytes, reservation.pages};
+    piece.borrowed = true;
+    if (mprotect(piece.base, bytes, PROT_READ | PROT_WRITE) != 0) {
+        std::perror("mprotect failed");
+        piece.base = NULL;
+        return piece;
+    }
+    prefault_after_setup(piece, options);
+    return piece;
 }
 
-void ArenaLockFreeHint::free(char* ptr, size_t size) {
-    if (ptr == NULL || size == 0) {
-        return;
+ArenaRegion arena_map_file_region(int fd, size_t offset, size_t bytes, const ArenaOptions& options) {
+    ArenaRegion region{NULL, bytes, options.pages};
+    // hugetlb only works for files on hugetlbfs, which is a mount nobody has. Ask for THP instead, shmem (memfd, tmpfs)
+    // honours it when shmem_enabled allows, regular file systems just ignore it.
+    if (region.pages == PageBacking::Huge2MB || region.pages == PageBacking::Huge1GB) {
+        region.pages = PageBacking::TransparentHuge;
+    }
+    int noreserve = 0;
+#if defined(MAP_NORESERVE)
+    noreserve = MAP_NORESERVE;
+#endif
+    // Aligned address space first and the file on top of it, same reason as map_aligned.
+    char* reserved = map_aligned(bytes, region.pages == PageBacking::TransparentHuge ? HUGE_PAGE_2MB : 1, PROT_NONE,
+                                 noreserve);
+    if (reserved == NULL) {
+        throw std::runtime_error("mmap failed");
     }
-
-    if (ptr < base || ptr >= base + capacity) {
-        return;
+    void* mapped =
+        mmap(reserved, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, static_cast<off_t>(offset));
+    if (mapped == MAP_FAILED) {
+        munmap(reserved, bytes);
+        throw std::runtime_error("mmap of the arena file failed");
     }
+    region.base = static_cast<char*>(mapped);
 
-    ptrdiff_t offset = ptr - base;
-    if (static_cast<size_t>(offset) % slot_size != 0) {
-        return;
-    }
-    // TODO: Add overflow check for (size + slot_size - 1) if this moves beyond prototype
-    size_t start_slot = static_cast<size_t>(offset) / slot_size;
-    size_t slots_to_free = (size + slot_size - 1) / slot_size;
-    if (slots_to_free != 1) {
-        return;
+    advise_huge_pages(region);
+    if (!apply_numa_policy(region.base, region.mapped_bytes, options)) {
+        arena_unmap_region(region);
+        throw std::runtime_error("mbind failed");
     }
 
-    if (start_slot < bitmap->num_slots) {
-        int rc = bitmap->free_slot(static_cast<uint32_t>(start_slot));
-        if (rc == 0) {
-            slots_in_use.fetch_sub(1, std::memory_order_relaxed);
+    // Prefaulting has to read here, not write: a write fault dirties the page and the next msync writes the whole file.
+    if (options.prefault != Prefault::None) {
+        auto start = std::chrono::steady_clock::now();
+        region.prefault = Prefault::Touch;
+#if defined(MADV_POPULATE_READ)
+        if (options.prefault == Prefault::Populate &&
+            madvise(region.base, region.mapped_bytes, MADV_POPULATE_READ) == 0) {
+            region.prefault = Prefault::Populate;
         }
+#endif
+        if (region.prefault == Prefault::Touch) {
+            size_t granule = region_granule(region);
+            for (size_t page = 0; page < region.mapped_bytes / granule; ++page) {
+                volatile char* byte = region.base + page * granule;
+                (void)*byte;
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        region.prefault_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
     }
+    return region;
 }
 
-// ArenaNoHint constructor - uses BitmapNoHint (no hint mechanism)
-ArenaNoHint::ArenaNoHint(size_t capacity, size_t page_size) {
-    size_t num_slots = (capacity + page_size - 1) / page_size;
+void arena_prefault_region(const ArenaRegion& region, unsigned threads) {
+    // Below this a thread costs more to start than it saves.
+    constexpr size_t MIN_BYTES_PER_THREAD = 64ULL << 20;
 
-    if (num_slots < BitmapNoHint::WORD_LENGTH) {
-        num_slots = BitmapNoHint::WORD_LENGTH;
+    size_t granule = region_granule(region);
+    size_t num_pages = region.mapped_bytes / granule;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
     }
-    num_slots = ((num_slots + BitmapNoHint::WORD_LENGTH - 1) / BitmapNoHint::WORD_LENGTH) * BitmapNoHint::WORD_LENGTH;
-
-    this->capacity = num_slots * page_size;
-    this->slot_size = page_size;
+    size_t max_threads = std::max<size_t>(1, region.mapped_bytes / MIN_BYTES_PER_THREAD);
+    threads = static_cast<unsigned>(std::min<size_t>(threads, max_threads));
 
-    base = static_cast<char*>(mmap(NULL, this->capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
-    if (base == MAP_FAILED) {
-        throw std::runtime_error("mmap failed");
+    // Contiguous chunks so every thread walks its own stretch of page tables.
+    auto touch = [&](size_t first_page, size_t last_page) {
+        for (size_t page = first_page; page < last_page; ++page) {
+            volatile char* byte = region.base + page * granule;
+            *byte = *byte;
+        }
+    };
+    size_t pages_per_thread = (num_pages + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; ++i) {
+        size_t first_page = std::min(num_pages, i * pages_per_thread);
+        workers.emplace_back(touch, first_page, std::min(num_pages, first_page + pages_per_thread));
+    }
+    touch(0, std::min(num_pages, pages_per_thread));
+    for (std::thread& worker : workers) {
+        worker.join();
     }
-
-    bitmap = new BitmapNoHint(num_slots);
-    slots_in_use.store(0, std::memory_order_relaxed);
 }
 
-ArenaNoHint::~ArenaNoHint() {
-    int unmapped = munmap(base, capacity);
+void arena_unmap_region(const ArenaRegion& region) {
+    int unmapped = munmap(region.base, region.mapped_bytes);
 
     if (unmapped == -1) {
         std::perror("munmap failed");
     }
-
-    delete bitmap;
 }
 
-char* ArenaNoHint::allocate(size_t size) {
-    char* allocation_base = NULL;
-
-    if (size == 0) {
-        return allocation_base;
+size_t arena_release_pages(const ArenaRegion& region, char* begin, size_t bytes, PageReclaim advice) {
+    if (advice == PageReclaim::None || bytes == 0) {
+        return 0;
     }
-    // TODO: Add overflow check for (size + slot_size - 1) if this moves beyond prototype
-    size_t slots_required = (size + slot_size - 1) / slot_size;
-
-    std::lock_guard<std::mutex> lock(bitmap_mutex);
-
-    if (slots_required == 1) {
-        int slot_idx = bitmap->allocate_one();
-        if (slot_idx != -1) {
-            allocation_base = base + slot_size * slot_idx;
-            slots_in_use.fetch_add(1, std::memory_order_relaxed);
-        }
+    // hugetlb pages can only go back whole, everything else in system pages.
+    size_t granule = region_granule(region);
+    uintptr_t start = round_up(reinterpret_cast<uintptr_t>(begin), granule);
+    uintptr_t end = (reinterpret_cast<uintptr_t>(begin) + bytes) / granule * granule;
+    if (end <= start) {
+        return 0;
     }
+    char* aligned = reinterpret_cast<char*>(start);
+    size_t length = end - start;
 
-    return allocation_base;
-}
-
-void ArenaNoHint::free(char* ptr, size_t size) {
-    if (ptr == NULL || size == 0) {
-        return;
+#if defined(MADV_FREE)
+    // MADV_FREE needs 4.5+ and doesn't do hugetlb, DONTNEED always works.
+    if (advice == PageReclaim::Free && region.pages != PageBacking::Huge2MB && region.pages != PageBacking::Huge1GB &&
+        madvise(aligned, length, MADV_FREE) == 0) {
+        return length;
     }
-
-    if (ptr < base || ptr >= base + capacity) {
-        return;
-    }
-
-    ptrdiff_t offset = ptr - base;
-    if (static_cast<size_t>(offset) % slot_size != 0) {
-        return;
+#endif
+    if (madvise(aligned, length, MADV_DONTNEED) != 0) {
+        std::perror("madvise failed");
+        return 0;
     }
-    // TODO: Add overflow check for (size + slot_size - 1) if this moves beyond prototype
-    size_t start_slot = static_cast<size_t>(offset) / slot_size;
-    size_t slots_to_free = (size + slot_size - 1) / slot_size;
-    if (slots_to_free != 1) {
-        return;
-    }
-
-    std::lock_guard<std::mutex> lock(bitmap_mutex);
-
-    if (start_slot >= bitmap->num_slots) {
-        return;
-    }
-    auto [word_idx, bit_idx] = bitmap->get_word_and_bit_index_from_slot_index(static_cast<uint32_t>(start_slot));
-    if (bitmap->words[word_idx] & (1ULL << bit_idx)) {
-        return;
-    }
-    bitmap->free_slot(static_cast<uint32_t>(start_slot));
-
-    slots_in_use.fetch_sub(1, std::memory_order_relaxed);
-}
-
-// ArenaNoHintSpinLock constructor - uses BitmapNoHint with spin-lock
-ArenaNoHintSpinLock::ArenaNoHintSpinLock(size_t capacity, size_t page_size) {
-    size_t num_slots = (capacity + page_size - 1) / page_size;
-
-    if (num_slots < BitmapNoHint::WORD_LENGTH) {
-        num_slots = BitmapNoHint::WORD_LENGTH;
-    }
-    num_slots = ((num_slots + BitmapNoHint::WORD_LENGTH - 1) / BitmapNoHint::WORD_LENGTH) * BitmapNoHint::WORD_LENGTH;
-
-    this->capacity = num_slots * page_size;
-    this->slot_size = page_size;
-    this->bitmap_spinlock.clear(std::memory_order_release);
-
-    base = static_cast<char*>(mmap(NULL, this->capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
-    if (base == MAP_FAILED) {
-        throw std::runtime_error("mmap failed");
-    }
-
-    bitmap = new BitmapNoHint(num_slots);
-    slots_in_use.store(0, std::memory_order_relaxed);
+    return length;
 }
 
-ArenaNoHintSpinLock::~ArenaNoHintSpinLock() {
-    int unmapped = munmap(base, capacity);
-
-    if (unmapped == -1) {
-        std::perror("munmap failed");
-    }
-
-    delete bitmap;
+const char* page_backing_name(PageBacking pages) {
+    switch (pages) {
+    case PageBacking::Default:
+        return "default pages";
+    case PageBacking::TransparentHuge:
+        return "transparent huge pages";
+    case PageBacking::Huge2MB:
+        return "2MB hugetlb pages";
+    case PageBacking::Huge1GB:
+        return "1GB hugetlb pages";
+    }
+    return "unknown";
 }
 
-char* ArenaNoHintSpinLock::allocate(size_t size) {
-    char* allocation_base = NULL;
-
-    if (size == 0) {
-        return allocation_base;
-    }
-    // TODO: Add overflow check for (size + slot_size - 1) if this moves beyond prototype
-    size_t slots_required = (size + slot_size - 1) / slot_size;
-
-    if (slots_required == 1) {
-        while (bitmap_spinlock.test_and_set(std::memory_order_acquire)) {
-            std::this_thread::yield();
-        }
-        int slot_idx = bitmap->allocate_one();
-        if (slot_idx != -1) {
-            allocation_base = base + slot_size * slot_idx;
-            slots_in_use.fetch_add(1, std::memory_order_relaxed);
-        }
-        bitmap_spinlock.clear(std::memory_order_release);
+const char* prefault_name(Prefault prefault) {
+    switch (prefault) {
+    case Prefault::None:
+        return "none";
+    case Prefault::Populate:
+        return "populate";
+    case Prefault::Touch:
+        return "touch";
     }
-
-    return allocation_base;
+    return "unknown";
 }
 
-void ArenaNoHintSpinLock::free(char* ptr, size_t size) {
-    if (ptr == NULL || size == 0) {
-        return;
-    }
-
-    if (ptr < base || ptr >= base + capacity) {
-        return;
-    }
-
-    ptrdiff_t offset = ptr - base;
-    if (static_cast<size_t>(offset) % slot_size != 0) {
-        return;
-    }
-    // TODO: Add overflow check for (size + slot_size - 1) if this moves beyond prototype
-    size_t start_slot = static_cast<size_t>(offset) / slot_size;
-    size_t slots_to_free = (size + slot_size - 1) / slot_size;
-    if (slots_to_free != 1) {
-        return;
-    }
-
-    while (bitmap_spinlock.test_and_set(std::memory_order_acquire)) {
-        std::this_thread::yield();
-    }
-    if (start_slot < bitmap->num_slots) {
-        auto [word_idx, bit_idx] = bitmap->get_word_and_bit_index_from_slot_index(static_cast<uint32_t>(start_slot));
-        if ((bitmap->words[word_idx] & (1ULL << bit_idx)) == 0) {
-            bitmap->free_slot(static_cast<uint32_t>(start_slot));
-            slots_in_use.fetch_sub(1, std::memory_order_relaxed);
-        }
-    }
-    bitmap_spinlock.clear(std::memory_order_release);
-}
+// The six named flavours, see the aliases in arena_allocator.h.
+template struct BasicArena<SharedBitmap, MutexLock, WithHint>;
+template struct BasicArena<SharedBitmap, SpinLock, WithHint>;
+template struct BasicArena<LockFreeBitmap, NoLock, NoHint>;
+template struct BasicArena<LockFreeBitmap, NoLock, WithHint>;
+template struct BasicArena<SharedBitmap, MutexLock, NoHint>;
+template struct BasicArena<SharedBitmap, SpinLock, NoHint>;
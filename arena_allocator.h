@@ -1,105 +1,885 @@
 #ifndef ARENA_ALLOCATOR_H
 #define ARENA_ALLOCATOR_H
 
+#include "arena_debug.h"
+#include "arena_stats.h"
 #include "bitmap.h"
+#include "lock_policies.h"
+#include "page_reclaimer.h"
+#include "slot_handle.h"
+#include "slot_iteration.h"
+#include "sharded_counter.h"
+#include "striped_bitmap.h"
 
+#include <algorithm>
 #include <atomic>
+#include <bit>
 #include <cstddef>
+#include <cstdio>
 #include <mutex>
+#include <stdexcept>
 #include <sys/mman.h>
+#include <type_traits>
 
 // Framed/Slotted arena, all allocation will be of the same size.
-struct Arena {
-    size_t capacity;
-    char* base;
-    size_t slot_size;
-    Bitmap* bitmap;
-    std::mutex bitmap_mutex;
-    std::atomic_int16_t slots_in_use;
+//
+// All the arena flavours used to be six copies of the same struct that only differed in which bitmap they held and how
+// they guarded it. They are now one template put together from three policies:
+//   - BitmapPolicy: SharedBitmap (plain words, needs a lock) or LockFreeBitmap (atomic words, no lock). The lock-free
+//                   one comes in other word layouts too, LockFreeBitmapWithLayout. StripedSharedBitmap is the shared
+//                   one cut into stripes that each get their own lock, see striped_bitmap.h.
+//   - LockPolicy:   MutexLock, one of the spin locks (SpinLock, TtasLock, TicketLock, McsLock), the spin-then-sleep
+//                   FutexLock, or NoLock. See lock_policies.h.
+//   - HintPolicy:   WithHint or NoHint, whether the bitmap remembers where the last allocation/free happened.
+// SlotSize is optional. When it is known at compile time (and a power of two, like every page size we care about) the
+// slot index <-> pointer math turns into shifts and masks instead of multiplies, divides and modulos. 0 means the slot
+// size is whatever the constructor is given.
+//
+// The old names are aliases at the bottom of this file, new combinations are just another alias away.
+// Single-slot-only workloads can skip the bitmap altogether with ArenaFreeList, see free_list_arena.h.
+//
+// Built with -DARENA_STATS=1 every flavour also counts what it does (allocations, failures, double frees, scan
+// lengths, lock contention), stats_snapshot() reads it out. See arena_stats.h.
+// Built with -DARENA_DEBUG=1 it checks instead of counting: guard slots, poison on free, an abort with diagnostics on
+// double frees, invalid frees and writes after free, ASan annotations under -fsanitize=address. See arena_debug.h.
 
-    Arena(size_t capacity, size_t page_size);
-    ~Arena();
-    char* allocate(size_t size);
-    void free(char* ptr, size_t size);
+struct WithHint {
+    static constexpr bool enabled = true;
 };
 
-// Spin-lock protected arena with hint mechanism.
-struct ArenaSpinLock {
-    size_t capacity;
-    char* base;
-    size_t slot_size;
-    Bitmap* bitmap;
-    std::atomic_flag bitmap_spinlock = ATOMIC_FLAG_INIT;
-    std::atomic_int16_t slots_in_use;
+struct NoHint {
+    static constexpr bool enabled = false;
+};
 
-    ArenaSpinLock(size_t capacity, size_t page_size);
-    ~ArenaSpinLock();
-    char* allocate(size_t size);
-    void free(char* ptr, size_t size);
+// `striped` bitmaps take the lock policy for themselves, one lock per stripe, and the arena has nothing to lock.
+struct SharedBitmap {
+    static constexpr bool lock_free = false;
+    static constexpr bool striped = false;
+    template <typename HintPolicy, typename LockPolicy>
+    using type = std::conditional_t<HintPolicy::enabled, Bitmap, BitmapNoHint>;
 };
 
-// Lock-free arena allocator using BitmapLockFree for thread-safe allocation without mutexes.
-struct ArenaLockFree {
-    size_t capacity;
-    char* base;
-    size_t slot_size;
-    BitmapLockFree* bitmap;
-    std::atomic_int16_t slots_in_use;
+struct StripedSharedBitmap {
+    static constexpr bool lock_free = false;
+    static constexpr bool striped = true;
+    template <typename HintPolicy, typename LockPolicy>
+    using type = StripedBitmap<SharedBitmap::type<HintPolicy, LockPolicy>, LockPolicy>;
+};
 
-    ArenaLockFree(size_t capacity, size_t page_size);
-    ~ArenaLockFree();
-    char* allocate(size_t size);
-    void free(char* ptr, size_t size);
-    uint64_t get_cas_retries() const {
-        return bitmap->get_cas_retries();
-    }
+// Words is the memory layout of the atomic words (DenseWords, PaddedWords or InterleavedWords, see word_layout.h).
+template <typename Words = DenseWords>
+struct LockFreeBitmapWithLayout {
+    static constexpr bool lock_free = true;
+    static constexpr bool striped = false;
+    template <typename HintPolicy, typename LockPolicy>
+    using type =
+        std::conditional_t<HintPolicy::enabled, BasicBitmapLockFreeHint<Words>, BasicBitmapLockFree<Words>>;
 };
 
-// Lock-free arena allocator with hint using BitmapLockFreeHint.
-struct ArenaLockFreeHint {
+using LockFreeBitmap = LockFreeBitmapWithLayout<DenseWords>;
+
+// How the arena region is backed. A 200 MB pool of 4 KB pages is 51200 dTLB entries worth of memory, with 2 MB pages
+// it is 100 and with 1 GB pages 1.
+enum class PageBacking {
+    Default,         // whatever the kernel hands out, usually 4 KB pages
+    TransparentHuge, // 2 MB aligned mapping + madvise(MADV_HUGEPAGE), the kernel collapses it when it can
+    Huge2MB,         // MAP_HUGETLB with 2 MB pages, needs pages reserved in /proc/sys/vm/nr_hugepages
+    Huge1GB,         // MAP_HUGETLB with 1 GB pages, needs hugepagesz=1G reservations
+};
+
+// Where on a multi-socket box the region's pages are placed. Only does something on Linux, elsewhere it's ignored.
+enum class NumaPolicy {
+    None,       // first touch, pages land on whichever node touches them first
+    Bind,       // all pages on numa_node
+    Interleave, // pages round-robin across interleave_nodes
+};
+
+// What happens to the pages of slots that stayed free for a long time, see page_reclaimer.h.
+enum class PageReclaim {
+    None,     // pages stay resident once touched, RSS sits at the high-water mark
+    Free,     // madvise(MADV_FREE), the kernel takes them lazily under memory pressure
+    DontNeed, // madvise(MADV_DONTNEED), gone from RSS right away, the next touch faults in a zero page
+};
+
+// Whether the whole region gets faulted in while the arena is built, instead of page by page on first write. Trades a
+// bounded warm-up for no minor faults (and their tail latency) once the arena is in use.
+enum class Prefault {
+    None,     // first touch faults, the default
+    Populate, // let the kernel do it: MAP_POPULATE, or MADV_POPULATE_WRITE once THP / NUMA placement is set up
+    Touch,    // write every page from prefault_threads threads, for huge arenas where one thread faulting is too slow
+};
+
+struct ArenaOptions {
+    PageBacking pages = PageBacking::Default;
+    NumaPolicy numa = NumaPolicy::None;
+    int numa_node = 0;
+    // Bit i = node i. 0 means every node we are allowed to use.
+    uint64_t interleave_nodes = 0;
+    // Anything but None turns on idle tracking on free and lets PageReclaimer / reclaim_idle() give pages back.
+    PageReclaim reclaim = PageReclaim::None;
+    Prefault prefault = Prefault::None;
+    // Threads for Prefault::Touch, 0 means one per hardware thread. Small regions use fewer, see arena_prefault_region.
+    unsigned prefault_threads = 0;
+    // Keep a generation byte per slot so the SlotHandle API can tell stale handles apart, see slot_handle.h.
+    bool slot_handles = false;
+    // Which free slot a single-slot allocation takes, see placement.h.
+    Placement placement = Placement::Default;
+    // Stripes of a StripedSharedBitmap arena, 0 means one per hardware thread. The other bitmaps ignore it.
+    size_t bitmap_stripes = 0;
+};
+
+// The mapping actually behind an arena. MAP_HUGETLB fails when no huge pages are reserved, in that case we fall back
+// to the transparent huge page route and `pages` says so.
+struct ArenaRegion {
+    char* base;
+    size_t mapped_bytes; // what gets munmap'd, huge pages round the arena capacity up
+    PageBacking pages;
+    // What prefaulting actually ran (Populate falls back to Touch on kernels without MADV_POPULATE_WRITE) and how long
+    // it took.
+    Prefault prefault = Prefault::None;
+    double prefault_ms = 0;
+    // Somebody else maps and unmaps this memory (a GrowableArena segment), the arena on top leaves it alone.
+    bool borrowed = false;
+};
+
+// The bits of setup that don't depend on the policies, these live in arena_allocator.cpp.
+
+/// Number of slots an arena of `capacity` bytes gets: rounded up to whole slots, then to whole bitmap words (with at
+/// least one word).
+size_t arena_slot_count(size_t capacity, size_t slot_size);
+/// Anonymous private mapping of at least `bytes` for the arena, backed, placed and prefaulted as `options` asks.
+/// Throws std::runtime_error if mmap or mbind fails, huge page shortages fall back instead of failing.
+ArenaRegion arena_map_region(size_t bytes, const ArenaOptions& options);
+void arena_unmap_region(const ArenaRegion& region);
+/// Address space only: a PROT_NONE, MAP_NORESERVE mapping of `bytes` that costs no memory until parts of it are
+/// committed. Huge page and NUMA options apply to the whole reservation (hugetlb can't be committed piecemeal and falls
+/// back to THP). Throws std::runtime_error like arena_map_region.
+ArenaRegion arena_reserve_region(size_t bytes, const ArenaOptions& options);
+/// Makes [offset, offset + bytes) of a reservation usable and prefaults it if `options` asks. Returns the committed
+/// piece as a borrowed region, base NULL if mprotect failed.
+ArenaRegion arena_commit_region(const ArenaRegion& reservation, size_t offset, size_t bytes,
+                                const ArenaOptions& options);
+/// Shared mapping of [offset, offset + bytes) of an open file or memfd, so what's written to the arena outlives the
+/// process. offset has to be page aligned (2 MB aligned for THP to do anything). Placement options apply as for
+/// arena_map_region, hugetlb becomes THP and prefaulting only reads so it doesn't dirty the file. Throws
+/// std::runtime_error if mmap or mbind fails. The caller keeps the fd, the mapping stays valid after it's closed.
+ArenaRegion arena_map_file_region(int fd, size_t offset, size_t bytes, const ArenaOptions& options);
+/// Gives the pages of [begin, begin + bytes) back to the kernel. The range is shrunk to whole pages of the region's
+/// backing first, returns how many bytes were actually advised away.
+size_t arena_release_pages(const ArenaRegion& region, char* begin, size_t bytes, PageReclaim advice);
+/// Faults in every page of the region with `threads` threads (0 = one per hardware thread). Writes each page's first
+/// byte back to itself so it works on mappings that already hold data too.
+void arena_prefault_region(const ArenaRegion& region, unsigned threads);
+const char* page_backing_name(PageBacking pages);
+const char* prefault_name(Prefault prefault);
+
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize = 0>
+struct BasicArena {
+    using BitmapType = typename BitmapPolicy::template type<HintPolicy, LockPolicy>;
+    using ArenaLock = std::conditional_t<BitmapPolicy::striped, NoLock, LockPolicy>;
+
+    static_assert(BitmapPolicy::lock_free || !std::is_same_v<LockPolicy, NoLock>,
+                  "the shared bitmap is not thread safe on its own, pick a real lock policy");
+    static_assert(!BitmapPolicy::lock_free || std::is_same_v<LockPolicy, NoLock>,
+                  "the lock-free bitmaps synchronize themselves, a lock would only add contention");
+
+    static constexpr bool SLOT_SIZE_IS_POW2 = SlotSize != 0 && std::has_single_bit(SlotSize);
+    static constexpr uint32_t SLOT_SHIFT = SLOT_SIZE_IS_POW2 ? std::countr_zero(SlotSize) : 0;
+
     size_t capacity;
     char* base;
     size_t slot_size;
-    BitmapLockFreeHint* bitmap;
-    std::atomic_int16_t slots_in_use;
+    ArenaRegion region;
+    BitmapType* bitmap;
+    [[no_unique_address]] ArenaLock bitmap_lock;
+    // Bumped on every allocate and free, sharded so that doesn't turn into one contended cache line. load() for the
+    // exact count, load_approx() when a cheap estimate will do.
+    ShardedCounter slots_in_use;
+    // Telemetry counters, an empty struct unless ARENA_STATS is on.
+    [[no_unique_address]] ArenaStatsType stats;
+    // Slot states, guards and poisoning, an empty struct unless ARENA_DEBUG is on.
+    [[no_unique_address]] ArenaDebugType debug;
+    // Idle tracking for page reclamation, NULL unless ArenaOptions::reclaim asked for it. See page_reclaimer.h.
+    std::unique_ptr<PageReclaimState> reclaim;
+    PageReclaim reclaim_advice;
+    // Per-slot generation, bumped by every free. NULL unless ArenaOptions::slot_handles.
+    std::unique_ptr<std::atomic<uint8_t>[]> generations;
+
+    explicit BasicArena(size_t capacity, size_t page_size = SlotSize, const ArenaOptions& options = ArenaOptions());
+    /// Arena over memory it doesn't own, as many whole bitmap words of slots as fit in region.mapped_bytes. Only the
+    /// reclaim part of `options` matters here, the mapping already exists.
+    BasicArena(const ArenaRegion& borrowed, size_t page_size, const ArenaOptions& options = ArenaOptions());
+    ~BasicArena();
+    BasicArena(const BasicArena&) = delete;
+    BasicArena& operator=(const BasicArena&) = delete;
 
-    ArenaLockFreeHint(size_t capacity, size_t page_size);
-    ~ArenaLockFreeHint();
     char* allocate(size_t size);
     void free(char* ptr, size_t size);
-    uint64_t get_cas_retries() const {
+    size_t allocate_batch(size_t n, char** out);
+    void free_batch(char** ptrs, size_t n);
+    size_t reclaim_idle(uint32_t min_idle_epochs);
+    FragmentationStats fragmentation_stats();
+    BitmapSnapshot snapshot_bitmap(uint32_t attempts = BitmapSnapshot::DEFAULT_ATTEMPTS);
+    template <typename Visit>
+    size_t for_each_allocated(Visit&& visit);
+    template <typename Visit>
+    size_t for_each_allocated_parallel(Visit&& visit, unsigned threads = 0);
+    ArenaStatsSnapshot stats_snapshot() const;
+    size_t unpark_words(size_t wanted);
+
+    // Single-slot handles, need ArenaOptions::slot_handles.
+    SlotHandle allocate_handle();
+    int free_handle(SlotHandle handle);
+    char* resolve(SlotHandle handle) const;
+    SlotHandle handle_of(const char* ptr) const;
+
+    uint64_t get_cas_retries() const
+        requires BitmapPolicy::lock_free
+    {
         return bitmap->get_cas_retries();
     }
-};
+    std::array<uint64_t, CasRetryHistogram::NUM_BUCKETS> get_cas_retry_histogram() const
+        requires BitmapPolicy::lock_free
+    {
+        return bitmap->get_cas_retry_histogram();
+    }
 
-// Arena allocator with BitmapNoHint (mutex-protected, no hint mechanism).
-struct ArenaNoHint {
-    size_t capacity;
-    char* base;
-    size_t slot_size;
-    BitmapNoHint* bitmap;
-    std::mutex bitmap_mutex;
-    std::atomic_int16_t slots_in_use;
+    // Slot index <-> byte offset math, compile-time slot sizes get shifts and masks.
+    size_t slots_for(size_t size) const;
+    size_t slot_offset(size_t slot_idx) const;
+    bool is_slot_aligned(size_t offset) const;
+    size_t slot_index_of_offset(size_t offset) const;
 
-    ArenaNoHint(size_t capacity, size_t page_size);
-    ~ArenaNoHint();
-    char* allocate(size_t size);
-    void free(char* ptr, size_t size);
+    int claim_slots(size_t slots_required);
+    int take_slots(size_t slots_required);
+    void note_free(size_t first_slot, size_t count);
+    void bump_generations(size_t first_slot, size_t count);
+    void init_slots(size_t num_slots, size_t page_size, const ArenaOptions& options);
 };
 
+// TODO: Understand the impact and significance of alignment.
+// Well be going the route of mmap for this one: https://stackoverflow.com/questions/45972/mmap-vs-reading-blocks
+// Since the buffer_pool would live for as long as the DB instance does, and we'll be accessing randomly, that seems
+// to make more sense. I'll benchmark the difference b/w malloc and mmap once I'm done with the initialization.
+// Arena will default to a 20MB region with a page size of 4KB.
+//
+// The capacity will be adjusted so that it is an exact multiple of page_size.
+// Ideally the page_size will be a power of 2 for good memory alignment.
+// For the bitmap implementation the number of slots in the arena need to be a multiple of 64.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::BasicArena(size_t capacity, size_t page_size,
+                                                                       const ArenaOptions& options) {
+    if (page_size == 0) {
+        throw std::invalid_argument("page_size must be non-zero");
+    }
+    if (SlotSize != 0 && page_size != SlotSize) {
+        throw std::invalid_argument("page_size does not match the compile-time slot size");
+    }
+    size_t num_slots = arena_slot_count(capacity, page_size);
+    if (options.slot_handles && num_slots >= SlotHandle::INDEX_MASK) {
+        throw std::invalid_argument("too many slots for 24-bit slot handles");
+    }
+
+    // Capacity is adjusted to be an exact multiple of page_size and slot count
+    this->region = arena_map_region(num_slots * page_size, options);
+    init_slots(num_slots, page_size, options);
+}
+
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::BasicArena(const ArenaRegion& borrowed, size_t page_size,
+                                                                       const ArenaOptions& options) {
+    if (page_size == 0) {
+        throw std::invalid_argument("page_size must be non-zero");
+    }
+    if (SlotSize != 0 && page_size != SlotSize) {
+        throw std::invalid_argument("page_size does not match the compile-time slot size");
+    }
+    // Rounded down here, the memory is what it is.
+    size_t num_slots = borrowed.mapped_bytes / page_size / BitmapType::WORD_LENGTH * BitmapType::WORD_LENGTH;
+    if (num_slots == 0) {
+        throw std::invalid_argument("borrowed region is smaller than one bitmap word of slots");
+    }
+    if (options.slot_handles && num_slots >= SlotHandle::INDEX_MASK) {
+        throw std::invalid_argument("too many slots for 24-bit slot handles");
+    }
+    this->region = borrowed;
+    this->region.borrowed = true;
+    init_slots(num_slots, page_size, options);
+}
+
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+void BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::init_slots(size_t num_slots, size_t page_size,
+                                                                            const ArenaOptions& options) {
+    this->capacity = num_slots * page_size;
+    this->slot_size = page_size;
+    this->base = region.base;
+    if constexpr (BitmapPolicy::striped) {
+        this->bitmap = new BitmapType(static_cast<uint32_t>(num_slots), options.bitmap_stripes, stats);
+        this->bitmap->set_placement(options.placement);
+    } else {
+        this->bitmap = new BitmapType(static_cast<uint32_t>(num_slots));
+        this->bitmap->placement = options.placement;
+    }
+    this->reclaim_advice = options.reclaim;
+    if (options.reclaim != PageReclaim::None) {
+        this->reclaim = std::make_unique<PageReclaimState>(num_slots / BitmapType::WORD_LENGTH);
+    }
+    if (options.slot_handles) {
+        this->generations = std::make_unique<std::atomic<uint8_t>[]>(num_slots);
+    }
+    if constexpr (ArenaDebugType::enabled) {
+        static_assert(BitmapType::WORD_LENGTH == ArenaDebugType::GUARD_EVERY, "one guard slot per bitmap word");
+        debug.init(base, page_size, num_slots, !region.borrowed, options.reclaim == PageReclaim::None);
+        // Guard slots are handed out to nobody: park every word, then give back all of it but the guard bit.
+        for (size_t word_idx = 0; debug.guards && word_idx < num_slots / BitmapType::WORD_LENGTH; ++word_idx) {
+            bitmap->park_word(word_idx);
+            bitmap->release_bits(word_idx, BitmapType::FULLY_FREE >> 1);
+        }
+    }
+}
+
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::~BasicArena() {
+    debug.teardown();
+    if (!region.borrowed) {
+        arena_unmap_region(region);
+    }
+    delete bitmap;
+}
+
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+inline size_t BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::slots_for(size_t size) const {
+    // TODO: Add overflow check for (size + slot_size - 1) if this moves beyond prototype
+    if constexpr (SLOT_SIZE_IS_POW2) {
+        return (size + SlotSize - 1) >> SLOT_SHIFT;
+    } else if constexpr (SlotSize != 0) {
+        return (size + SlotSize - 1) / SlotSize;
+    } else {
+        return (size + slot_size - 1) / slot_size;
+    }
+}
+
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+inline size_t BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::slot_offset(size_t slot_idx) const {
+    if constexpr (SLOT_SIZE_IS_POW2) {
+        return slot_idx << SLOT_SHIFT;
+    } else if constexpr (SlotSize != 0) {
+        return slot_idx * SlotSize;
+    } else {
+        return slot_idx * slot_size;
+    }
+}
+
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+inline bool BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::is_slot_aligned(size_t offset) const {
+    if constexpr (SLOT_SIZE_IS_POW2) {
+        return (offset & (SlotSize - 1)) == 0;
+    } else if constexpr (SlotSize != 0) {
+        return offset % SlotSize == 0;
+    } else {
+        return offset % slot_size == 0;
+    }
+}
+
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+inline size_t BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::slot_index_of_offset(size_t offset) const {
+    if constexpr (SLOT_SIZE_IS_POW2) {
+        return offset >> SLOT_SHIFT;
+    } else if constexpr (SlotSize != 0) {
+        return offset / SlotSize;
+    } else {
+        return offset / slot_size;
+    }
+}
+
+/// Takes slots_required slots out of the bitmap under the lock policy, -1 if there is no room.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+inline int BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::claim_slots(size_t slots_required) {
+    StatsLockGuard<ArenaLock, ArenaStatsType> lock(bitmap_lock, stats);
+    return slots_required == 1 ? bitmap->allocate_one() : bitmap->allocate_many(static_cast<uint32_t>(slots_required));
+}
+
+/// Records a free for the reclaimer, one note per word the slots live in.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+inline void BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::note_free(size_t first_slot, size_t count) {
+    size_t last_word = (first_slot + count - 1) >> BitmapType::WORD_SHIFT;
+    for (size_t word_idx = first_slot >> BitmapType::WORD_SHIFT; word_idx <= last_word; ++word_idx) {
+        reclaim->note_free(word_idx);
+    }
+}
+
+/// Single slot requests go through allocate_one, anything bigger claims a contiguous run with allocate_many.
+/// For the lock-free bitmaps the lock is NoLock and the guard compiles away.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+inline char* BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::allocate(size_t size) {
+    if (size == 0) {
+        stats.add(ArenaCounter::FailedAllocations);
+        return NULL;
+    }
+    size_t slots_required = slots_for(size);
+    if (slots_required > bitmap->num_slots) {
+        stats.add(ArenaCounter::FailedAllocations);
+        return NULL;
+    }
+
+    int slot_idx = take_slots(slots_required);
+    if (slot_idx == -1) {
+        return NULL;
+    }
+    return base + slot_offset(static_cast<size_t>(slot_idx));
+}
+
+/// claim_slots plus the reclaim fallback and the usage counter, what every allocation path goes through.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+inline int BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::take_slots(size_t slots_required) {
+    uint64_t scanned_before = 0;
+    if constexpr (ArenaStatsType::enabled) {
+        scanned_before = arena_words_scanned;
+    }
+    int slot_idx = claim_slots(slots_required);
+    if (slot_idx == -1 && reclaim != NULL && unpark_words(slots_required == 1 ? 1 : SIZE_MAX) != 0) {
+        // Everything resident is taken, fall back to words the reclaimer gave back (and take the page faults).
+        slot_idx = claim_slots(slots_required);
+    }
+    if (slot_idx != -1) {
+        slots_in_use.add(static_cast<int64_t>(slots_required));
+        debug.on_allocate(static_cast<size_t>(slot_idx), slots_required);
+    }
+    if constexpr (ArenaStatsType::enabled) {
+        bool failed = slot_idx == -1;
+        stats.add_allocation(arena_words_scanned - scanned_before, failed ? 0 : 1, failed ? 0 : slots_required, failed);
+    }
+    return slot_idx;
+}
+
+/// Out of range, misaligned and double frees are ignored, the bitmaps report the last two and slots_in_use is only
+/// touched when the free actually happened.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+inline void BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::free(char* ptr, size_t size) {
+    if (ptr == NULL || size == 0) {
+        return;
+    }
+
+    if (ptr < base || ptr >= base + capacity) {
+        debug.on_invalid_free(ptr, size, "outside the arena");
+        stats.add(ArenaCounter::InvalidFrees);
+        return;
+    }
+
+    // Alignment check
+    size_t offset = static_cast<size_t>(ptr - base);
+    if (!is_slot_aligned(offset)) {
+        debug.on_invalid_free(ptr, size, "not at the start of a slot");
+        stats.add(ArenaCounter::InvalidFrees);
+        return; // not aligned to slot
+    }
+    size_t start_slot = slot_index_of_offset(offset);
+    size_t slots_to_free = slots_for(size);
+    if (slots_to_free > bitmap->num_slots - start_slot) {
+        debug.on_invalid_free(ptr, size, "runs past the end of the arena");
+    }
+    if (slots_to_free > bitmap->num_slots) {
+        stats.add(ArenaCounter::InvalidFrees);
+        return;
+    }
+    debug.on_free(start_slot, slots_to_free);
+    if (generations != NULL && slots_to_free <= bitmap->num_slots - start_slot) {
+        // Before the bits go back, once they're free an allocate_handle() may take the slot and read its generation
+        // (the lock-free arenas have no lock to keep it out meanwhile). A double free bumps a slot that is free
+        // already, no live handle has its generation.
+        bump_generations(start_slot, slots_to_free);
+    }
+
+    int rc;
+    {
+        StatsLockGuard<ArenaLock, ArenaStatsType> lock(bitmap_lock, stats);
+        rc = slots_to_free == 1
+                 ? bitmap->free_slot(static_cast<uint32_t>(start_slot))
+                 : bitmap->free_many(static_cast<uint32_t>(start_slot), static_cast<uint32_t>(slots_to_free));
+    }
+    // rc == 1 double-free; rc == -1 OOB -> ignore
+    if (rc == 0) {
+        stats.add_free(1, slots_to_free);
+        slots_in_use.sub(static_cast<int64_t>(slots_to_free));
+        if (reclaim != NULL) {
+            note_free(start_slot, slots_to_free);
+        }
+    } else {
+        stats.add(rc == 1 ? ArenaCounter::DoubleFrees : ArenaCounter::InvalidFrees);
+    }
+}
+
+/// Invalidates the handles of freed slots.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+inline void BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::bump_generations(size_t first_slot,
+                                                                                         size_t count) {
+    for (size_t slot_idx = first_slot; slot_idx < first_slot + count; ++slot_idx) {
+        generations[slot_idx].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/// One slot, returned as a handle instead of a pointer. Invalid when the arena is full or wasn't built with
+/// ArenaOptions::slot_handles.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+inline SlotHandle BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::allocate_handle() {
+    if (generations == NULL) {
+        return SlotHandle();
+    }
+    int slot_idx = take_slots(1);
+    if (slot_idx == -1) {
+        return SlotHandle();
+    }
+    return SlotHandle::make(static_cast<uint32_t>(slot_idx),
+                            generations[slot_idx].load(std::memory_order_relaxed));
+}
+
+/// Frees the handle's slot, no size, no range check beyond the index, no division. Same return codes as the bitmaps:
+/// -1 (invalid or out of range), 1 (stale handle or double free), 0 on success. The generation moves on with a CAS, so
+/// of two threads freeing the same handle exactly one wins.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+inline int BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::free_handle(SlotHandle handle) {
+    if (generations == NULL || !handle.valid() || handle.index() >= bitmap->num_slots) {
+        stats.add(ArenaCounter::InvalidFrees);
+        return -1;
+    }
+    uint32_t slot_idx = handle.index();
+    uint8_t expected = handle.generation();
+    if (!generations[slot_idx].compare_exchange_strong(expected, static_cast<uint8_t>(expected + 1),
+                                                       std::memory_order_relaxed)) {
+        stats.add(ArenaCounter::DoubleFrees);
+        return 1;
+    }
+    debug.on_free(slot_idx, 1);
+    int rc;
+    {
+        StatsLockGuard<ArenaLock, ArenaStatsType> lock(bitmap_lock, stats);
+        rc = bitmap->free_slot(slot_idx);
+    }
+    if (rc == 0) {
+        stats.add_free(1, 1);
+        slots_in_use.sub(1);
+        if (reclaim != NULL) {
+            reclaim->note_free(slot_idx >> BitmapType::WORD_SHIFT);
+        }
+    }
+    return rc;
+}
+
+/// Pointer to the handle's slot, NULL if the handle is invalid or stale.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+inline char* BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::resolve(SlotHandle handle) const {
+    if (generations == NULL || !handle.valid() || handle.index() >= bitmap->num_slots ||
+        generations[handle.index()].load(std::memory_order_relaxed) != handle.generation()) {
+        return NULL;
+    }
+    return base + slot_offset(handle.index());
+}
+
+/// Current handle of the slot at ptr, for code that got a pointer from allocate() and wants to store a handle.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+inline SlotHandle BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::handle_of(const char* ptr) const {
+    if (generations == NULL || ptr < base || ptr >= base + capacity) {
+        return SlotHandle();
+    }
+    size_t offset = static_cast<size_t>(ptr - base);
+    if (!is_slot_aligned(offset)) {
+        return SlotHandle();
+    }
+    size_t slot_idx = slot_index_of_offset(offset);
+    return SlotHandle::make(static_cast<uint32_t>(slot_idx), generations[slot_idx].load(std::memory_order_relaxed));
+}
+
+/// Allocates up to n single slots at once into out, returns how many it got, fewer than n only when the arena runs out.
+/// Whole words are taken in one lock hold or one fetch_and per word, and slots_in_use is updated once per batch, so the
+/// per-slot cost drops the bigger the batch. Slots that share a word end up next to each other in out.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+inline size_t BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::allocate_batch(size_t n, char** out) {
+    if (n == 0 || out == NULL) {
+        return 0;
+    }
+    size_t count = std::min<size_t>(n, bitmap->num_slots);
+    size_t taken = 0;
+    uint64_t scanned_before = 0;
+    if constexpr (ArenaStatsType::enabled) {
+        scanned_before = arena_words_scanned;
+    }
+    auto claim = [&]() {
+        StatsLockGuard<ArenaLock, ArenaStatsType> lock(bitmap_lock, stats);
+        bitmap->allocate_batch(static_cast<uint32_t>(count - taken), [&](size_t word_idx, uint64_t mask) {
+            while (mask != 0) {
+                uint32_t bit_idx = static_cast<uint32_t>(std::countr_zero(mask));
+                mask &= mask - 1;
+                size_t slot_idx = bitmap->get_slot_index_from_word_and_bit_index(word_idx, bit_idx);
+                debug.on_allocate(slot_idx, 1);
+                out[taken++] = base + slot_offset(slot_idx);
+            }
+        });
+    };
+    claim();
+    if (taken < count && reclaim != NULL &&
+        unpark_words((count - taken + BitmapType::WORD_LENGTH - 1) / BitmapType::WORD_LENGTH) != 0) {
+        claim();
+    }
+    if (taken != 0) {
+        slots_in_use.add(static_cast<int64_t>(taken));
+    }
+    if constexpr (ArenaStatsType::enabled) {
+        // One allocation per slot, plus one failure if the batch came up short.
+        stats.add_allocation(arena_words_scanned - scanned_before, taken, taken, taken < n);
+    }
+    return taken;
+}
+
+/// Frees n single-slot allocations at once. NULL, foreign and misaligned pointers and double frees are skipped, same
+/// as free(). Consecutive pointers into the same bitmap word are released together with one update, which is what a
+/// batch from allocate_batch looks like; ptrs in random order still work, they just don't group as well.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+inline void BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::free_batch(char** ptrs, size_t n) {
+    if (ptrs == NULL || n == 0) {
+        return;
+    }
+    size_t released = 0;
+    {
+        StatsLockGuard<ArenaLock, ArenaStatsType> lock(bitmap_lock, stats);
+        size_t word_idx = 0;
+        uint64_t mask = 0;
+        auto release = [&]() {
+            if (mask != 0) {
+                // Generations first, same as free().
+                for (uint64_t bits = generations != NULL ? mask : 0; bits != 0; bits &= bits - 1) {
+                    generations[(word_idx << BitmapType::WORD_SHIFT) + std::countr_zero(bits)].fetch_add(
+                        1, std::memory_order_relaxed);
+                }
+                uint64_t freed = mask & ~bitmap->release_bits(word_idx, mask);
+                released += std::popcount(freed);
+                stats.add(ArenaCounter::DoubleFrees, static_cast<uint64_t>(std::popcount(mask & ~freed)));
+                if (reclaim != NULL) {
+                    reclaim->note_free(word_idx);
+                }
+                mask = 0;
+            }
+        };
+        for (size_t i = 0; i < n; ++i) {
+            char* ptr = ptrs[i];
+            if (ptr == NULL) {
+                continue;
+            }
+            if (ptr < base || ptr >= base + capacity || !is_slot_aligned(static_cast<size_t>(ptr - base))) {
+                debug.on_invalid_free(ptr, slot_size, "outside the arena or not at the start of a slot");
+                stats.add(ArenaCounter::InvalidFrees);
+                continue;
+            }
+            size_t offset = static_cast<size_t>(ptr - base);
+            debug.on_free(slot_index_of_offset(offset), 1);
+            auto [slot_word, bit_idx] =
+                bitmap->get_word_and_bit_index_from_slot_index(static_cast<uint32_t>(slot_index_of_offset(offset)));
+            if (slot_word != word_idx) {
+                release();
+                word_idx = slot_word;
+            }
+            mask |= 1ULL << bit_idx;
+        }
+        release();
+    }
+    if (released != 0) {
+        slots_in_use.sub(static_cast<int64_t>(released));
+        stats.add_free(released, released); // one per slot, like allocate_batch
+    }
+}
+
+/// Counters plus occupancy, cheap enough to poll from a metrics exporter: one pass over the stats and usage shards.
+/// The counters are all zero unless the arena was built with ARENA_STATS, see arena_stats.h.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+ArenaStatsSnapshot BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::stats_snapshot() const {
+    ArenaStatsSnapshot snapshot;
+    stats.snapshot(snapshot);
+    snapshot.slots_in_use = static_cast<uint64_t>(std::max<int64_t>(0, slots_in_use.load()));
+    snapshot.num_slots = bitmap->num_slots;
+    if (reclaim != NULL) {
+        snapshot.parked_slots = reclaim->parked_words.load(std::memory_order_relaxed) * BitmapType::WORD_LENGTH;
+    }
+    if constexpr (BitmapPolicy::lock_free) {
+        snapshot.cas_retries = bitmap->get_cas_retries();
+    }
+    return snapshot;
+}
+
+/// Copy of which slots are live, see slot_iteration.h. Point in time for the plain bitmap (one pass under the lock),
+/// double-collected for the others, `consistent` says whether that worked out. Parked words and debug guard slots
+/// don't count as live.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+BitmapSnapshot BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::snapshot_bitmap(uint32_t attempts) {
+    size_t num_words = bitmap->num_slots / BitmapType::WORD_LENGTH;
+    BitmapSnapshot snapshot;
+    if constexpr (BitmapPolicy::lock_free) {
+        snapshot.consistent = collect_words(
+            num_words, [this](size_t word_idx) { return bitmap->words[word_idx].load(std::memory_order_acquire); },
+            snapshot, attempts);
+    } else if constexpr (BitmapPolicy::striped) {
+        // Every word() takes its stripe's lock, so this is the lock-free case one stripe at a time.
+        snapshot.consistent = collect_words(
+            num_words, [this](size_t word_idx) { return bitmap->word(word_idx); }, snapshot, attempts);
+    } else {
+        StatsLockGuard<ArenaLock, ArenaStatsType> lock(bitmap_lock, stats);
+        collect_words(num_words, [this](size_t word_idx) { return bitmap->words[word_idx]; }, snapshot, 0);
+        snapshot.consistent = true;
+    }
+    for (size_t word_idx = 0; word_idx < num_words; ++word_idx) {
+        bool parked = reclaim != NULL && reclaim->is_parked(word_idx);
+        snapshot.live[word_idx] = parked ? 0 : ~snapshot.live[word_idx];
+        if (debug.guards) {
+            snapshot.live[word_idx] &= BitmapType::FULLY_FREE >> 1;
+        }
+    }
+    return snapshot;
+}
+
+/// Calls visit(slot_idx, ptr) for every slot that was live when the bitmap was copied, in address order, and returns
+/// how many that was. The bitmap isn't locked while visit() runs. See slot_iteration.h for what that means for slots
+/// allocated or freed meanwhile.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+template <typename Visit>
+size_t BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::for_each_allocated(Visit&& visit) {
+    BitmapSnapshot snapshot = snapshot_bitmap();
+    return walk_live_slots(
+        snapshot, 0, snapshot.live.size(), [this](size_t slot_idx) { return base + slot_offset(slot_idx); }, visit);
+}
+
+/// for_each_allocated with the words split over `threads` threads (0 = one per hardware thread), about the same number
+/// of live slots each. visit() gets called from all of them at once. Small arenas are walked on the calling thread.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+template <typename Visit>
+size_t BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::for_each_allocated_parallel(Visit&& visit,
+                                                                                               unsigned threads) {
+    BitmapSnapshot snapshot = snapshot_bitmap();
+    return walk_live_slots_parallel(
+        snapshot, threads, [this](size_t slot_idx) { return base + slot_offset(slot_idx); }, visit);
+}
+
+/// Fragmentation of the bitmap right now, see FragmentationStats. Takes the bitmap lock for the plain bitmaps (one
+/// pass over the words), the lock-free ones get a racy but consistent enough view. Parked words count as full.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+FragmentationStats BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::fragmentation_stats() {
+    StatsLockGuard<ArenaLock, ArenaStatsType> lock(bitmap_lock, stats);
+    return measure_fragmentation(bitmap->num_slots / BitmapType::WORD_LENGTH, [this](size_t word_idx) -> uint64_t {
+        if constexpr (BitmapPolicy::lock_free) {
+            return bitmap->words[word_idx].load(std::memory_order_relaxed);
+        } else {
+            return bitmap->words[word_idx];
+        }
+    });
+}
+
+/// Parks the words that are completely free and haven't seen a free for min_idle_epochs reclaim epochs, then gives
+/// their pages back to the kernel, adjacent words as one extent. Words are parked in chunks so the lock is never held
+/// for a whole-bitmap scan, and madvise runs with no lock held at all. Returns the bytes given back, 0 when the arena
+/// has no reclaim tracking.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+size_t BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::reclaim_idle(uint32_t min_idle_epochs) {
+    constexpr size_t CHUNK_WORDS = 64;
+    if (reclaim == NULL) {
+        return 0;
+    }
+    size_t released = 0;
+    // Words [extent_begin, extent_end) are RELEASING and haven't been advised yet.
+    size_t extent_begin = 0;
+    size_t extent_end = 0;
+    // Only once madvise has returned may unpark_words() have the words, so PARKED is published per extent after it.
+    // The count goes up first so unpark_words() never takes it below zero.
+    auto release_extent = [&]() {
+        if (extent_end > extent_begin) {
+            size_t first_slot = extent_begin * BitmapType::WORD_LENGTH;
+            size_t num_slots = (extent_end - extent_begin) * BitmapType::WORD_LENGTH;
+            released += arena_release_pages(region, base + slot_offset(first_slot), slot_offset(num_slots),
+                                            reclaim_advice);
+            reclaim->parked_words.fetch_add(extent_end - extent_begin, std::memory_order_relaxed);
+            for (size_t word_idx = extent_begin; word_idx < extent_end; ++word_idx) {
+                reclaim->word_state[word_idx].store(PageReclaimState::PARKED, std::memory_order_release);
+            }
+        }
+        extent_begin = extent_end = 0;
+    };
+
+    for (size_t chunk = 0; chunk < reclaim->num_words; chunk += CHUNK_WORDS) {
+        size_t chunk_end = std::min(reclaim->num_words, chunk + CHUNK_WORDS);
+        uint64_t parked_mask = 0;
+        {
+            StatsLockGuard<ArenaLock, ArenaStatsType> lock(bitmap_lock, stats);
+            for (size_t word_idx = chunk; word_idx < chunk_end; ++word_idx) {
+                if (reclaim->is_idle(word_idx, min_idle_epochs) && bitmap->park_word(word_idx)) {
+                    reclaim->word_state[word_idx].store(PageReclaimState::RELEASING, std::memory_order_relaxed);
+                    parked_mask |= 1ULL << (word_idx - chunk);
+                }
+            }
+        }
+        while (parked_mask != 0) {
+            size_t word_idx = chunk + static_cast<size_t>(std::countr_zero(parked_mask));
+            parked_mask &= parked_mask - 1;
+            if (word_idx != extent_end) {
+                release_extent();
+                extent_begin = word_idx;
+            }
+            extent_end = word_idx + 1;
+        }
+    }
+    release_extent();
+    return released;
+}
+
+/// Puts up to `wanted` parked words back into circulation, returns how many. Only called once allocation would fail
+/// otherwise, resident slots are always used first. Words still RELEASING are skipped, their madvise isn't done yet.
+template <typename BitmapPolicy, typename LockPolicy, typename HintPolicy, size_t SlotSize>
+size_t BasicArena<BitmapPolicy, LockPolicy, HintPolicy, SlotSize>::unpark_words(size_t wanted) {
+    if (reclaim == NULL || reclaim->parked_words.load(std::memory_order_relaxed) == 0) {
+        return 0;
+    }
+    size_t unparked = 0;
+    for (size_t word_idx = 0; word_idx < reclaim->num_words && unparked < wanted; ++word_idx) {
+        uint32_t expected = PageReclaimState::PARKED;
+        if (!reclaim->word_state[word_idx].compare_exchange_strong(expected, PageReclaimState::CLEAN,
+                                                                   std::memory_order_acquire)) {
+            continue;
+        }
+        StatsLockGuard<ArenaLock, ArenaStatsType> lock(bitmap_lock, stats);
+        bitmap->release_bits(word_idx, BitmapType::FULLY_FREE);
+        unparked++;
+    }
+    reclaim->parked_words.fetch_sub(unparked, std::memory_order_relaxed);
+    return unparked;
+}
+
+// Mutex protected arena with hint mechanism.
+using Arena = BasicArena<SharedBitmap, MutexLock, WithHint>;
+// Spin-lock protected arena with hint mechanism.
+using ArenaSpinLock = BasicArena<SharedBitmap, SpinLock, WithHint>;
+// Lock-free arena allocator using BitmapLockFree for thread-safe allocation without mutexes.
+using ArenaLockFree = BasicArena<LockFreeBitmap, NoLock, NoHint>;
+// Lock-free arena allocator with hint using BitmapLockFreeHint.
+using ArenaLockFreeHint = BasicArena<LockFreeBitmap, NoLock, WithHint>;
+// Arena allocator with BitmapNoHint (mutex-protected, no hint mechanism).
+using ArenaNoHint = BasicArena<SharedBitmap, MutexLock, NoHint>;
 // Spin-lock protected arena without hint mechanism.
-struct ArenaNoHintSpinLock {
-    size_t capacity;
-    char* base;
-    size_t slot_size;
-    BitmapNoHint* bitmap;
-    std::atomic_flag bitmap_spinlock = ATOMIC_FLAG_INIT;
-    std::atomic_int16_t slots_in_use;
+using ArenaNoHintSpinLock = BasicArena<SharedBitmap, SpinLock, NoHint>;
+// Arena / ArenaNoHint with a striped bitmap, one mutex and hint per stripe.
+using ArenaStriped = BasicArena<StripedSharedBitmap, MutexLock, WithHint>;
+using ArenaStripedNoHint = BasicArena<StripedSharedBitmap, MutexLock, NoHint>;
+// ArenaSpinLock with the other lock policies.
+using ArenaTtasLock = BasicArena<SharedBitmap, TtasLock, WithHint>;
+using ArenaTicketLock = BasicArena<SharedBitmap, TicketLock, WithHint>;
+using ArenaMcsLock = BasicArena<SharedBitmap, McsLock, WithHint>;
+using ArenaFutexLock = BasicArena<SharedBitmap, FutexLock, WithHint>;
+// ArenaLockFreeHint with one bitmap word per cache line.
+using ArenaLockFreeHintPadded = BasicArena<LockFreeBitmapWithLayout<PaddedWords>, NoLock, WithHint>;
+// ArenaLockFreeHint with neighbouring bitmap words on different cache lines, same memory as the dense layout.
+using ArenaLockFreeHintInterleaved = BasicArena<LockFreeBitmapWithLayout<InterleavedWords>, NoLock, WithHint>;
 
-    ArenaNoHintSpinLock(size_t capacity, size_t page_size);
-    ~ArenaNoHintSpinLock();
-    char* allocate(size_t size);
-    void free(char* ptr, size_t size);
-};
+// The named flavours are instantiated once in arena_allocator.cpp. The hot paths above are inline so they still get
+// inlined at the call site, this only saves every includer from re-instantiating the rest.
+extern template struct BasicArena<SharedBitmap, MutexLock, WithHint>;
+extern template struct BasicArena<SharedBitmap, SpinLock, WithHint>;
+extern template struct BasicArena<LockFreeBitmap, NoLock, NoHint>;
+extern template struct BasicArena<LockFreeBitmap, NoLock, WithHint>;
+extern template struct BasicArena<SharedBitmap, MutexLock, NoHint>;
+extern template struct BasicArena<SharedBitmap, SpinLock, NoHint>;
 
 #endif // ARENA_ALLOCATOR_H
@@ -0,0 +1,216 @@
+#ifndef ARENA_DEBUG_H
+#define ARENA_DEBUG_H
+
+// Debug checks for chasing corruption, compiled in with -DARENA_DEBUG=1 and gone entirely without it.
+//
+// Same deal as arena_stats.h: every BasicArena holds an ArenaDebugType, which is the empty NoArenaDebug unless
+// ARENA_DEBUG is on, so the hooks in the hot paths compile to nothing in a release build. With it on it's ArenaDebug:
+//   - a state byte per slot (fresh, allocated, freed, guard). A double free, a free of a slot that was never handed
+//     out and a free of a misaligned or foreign pointer all abort with what, where (slot, offset) and how big, instead
+//     of being counted and dropped like in release builds. On a borrowed region (persistent, growable) fresh slots
+//     may be live data from before, freeing those is fine.
+//   - poison on free: the slot is filled with POISON, and the next allocation of it checks the fill is still intact.
+//     A byte that isn't means somebody wrote to the slot after freeing it, which aborts too, naming the first such
+//     byte. Skipped when the arena reclaims pages, MADV_DONTNEED hands the page back zeroed.
+//   - guard slots: the last slot of every bitmap word is never handed out and mprotect'ed PROT_NONE, so running off
+//     the end of a word's slots (or of the arena) faults right there. Needs slots that are whole pages of the region's
+//     backing and an arena that maps its own memory, borrowed regions don't get guards. The price: 1 slot in 64, and
+//     no run longer than 63 slots.
+//   - ASan manual poisoning when built with -fsanitize=address: slots that aren't handed out are poisoned (on a
+//     borrowed region only once they've been freed), so any access to them gets reported by ASan with a stack trace,
+//     reads included.
+// SlotCache goes through the same hooks, a slot sitting in a thread cache counts as freed here.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sys/mman.h>
+#include <type_traits>
+#include <unistd.h>
+
+#ifndef ARENA_DEBUG
+#define ARENA_DEBUG 0
+#endif
+
+#if defined(__SANITIZE_ADDRESS__)
+#define ARENA_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define ARENA_ASAN 1
+#endif
+#endif
+
+#ifdef ARENA_ASAN
+#include <sanitizer/asan_interface.h>
+#endif
+
+inline constexpr bool ARENA_DEBUG_ENABLED = ARENA_DEBUG != 0;
+
+inline void arena_asan_poison(const void* ptr, size_t bytes) {
+#ifdef ARENA_ASAN
+    ASAN_POISON_MEMORY_REGION(ptr, bytes);
+#else
+    (void)ptr;
+    (void)bytes;
+#endif
+}
+
+inline void arena_asan_unpoison(const void* ptr, size_t bytes) {
+#ifdef ARENA_ASAN
+    ASAN_UNPOISON_MEMORY_REGION(ptr, bytes);
+#else
+    (void)ptr;
+    (void)bytes;
+#endif
+}
+
+struct ArenaDebug {
+    static constexpr bool enabled = true;
+    static constexpr uint8_t POISON = 0xDF;
+    // One guard per bitmap word, the highest slot of it.
+    static constexpr size_t GUARD_EVERY = 64;
+
+    enum SlotState : uint8_t {
+        Fresh, // never handed out
+        Allocated,
+        Freed,
+        Guard,
+    };
+
+    char* base = NULL;
+    size_t slot_size = 0;
+    size_t num_slots = 0;
+    bool owned = false; // the arena mapped this memory itself, so fresh really means never handed out
+    bool guards = false;
+    bool check_poison = false;
+    std::unique_ptr<std::atomic<uint8_t>[]> state;
+
+    void init(char* base, size_t slot_size, size_t num_slots, bool owned, bool check_poison);
+    void teardown();
+    void on_allocate(size_t first_slot, size_t count);
+    void on_free(size_t first_slot, size_t count);
+    [[noreturn]] void on_invalid_free(const char* ptr, size_t size, const char* why) const;
+    [[noreturn]] void fail(const char* what, size_t slot_idx, ptrdiff_t bad_byte = -1) const;
+};
+
+/// Guards need an owned region, page sized slots and mprotect to work, without them the arena just has no guards.
+inline void ArenaDebug::init(char* base, size_t slot_size, size_t num_slots, bool owned, bool check_poison) {
+    this->base = base;
+    this->slot_size = slot_size;
+    this->num_slots = num_slots;
+    this->owned = owned;
+    this->check_poison = check_poison;
+    state = std::make_unique<std::atomic<uint8_t>[]>(num_slots);
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    guards = owned && slot_size % page == 0;
+    for (size_t slot_idx = GUARD_EVERY - 1; guards && slot_idx < num_slots; slot_idx += GUARD_EVERY) {
+        if (mprotect(base + slot_idx * slot_size, slot_size, PROT_NONE) != 0) {
+            // Hugetlb backing can't protect single pages, and every guard splits the mapping, which runs into
+            // vm.max_map_count on big arenas. Undo what we have and go without.
+            std::perror("arena debug: mprotect of guard slot failed, no guards");
+            for (size_t done = GUARD_EVERY - 1; done < slot_idx; done += GUARD_EVERY) {
+                mprotect(base + done * slot_size, slot_size, PROT_READ | PROT_WRITE);
+                state[done].store(Fresh, std::memory_order_relaxed);
+            }
+            guards = false;
+            break;
+        }
+        state[slot_idx].store(Guard, std::memory_order_relaxed);
+    }
+    if (owned) {
+        arena_asan_poison(base, num_slots * slot_size);
+    }
+}
+
+/// Unprotects the guards and unpoisons everything, for memory that outlives the arena (and so a later mapping at the
+/// same address doesn't inherit stale ASan poison).
+inline void ArenaDebug::teardown() {
+    if (state == NULL) {
+        return;
+    }
+    for (size_t slot_idx = GUARD_EVERY - 1; guards && slot_idx < num_slots; slot_idx += GUARD_EVERY) {
+        mprotect(base + slot_idx * slot_size, slot_size, PROT_READ | PROT_WRITE);
+    }
+    arena_asan_unpoison(base, num_slots * slot_size);
+    state.reset();
+}
+
+/// The slots were just taken out of the bitmap (or a thread cache) and are about to be handed out.
+inline void ArenaDebug::on_allocate(size_t first_slot, size_t count) {
+    for (size_t slot_idx = first_slot; slot_idx < first_slot + count; ++slot_idx) {
+        uint8_t was = state[slot_idx].exchange(Allocated, std::memory_order_acq_rel);
+        if (was == Allocated || was == Guard) {
+            fail(was == Guard ? "guard slot handed out" : "slot handed out twice", slot_idx);
+        }
+        char* slot = base + slot_idx * slot_size;
+        arena_asan_unpoison(slot, slot_size);
+        if (was == Freed && check_poison) {
+            for (size_t i = 0; i < slot_size; ++i) {
+                if (static_cast<uint8_t>(slot[i]) != POISON) {
+                    fail("written after free", slot_idx, static_cast<ptrdiff_t>(i));
+                }
+            }
+        }
+    }
+}
+
+/// Before the slots go back, poisons them and aborts if any of them wasn't handed out.
+inline void ArenaDebug::on_free(size_t first_slot, size_t count) {
+    for (size_t slot_idx = first_slot; slot_idx < first_slot + count; ++slot_idx) {
+        uint8_t was = state[slot_idx].exchange(Freed, std::memory_order_acq_rel);
+        if (was != Allocated && (was != Fresh || owned)) {
+            const char* what = was == Freed   ? "double free"
+                               : was == Guard ? "free of a guard slot"
+                                              : "free of a slot never handed out";
+            fail(what, slot_idx);
+        }
+        char* slot = base + slot_idx * slot_size;
+        std::memset(slot, POISON, slot_size);
+        arena_asan_poison(slot, slot_size);
+    }
+}
+
+inline void ArenaDebug::on_invalid_free(const char* ptr, size_t size, const char* why) const {
+    std::fprintf(stderr, "arena debug: invalid free of %p (%zu bytes): %s, arena is [%p, %p)\n",
+                 static_cast<const void*>(ptr), size, why, static_cast<void*>(base),
+                 static_cast<void*>(base + num_slots * slot_size));
+    std::abort();
+}
+
+/// bad_byte is the offset of the first overwritten poison byte, for "written after free".
+inline void ArenaDebug::fail(const char* what, size_t slot_idx, ptrdiff_t bad_byte) const {
+    char* slot = base + slot_idx * slot_size;
+    std::fprintf(stderr, "arena debug: %s: slot %zu of %zu at %p (offset %zu, %zu byte slots)", what, slot_idx,
+                 num_slots, static_cast<void*>(slot), slot_idx * slot_size, slot_size);
+    if (bad_byte >= 0) {
+        std::fprintf(stderr, ", byte %td is 0x%02x instead of 0x%02x", bad_byte, static_cast<uint8_t>(slot[bad_byte]),
+                     POISON);
+    }
+    std::fprintf(stderr, "\n");
+    std::abort();
+}
+
+struct NoArenaDebug {
+    static constexpr bool enabled = false;
+    static constexpr size_t GUARD_EVERY = ArenaDebug::GUARD_EVERY;
+    static constexpr bool guards = false;
+
+    void init(char*, size_t, size_t, bool, bool) {
+    }
+    void teardown() {
+    }
+    void on_allocate(size_t, size_t) {
+    }
+    void on_free(size_t, size_t) {
+    }
+    void on_invalid_free(const char*, size_t, const char*) const {
+    }
+};
+
+using ArenaDebugType = std::conditional_t<ARENA_DEBUG_ENABLED, ArenaDebug, NoArenaDebug>;
+
+#endif // ARENA_DEBUG_H
@@ -0,0 +1,220 @@
+#ifndef ARENA_RESOURCE_H
+#define ARENA_RESOURCE_H
+
+// std::pmr::memory_resource and STL allocator over an arena, for per-query containers.
+//
+// The arena hands out whole slots, which is the wrong granularity for a hash table node or a vector of ints. So
+// ArenaBumpResource takes slots from it in chunks and bump allocates out of those: an allocation is an align and an
+// add, deallocate does nothing, and everything goes at once with reset(). That's std::pmr::monotonic_buffer_resource
+// with the arena as upstream, minus the malloc calls: the chunk list lives in a header at the front of every chunk, so
+// nothing outside the arena's slots is ever allocated.
+//
+//   - reset() is O(1): it rewinds to the first chunk and keeps the chunks for the next query. Nothing is freed.
+//   - release() hands every chunk back to the arena, the destructor does that too.
+//   - an allocation bigger than a chunk gets a run of slots of its own (an arena multi-slot allocation) that joins
+//     the chunk list like any other chunk.
+//   - running the arena out of slots throws std::bad_alloc, that's what memory_resource::allocate promises.
+//
+// Like the std pmr resources this isn't synchronized, one resource per query (or thread). The arena underneath can be
+// any flavour and is shared as usual. The resource has to go before the arena does, and the containers using it before
+// the resource, or at least before the next reset().
+//
+//   ArenaBumpResource<ArenaLockFreeHint> query_memory(&arena);
+//   std::pmr::unordered_map<uint64_t, Row*> index(&query_memory);
+//   std::pmr::vector<uint64_t> keys(&query_memory);
+//   ... run the query ...
+//   query_memory.reset(); // once the containers are gone
+//
+// ArenaAllocator<T, ArenaT> is the same thing for code that takes a std allocator template parameter instead of a
+// polymorphic_allocator: a pointer to the resource, deallocate a no-op, equal when the resource is.
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+
+template <typename ArenaT>
+struct ArenaBumpResource : std::pmr::memory_resource {
+    static constexpr size_t DEFAULT_CHUNK_SLOTS = 1;
+
+    // Lives at the front of its chunk.
+    struct Chunk {
+        Chunk* next;
+        size_t size; // bytes, header included
+    };
+
+    ArenaT* arena;
+    size_t chunk_bytes;
+    Chunk* head;
+    Chunk* tail;
+    // The chunk being bumped through, and where in it.
+    Chunk* current;
+    char* cursor;
+    char* limit;
+    size_t chunks;
+    uint64_t resets;
+
+    /// The arena is borrowed and has to outlive this. Chunks are chunk_slots slots (at least one) worth of bytes.
+    explicit ArenaBumpResource(ArenaT* arena, size_t chunk_slots = DEFAULT_CHUNK_SLOTS);
+    ~ArenaBumpResource() override;
+    ArenaBumpResource(const ArenaBumpResource&) = delete;
+    ArenaBumpResource& operator=(const ArenaBumpResource&) = delete;
+
+    void reset();
+    void release();
+    size_t bytes_reserved() const;
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+private:
+    void enter(Chunk* chunk);
+    void* bump(size_t bytes, size_t alignment);
+};
+
+template <typename ArenaT>
+ArenaBumpResource<ArenaT>::ArenaBumpResource(ArenaT* arena, size_t chunk_slots)
+    : arena(arena), chunk_bytes((chunk_slots == 0 ? 1 : chunk_slots) * arena->slot_size), head(NULL), tail(NULL),
+      current(NULL), cursor(NULL), limit(NULL), chunks(0), resets(0) {
+}
+
+template <typename ArenaT>
+ArenaBumpResource<ArenaT>::~ArenaBumpResource() {
+    release();
+}
+
+/// Forgets every allocation and starts over at the first chunk. The chunks stay, so the next query that needs as much
+/// memory as this one did doesn't go to the arena at all.
+template <typename ArenaT>
+void ArenaBumpResource<ArenaT>::reset() {
+    current = NULL;
+    cursor = limit = NULL;
+    if (head != NULL) {
+        enter(head);
+    }
+    resets++;
+}
+
+/// Gives every chunk back to the arena.
+template <typename ArenaT>
+void ArenaBumpResource<ArenaT>::release() {
+    Chunk* chunk = head;
+    while (chunk != NULL) {
+        Chunk* next = chunk->next;
+        arena->free(reinterpret_cast<char*>(chunk), chunk->size);
+        chunk = next;
+    }
+    head = tail = current = NULL;
+    cursor = limit = NULL;
+    chunks = 0;
+}
+
+/// Bytes taken from the arena, chunk headers and unused tails included.
+template <typename ArenaT>
+size_t ArenaBumpResource<ArenaT>::bytes_reserved() const {
+    size_t bytes = 0;
+    for (Chunk* chunk = head; chunk != NULL; chunk = chunk->next) {
+        bytes += chunk->size;
+    }
+    return bytes;
+}
+
+template <typename ArenaT>
+inline void ArenaBumpResource<ArenaT>::enter(Chunk* chunk) {
+    current = chunk;
+    cursor = reinterpret_cast<char*>(chunk) + sizeof(Chunk);
+    limit = reinterpret_cast<char*>(chunk) + chunk->size;
+}
+
+template <typename ArenaT>
+inline void* ArenaBumpResource<ArenaT>::bump(size_t bytes, size_t alignment) {
+    uintptr_t at = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (cursor == NULL || at > reinterpret_cast<uintptr_t>(limit) || bytes > reinterpret_cast<uintptr_t>(limit) - at) {
+        return NULL;
+    }
+    cursor = reinterpret_cast<char*>(at + bytes);
+    return reinterpret_cast<void*>(at);
+}
+
+/// Bumps through the current chunk, then through the ones a reset() left behind, then asks the arena for a new one.
+template <typename ArenaT>
+void* ArenaBumpResource<ArenaT>::do_allocate(size_t bytes, size_t alignment) {
+    if (bytes == 0) {
+        bytes = 1;
+    }
+    void* ptr = bump(bytes, alignment);
+    if (ptr != NULL) {
+        return ptr;
+    }
+    // Kept chunks, in the order they were taken. One that is too small for this request stays unused until the next
+    // reset, same as the tail of a chunk.
+    while (current != NULL && current->next != NULL) {
+        enter(current->next);
+        if ((ptr = bump(bytes, alignment)) != NULL) {
+            return ptr;
+        }
+    }
+    // Room for the worst case padding, slot addresses only have the alignment the slot size gives them.
+    size_t needed = sizeof(Chunk) + bytes + alignment - 1;
+    if (needed < bytes) {
+        throw std::bad_alloc();
+    }
+    size_t size = needed <= chunk_bytes ? chunk_bytes : arena->slots_for(needed) * arena->slot_size;
+    char* memory = arena->allocate(size);
+    if (memory == NULL) {
+        throw std::bad_alloc();
+    }
+    Chunk* chunk = reinterpret_cast<Chunk*>(memory);
+    chunk->next = NULL;
+    chunk->size = size;
+    if (tail == NULL) {
+        head = chunk;
+    } else {
+        tail->next = chunk;
+    }
+    tail = chunk;
+    chunks++;
+    enter(chunk);
+    return bump(bytes, alignment);
+}
+
+/// Nothing, memory only comes back with reset() or release().
+template <typename ArenaT>
+void ArenaBumpResource<ArenaT>::do_deallocate(void*, size_t, size_t) {
+}
+
+template <typename ArenaT>
+bool ArenaBumpResource<ArenaT>::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+template <typename T, typename ArenaT>
+struct ArenaAllocator {
+    using value_type = T;
+
+    ArenaBumpResource<ArenaT>* resource;
+
+    explicit ArenaAllocator(ArenaBumpResource<ArenaT>* resource) : resource(resource) {
+    }
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U, ArenaT>& other) : resource(other.resource) {
+    }
+
+    T* allocate(size_t n) {
+        if (n > SIZE_MAX / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        return static_cast<T*>(resource->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, size_t) {
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U, ArenaT>& other) const {
+        return resource == other.resource;
+    }
+};
+
+#endif // ARENA_RESOURCE_H
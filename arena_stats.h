@@ -0,0 +1,206 @@
+#ifndef ARENA_STATS_H
+#define ARENA_STATS_H
+
+// Allocator telemetry, compiled in with -DARENA_STATS=1 and gone entirely without it.
+//
+// Every BasicArena holds an ArenaStatsType. With ARENA_STATS off that's NoArenaStats, an empty struct whose add()
+// does nothing, so the calls in the hot paths compile away and the arena doesn't get any bigger. With it on it's
+// ArenaStats: one cache line aligned shard of counters per thread slot (ShardedCounter::thread_slot(), round robin),
+// summed up by snapshot(). A shard is bumped with a relaxed load and store, no lock prefix, on lines that almost never
+// leave the core. The catch: once there are more threads than shards, two threads sharing a shard can lose the odd
+// increment to each other. Fine for telemetry, and what keeps an allocation under ARENA_STATS a few ns dearer instead
+// of a few atomic RMWs dearer.
+//
+// What's counted:
+//   - allocations / failed allocations / frees, calls and slots (multi-slot and batch calls count all their slots)
+//   - double frees and invalid frees (out of range or misaligned), which free() used to just drop
+//   - words the free slot search touched per allocation, summary and bitmap words, as a total and a histogram
+//   - lock acquisitions, how many found the lock taken, how long those waited (cycle counter, so only the contended
+//     path pays for the timer) and how often the spin lock spun
+// The arena adds occupancy and the CAS retry count of the lock-free bitmaps to its snapshot, those exist either way.
+
+#include "latency_histogram.h"
+#include "sharded_counter.h"
+#include "word_layout.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <type_traits>
+
+#ifndef ARENA_STATS
+#define ARENA_STATS 0
+#endif
+
+inline constexpr bool ARENA_STATS_ENABLED = ARENA_STATS != 0;
+
+// Words the summary searches touched on this thread so far, see SummaryBitmap::find_next. The arena takes the
+// difference around a claim, so nothing here has to know which arena it's working for.
+inline thread_local uint64_t arena_words_scanned = 0;
+
+inline void arena_stats_count_scan(uint64_t words) {
+    if constexpr (ARENA_STATS_ENABLED) {
+        arena_words_scanned += words;
+    } else {
+        (void)words;
+    }
+}
+
+enum class ArenaCounter : uint32_t {
+    Allocations,       // calls (or batch slots) that got memory
+    FailedAllocations, // calls that didn't, a short allocate_batch counts once
+    SlotsAllocated,
+    Frees,
+    SlotsFreed,
+    DoubleFrees,
+    InvalidFrees, // out of range, misaligned, invalid handle
+    WordsScanned,
+    LockAcquisitions,
+    LockContended,
+    LockWaitTicks,
+    LockSpins,
+    Count,
+};
+
+// Words scanned per allocation in power of two buckets: [0], [1], [2, 3], [4, 7] ... the last one open ended.
+inline constexpr size_t SCAN_HISTOGRAM_BUCKETS = 8;
+
+inline size_t scan_histogram_bucket(uint64_t words) {
+    return std::min<size_t>(static_cast<size_t>(std::bit_width(words)), SCAN_HISTOGRAM_BUCKETS - 1);
+}
+
+// What an exporter polls, see BasicArena::stats_snapshot(). All zeros except the occupancy part when the counters
+// aren't compiled in, `enabled` says which.
+struct ArenaStatsSnapshot {
+    bool enabled = ARENA_STATS_ENABLED;
+    std::array<uint64_t, static_cast<size_t>(ArenaCounter::Count)> counters{};
+    std::array<uint64_t, SCAN_HISTOGRAM_BUCKETS> words_scanned_histogram{};
+    // Filled in by the arena.
+    uint64_t slots_in_use = 0;
+    uint64_t num_slots = 0;
+    uint64_t parked_slots = 0; // given back to the kernel by the reclaimer, see page_reclaimer.h
+    uint64_t cas_retries = 0;  // lock-free bitmaps only
+
+    uint64_t operator[](ArenaCounter counter) const {
+        return counters[static_cast<size_t>(counter)];
+    }
+    double occupancy() const {
+        return num_slots == 0 ? 0.0 : static_cast<double>(slots_in_use) / num_slots;
+    }
+    double words_scanned_per_allocation() const {
+        uint64_t allocations = (*this)[ArenaCounter::Allocations] + (*this)[ArenaCounter::FailedAllocations];
+        return allocations == 0 ? 0.0 : static_cast<double>((*this)[ArenaCounter::WordsScanned]) / allocations;
+    }
+    double lock_wait_ns() const {
+        return cycle_counter_ns((*this)[ArenaCounter::LockWaitTicks]);
+    }
+};
+
+struct ArenaStats {
+    static constexpr bool enabled = true;
+
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        std::array<std::atomic<uint64_t>, static_cast<size_t>(ArenaCounter::Count)> counters{};
+        std::array<std::atomic<uint64_t>, SCAN_HISTOGRAM_BUCKETS> words_scanned_histogram{};
+    };
+
+    size_t shard_mask;
+    std::unique_ptr<Shard[]> shards;
+
+    ArenaStats() {
+        size_t num_shards = std::bit_ceil(
+            std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), ShardedCounter::MAX_SHARDS));
+        shard_mask = num_shards - 1;
+        shards = std::make_unique<Shard[]>(num_shards);
+    }
+
+    Shard& local() {
+        return shards[ShardedCounter::thread_slot() & shard_mask];
+    }
+    static void bump(std::atomic<uint64_t>& counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    void add(ArenaCounter counter, uint64_t n = 1) {
+        bump(local().counters[static_cast<size_t>(counter)], n);
+    }
+    /// One search that touched `words` words and came back with `allocations` allocations worth `slots` slots, and
+    /// `failed` failures (a short batch has both).
+    void add_allocation(uint64_t words, uint64_t allocations, uint64_t slots, uint64_t failed) {
+        Shard& shard = local();
+        bump(shard.counters[static_cast<size_t>(ArenaCounter::WordsScanned)], words);
+        bump(shard.words_scanned_histogram[scan_histogram_bucket(words)], 1);
+        bump(shard.counters[static_cast<size_t>(ArenaCounter::Allocations)], allocations);
+        bump(shard.counters[static_cast<size_t>(ArenaCounter::SlotsAllocated)], slots);
+        bump(shard.counters[static_cast<size_t>(ArenaCounter::FailedAllocations)], failed);
+    }
+    void add_free(uint64_t frees, uint64_t slots) {
+        Shard& shard = local();
+        bump(shard.counters[static_cast<size_t>(ArenaCounter::Frees)], frees);
+        bump(shard.counters[static_cast<size_t>(ArenaCounter::SlotsFreed)], slots);
+    }
+    void snapshot(ArenaStatsSnapshot& out) const {
+        for (size_t i = 0; i <= shard_mask; ++i) {
+            for (size_t c = 0; c < out.counters.size(); ++c) {
+                out.counters[c] += shards[i].counters[c].load(std::memory_order_relaxed);
+            }
+            for (size_t b = 0; b < SCAN_HISTOGRAM_BUCKETS; ++b) {
+                const std::atomic<uint64_t>& count = shards[i].words_scanned_histogram[b];
+                out.words_scanned_histogram[b] += count.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+struct NoArenaStats {
+    static constexpr bool enabled = false;
+
+    void add(ArenaCounter, uint64_t = 1) {
+    }
+    void add_allocation(uint64_t, uint64_t, uint64_t, uint64_t) {
+    }
+    void add_free(uint64_t, uint64_t) {
+    }
+    void snapshot(ArenaStatsSnapshot&) const {
+    }
+};
+
+using ArenaStatsType = std::conditional_t<ARENA_STATS_ENABLED, ArenaStats, NoArenaStats>;
+
+/// std::lock_guard that also feeds the lock counters. An uncontended acquisition is one try_lock, only when that
+/// fails does the wait get timed (and, for locks that can tell, its spins counted). Without stats it is lock_guard.
+template <typename Lock, typename Stats>
+struct StatsLockGuard {
+    Lock& held;
+
+    StatsLockGuard(Lock& lock, Stats& stats) : held(lock) {
+        if constexpr (Stats::enabled && requires { lock.try_lock(); }) {
+            stats.add(ArenaCounter::LockAcquisitions);
+            if (lock.try_lock()) {
+                return;
+            }
+            uint64_t start = read_cycle_counter();
+            if constexpr (requires { lock.lock_counting_spins(); }) {
+                stats.add(ArenaCounter::LockSpins, lock.lock_counting_spins());
+            } else {
+                lock.lock();
+            }
+            stats.add(ArenaCounter::LockContended);
+            stats.add(ArenaCounter::LockWaitTicks, read_cycle_counter() - start);
+        } else {
+            (void)stats;
+            lock.lock();
+        }
+    }
+    ~StatsLockGuard() {
+        held.unlock();
+    }
+    StatsLockGuard(const StatsLockGuard&) = delete;
+    StatsLockGuard& operator=(const StatsLockGuard&) = delete;
+};
+
+#endif // ARENA_STATS_H
@@ -0,0 +1,851 @@
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+// The multi-threaded allocate/free harness behind benchmark.cpp's allocator comparisons.
+//
+//   - Drivers: one per allocator, all with the same shape. A driver owns one allocator instance for one repetition,
+//     local() hands each worker thread its front end (the arena itself, a SlotCache, malloc) with allocate()/free().
+//     The malloc driver is the system allocator; jemalloc and mimalloc get their own drivers when built with
+//     -DARENA_BENCH_JEMALLOC -ljemalloc / -DARENA_BENCH_MIMALLOC -lmimalloc (or just LD_PRELOAD one under "malloc").
+//   - Workloads: what every worker does with its front end, see Workload. One generic worker runs all of them for all
+//     drivers, so the only thing that differs between two rows of output is the allocator.
+//   - Runs: `warmup` unmeasured repetitions, then `reps` measured ones, each on a fresh allocator. Threads start
+//     together off a flag once all of them are up and pinned (optionally), a repetition's time is from that flag to
+//     the last thread finishing. Per repetition ms are summarized as mean, stddev, min, median, p95 and max.
+//   - Latency (record_latency): every allocate and free call timed with the cycle counter into per-thread
+//     LatencyHistograms (see latency_histogram.h), merged over threads and repetitions. Allocations are also split by
+//     how full the arena was when the call started. Costs two counter reads per call, so the rep times of a run with
+//     it on aren't comparable to one without.
+//   - Output: a human table, CSV or JSON, one row per (driver, workload, threads) so results can be diffed across
+//     builds instead of scraped from the table.
+// Every thread has its own seeded xorshift, runs are reproducible for a given --seed.
+
+#include "arena_allocator.h"
+#include "epoch_reclaim.h"
+#include "free_list_arena.h"
+#include "latency_histogram.h"
+#include "numa_arena.h"
+#include "sharded_counter.h"
+#include "slot_cache.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#if defined(ARENA_BENCH_JEMALLOC)
+#include <jemalloc/jemalloc.h>
+#endif
+#if defined(ARENA_BENCH_MIMALLOC)
+#include <mimalloc.h>
+#endif
+
+enum class Workload {
+    SteadyState,      // random mix, alloc_percent allocates and the rest frees a random live slot
+    FillDrain,        // allocate up to the thread's share of the arena, free it all in random order, fill_cycles times
+    ProducerConsumer, // thread pairs, one allocates and hands slots over a ring, the other frees them
+    Bursty,           // bursts of up to 2 * burst_size allocations, each followed by freeing part of the live set
+};
+
+inline const char* workload_name(Workload workload) {
+    switch (workload) {
+    case Workload::SteadyState:
+        return "steady";
+    case Workload::FillDrain:
+        return "fill-drain";
+    case Workload::ProducerConsumer:
+        return "producer-consumer";
+    case Workload::Bursty:
+        return "bursty";
+    }
+    return "unknown";
+}
+
+/// false if name isn't one of the workload_name()s.
+inline bool parse_workload(const char* name, Workload& workload) {
+    for (Workload candidate :
+         {Workload::SteadyState, Workload::FillDrain, Workload::ProducerConsumer, Workload::Bursty}) {
+        if (std::strcmp(name, workload_name(candidate)) == 0) {
+            workload = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct HarnessConfig {
+    size_t arena_capacity = 200 * 1024 * 1024;
+    size_t slot_size = 4 * 1024;
+    uint32_t num_threads = 4;
+    Workload workload = Workload::SteadyState;
+    // Operations (allocate or free attempts) per thread, for everything but FillDrain.
+    uint32_t ops_per_thread = 10000;
+    uint32_t alloc_percent = 60;
+    uint32_t burst_size = 256;
+    uint32_t fill_cycles = 4;
+    // Write 1 KB to a whole slot into every allocation, so page faults and cache misses are part of the cost.
+    bool write_to_slots = false;
+    // Free whatever is still live when the workload ends (part of the measured time).
+    bool free_at_end = false;
+    bool pin_threads = false;
+    bool record_latency = false;
+    int warmup = 2;
+    int reps = 20;
+    uint64_t seed = 42;
+};
+
+// splitmix64 seeded xorshift64*, a lot cheaper than mt19937 and nothing shared between threads.
+struct BenchRng {
+    uint64_t state;
+
+    explicit BenchRng(uint64_t seed) {
+        uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        state = (z ^ (z >> 31)) | 1;
+    }
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+    /// Uniform in [0, bound), bound > 0, Lemire's multiply-shift.
+    uint64_t below(uint64_t bound) {
+        return static_cast<uint64_t>((static_cast<unsigned __int128>(next()) * bound) >> 64);
+    }
+};
+
+/// Pins the calling thread to the index-th CPU it's allowed on (wrapping). false where that isn't supported.
+inline bool pin_current_thread(uint32_t index) {
+#if defined(__linux__)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+        return false;
+    }
+    uint32_t target = index % static_cast<uint32_t>(CPU_COUNT(&allowed));
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed) && target-- == 0) {
+            cpu_set_t one;
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            return pthread_setaffinity_np(pthread_self(), sizeof(one), &one) == 0;
+        }
+    }
+    return false;
+#else
+    (void)index;
+    return false;
+#endif
+}
+
+// Drivers. Everything a worker needs is local().allocate() / local().free(ptr), the rest is for reporting.
+
+template <typename ArenaT>
+struct ArenaDriver {
+    ArenaT arena;
+    size_t slot_size;
+
+    struct Local {
+        ArenaDriver& driver;
+        char* allocate() {
+            return driver.arena.allocate(driver.slot_size);
+        }
+        void free(char* ptr) {
+            driver.arena.free(ptr, driver.slot_size);
+        }
+    };
+
+    explicit ArenaDriver(const HarnessConfig& config)
+        : arena(config.arena_capacity, config.slot_size), slot_size(config.slot_size) {
+    }
+    Local local() {
+        return Local{*this};
+    }
+    uint64_t cas_retries() const {
+        if constexpr (requires(const ArenaT& a) { a.get_cas_retries(); }) {
+            return arena.get_cas_retries();
+        }
+        return 0;
+    }
+    std::array<uint64_t, CasRetryHistogram::NUM_BUCKETS> retry_histogram() const {
+        if constexpr (requires(const ArenaT& a) { a.get_cas_retry_histogram(); }) {
+            return arena.get_cas_retry_histogram();
+        }
+        return {};
+    }
+};
+
+// ArenaLockFreeHint behind one SlotCache per worker thread.
+struct SlotCacheDriver : ArenaDriver<ArenaLockFreeHint> {
+    struct Local {
+        SlotCache cache;
+        size_t slot_size;
+        char* allocate() {
+            return cache.allocate(slot_size);
+        }
+        void free(char* ptr) {
+            cache.free(ptr, slot_size);
+        }
+    };
+
+    using ArenaDriver<ArenaLockFreeHint>::ArenaDriver;
+    Local local() {
+        return Local{SlotCache(&arena), slot_size};
+    }
+};
+
+// ArenaLockFreeHint with frees deferred through an EpochArena: every free is a pin, a retire and an unpin, what a
+// writer that looked at the page last and then unlinked it would do. Slots come back in batches of RETIRE_BATCH.
+struct EpochDriver : ArenaDriver<ArenaLockFreeHint> {
+    EpochArena<ArenaLockFreeHint> epochs;
+
+    struct Local {
+        EpochArena<ArenaLockFreeHint>::Participant participant;
+        size_t slot_size;
+        char* allocate() {
+            return participant.allocate(slot_size);
+        }
+        void free(char* ptr) {
+            EpochGuard<ArenaLockFreeHint> guard(participant);
+            participant.retire(ptr, slot_size);
+        }
+    };
+
+    explicit EpochDriver(const HarnessConfig& config) : ArenaDriver(config), epochs(&arena, config.num_threads) {
+    }
+    Local local() {
+        return Local{EpochArena<ArenaLockFreeHint>::Participant(epochs), slot_size};
+    }
+};
+
+// malloc never runs out, fill-style workloads stop at the same per-thread share the arenas get instead.
+struct MallocDriver {
+    size_t slot_size;
+    size_t alignment;
+
+    struct Local {
+        MallocDriver& driver;
+        char* allocate() {
+            return static_cast<char*>(std::aligned_alloc(driver.alignment, driver.slot_size));
+        }
+        void free(char* ptr) {
+            std::free(ptr);
+        }
+    };
+
+    explicit MallocDriver(const HarnessConfig& config)
+        : slot_size(config.slot_size), alignment(std::min<size_t>(std::bit_floor(config.slot_size), 4096)) {
+        // aligned_alloc wants the size to be a multiple of the alignment.
+        slot_size = (slot_size + alignment - 1) / alignment * alignment;
+    }
+    Local local() {
+        return Local{*this};
+    }
+    uint64_t cas_retries() const {
+        return 0;
+    }
+    std::array<uint64_t, CasRetryHistogram::NUM_BUCKETS> retry_histogram() const {
+        return {};
+    }
+};
+
+#if defined(ARENA_BENCH_JEMALLOC)
+struct JemallocDriver : MallocDriver {
+    struct Local {
+        JemallocDriver& driver;
+        char* allocate() {
+            return static_cast<char*>(mallocx(driver.slot_size, MALLOCX_ALIGN(driver.alignment)));
+        }
+        void free(char* ptr) {
+            dallocx(ptr, 0);
+        }
+    };
+
+    using MallocDriver::MallocDriver;
+    Local local() {
+        return Local{*this};
+    }
+};
+#endif
+
+#if defined(ARENA_BENCH_MIMALLOC)
+struct MimallocDriver : MallocDriver {
+    struct Local {
+        MimallocDriver& driver;
+        char* allocate() {
+            return static_cast<char*>(mi_malloc_aligned(driver.slot_size, driver.alignment));
+        }
+        void free(char* ptr) {
+            mi_free(ptr);
+        }
+    };
+
+    using MallocDriver::MallocDriver;
+    Local local() {
+        return Local{*this};
+    }
+};
+#endif
+
+// What one worker did in one repetition.
+struct WorkerStats {
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+    uint64_t failed = 0; // allocate returned NULL
+    std::chrono::steady_clock::time_point finished;
+    // Only filled with HarnessConfig::record_latency, in cycle counter ticks.
+    std::array<LatencyHistogram, NUM_FILL_LEVELS> allocate_latency;
+    LatencyHistogram free_latency;
+};
+
+// Single-producer single-consumer hand-off ring for ProducerConsumer.
+struct SlotRing {
+    static constexpr size_t CAPACITY = 1024;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<bool> producer_done{false};
+    char* slots[CAPACITY];
+
+    bool push(char* slot) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == CAPACITY) {
+            return false;
+        }
+        slots[t % CAPACITY] = slot;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+    bool pop(char*& slot) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slot = slots[h % CAPACITY];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+// What the workers of one repetition share besides the driver.
+struct RunShared {
+    std::vector<SlotRing> rings;
+    // Slots live across all threads, the fill level latencies are split by. Only kept up with record_latency.
+    ShardedCounter live;
+
+    explicit RunShared(uint32_t num_threads) : rings(num_threads / 2 + 1) {
+    }
+};
+
+/// Everything one thread does in one repetition, for any driver and workload. thread_idx picks the seed and, for
+/// ProducerConsumer, the role: even threads produce into rings[thread_idx / 2], odd ones consume from it.
+template <typename Driver>
+void run_workload(Driver& driver, const HarnessConfig& config, uint32_t thread_idx, RunShared& shared,
+                  WorkerStats& stats) {
+    auto front = driver.local();
+    BenchRng rng(config.seed * 1000003 + thread_idx);
+    size_t num_slots = arena_slot_count(config.arena_capacity, config.slot_size);
+    size_t share = std::max<size_t>(1, num_slots / config.num_threads);
+    std::vector<char*> live;
+    live.reserve(std::min<size_t>(share, 1 << 16));
+
+    auto allocate = [&]() -> char* {
+        char* slot;
+        if (config.record_latency) {
+            size_t level = fill_level_of(static_cast<uint64_t>(std::max<int64_t>(0, shared.live.load())), num_slots);
+            uint64_t start = read_cycle_counter();
+            slot = front.allocate();
+            stats.allocate_latency[level].record(read_cycle_counter() - start);
+            if (slot != NULL) {
+                shared.live.add(1);
+            }
+        } else {
+            slot = front.allocate();
+        }
+        if (slot == NULL) {
+            stats.failed++;
+            return NULL;
+        }
+        if (config.write_to_slots) {
+            size_t min_bytes = std::min<size_t>(1024, config.slot_size);
+            size_t bytes = min_bytes + rng.below(config.slot_size - min_bytes + 1);
+            std::memset(slot, static_cast<int>(thread_idx + 1), bytes);
+        }
+        stats.allocations++;
+        return slot;
+    };
+    auto release = [&](char* slot) {
+        if (config.record_latency) {
+            uint64_t start = read_cycle_counter();
+            front.free(slot);
+            stats.free_latency.record(read_cycle_counter() - start);
+            shared.live.sub(1);
+        } else {
+            front.free(slot);
+        }
+        stats.frees++;
+    };
+    auto free_at = [&](size_t idx) {
+        release(live[idx]);
+        live[idx] = live.back();
+        live.pop_back();
+    };
+
+    switch (config.workload) {
+    case Workload::SteadyState:
+        for (uint32_t op = 0; op < config.ops_per_thread; ++op) {
+            if (live.empty() || rng.below(100) < config.alloc_percent) {
+                if (char* slot = allocate()) {
+                    live.push_back(slot);
+                }
+            } else {
+                free_at(rng.below(live.size()));
+            }
+        }
+        break;
+    case Workload::FillDrain:
+        for (uint32_t cycle = 0; cycle < config.fill_cycles; ++cycle) {
+            while (live.size() < share) {
+                char* slot = allocate();
+                if (slot == NULL) {
+                    break;
+                }
+                live.push_back(slot);
+            }
+            while (!live.empty()) {
+                free_at(rng.below(live.size()));
+            }
+        }
+        break;
+    case Workload::ProducerConsumer: {
+        SlotRing& ring = shared.rings[thread_idx / 2];
+        if (thread_idx % 2 == 0) {
+            for (uint32_t op = 0; op < config.ops_per_thread; ++op) {
+                char* slot = allocate();
+                if (slot == NULL) {
+                    std::this_thread::yield(); // consumer is behind, the arena is full of slots in flight
+                    continue;
+                }
+                while (!ring.push(slot)) {
+                    std::this_thread::yield();
+                }
+            }
+            ring.producer_done.store(true, std::memory_order_release);
+        } else {
+            char* slot;
+            for (;;) {
+                if (ring.pop(slot)) {
+                    release(slot);
+                } else if (ring.producer_done.load(std::memory_order_acquire)) {
+                    if (!ring.pop(slot)) {
+                        break;
+                    }
+                    release(slot);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        break;
+    }
+    case Workload::Bursty:
+        for (uint64_t ops = 0; ops < config.ops_per_thread;) {
+            uint64_t burst = 1 + rng.below(2 * config.burst_size);
+            for (uint64_t i = 0; i < burst && live.size() < share; ++i, ++ops) {
+                if (char* slot = allocate()) {
+                    live.push_back(slot);
+                }
+            }
+            // Free between half and all of what's live.
+            uint64_t to_free = live.size() / 2 + rng.below(live.size() / 2 + 1);
+            for (uint64_t i = 0; i < to_free; ++i, ++ops) {
+                free_at(rng.below(live.size()));
+            }
+        }
+        break;
+    }
+
+    if (config.free_at_end) {
+        while (!live.empty()) {
+            free_at(live.size() - 1);
+        }
+    }
+    stats.finished = std::chrono::steady_clock::now();
+    // Anything not freed is left to the allocator's teardown, except for malloc which would leak it.
+    if constexpr (std::is_base_of_v<MallocDriver, Driver>) {
+        for (char* slot : live) {
+            front.free(slot);
+        }
+    }
+}
+
+struct RepStats {
+    double mean = 0;
+    double stddev = 0;
+    double min = 0;
+    double median = 0;
+    double p95 = 0;
+    double max = 0;
+};
+
+inline RepStats summarize(std::vector<double> samples) {
+    RepStats stats;
+    if (samples.empty()) {
+        return stats;
+    }
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double sample : samples) {
+        sum += sample;
+    }
+    stats.mean = sum / samples.size();
+    double squares = 0;
+    for (double sample : samples) {
+        squares += (sample - stats.mean) * (sample - stats.mean);
+    }
+    stats.stddev = samples.size() > 1 ? std::sqrt(squares / (samples.size() - 1)) : 0;
+    stats.min = samples.front();
+    stats.max = samples.back();
+    stats.median = samples[samples.size() / 2];
+    stats.p95 = samples[std::min(samples.size() - 1, samples.size() * 95 / 100)];
+    return stats;
+}
+
+// One row of output: a driver on a workload at a thread count. Counts are averages per repetition.
+struct BenchResult {
+    std::string label;  // free-form, which suite the row belongs to
+    std::string driver; // short id, stable across builds
+    std::string driver_name;
+    Workload workload;
+    uint32_t threads;
+    bool writes;
+    int reps;
+    RepStats ms;
+    double ops_per_ms;
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t failed;
+    uint64_t cas_retries;
+    std::array<uint64_t, CasRetryHistogram::NUM_BUCKETS> retry_histogram; // summed over the repetitions
+    // With record_latency, in cycle counter ticks, all threads and repetitions merged.
+    bool has_latency;
+    LatencyHistogram allocate_latency;
+    LatencyHistogram free_latency;
+    std::array<LatencyHistogram, NUM_FILL_LEVELS> allocate_latency_by_fill;
+};
+
+/// Runs warmup + reps repetitions of config.workload on a fresh Driver each.
+template <typename Driver>
+BenchResult run_driver(const char* driver_id, const char* driver_name, const HarnessConfig& config) {
+    HarnessConfig run_config = config;
+    if (run_config.workload == Workload::ProducerConsumer) {
+        run_config.num_threads = std::max<uint32_t>(2, run_config.num_threads / 2 * 2);
+    }
+    BenchResult result{};
+    result.driver = driver_id;
+    result.driver_name = driver_name;
+    result.workload = run_config.workload;
+    result.threads = run_config.num_threads;
+    result.writes = run_config.write_to_slots;
+    result.reps = run_config.reps;
+    result.has_latency = run_config.record_latency;
+
+    std::vector<double> rep_ms;
+    uint64_t total_ops = 0;
+    double total_ms = 0;
+    for (int rep = -run_config.warmup; rep < run_config.reps; ++rep) {
+        Driver driver(run_config);
+        RunShared shared(run_config.num_threads);
+        std::vector<WorkerStats> stats(run_config.num_threads);
+        std::atomic<uint32_t> ready{0};
+        std::atomic<bool> go{false};
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < run_config.num_threads; ++t) {
+            threads.emplace_back([&, t] {
+                if (run_config.pin_threads) {
+                    pin_current_thread(t);
+                }
+                ready.fetch_add(1, std::memory_order_acq_rel);
+                while (!go.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+                run_workload(driver, run_config, t, shared, stats[t]);
+            });
+        }
+        while (ready.load(std::memory_order_acquire) != run_config.num_threads) {
+            std::this_thread::yield();
+        }
+        auto start = std::chrono::steady_clock::now();
+        go.store(true, std::memory_order_release);
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        if (rep < 0) {
+            continue;
+        }
+
+        auto finished = start;
+        for (const WorkerStats& worker : stats) {
+            finished = std::max(finished, worker.finished);
+            result.allocations += worker.allocations;
+            result.frees += worker.frees;
+            result.failed += worker.failed;
+            total_ops += worker.allocations + worker.frees;
+            for (size_t level = 0; level < NUM_FILL_LEVELS; ++level) {
+                result.allocate_latency_by_fill[level].merge(worker.allocate_latency[level]);
+                result.allocate_latency.merge(worker.allocate_latency[level]);
+            }
+            result.free_latency.merge(worker.free_latency);
+        }
+        double ms = std::chrono::duration_cast<std::chrono::nanoseconds>(finished - start).count() / 1e6;
+        rep_ms.push_back(ms);
+        total_ms += ms;
+        result.cas_retries += driver.cas_retries();
+        auto histogram = driver.retry_histogram();
+        for (size_t b = 0; b < histogram.size(); ++b) {
+            result.retry_histogram[b] += histogram[b];
+        }
+    }
+    int reps = std::max(1, run_config.reps);
+    result.ms = summarize(rep_ms);
+    result.ops_per_ms = total_ms > 0 ? total_ops / total_ms : 0;
+    result.allocations /= reps;
+    result.frees /= reps;
+    result.failed /= reps;
+    result.cas_retries /= reps;
+    return result;
+}
+
+// Every driver the harness knows, in the order the comparison tables list them.
+struct DriverEntry {
+    const char* id;
+    const char* name;
+    BenchResult (*run)(const char* id, const char* name, const HarnessConfig& config);
+};
+
+inline const std::vector<DriverEntry>& all_drivers() {
+    static const std::vector<DriverEntry> drivers = {
+        {"mutex-hint", "Mutex with Hint", run_driver<ArenaDriver<Arena>>},
+        {"spin-hint", "Spin-Lock with Hint", run_driver<ArenaDriver<ArenaSpinLock>>},
+        {"mutex-nohint", "Mutex without Hint", run_driver<ArenaDriver<ArenaNoHint>>},
+        {"spin-nohint", "Spin-Lock without Hint", run_driver<ArenaDriver<ArenaNoHintSpinLock>>},
+        {"striped-hint", "Striped Mutex with Hint", run_driver<ArenaDriver<ArenaStriped>>},
+        {"striped-nohint", "Striped Mutex without Hint", run_driver<ArenaDriver<ArenaStripedNoHint>>},
+        {"ttas-hint", "TTAS Lock with Hint", run_driver<ArenaDriver<ArenaTtasLock>>},
+        {"ticket-hint", "Ticket Lock with Hint", run_driver<ArenaDriver<ArenaTicketLock>>},
+        {"mcs-hint", "MCS Lock with Hint", run_driver<ArenaDriver<ArenaMcsLock>>},
+        {"futex-hint", "Spin-then-Futex Lock with Hint", run_driver<ArenaDriver<ArenaFutexLock>>},
+        {"lockfree", "Lock-Free without Hint", run_driver<ArenaDriver<ArenaLockFree>>},
+        {"lockfree-hint", "Lock-Free with Hint", run_driver<ArenaDriver<ArenaLockFreeHint>>},
+        {"lockfree-hint-padded", "Lock-Free with Hint, padded", run_driver<ArenaDriver<ArenaLockFreeHintPadded>>},
+        {"lockfree-hint-interleaved", "Lock-Free with Hint, interleaved",
+         run_driver<ArenaDriver<ArenaLockFreeHintInterleaved>>},
+        {"tcache", "Lock-Free with Hint + TCache", run_driver<SlotCacheDriver>},
+        {"epoch", "Lock-Free with Hint + Epoch Free", run_driver<EpochDriver>},
+        {"freelist", "Lock-Free Free List", run_driver<ArenaDriver<ArenaFreeList>>},
+        {"numa", "Lock-Free with Hint per NUMA node", run_driver<ArenaDriver<NumaArena<>>>},
+        {"malloc", "malloc (system)", run_driver<MallocDriver>},
+#if defined(ARENA_BENCH_JEMALLOC)
+        {"jemalloc", "jemalloc", run_driver<JemallocDriver>},
+#endif
+#if defined(ARENA_BENCH_MIMALLOC)
+        {"mimalloc", "mimalloc", run_driver<MimallocDriver>},
+#endif
+    };
+    return drivers;
+}
+
+inline const DriverEntry* find_driver(const char* id) {
+    for (const DriverEntry& entry : all_drivers()) {
+        if (std::strcmp(entry.id, id) == 0) {
+            return &entry;
+        }
+    }
+    return NULL;
+}
+
+// Output. The table is for people, CSV and JSON carry the same fields for scripts.
+
+// Percentiles the latency output reports, next to the mean and the max.
+inline constexpr double LATENCY_PERCENTILES[] = {50, 90, 99, 99.9};
+inline constexpr const char* LATENCY_PERCENTILE_NAMES[] = {"p50", "p90", "p99", "p999"};
+
+/// "0-50%" and so on.
+inline std::string fill_level_name(size_t level) {
+    uint32_t upper = level + 1 < NUM_FILL_LEVELS ? FILL_LEVEL_FLOOR[level + 1] : 100;
+    return std::to_string(FILL_LEVEL_FLOOR[level]) + "-" + std::to_string(upper) + "%";
+}
+
+inline void write_latency_table(FILE* out, const std::vector<BenchResult>& results) {
+    fprintf(out, "\nPer-call latency (ns)\n");
+    fprintf(out, "%-34s %-17s %7s %-8s %10s %8s %8s %8s %8s %8s %10s\n", "Driver", "Workload", "Threads", "Call",
+            "Calls", "Mean", "p50", "p90", "p99", "p99.9", "Max");
+    for (const BenchResult& r : results) {
+        if (!r.has_latency) {
+            continue;
+        }
+        const std::pair<const char*, const LatencyHistogram*> calls[] = {{"allocate", &r.allocate_latency},
+                                                                         {"free", &r.free_latency}};
+        for (const auto& [call, h] : calls) {
+            fprintf(out, "%-34s %-17s %7u %-8s %10llu %8.0f", r.driver_name.c_str(), workload_name(r.workload),
+                    r.threads, call, (unsigned long long)h->total, cycle_counter_ns(h->mean()));
+            for (double percentile : LATENCY_PERCENTILES) {
+                fprintf(out, " %8.0f", cycle_counter_ns(h->percentile(percentile)));
+            }
+            fprintf(out, " %10.0f\n", cycle_counter_ns(h->max_value));
+        }
+    }
+
+    fprintf(out, "\nAllocate latency by arena fill level (ns)\n");
+    fprintf(out, "%-34s %-17s %7s %-8s %10s %8s %8s %8s %8s %8s %10s\n", "Driver", "Workload", "Threads", "Fill",
+            "Calls", "Mean", "p50", "p90", "p99", "p99.9", "Max");
+    for (const BenchResult& r : results) {
+        if (!r.has_latency) {
+            continue;
+        }
+        for (size_t level = 0; level < NUM_FILL_LEVELS; ++level) {
+            const LatencyHistogram& h = r.allocate_latency_by_fill[level];
+            if (h.total == 0) {
+                continue;
+            }
+            fprintf(out, "%-34s %-17s %7u %-8s %10llu %8.0f", r.driver_name.c_str(), workload_name(r.workload),
+                    r.threads, fill_level_name(level).c_str(), (unsigned long long)h.total, cycle_counter_ns(h.mean()));
+            for (double percentile : LATENCY_PERCENTILES) {
+                fprintf(out, " %8.0f", cycle_counter_ns(h.percentile(percentile)));
+            }
+            fprintf(out, " %10.0f\n", cycle_counter_ns(h.max_value));
+        }
+    }
+}
+
+inline void write_results_table(FILE* out, const std::vector<BenchResult>& results) {
+    fprintf(out, "%-34s %-17s %7s %10s %9s %10s %10s %12s %10s %10s %10s\n", "Driver", "Workload", "Threads",
+            "Mean (ms)", "Stddev", "Median", "p95", "Ops/ms", "Allocs", "Frees", "CAS retr.");
+    bool any_latency = false;
+    for (const BenchResult& r : results) {
+        fprintf(out, "%-34s %-17s %7u %10.3f %9.3f %10.3f %10.3f %12.1f %10llu %10llu %10llu\n", r.driver_name.c_str(),
+                workload_name(r.workload), r.threads, r.ms.mean, r.ms.stddev, r.ms.median, r.ms.p95, r.ops_per_ms,
+                (unsigned long long)r.allocations, (unsigned long long)r.frees, (unsigned long long)r.cas_retries);
+        any_latency |= r.has_latency;
+    }
+    if (any_latency) {
+        write_latency_table(out, results);
+    }
+}
+
+// Latency columns: calls, mean, the percentiles and max, in ns. Empty histograms (latency off) come out as zeros so
+// the column set doesn't depend on the flags.
+inline void write_latency_csv_header(FILE* out, const char* prefix) {
+    fprintf(out, ",%s_calls,%s_mean_ns", prefix, prefix);
+    for (const char* name : LATENCY_PERCENTILE_NAMES) {
+        fprintf(out, ",%s_%s_ns", prefix, name);
+    }
+    fprintf(out, ",%s_max_ns", prefix);
+}
+
+inline void write_latency_csv(FILE* out, const LatencyHistogram& h) {
+    fprintf(out, ",%llu,%.1f", (unsigned long long)h.total, cycle_counter_ns(h.mean()));
+    for (double percentile : LATENCY_PERCENTILES) {
+        fprintf(out, ",%.1f", cycle_counter_ns(h.percentile(percentile)));
+    }
+    fprintf(out, ",%.1f", cycle_counter_ns(h.max_value));
+}
+
+inline void write_latency_json(FILE* out, const LatencyHistogram& h) {
+    fprintf(out, "{\"calls\": %llu, \"mean\": %.1f", (unsigned long long)h.total, cycle_counter_ns(h.mean()));
+    for (size_t i = 0; i < std::size(LATENCY_PERCENTILES); ++i) {
+        fprintf(out, ", \"%s\": %.1f", LATENCY_PERCENTILE_NAMES[i],
+                cycle_counter_ns(h.percentile(LATENCY_PERCENTILES[i])));
+    }
+    fprintf(out, ", \"max\": %.1f}", cycle_counter_ns(h.max_value));
+}
+
+inline void write_results_csv(FILE* out, const std::vector<BenchResult>& results) {
+    fprintf(out, "label,driver,workload,threads,writes,reps,mean_ms,stddev_ms,min_ms,median_ms,p95_ms,max_ms,"
+                 "ops_per_ms,allocations,frees,failed,cas_retries");
+    for (size_t b = 0; b < CasRetryHistogram::NUM_BUCKETS; ++b) {
+        fprintf(out, ",retries_%llu", (unsigned long long)CasRetryHistogram::bucket_floor(b));
+    }
+    write_latency_csv_header(out, "allocate");
+    write_latency_csv_header(out, "free");
+    for (size_t level = 0; level < NUM_FILL_LEVELS; ++level) {
+        write_latency_csv_header(out, ("allocate_fill" + std::to_string(FILL_LEVEL_FLOOR[level])).c_str());
+    }
+    fprintf(out, "\n");
+    for (const BenchResult& r : results) {
+        fprintf(out, "%s,%s,%s,%u,%d,%d,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.3f,%llu,%llu,%llu,%llu", r.label.c_str(),
+                r.driver.c_str(), workload_name(r.workload), r.threads, r.writes ? 1 : 0, r.reps, r.ms.mean,
+                r.ms.stddev, r.ms.min, r.ms.median, r.ms.p95, r.ms.max, r.ops_per_ms,
+                (unsigned long long)r.allocations, (unsigned long long)r.frees, (unsigned long long)r.failed,
+                (unsigned long long)r.cas_retries);
+        for (uint64_t count : r.retry_histogram) {
+            fprintf(out, ",%llu", (unsigned long long)count);
+        }
+        write_latency_csv(out, r.allocate_latency);
+        write_latency_csv(out, r.free_latency);
+        for (const LatencyHistogram& h : r.allocate_latency_by_fill) {
+            write_latency_csv(out, h);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+inline void write_results_json(FILE* out, const std::vector<BenchResult>& results) {
+    // Labels and driver names are ours, no quotes or backslashes in them, so no escaping needed.
+    fprintf(out, "[\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        fprintf(out,
+                "  {\"label\": \"%s\", \"driver\": \"%s\", \"driver_name\": \"%s\", \"workload\": \"%s\", "
+                "\"threads\": %u, \"writes\": %s, \"reps\": %d,\n"
+                "   \"ms\": {\"mean\": %.6f, \"stddev\": %.6f, \"min\": %.6f, \"median\": %.6f, \"p95\": %.6f, "
+                "\"max\": %.6f},\n"
+                "   \"ops_per_ms\": %.3f, \"allocations\": %llu, \"frees\": %llu, \"failed\": %llu, "
+                "\"cas_retries\": %llu, \"retry_histogram\": [",
+                r.label.c_str(), r.driver.c_str(), r.driver_name.c_str(), workload_name(r.workload), r.threads,
+                r.writes ? "true" : "false", r.reps, r.ms.mean, r.ms.stddev, r.ms.min, r.ms.median, r.ms.p95,
+                r.ms.max, r.ops_per_ms, (unsigned long long)r.allocations, (unsigned long long)r.frees,
+                (unsigned long long)r.failed, (unsigned long long)r.cas_retries);
+        for (size_t b = 0; b < r.retry_histogram.size(); ++b) {
+            fprintf(out, "%s%llu", b == 0 ? "" : ", ", (unsigned long long)r.retry_histogram[b]);
+        }
+        fprintf(out, "],\n   \"latency_ns\": ");
+        if (!r.has_latency) {
+            fprintf(out, "null");
+        } else {
+            fprintf(out, "{\"allocate\": ");
+            write_latency_json(out, r.allocate_latency);
+            fprintf(out, ",\n                  \"free\": ");
+            write_latency_json(out, r.free_latency);
+            fprintf(out, ",\n                  \"allocate_by_fill\": [");
+            for (size_t level = 0; level < NUM_FILL_LEVELS; ++level) {
+                uint32_t upper = level + 1 < NUM_FILL_LEVELS ? FILL_LEVEL_FLOOR[level + 1] : 100;
+                fprintf(out, "%s\n                    {\"fill_from\": %u, \"fill_to\": %u, \"latency\": ",
+                        level == 0 ? "" : ",", FILL_LEVEL_FLOOR[level], upper);
+                write_latency_json(out, r.allocate_latency_by_fill[level]);
+                fprintf(out, "}");
+            }
+            fprintf(out, "]}");
+        }
+        fprintf(out, "}%s\n", i + 1 == results.size() ? "" : ",");
+    }
+    fprintf(out, "]\n");
+}
+
+#endif // BENCH_HARNESS_H
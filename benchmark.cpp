@@ -1,48 +1,133 @@
 /*
    Arena Allocator Benchmark
 
-   This benchmark compares the performance of six arena allocator implementations:
-   - Phase 1: Mutex-protected Arena with hint (allocation_hint in Bitmap)
-   - Phase 1b: Spin-lock-protected ArenaSpinLock with hint
-   - Phase 2: Mutex-protected ArenaNoHint without hint (BitmapNoHint)
-   - Phase 2b: Spin-lock-protected ArenaNoHintSpinLock without hint
-   - Phase 3: Lock-free ArenaLockFree (BitmapLockFree)
-   - Phase 4: Lock-free ArenaLockFreeHint with hint
-
-   Each phase spawns multiple threads that compete to allocate slots until the arena is full.
-   Each phase is run 100 times to get average, min, and max timings.
+   The first two runs compare the allocators, every driver of bench_harness.h on the steady state workload
+   (60% allocate, 40% free a random live slot, 10000 operations per thread), without and then with writes to the slots:
+   - Mutex / Spin-Lock with Hint (Arena, ArenaSpinLock)
+   - Mutex / Spin-Lock without Hint (ArenaNoHint, ArenaNoHintSpinLock)
+   - Mutex with and without Hint on a striped bitmap, one lock per stripe (ArenaStriped, ArenaStripedNoHint)
+   - TTAS, ticket, MCS and spin-then-futex locks with Hint (ArenaTtasLock, ArenaTicketLock, ArenaMcsLock,
+     ArenaFutexLock)
+   - Lock-Free without Hint (ArenaLockFree), Lock-Free with Hint (ArenaLockFreeHint) and its padded and interleaved
+     word layouts
+   - Lock-Free with Hint behind a per-thread SlotCache
+   - Lock-Free with Hint freeing through an EpochArena, retire + deferred free_batch (see epoch_reclaim.h)
+   - the bitmap-free Treiber stack arena for single slots (ArenaFreeList, see free_list_arena.h)
+   - Lock-Free with Hint split into one sub-arena per NUMA node (NumaArena, see numa_arena.h), a single node holding
+     the whole capacity on a one-node box
+   - malloc as the baseline, plus jemalloc / mimalloc when built with them (see bench_harness.h)
+
+   Each allocator gets 10 warmup and 1000 measured repetitions on a fresh instance, all threads start together and
+   every thread has its own seeded generator.
 
    Configuration:
    - Arena capacity: 200 MB
    - Slot size: 4 KB
    - Total slots: 51,200
    - Thread count: Configurable (default: 4)
-   - Iterations: 100 per phase
 
    Metrics tracked:
-   - Average, min, max time to fill all slots in each phase
-   - Number of slots allocated
-   - CAS retry count (Phases 3 & 4 only)
+   - Mean, stddev, min, median, p95 and max time per repetition
+   - Number of allocations and frees
+   - CAS retry count for the lock-free drivers, with a histogram of retries per contended allocation
+   - Throughput in operations (allocs + frees) per ms
    - Performance comparison across all implementations
+   - Per-call allocate / free latency (mean, p50, p90, p99, p99.9, max), overall and by arena fill level, from
+     separate runs with the cycle counter on (see latency_histogram.h)
+
+   After the two allocator runs a third run measures the bitmap word scan on an almost full bitmap, where the scan
+   cost dominates: the raw scalar vs vectorized kernel (see simd_scan.h) and Bitmap::allocate_many on top of it.
+   A fourth run fills the arena once per page backing (default, THP, 2 MB and 1 GB hugetlb, see ArenaOptions) and
+   measures random access to the slots, which is where dTLB misses show up. Hugetlb falls back to THP when no huge
+   pages are reserved, the output says what each run actually got.
+   A fifth run repeats the Lock-Free with Hint workload at 8, 16 and 32 threads for the dense, padded and interleaved
+   bitmap word layouts (see word_layout.h) to show how much false sharing on the bitmap lines costs.
+   A sixth run fills and empties the arena with allocate_batch / free_batch at growing batch sizes, next to the plain
+   per-page calls.
+   A seventh run writes to every slot, frees them all and lets the page reclaimer (see page_reclaimer.h) give the
+   idle pages back, printing RSS before and after and what refilling the reclaimed arena costs in page faults. It is the
+   same fault/teardown cost benchmark_free_pages_at_end.txt and benchmark_dont_free_pages_at_end.txt compare.
+   An eighth run builds the arena with each prefault mode (see ArenaOptions::prefault) and times every allocate + first
+   write while filling it, so the warm-up cost shows up next to the first-touch tail latency it removes.
+   A ninth run fills a memfd backed PersistentArena (see persistent_arena.h), shuts it down and brings it back, after
+   a clean shutdown and after a "crash" with the rebuild callback, next to what warming a fresh anonymous arena back up
+   by writing every slot costs (a lower bound on re-reading the working set from storage).
+   A tenth run churns the Lock-Free with Hint arena (random allocates and frees around half full) under each placement
+   policy (see placement.h) and prints the time per operation next to the fragmentation it leaves behind.
+   An eleventh run puts every bitmap lock policy (see lock_policies.h) through the allocator workload at 4, 16 and 64
+   threads, past the core count on most machines, which is where spinning without backing off or sleeping falls over.
+   The striped mutex arena (see striped_bitmap.h) runs next to them, one lock per stripe instead of a better lock.
+   A twelfth run builds and drops a per-query hash index and vector on new/delete and on an ArenaBumpResource (see
+   arena_resource.h), reset after every query so later queries reuse the same chunks, and released after every query
+   so every query goes back to the arena.
+   A thirteenth run puts the free list arena next to the Lock-Free with Hint bitmap, bare and behind the thread cache,
+   at 1, 4, 16 and 64 threads: one CAS on one head word against a bitmap word CAS spread over the whole bitmap. It
+   writes to the slots, the free list writes its links into them anyway.
+   A fourteenth run fills the arena to 1, 10, 50 and 90% live and times what a checkpointer pays to visit the live
+   slots: the bitmap snapshot, for_each_allocated serial and parallel (see slot_iteration.h), next to touching every
+   slot of the arena.
+   A fifteenth run has threads allocating pointers and threads allocating handles (see slot_handle.h) churn the same
+   small Lock-Free with Hint arena. It checks that every fresh handle resolves and that slots_in_use is back at 0 once
+   everything is freed. A stale fresh handle means a free bumped the generation after it had already let go of the slot.
+   A sixteenth run pushes four times as many pages as it has frames through a BufferPool (see buffer_pool.h) backed by
+   an in-memory page store, dirtying every page, then reads them all back. It times a fetch on a miss and on a hit, and
+   checks the page contents, the eviction and write back counters and what unpin_page returns for a double unpin.
+   A seventeenth run does the same through a UringPageStore (see uring_page_io.h) on a temporary file: dirty pages
+   written back by eviction and flush_all, then read again by a fresh pool, readahead in batches and single fetches,
+   every page checked. It is skipped on machines without io_uring (ENOSYS, or EPERM when it's disabled).
+   An eighteenth run fills a GrowableArena (see growable_arena.h) over eight segments, growing only when allocation
+   fails and then with the grow-ahead watermark. It times the fill and checks the segment count, committed_bytes and
+   that every free found its segment again.
+   A nineteenth run builds a SizeClassArena (see size_class_arena.h) with 4/8/16/64 KB page classes and slabs for the
+   small objects. It times allocate + free per size and checks the boundaries: the largest slab object, one byte more,
+   every page class and one byte past the largest. Then it checks that a misaligned free, a free into a slab that
+   isn't handed out and a double free leave the live objects alone (and are counted with ARENA_STATS; ARENA_DEBUG
+   aborts on them, so they're skipped there).
+
+   The runs with checks print FAILED for any check that doesn't hold, and the benchmark then exits with 1.
 
    How to compile:
      g++ -std=c++20 -O2 -pthread -o benchmark benchmark.cpp arena_allocator.cpp
 
+     add -DARENA_BENCH_JEMALLOC -ljemalloc and/or -DARENA_BENCH_MIMALLOC -lmimalloc for those baselines
+     add -DARENA_STATS=1 to see what the arena telemetry counters (see arena_stats.h) cost
+     add -DARENA_DEBUG=1 for the guard slot / poisoning checks (see arena_debug.h), the timings mean nothing then
+
    How to run:
      ./benchmark           # Run with default 4 threads
      ./benchmark 2         # Run with 2 threads
-     ./benchmark 8         # Run with 8 threads
-     ./benchmark 16        # Run with 16 threads
+     ./benchmark 8 1       # Run with 8 threads, freeing what's left at the end of each repetition
+     ./benchmark --help    # Harness only: sweep threads, workloads and allocators, pin threads, CSV / JSON output
+     ./benchmark --threads=1,4,16 --workload=all --drivers=tcache,malloc --pin --format=json --out=results.json
 */
 
 #include "arena_allocator.h"
-
+#include "arena_resource.h"
+#include "bench_harness.h"
+#include "growable_arena.h"
+#include "buffer_pool.h"
+#include "page_reclaimer.h"
+#include "persistent_arena.h"
+#include "placement.h"
+#include "simd_scan.h"
+#include "size_class_arena.h"
+#include "slot_cache.h"
+#include "uring_page_io.h"
+
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory_resource>
 #include <random>
+#include <string>
 #include <thread>
+#include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
 // Benchmark configuration
@@ -52,696 +137,1209 @@ struct BenchmarkConfig {
     uint32_t num_threads;
 };
 
-// Shared counter for allocated slots across all threads
-std::atomic<uint32_t> global_allocated_count{0};
+// Checks that failed in the runs that check something, main's exit code.
+static int failed_checks = 0;
 
-// Global flag to control whether to free remaining pages at the end
-bool g_free_remaining_pages = false;
+/// Prints what was checked and whether it held.
+static void check(bool ok, const char* what) {
+    printf("  %-60s %s\n", what, ok ? "ok" : "FAILED");
+    failed_checks += ok ? 0 : 1;
+}
 
-// Global flag to control whether to write to allocated slots
-bool g_write_to_slots = true;
+/// How many contended allocations needed how many retries over all iterations, one bucket per power of two.
+void print_retry_histogram(const std::array<uint64_t, CasRetryHistogram::NUM_BUCKETS>& histogram, int iterations) {
+    printf("  Retries per contended allocation (%d runs):", iterations);
+    for (size_t b = 0; b < histogram.size(); ++b) {
+        unsigned long long floor = CasRetryHistogram::bucket_floor(b);
+        if (b + 1 == histogram.size()) {
+            printf(" %llu+: %llu", floor, (unsigned long long)histogram[b]);
+        } else if (b == 0) {
+            printf(" %llu: %llu", floor, (unsigned long long)histogram[b]);
+        } else {
+            printf(" %llu-%llu: %llu", floor, floor * 2 - 1, (unsigned long long)histogram[b]);
+        }
+    }
+    printf("\n");
+}
 
-// Structure to hold thread statistics
-struct ThreadStats {
-    uint32_t allocations;
-    uint32_t frees;
-};
+static const BenchResult* find_result(const std::vector<BenchResult>& results, const char* driver) {
+    for (const BenchResult& result : results) {
+        if (result.driver == driver) {
+            return &result;
+        }
+    }
+    return NULL;
+}
 
-// Worker function for Phase 1 (mutex-protected Arena)
-void worker_phase1(Arena* arena, size_t slot_size, ThreadStats* stats) {
-    std::vector<char*> allocated_pages;
-    allocated_pages.reserve(4000); // Reserve space for efficiency
-
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> action_dist(0, 99);
-    std::uniform_int_distribution<> page_dist;
-    std::uniform_int_distribution<size_t> write_size_dist(1024, 4096); // 1KB to 4KB
-
-    uint32_t local_alloc_count = 0;
-    uint32_t local_free_count = 0;
-    uint32_t total_operations = 0;
-    const uint32_t MAX_OPERATIONS = 10000;
-
-    // Run for exactly MAX_OPERATIONS iterations
-    while (total_operations < MAX_OPERATIONS) {
-        total_operations++;
-        int action = action_dist(gen);
-
-        // 60% allocate, 40% free if we have pages
-        bool should_allocate = allocated_pages.empty() || action < 60;
-
-        if (should_allocate) {
-            char* slot = arena->allocate(slot_size);
-            if (slot != NULL) {
-                // Write random bytes (1KB to 4KB) to the allocated slot
-                if (g_write_to_slots) {
-                    size_t bytes_to_write = write_size_dist(gen);
-                    for (size_t i = 0; i < bytes_to_write; ++i) {
-                        slot[i] = static_cast<char>(gen() & 0xFF);
-                    }
-                }
+// The allocator comparison, every driver on the steady state workload (60% allocate, 40% free a random live slot,
+// 10000 operations per thread).
+void run_benchmark(const HarnessConfig& harness) {
+    const int LATENCY_REPS = 50;
+    const int LATENCY_FILL_REPS = 3;
 
-                allocated_pages.push_back(slot);
-                local_alloc_count++;
-                global_allocated_count.fetch_add(1, std::memory_order_relaxed);
-            }
-        } else if (!allocated_pages.empty()) {
-            // Free a random page
-            std::uniform_int_distribution<> page_dist(0, allocated_pages.size() - 1);
-            size_t idx = page_dist(gen);
-            arena->free(allocated_pages[idx], slot_size);
-            allocated_pages[idx] = allocated_pages.back();
-            allocated_pages.pop_back();
-            local_free_count++;
-            global_allocated_count.fetch_sub(1, std::memory_order_relaxed);
+    printf("\n=== Arena Allocator Benchmark ===\n");
+    printf("Write to Slots: %s\n", harness.write_to_slots ? "Yes" : "No");
+    printf("Arena Capacity: %zu MB\n", harness.arena_capacity / (1024 * 1024));
+    printf("Slot Size: %zu KB\n", harness.slot_size / 1024);
+    printf("Total Slots: %zu\n", arena_slot_count(harness.arena_capacity, harness.slot_size));
+    printf("Threads: %u%s\n", harness.num_threads, harness.pin_threads ? " (pinned)" : "");
+    printf("Arena Stats: %s\n", ARENA_STATS_ENABLED ? "compiled in" : "off");
+    printf("Repetitions per allocator: %d (+%d warmup)\n\n", harness.reps, harness.warmup);
+
+    std::vector<BenchResult> results;
+    for (const DriverEntry& entry : all_drivers()) {
+        printf("%s: Running...", entry.name);
+        fflush(stdout);
+        results.push_back(entry.run(entry.id, entry.name, harness));
+        const BenchResult& r = results.back();
+        printf(" Done\n");
+        printf("  Mean: %.3f ms, Stddev: %.3f ms, Min: %.3f ms, Median: %.3f ms, Max: %.3f ms, Allocs: %llu, "
+               "Frees: %llu, CAS Retries: %llu\n",
+               r.ms.mean, r.ms.stddev, r.ms.min, r.ms.median, r.ms.max, (unsigned long long)r.allocations,
+               (unsigned long long)r.frees, (unsigned long long)r.cas_retries);
+        if (r.cas_retries != 0) {
+            print_retry_histogram(r.retry_histogram, r.reps);
         }
+        printf("\n");
     }
 
-    // Free any remaining pages (if configured)
-    if (g_free_remaining_pages) {
-        for (char* page : allocated_pages) {
-            arena->free(page, slot_size);
-            local_free_count++;
+    printf("=== Performance Summary Table ===\n\n");
+    write_results_table(stdout, results);
+
+    auto mean = [&](const char* driver) {
+        const BenchResult* result = find_result(results, driver);
+        return result != NULL ? result->ms.mean : 0.0;
+    };
+    auto compare = [&](const char* what, const char* a, const char* b, const char* a_wins, const char* b_wins) {
+        double ma = mean(a), mb = mean(b);
+        if (ma > 0 && mb > 0) {
+            printf("%-38s %.2fx %s\n", what, ma < mb ? mb / ma : ma / mb, ma < mb ? a_wins : b_wins);
+        }
+    };
+    printf("\n=== Direct Comparisons (Mean Times) ===\n");
+    compare("Mutex vs Spin-Lock (with Hint):", "mutex-hint", "spin-hint", "faster with mutex", "faster with spin-lock");
+    compare("Mutex vs Spin-Lock (without Hint):", "mutex-nohint", "spin-nohint", "faster with mutex",
+            "faster with spin-lock");
+    compare("Striped vs one Mutex (with Hint):", "striped-hint", "mutex-hint", "faster striped",
+            "faster with one lock");
+    compare("Striped vs one Mutex (without Hint):", "striped-nohint", "mutex-nohint", "faster striped",
+            "faster with one lock");
+    compare("TTAS vs test-and-set (with Hint):", "ttas-hint", "spin-hint", "faster with TTAS",
+            "faster with test-and-set");
+    compare("MCS vs Ticket (with Hint):", "mcs-hint", "ticket-hint", "faster with MCS", "faster with ticket");
+    compare("Spin-then-Futex vs Mutex (with Hint):", "futex-hint", "mutex-hint", "faster with spin-then-futex",
+            "faster with mutex");
+    compare("Hint vs No-Hint (Mutex):", "mutex-hint", "mutex-nohint", "faster with hint", "faster without hint");
+    compare("Hint vs No-Hint (Spin-Lock):", "spin-hint", "spin-nohint", "faster with hint", "faster without hint");
+    compare("Hint vs No-Hint (Lock-Free):", "lockfree-hint", "lockfree", "faster with hint", "faster without hint");
+    compare("Thread Cache vs Bitmap (Lock-Free):", "tcache", "lockfree-hint", "faster with thread cache",
+            "faster without thread cache");
+    compare("Epoch deferred free vs plain free (Lock-Free):", "epoch", "lockfree-hint", "faster with epochs",
+            "faster with plain free");
+    compare("Free List vs Bitmap (Lock-Free):", "freelist", "lockfree-hint", "faster with the free list",
+            "faster with the bitmap");
+    compare("Per-node arenas vs one arena (Lock-Free):", "numa", "lockfree-hint", "faster per node",
+            "faster with one arena");
+    compare("Lock-Free with Hint vs malloc:", "lockfree-hint", "malloc", "faster with the arena", "faster with malloc");
+    compare("Thread Cache vs malloc:", "tcache", "malloc", "faster with the arena", "faster with malloc");
+
+    // Per-call latency in separate, shorter runs, the timer reads would skew the rep times above. Fill/drain takes
+    // every thread's share of the arena right up to full, that's where the near-full scans and the lock hold times
+    // behind them show up.
+    printf("\n=== Per-Call Latency (steady state: %d reps, fill/drain: %d reps, cycle counter at %.2f ticks/ns) ===\n",
+           LATENCY_REPS, LATENCY_FILL_REPS, cycle_counter_ticks_per_ns());
+    HarnessConfig latency_config = harness;
+    latency_config.record_latency = true;
+    latency_config.warmup = 1;
+    std::vector<BenchResult> latency_results;
+    for (Workload workload : {Workload::SteadyState, Workload::FillDrain}) {
+        latency_config.workload = workload;
+        latency_config.reps = workload == Workload::FillDrain ? LATENCY_FILL_REPS : LATENCY_REPS;
+        for (const DriverEntry& entry : all_drivers()) {
+            latency_results.push_back(entry.run(entry.id, entry.name, latency_config));
         }
     }
-
-    stats->allocations = local_alloc_count;
-    stats->frees = local_free_count;
+    write_latency_table(stdout, latency_results);
+    printf("\n");
 }
 
-// Worker function for Phase 2 (mutex-protected ArenaNoHint)
-void worker_phase2(ArenaNoHint* arena, size_t slot_size, ThreadStats* stats) {
-    std::vector<char*> allocated_pages;
-    allocated_pages.reserve(4000);
-
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> action_dist(0, 99);
-    std::uniform_int_distribution<size_t> write_size_dist(1024, 4096); // 1KB to 4KB
-
-    uint32_t local_alloc_count = 0;
-    uint32_t local_free_count = 0;
-    uint32_t total_operations = 0;
-    const uint32_t MAX_OPERATIONS = 10000;
-
-    while (total_operations < MAX_OPERATIONS) {
-        total_operations++;
-        int action = action_dist(gen);
-        bool should_allocate = allocated_pages.empty() || action < 60;
-
-        if (should_allocate) {
-            char* slot = arena->allocate(slot_size);
-            if (slot != NULL) {
-                // Write random bytes (1KB to 4KB) to the allocated slot
-                if (g_write_to_slots) {
-                    size_t bytes_to_write = write_size_dist(gen);
-                    for (size_t i = 0; i < bytes_to_write; ++i) {
-                        slot[i] = static_cast<char>(gen() & 0xFF);
-                    }
-                }
+// Near-full scan benchmark: every word but the last one is fully allocated, so the scans have to walk everything.
+void run_scan_benchmark() {
+    const size_t NUM_WORDS = 16384; // 1M slots, a 4 GB pool of 4 KB pages
+    const int NUM_SCANS = 20000;
+    const int NUM_RUN_ALLOCS = 20000;
 
-                allocated_pages.push_back(slot);
-                local_alloc_count++;
-                global_allocated_count.fetch_add(1, std::memory_order_relaxed);
-            }
-        } else if (!allocated_pages.empty()) {
-            std::uniform_int_distribution<> page_dist(0, allocated_pages.size() - 1);
-            size_t idx = page_dist(gen);
-            arena->free(allocated_pages[idx], slot_size);
-            allocated_pages[idx] = allocated_pages.back();
-            allocated_pages.pop_back();
-            local_free_count++;
-            global_allocated_count.fetch_sub(1, std::memory_order_relaxed);
-        }
+    printf("\n=== Near-Full Bitmap Scan Benchmark ===\n");
+    printf("Words: %zu (%zu slots), Kernel: %s\n\n", NUM_WORDS, NUM_WORDS * Bitmap::WORD_LENGTH, scan_kernel_name());
+
+    std::vector<uint64_t> words(NUM_WORDS, Bitmap::FULLY_ALLOCATED);
+    words[NUM_WORDS - 1] = 0x3ULL;
+    volatile size_t sink = 0;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < NUM_SCANS; ++i) {
+        sink = sink + scan_first_not_equal_scalar(words.data(), 0, NUM_WORDS, Bitmap::FULLY_ALLOCATED);
     }
+    auto end = std::chrono::high_resolution_clock::now();
+    double scalar_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (double)NUM_SCANS;
 
-    // Free any remaining pages (if configured)
-    if (g_free_remaining_pages) {
-        for (char* page : allocated_pages) {
-            arena->free(page, slot_size);
-            local_free_count++;
-        }
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < NUM_SCANS; ++i) {
+        sink = sink + scan_first_not_equal(words.data(), 0, NUM_WORDS, Bitmap::FULLY_ALLOCATED);
     }
+    end = std::chrono::high_resolution_clock::now();
+    double vector_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (double)NUM_SCANS;
 
-    stats->allocations = local_alloc_count;
-    stats->frees = local_free_count;
-}
+    printf("Full scan, scalar kernel: %10.1f ns (%.2f words/ns)\n", scalar_ns, NUM_WORDS / scalar_ns);
+    printf("Full scan, %-6s kernel: %10.1f ns (%.2f words/ns), %.2fx\n", scan_kernel_name(), vector_ns,
+           NUM_WORDS / vector_ns, scalar_ns / vector_ns);
 
-// Worker function for Phase 3 (lock-free ArenaLockFree)
-void worker_phase3(ArenaLockFree* arena, size_t slot_size, ThreadStats* stats) {
-    std::vector<char*> allocated_pages;
-    allocated_pages.reserve(4000);
-
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> action_dist(0, 99);
-    std::uniform_int_distribution<size_t> write_size_dist(1024, 4096); // 1KB to 4KB
-
-    uint32_t local_alloc_count = 0;
-    uint32_t local_free_count = 0;
-    uint32_t total_operations = 0;
-    const uint32_t MAX_OPERATIONS = 10000;
-
-    while (total_operations < MAX_OPERATIONS) {
-        total_operations++;
-        int action = action_dist(gen);
-        bool should_allocate = allocated_pages.empty() || action < 60;
-
-        if (should_allocate) {
-            char* slot = arena->allocate(slot_size);
-            if (slot != NULL) {
-                // Write random bytes (1KB to 4KB) to the allocated slot
-                if (g_write_to_slots) {
-                    size_t bytes_to_write = write_size_dist(gen);
-                    for (size_t i = 0; i < bytes_to_write; ++i) {
-                        slot[i] = static_cast<char>(gen() & 0xFF);
-                    }
-                }
+    // allocate_many on a bitmap where the only run of 2 slots is at the very end.
+    Bitmap bitmap(static_cast<uint32_t>(NUM_WORDS * Bitmap::WORD_LENGTH));
+    while (bitmap.allocate_one() != -1) {
+    }
+    uint32_t last = bitmap.num_slots - 2;
+    bitmap.free_many(last, 2);
+
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < NUM_RUN_ALLOCS; ++i) {
+        // Reset the hint so every call starts from the front, like a worst case wrap-around.
+        bitmap.allocation_hint.store(0, std::memory_order_relaxed);
+        int slot = bitmap.allocate_many(2);
+        bitmap.free_many(static_cast<uint32_t>(slot), 2);
+    }
+    end = std::chrono::high_resolution_clock::now();
+    double run_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (double)NUM_RUN_ALLOCS;
+    printf("Bitmap::allocate_many(2) + free_many, 99.99%% full: %.1f ns per pair\n", run_ns);
+    (void)sink;
+}
 
-                allocated_pages.push_back(slot);
-                local_alloc_count++;
-                global_allocated_count.fetch_add(1, std::memory_order_relaxed);
+// Fill the whole arena and empty it again, either page by page or in batches of batch_size. batch_size 0 means the
+// plain allocate/free calls. Returns ns per page for an allocate + free pair.
+template <typename ArenaT>
+double run_batch_phase(const BenchmarkConfig& config, size_t batch_size, int rounds) {
+    ArenaT arena(config.arena_capacity, config.slot_size);
+    std::vector<char*> pages(arena.bitmap->num_slots);
+    size_t total_pages = 0;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        size_t allocated = 0;
+        if (batch_size == 0) {
+            for (char* page = arena.allocate(config.slot_size); page != NULL; page = arena.allocate(config.slot_size)) {
+                pages[allocated++] = page;
+            }
+            for (size_t i = 0; i < allocated; ++i) {
+                arena.free(pages[i], config.slot_size);
+            }
+        } else {
+            for (size_t got = 1; got != 0; allocated += got) {
+                got = arena.allocate_batch(std::min(batch_size, pages.size() - allocated), pages.data() + allocated);
+            }
+            for (size_t i = 0; i < allocated; i += batch_size) {
+                arena.free_batch(pages.data() + i, std::min(batch_size, allocated - i));
             }
-        } else if (!allocated_pages.empty()) {
-            std::uniform_int_distribution<> page_dist(0, allocated_pages.size() - 1);
-            size_t idx = page_dist(gen);
-            arena->free(allocated_pages[idx], slot_size);
-            allocated_pages[idx] = allocated_pages.back();
-            allocated_pages.pop_back();
-            local_free_count++;
-            global_allocated_count.fetch_sub(1, std::memory_order_relaxed);
         }
+        total_pages += allocated;
     }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / static_cast<double>(total_pages);
+}
 
-    // Free any remaining pages (if configured)
-    if (g_free_remaining_pages) {
-        for (char* page : allocated_pages) {
-            arena->free(page, slot_size);
-            local_free_count++;
-        }
+// Bulk page operations (prefetcher / checkpointer style): per-page cost of allocate_batch + free_batch by batch size.
+void run_batch_benchmark(const BenchmarkConfig& config) {
+    const int NUM_ROUNDS = 20;
+    const size_t batch_sizes[] = {0, 1, 8, 64, 512};
+
+    printf("\n=== Batch Allocate/Free Benchmark (single thread, ns per page) ===\n");
+    printf("Rounds: %d, each fills and empties the whole arena\n\n", NUM_ROUNDS);
+    printf("%-12s %12s %12s %12s %12s %12s\n", "Batch", "Mutex", "Spin-Lock", "Lock-Free", "LF + Hint", "No Hint");
+    for (size_t batch_size : batch_sizes) {
+        char label[16];
+        snprintf(label, sizeof(label), batch_size == 0 ? "unbatched" : "%zu", batch_size);
+        printf("%-12s %12.1f %12.1f %12.1f %12.1f %12.1f\n", label,
+               run_batch_phase<Arena>(config, batch_size, NUM_ROUNDS),
+               run_batch_phase<ArenaSpinLock>(config, batch_size, NUM_ROUNDS),
+               run_batch_phase<ArenaLockFree>(config, batch_size, NUM_ROUNDS),
+               run_batch_phase<ArenaLockFreeHint>(config, batch_size, NUM_ROUNDS),
+               run_batch_phase<ArenaNoHint>(config, batch_size, NUM_ROUNDS));
     }
+}
 
-    stats->allocations = local_alloc_count;
-    stats->frees = local_free_count;
+// False sharing: the dense layout puts eight bitmap words on a line, padded puts one, interleaved keeps the dense
+// footprint but moves neighbouring words to different lines. Only shows up with enough threads on enough cores.
+void run_layout_benchmark(const HarnessConfig& harness) {
+    const uint32_t thread_counts[] = {8, 16, 32};
+    const char* const layouts[][2] = {{"lockfree-hint", DenseWords::NAME},
+                                      {"lockfree-hint-padded", PaddedWords::NAME},
+                                      {"lockfree-hint-interleaved", InterleavedWords::NAME}};
+
+    // Same workload as the allocator comparison, without writes, only bitmap traffic matters here.
+    HarnessConfig layout_config = harness;
+    layout_config.write_to_slots = false;
+    layout_config.reps = 50;
+    printf("\n=== Bitmap Word Layout Benchmark (Lock-Free with Hint, no writes) ===\n");
+    printf("Hardware threads: %u, Repetitions per layout: %d\n\n", std::thread::hardware_concurrency(),
+           layout_config.reps);
+    printf("%-8s %-12s %12s %10s %14s %14s\n", "Threads", "Layout", "Mean (ms)", "Stddev", "Ops/ms", "CAS Retries");
+
+    for (uint32_t num_threads : thread_counts) {
+        layout_config.num_threads = num_threads;
+        for (const auto& [driver_id, name] : layouts) {
+            const DriverEntry* entry = find_driver(driver_id);
+            BenchResult result = entry->run(entry->id, entry->name, layout_config);
+            printf("%-8u %-12s %12.3f %10.3f %14.1f %14llu\n", num_threads, name, result.ms.mean, result.ms.stddev,
+                   result.ops_per_ms, (unsigned long long)result.cas_retries);
+        }
+    }
 }
 
-// Worker function for Phase 4 (lock-free ArenaLockFreeHint)
-void worker_phase4(ArenaLockFreeHint* arena, size_t slot_size, ThreadStats* stats) {
-    std::vector<char*> allocated_pages;
-    allocated_pages.reserve(4000);
-
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> action_dist(0, 99);
-    std::uniform_int_distribution<size_t> write_size_dist(1024, 4096); // 1KB to 4KB
-
-    uint32_t local_alloc_count = 0;
-    uint32_t local_free_count = 0;
-    uint32_t total_operations = 0;
-    const uint32_t MAX_OPERATIONS = 10000;
-
-    while (total_operations < MAX_OPERATIONS) {
-        total_operations++;
-        int action = action_dist(gen);
-        bool should_allocate = allocated_pages.empty() || action < 60;
-
-        if (should_allocate) {
-            char* slot = arena->allocate(slot_size);
-            if (slot != NULL) {
-                // Write random bytes (1KB to 4KB) to the allocated slot
-                if (g_write_to_slots) {
-                    size_t bytes_to_write = write_size_dist(gen);
-                    for (size_t i = 0; i < bytes_to_write; ++i) {
-                        slot[i] = static_cast<char>(gen() & 0xFF);
-                    }
-                }
+// The bitmap lock policies against each other as the thread count goes past the core count. p95 is there because
+// the unfair locks can look fine on the mean while the odd repetition waits on a descheduled holder.
+void run_free_list_benchmark(const HarnessConfig& harness) {
+    const uint32_t thread_counts[] = {1, 4, 16, 64};
+    const char* const drivers[] = {"lockfree-hint", "tcache", "freelist"};
+
+    // With writes: the free list keeps its link in the freed slot, so without them it would be the only one paying for
+    // the page faults of a fresh arena and the comparison would be faults against CAS.
+    HarnessConfig free_list_config = harness;
+    free_list_config.write_to_slots = true;
+    free_list_config.reps = 50;
+    printf("\n=== Free List vs Bitmap (single slots, with writes) ===\n");
+    printf("Hardware threads: %u, Repetitions per arena: %d\n\n", std::thread::hardware_concurrency(),
+           free_list_config.reps);
+    printf("%-8s %-32s %12s %10s %12s %14s %14s\n", "Threads", "Arena", "Mean (ms)", "Stddev", "p95", "Ops/ms",
+           "CAS Retries");
+
+    for (uint32_t num_threads : thread_counts) {
+        free_list_config.num_threads = num_threads;
+        for (const char* driver_id : drivers) {
+            const DriverEntry* entry = find_driver(driver_id);
+            BenchResult result = entry->run(entry->id, entry->name, free_list_config);
+            printf("%-8u %-32s %12.3f %10.3f %12.3f %14.1f %14llu\n", num_threads, entry->name, result.ms.mean,
+                   result.ms.stddev, result.ms.p95, result.ops_per_ms, (unsigned long long)result.cas_retries);
+        }
+    }
+}
 
-                allocated_pages.push_back(slot);
-                local_alloc_count++;
-                global_allocated_count.fetch_add(1, std::memory_order_relaxed);
-            }
-        } else if (!allocated_pages.empty()) {
-            std::uniform_int_distribution<> page_dist(0, allocated_pages.size() - 1);
-            size_t idx = page_dist(gen);
-            arena->free(allocated_pages[idx], slot_size);
-            allocated_pages[idx] = allocated_pages.back();
-            allocated_pages.pop_back();
-            local_free_count++;
-            global_allocated_count.fetch_sub(1, std::memory_order_relaxed);
+void run_lock_benchmark(const HarnessConfig& harness) {
+    const uint32_t thread_counts[] = {4, 16, 64};
+    const char* const locks[][2] = {{"mutex-hint", "mutex"},   {"spin-hint", "test-and-set"}, {"ttas-hint", "ttas"},
+                                    {"ticket-hint", "ticket"}, {"mcs-hint", "mcs"},           {"futex-hint", "futex"},
+                                    {"striped-hint", "striped mutex"}};
+
+    HarnessConfig lock_config = harness;
+    lock_config.write_to_slots = false;
+    lock_config.reps = 20;
+    lock_config.warmup = 2;
+    printf("\n=== Lock Policy Benchmark (shared bitmap with hint, no writes) ===\n");
+    printf("Hardware threads: %u, Repetitions per lock: %d\n\n", std::thread::hardware_concurrency(), lock_config.reps);
+    printf("%-8s %-14s %12s %10s %12s %14s\n", "Threads", "Lock", "Mean (ms)", "Stddev", "p95 (ms)", "Ops/ms");
+
+    for (uint32_t num_threads : thread_counts) {
+        lock_config.num_threads = num_threads;
+        for (const auto& [driver_id, name] : locks) {
+            const DriverEntry* entry = find_driver(driver_id);
+            BenchResult result = entry->run(entry->id, entry->name, lock_config);
+            printf("%-8u %-14s %12.3f %10.3f %12.3f %14.1f\n", num_threads, name, result.ms.mean, result.ms.stddev,
+                   result.ms.p95, result.ops_per_ms);
         }
     }
+}
 
-    // Free any remaining pages (if configured)
-    if (g_free_remaining_pages) {
-        for (char* page : allocated_pages) {
-            arena->free(page, slot_size);
-            local_free_count++;
+// TLB-sensitive access: fill the arena, then hit one cache line in randomly chosen slots, the same slots the workers
+// above write to. With 4 KB pages nearly every access needs a page walk once the pool is bigger than the dTLB, huge
+// pages cover it with a handful of entries.
+void run_tlb_benchmark(const BenchmarkConfig& config) {
+    const size_t NUM_ACCESSES = 20 * 1000 * 1000;
+    const PageBacking backings[] = {PageBacking::Default, PageBacking::TransparentHuge, PageBacking::Huge2MB,
+                                    PageBacking::Huge1GB};
+
+    printf("\n=== TLB-Sensitive Slot Access Benchmark ===\n");
+    printf("Arena: %zu MB, Slot size: %zu KB, Accesses: %zu\n\n", config.arena_capacity / (1024 * 1024),
+           config.slot_size / 1024, NUM_ACCESSES);
+
+    for (PageBacking requested : backings) {
+        ArenaOptions options;
+        options.pages = requested;
+        ArenaLockFreeHint arena(config.arena_capacity, config.slot_size, options);
+
+        std::vector<char*> slots;
+        slots.reserve(arena.bitmap->num_slots);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (char* slot = arena.allocate(config.slot_size); slot != NULL; slot = arena.allocate(config.slot_size)) {
+            slot[0] = 1; // fault it in
+            slots.push_back(slot);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        double fill_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+
+        // Precomputed targets so the RNG isn't part of what we measure, and the offset within the slot moves around
+        // so the accesses don't all share a cache set.
+        std::mt19937_64 gen(42);
+        std::vector<uint32_t> targets(1 << 20);
+        for (uint32_t& target : targets) {
+            target = static_cast<uint32_t>(gen() % slots.size());
+        }
+        uint64_t sum = 0;
+        start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < NUM_ACCESSES; ++i) {
+            char* slot = slots[targets[i & (targets.size() - 1)]];
+            uint64_t* line = reinterpret_cast<uint64_t*>(slot + ((i * 64) & (config.slot_size - 1)));
+            sum += ++*line;
         }
+        end = std::chrono::high_resolution_clock::now();
+        double access_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() /
+                           static_cast<double>(NUM_ACCESSES);
+
+        printf("Requested %-24s got %-24s fill + touch: %8.2f ms, random slot access: %6.2f ns (sum %llu)\n",
+               page_backing_name(requested), page_backing_name(arena.region.pages), fill_ms, access_ns,
+               (unsigned long long)(sum & 0xFF));
     }
+}
 
-    stats->allocations = local_alloc_count;
-    stats->frees = local_free_count;
+// Resident set size of the whole process in MB, from /proc/self/statm (pages).
+static double resident_mb() {
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0, resident_pages = 0;
+    statm >> total_pages >> resident_pages;
+    return resident_pages * (double)sysconf(_SC_PAGESIZE) / (1024 * 1024);
 }
 
-// Worker function for ArenaSpinLock
-void worker_arena_spinlock(ArenaSpinLock* arena, size_t slot_size, ThreadStats* stats) {
-    std::vector<char*> allocated_pages;
-    allocated_pages.reserve(4000);
-
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> action_dist(0, 99);
-    std::uniform_int_distribution<size_t> write_size_dist(1024, 4096); // 1KB to 4KB
-
-    uint32_t local_alloc_count = 0;
-    uint32_t local_free_count = 0;
-    uint32_t total_operations = 0;
-    const uint32_t MAX_OPERATIONS = 10000;
-
-    while (total_operations < MAX_OPERATIONS) {
-        total_operations++;
-        int action = action_dist(gen);
-        bool should_allocate = allocated_pages.empty() || action < 60;
-
-        if (should_allocate) {
-            char* slot = arena->allocate(slot_size);
-            if (slot != NULL) {
-                // Write random bytes (1KB to 4KB) to the allocated slot
-                if (g_write_to_slots) {
-                    size_t bytes_to_write = write_size_dist(gen);
-                    for (size_t i = 0; i < bytes_to_write; ++i) {
-                        slot[i] = static_cast<char>(gen() & 0xFF);
-                    }
-                }
+// Fill with writes, free everything, reclaim, refill. The refill after reclaiming pays one fault per page again, the
+// first refill (slots still resident) doesn't.
+void run_reclaim_benchmark(const BenchmarkConfig& config) {
+    const PageReclaim advices[] = {PageReclaim::DontNeed, PageReclaim::Free};
+
+    printf("\n=== Idle Page Reclamation Benchmark (Lock-Free with Hint, single thread) ===\n");
+    printf("Arena: %zu MB, Slot size: %zu KB\n\n", config.arena_capacity / (1024 * 1024), config.slot_size / 1024);
+    printf("%-10s %12s %12s %14s %14s %14s %16s\n", "Advice", "RSS full", "RSS freed", "RSS reclaimed",
+           "Reclaim (ms)", "Refill (ms)", "Refill cold (ms)");
+
+    for (PageReclaim advice : advices) {
+        ArenaOptions options;
+        options.reclaim = advice;
+        ArenaLockFreeHint arena(config.arena_capacity, config.slot_size, options);
+        std::vector<char*> slots;
+        slots.reserve(arena.bitmap->num_slots);
+
+        auto fill = [&]() {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (char* slot = arena.allocate(config.slot_size); slot != NULL; slot = arena.allocate(config.slot_size)) {
+                slot[0] = 1;
+                slots.push_back(slot);
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+        };
+        auto empty = [&]() {
+            for (char* slot : slots) {
+                arena.free(slot, config.slot_size);
+            }
+            slots.clear();
+        };
 
-                allocated_pages.push_back(slot);
-                local_alloc_count++;
-                global_allocated_count.fetch_add(1, std::memory_order_relaxed);
+        fill();
+        double rss_full = resident_mb();
+        empty();
+        double rss_freed = resident_mb();
+        double warm_ms = fill();
+        empty();
+
+        // One epoch later everything freed above counts as idle, same as the background reclaimer finding it.
+        auto start = std::chrono::high_resolution_clock::now();
+        arena.reclaim->tick();
+        arena.reclaim_idle(1);
+        auto end = std::chrono::high_resolution_clock::now();
+        double reclaim_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+        double rss_reclaimed = resident_mb();
+        double cold_ms = fill();
+        empty();
+
+        printf("%-10s %9.1f MB %9.1f MB %11.1f MB %14.3f %14.3f %16.3f\n",
+               advice == PageReclaim::Free ? "MADV_FREE" : "DONTNEED", rss_full, rss_freed, rss_reclaimed,
+               reclaim_ms, warm_ms, cold_ms);
+    }
+    printf("\nMADV_FREE pages only leave RSS under memory pressure, so its RSS drop may not show here.\n");
+}
+
+// First-touch latency: every slot is written right after allocate, like the harness workers with writes on.
+// Without prefaulting each of those writes takes a minor fault.
+void run_prefault_benchmark(const BenchmarkConfig& config) {
+    const Prefault modes[] = {Prefault::None, Prefault::Populate, Prefault::Touch};
+
+    printf("\n=== Prefault Benchmark (Lock-Free with Hint, single thread, allocate + first write) ===\n");
+    printf("Arena: %zu MB, Slot size: %zu KB, Hardware threads: %u\n\n", config.arena_capacity / (1024 * 1024),
+           config.slot_size / 1024, std::thread::hardware_concurrency());
+    printf("%-10s %-10s %14s %12s %12s %12s %12s\n", "Requested", "Got", "Warm-up (ms)", "Fill (ms)", "p50 (ns)",
+           "p99 (ns)", "Max (ns)");
+
+    for (Prefault requested : modes) {
+        ArenaOptions options;
+        options.prefault = requested;
+        ArenaLockFreeHint arena(config.arena_capacity, config.slot_size, options);
+
+        std::vector<uint64_t> latencies;
+        latencies.reserve(arena.bitmap->num_slots);
+        auto fill_start = std::chrono::high_resolution_clock::now();
+        for (;;) {
+            auto start = std::chrono::high_resolution_clock::now();
+            char* slot = arena.allocate(config.slot_size);
+            if (slot == NULL) {
+                break;
             }
-        } else if (!allocated_pages.empty()) {
-            std::uniform_int_distribution<> page_dist(0, allocated_pages.size() - 1);
-            size_t idx = page_dist(gen);
-            arena->free(allocated_pages[idx], slot_size);
-            allocated_pages[idx] = allocated_pages.back();
-            allocated_pages.pop_back();
-            local_free_count++;
-            global_allocated_count.fetch_sub(1, std::memory_order_relaxed);
+            slot[0] = 1;
+            auto end = std::chrono::high_resolution_clock::now();
+            latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
         }
+        auto fill_end = std::chrono::high_resolution_clock::now();
+        double fill_ms = std::chrono::duration_cast<std::chrono::microseconds>(fill_end - fill_start).count() / 1000.0;
+
+        std::sort(latencies.begin(), latencies.end());
+        printf("%-10s %-10s %14.3f %12.3f %12llu %12llu %12llu\n", prefault_name(requested),
+               prefault_name(arena.region.prefault), arena.region.prefault_ms, fill_ms,
+               (unsigned long long)latencies[latencies.size() / 2],
+               (unsigned long long)latencies[latencies.size() * 99 / 100], (unsigned long long)latencies.back());
     }
+}
 
-    // Free any remaining pages (if configured)
-    if (g_free_remaining_pages) {
-        for (char* page : allocated_pages) {
-            arena->free(page, slot_size);
-            local_free_count++;
+void run_persistent_benchmark(const BenchmarkConfig& config) {
+    printf("\n=== Persistent Arena Restart Benchmark (memfd backed, Lock-Free with Hint) ===\n");
+    printf("Arena: %zu MB, Slot size: %zu KB\n\n", config.arena_capacity / (1024 * 1024), config.slot_size / 1024);
+
+    int fd = memfd_create("arena_benchmark", MFD_CLOEXEC);
+    if (fd < 0) {
+        printf("memfd_create failed, skipping\n");
+        return;
+    }
+    auto elapsed_ms = [](auto start) {
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+    };
+
+    double shutdown_ms;
+    {
+        PersistentArena<> arena(fd, config.arena_capacity, config.slot_size);
+        while (char* slot = arena.allocate(config.slot_size)) {
+            std::memset(slot, 1, config.slot_size);
         }
+        auto start = std::chrono::high_resolution_clock::now();
+        arena.shutdown();
+        shutdown_ms = elapsed_ms(start);
     }
 
-    stats->allocations = local_alloc_count;
-    stats->frees = local_free_count;
+    double restored_ms;
+    int64_t restored_slots;
+    {
+        PersistentArena<> arena(fd, config.arena_capacity, config.slot_size);
+        restored_ms = arena.open_ms;
+        restored_slots = arena.arena->slots_in_use.load();
+        arena.shut_down = true; // leave the file marked unclean, like a crash would
+    }
+
+    double rebuilt_ms;
+    int64_t rebuilt_slots;
+    {
+        PersistentArena<> arena(fd, config.arena_capacity, config.slot_size,
+                                [](size_t, const char* data) { return data[0] != 0; });
+        rebuilt_ms = arena.open_ms;
+        rebuilt_slots = arena.arena->slots_in_use.load();
+    }
+    close(fd);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    int64_t rewarmed_slots = 0;
+    {
+        ArenaLockFreeHint arena(config.arena_capacity, config.slot_size);
+        while (char* slot = arena.allocate(config.slot_size)) {
+            std::memset(slot, 1, config.slot_size);
+            rewarmed_slots++;
+        }
+    }
+    double rewarm_ms = elapsed_ms(start);
+
+    printf("%-36s %12s %12s\n", "Step", "Time (ms)", "Slots used");
+    printf("%-36s %12.3f %12s\n", "Clean shutdown (save + msync)", shutdown_ms, "-");
+    printf("%-36s %12.3f %12lld\n", "Reopen after clean shutdown", restored_ms, (long long)restored_slots);
+    printf("%-36s %12.3f %12lld\n", "Reopen after crash, rebuild callback", rebuilt_ms, (long long)rebuilt_slots);
+    printf("%-36s %12.3f %12lld\n", "Fresh anonymous arena, rewrite all", rewarm_ms, (long long)rewarmed_slots);
 }
 
-// Worker function for ArenaNoHintSpinLock
-void worker_arena_nohint_spinlock(ArenaNoHintSpinLock* arena, size_t slot_size, ThreadStats* stats) {
-    std::vector<char*> allocated_pages;
-    allocated_pages.reserve(4000);
-
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> action_dist(0, 99);
-    std::uniform_int_distribution<size_t> write_size_dist(1024, 4096); // 1KB to 4KB
-
-    uint32_t local_alloc_count = 0;
-    uint32_t local_free_count = 0;
-    uint32_t total_operations = 0;
-    const uint32_t MAX_OPERATIONS = 10000;
-
-    while (total_operations < MAX_OPERATIONS) {
-        total_operations++;
-        int action = action_dist(gen);
-        bool should_allocate = allocated_pages.empty() || action < 60;
-
-        if (should_allocate) {
-            char* slot = arena->allocate(slot_size);
-            if (slot != NULL) {
-                // Write random bytes (1KB to 4KB) to the allocated slot
-                if (g_write_to_slots) {
-                    size_t bytes_to_write = write_size_dist(gen);
-                    for (size_t i = 0; i < bytes_to_write; ++i) {
-                        slot[i] = static_cast<char>(gen() & 0xFF);
-                    }
-                }
+void run_placement_benchmark(const BenchmarkConfig& config) {
+    const Placement policies[] = {Placement::Default, Placement::AddressOrdered, Placement::FullestWord,
+                                  Placement::BestFit};
+    const char* names[] = {"default", "address-ordered", "fullest-word", "best-fit"};
+    const size_t NUM_OPS = 2000000;
+
+    printf("\n=== Placement Benchmark (Lock-Free with Hint, single thread, random churn around half full) ===\n");
+    printf("Arena: %zu MB, Slot size: %zu KB, Ops: %zu\n\n", config.arena_capacity / (1024 * 1024),
+           config.slot_size / 1024, NUM_OPS);
+    printf("%-16s %10s %10s %10s %14s %11s %10s\n", "Policy", "ns / op", "Partial", "Free runs", "Largest run",
+           "Dispersion", "Ext frag");
+
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); ++p) {
+        ArenaOptions options;
+        options.placement = policies[p];
+        ArenaLockFreeHint arena(config.arena_capacity, config.slot_size, options);
+        size_t num_slots = arena.bitmap->num_slots;
+        std::vector<char*> live;
+        live.reserve(num_slots);
+        std::mt19937_64 rng(42);
 
-                allocated_pages.push_back(slot);
-                local_alloc_count++;
-                global_allocated_count.fetch_add(1, std::memory_order_relaxed);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t op = 0; op < NUM_OPS; ++op) {
+            bool grow = live.size() < num_slots / 4 || (live.size() < num_slots * 3 / 4 && (rng() & 1));
+            if (grow) {
+                char* slot = arena.allocate(config.slot_size);
+                if (slot != NULL) {
+                    live.push_back(slot);
+                }
+            } else {
+                size_t victim = rng() % live.size();
+                arena.free(live[victim], config.slot_size);
+                live[victim] = live.back();
+                live.pop_back();
             }
-        } else if (!allocated_pages.empty()) {
-            std::uniform_int_distribution<> page_dist(0, allocated_pages.size() - 1);
-            size_t idx = page_dist(gen);
-            arena->free(allocated_pages[idx], slot_size);
-            allocated_pages[idx] = allocated_pages.back();
-            allocated_pages.pop_back();
-            local_free_count++;
-            global_allocated_count.fetch_sub(1, std::memory_order_relaxed);
         }
-    }
+        auto end = std::chrono::high_resolution_clock::now();
+        double ns_per_op = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (double)NUM_OPS;
 
-    // Free any remaining pages (if configured)
-    if (g_free_remaining_pages) {
-        for (char* page : allocated_pages) {
-            arena->free(page, slot_size);
-            local_free_count++;
+        FragmentationStats stats = arena.fragmentation_stats();
+        printf("%-16s %10.1f %10zu %10zu %14zu %11.2f %10.3f\n", names[p], ns_per_op, stats.partial_words,
+               stats.free_runs, stats.largest_free_run, stats.dispersion, stats.external_fragmentation);
+        for (char* slot : live) {
+            arena.free(slot, config.slot_size);
         }
     }
+}
 
-    stats->allocations = local_alloc_count;
-    stats->frees = local_free_count;
+/// One fake query: a hash index and a key vector built up, probed and dropped, on whatever `resource` is.
+static uint64_t run_query(std::pmr::memory_resource* resource, uint64_t seed, size_t rows) {
+    std::pmr::unordered_map<uint64_t, uint64_t> index(resource);
+    std::pmr::vector<uint64_t> keys(resource);
+    std::mt19937_64 rng(seed);
+    for (size_t i = 0; i < rows; ++i) {
+        uint64_t key = rng();
+        index[key] = i;
+        keys.push_back(key);
+    }
+    uint64_t sum = 0;
+    for (uint64_t key : keys) {
+        sum += index[key];
+    }
+    return sum;
 }
 
-void run_benchmark(const BenchmarkConfig& config) {
-    const int NUM_ITERATIONS = 1000;
+void run_resource_benchmark(const BenchmarkConfig& config) {
+    const size_t NUM_QUERIES = 2000;
+    const size_t ROWS = 1000;
 
-    printf("\n=== Arena Allocator Benchmark ===\n");
-    printf("Write to Slots: %s\n", g_write_to_slots ? "Yes" : "No");
-    printf("Arena Capacity: %zu MB\n", config.arena_capacity / (1024 * 1024));
-    printf("Slot Size: %zu KB\n", config.slot_size / 1024);
-
-    // Calculate total slots
-    uint32_t total_slots = (config.arena_capacity + config.slot_size - 1) / config.slot_size;
-    total_slots = (total_slots < 64) ? 64 : total_slots;
-    if (total_slots % 64 != 0) {
-        total_slots = ((total_slots / 64) + 1) * 64;
-    }
-    printf("Total Slots: %u\n", total_slots);
-    printf("Threads: %u\n", config.num_threads);
-    printf("Iterations per phase: %d\n\n", NUM_ITERATIONS);
-
-    // Phase 1: Mutex-Protected Arena with Hint
-    printf("Phase 1 (Mutex with Hint): Running...");
-    fflush(stdout);
-    double min1 = 1e9, max1 = 0, sum1 = 0;
-    uint64_t total_allocs1 = 0, total_frees1 = 0;
-    for (int iter = 0; iter < NUM_ITERATIONS; ++iter) {
-        global_allocated_count.store(0, std::memory_order_relaxed);
-        Arena arena1(config.arena_capacity, config.slot_size);
-        std::vector<std::thread> threads1;
-        std::vector<ThreadStats> thread_stats1(config.num_threads, {0, 0});
+    printf("\n=== Per-Query Containers (unordered_map + vector of %zu rows, single thread) ===\n", ROWS);
+    printf("Arena: %zu MB, Slot size: %zu KB, Queries: %zu\n\n", config.arena_capacity / (1024 * 1024),
+           config.slot_size / 1024, NUM_QUERIES);
+    printf("%-28s %12s %14s %12s\n", "Resource", "us / query", "Arena chunks", "Reserved KB");
 
+    auto time_queries = [&](const char* name, std::pmr::memory_resource* resource, auto&& end_of_query, size_t chunks,
+                            size_t reserved) {
+        uint64_t checksum = 0;
         auto start = std::chrono::high_resolution_clock::now();
-        for (uint32_t i = 0; i < config.num_threads; ++i) {
-            threads1.emplace_back(worker_phase1, &arena1, config.slot_size, &thread_stats1[i]);
-        }
-        for (auto& t : threads1) {
-            t.join();
+        for (size_t q = 0; q < NUM_QUERIES; ++q) {
+            checksum += run_query(resource, q, ROWS);
+            end_of_query();
         }
         auto end = std::chrono::high_resolution_clock::now();
+        double us = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / 1000.0 / NUM_QUERIES;
+        printf("%-28s %12.2f %14zu %12zu   (checksum %llu)\n", name, us, chunks, reserved / 1024,
+               (unsigned long long)checksum);
+    };
+
+    time_queries("new/delete", std::pmr::new_delete_resource(), [] {}, 0, 0);
+
+    ArenaLockFreeHint arena(config.arena_capacity, config.slot_size);
+    ArenaBumpResource<ArenaLockFreeHint> query_memory(&arena);
+    // Warm once so the chunk count below is what a query needs, the timed loop never goes back to the arena.
+    run_query(&query_memory, 0, ROWS);
+    query_memory.reset();
+    time_queries("arena bump + reset", &query_memory, [&] { query_memory.reset(); }, query_memory.chunks,
+                 query_memory.bytes_reserved());
+    query_memory.release();
+    time_queries("arena bump + release", &query_memory, [&] { query_memory.release(); }, 0, 0);
+}
 
-        double time_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
-        sum1 += time_ms;
-        if (time_ms < min1)
-            min1 = time_ms;
-        if (time_ms > max1)
-            max1 = time_ms;
-
-        for (const auto& stats : thread_stats1) {
-            total_allocs1 += stats.allocations;
-            total_frees1 += stats.frees;
-        }
-    }
-    double avg1 = sum1 / NUM_ITERATIONS;
-    uint64_t avg_allocs1 = total_allocs1 / NUM_ITERATIONS;
-    uint64_t avg_frees1 = total_frees1 / NUM_ITERATIONS;
-    printf(" Done\n");
-    printf("  Avg: %.3f ms, Min: %.3f ms, Max: %.3f ms, Allocs: %llu, Frees: %llu\n\n", avg1, min1, max1,
-           (unsigned long long)avg_allocs1, (unsigned long long)avg_frees1);
-
-    // Phase 1b: Spin-Lock with Hint
-    printf("Phase 1b (Spin-Lock with Hint): Running...");
-    fflush(stdout);
-    double min1b = 1e9, max1b = 0, sum1b = 0;
-    uint64_t total_allocs1b = 0, total_frees1b = 0;
-    for (int iter = 0; iter < NUM_ITERATIONS; ++iter) {
-        global_allocated_count.store(0, std::memory_order_relaxed);
-        ArenaSpinLock arena1s(config.arena_capacity, config.slot_size);
-        std::vector<std::thread> threads1s;
-        std::vector<ThreadStats> thread_stats1s(config.num_threads, {0, 0});
-
-        auto start = std::chrono::high_resolution_clock::now();
-        for (uint32_t i = 0; i < config.num_threads; ++i) {
-            threads1s.emplace_back(worker_arena_spinlock, &arena1s, config.slot_size, &thread_stats1s[i]);
+void run_checkpoint_benchmark(const BenchmarkConfig& config) {
+    const double fills[] = {0.01, 0.10, 0.50, 0.90};
+    const int REPS = 20;
+
+    printf("\n=== Checkpoint Scan (Lock-Free with Hint, reads the first line of every live slot, %d reps) ===\n", REPS);
+    printf("Arena: %zu MB, Slot size: %zu KB, Hardware threads: %u\n\n", config.arena_capacity / (1024 * 1024),
+           config.slot_size / 1024, std::thread::hardware_concurrency());
+    printf("%-8s %10s %14s %16s %16s %16s\n", "Live", "Slots", "Snapshot (us)", "Every slot (us)", "Live only (us)",
+           "Parallel (us)");
+
+    for (double fill : fills) {
+        ArenaLockFreeHint arena(config.arena_capacity, config.slot_size);
+        size_t num_slots = arena.bitmap->num_slots;
+        std::vector<char*> slots;
+        char* slot;
+        while ((slot = arena.allocate(config.slot_size)) != NULL) {
+            slot[0] = 1; // resident, so the scans below measure reads and not page faults
+            slots.push_back(slot);
         }
-        for (auto& t : threads1s) {
-            t.join();
+        std::mt19937_64 rng(42);
+        std::shuffle(slots.begin(), slots.end(), rng);
+        size_t keep = static_cast<size_t>(num_slots * fill);
+        for (size_t i = keep; i < slots.size(); ++i) {
+            arena.free(slots[i], config.slot_size);
         }
-        auto end = std::chrono::high_resolution_clock::now();
-
-        double time_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
-        sum1b += time_ms;
-        if (time_ms < min1b)
-            min1b = time_ms;
-        if (time_ms > max1b)
-            max1b = time_ms;
-
-        for (const auto& stats : thread_stats1s) {
-            total_allocs1b += stats.allocations;
-            total_frees1b += stats.frees;
-        }
-    }
-    double avg1b = sum1b / NUM_ITERATIONS;
-    uint64_t avg_allocs1b = total_allocs1b / NUM_ITERATIONS;
-    uint64_t avg_frees1b = total_frees1b / NUM_ITERATIONS;
-    printf(" Done\n");
-    printf("  Avg: %.3f ms, Min: %.3f ms, Max: %.3f ms, Allocs: %llu, Frees: %llu\n\n", avg1b, min1b, max1b,
-           (unsigned long long)avg_allocs1b, (unsigned long long)avg_frees1b);
-
-    // Phase 2: Mutex without Hint
-    printf("Phase 2 (Mutex without Hint): Running...");
-    fflush(stdout);
-    double min2 = 1e9, max2 = 0, sum2 = 0;
-    uint64_t total_allocs2 = 0, total_frees2 = 0;
-    for (int iter = 0; iter < NUM_ITERATIONS; ++iter) {
-        global_allocated_count.store(0, std::memory_order_relaxed);
-        ArenaNoHint arena2(config.arena_capacity, config.slot_size);
-        std::vector<std::thread> threads2;
-        std::vector<ThreadStats> thread_stats2(config.num_threads, {0, 0});
 
-        auto start = std::chrono::high_resolution_clock::now();
-        for (uint32_t i = 0; i < config.num_threads; ++i) {
-            threads2.emplace_back(worker_phase2, &arena2, config.slot_size, &thread_stats2[i]);
+        auto time_us = [&](auto&& scan) {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int rep = 0; rep < REPS; ++rep) {
+                scan();
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / 1000.0 / REPS;
+        };
+        std::atomic<uint64_t> checksum{0};
+        double snapshot_us = time_us([&] { checksum += arena.snapshot_bitmap().live.size(); });
+        // What a checkpointer without the bitmap would do: look at every slot of the arena.
+        double every_slot_us = time_us([&] {
+            uint64_t sum = 0;
+            for (size_t slot_idx = 0; slot_idx < num_slots; ++slot_idx) {
+                sum += static_cast<uint8_t>(arena.base[slot_idx * config.slot_size]);
+            }
+            checksum += sum;
+        });
+        double live_us = time_us([&] {
+            uint64_t sum = 0;
+            arena.for_each_allocated([&](size_t, char* ptr) { sum += static_cast<uint8_t>(*ptr); });
+            checksum += sum;
+        });
+        double parallel_us = time_us([&] {
+            arena.for_each_allocated_parallel([&](size_t, char* ptr) {
+                checksum.fetch_add(static_cast<uint8_t>(*ptr), std::memory_order_relaxed);
+            });
+        });
+        char live_label[16];
+        snprintf(live_label, sizeof(live_label), "%.0f%%", fill * 100);
+        printf("%-8s %10zu %14.1f %16.1f %16.1f %16.1f   (checksum %llu)\n", live_label, keep, snapshot_us,
+               every_slot_us, live_us, parallel_us, (unsigned long long)checksum.load());
+        for (size_t i = 0; i < keep; ++i) {
+            arena.free(slots[i], config.slot_size);
         }
-        for (auto& t : threads2) {
-            t.join();
+    }
+}
+
+// Pointer and handle allocations racing on the same slots. A handle that doesn't resolve right after allocate_handle
+// is one the generation moved past, its slot can't be freed through it any more and stays in use for good.
+void run_handle_benchmark(const BenchmarkConfig& config) {
+    const uint32_t POINTER_THREADS = 2;
+    const uint32_t HANDLE_THREADS = 2;
+    const size_t OPS_PER_THREAD = 200000;
+    // Small, so the threads keep getting each other's slots.
+    const size_t CAPACITY = 256 * config.slot_size;
+
+    printf("\n=== Slot Handles Mixed With Pointers (Lock-Free with Hint, %u pointer + %u handle threads) ===\n",
+           POINTER_THREADS, HANDLE_THREADS);
+    printf("Arena: %zu KB, Slot size: %zu KB, Ops per thread: %zu\n\n", CAPACITY / 1024, config.slot_size / 1024,
+           OPS_PER_THREAD);
+
+    ArenaOptions options;
+    options.slot_handles = true;
+    ArenaLockFreeHint arena(CAPACITY, config.slot_size, options);
+    std::atomic<uint64_t> stale{0};
+    std::atomic<uint64_t> failed_frees{0};
+    std::vector<std::thread> threads;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t t = 0; t < POINTER_THREADS + HANDLE_THREADS; ++t) {
+        threads.emplace_back([&, t] {
+            for (size_t op = 0; op < OPS_PER_THREAD; ++op) {
+                if (t < POINTER_THREADS) {
+                    char* ptr = arena.allocate(config.slot_size);
+                    arena.free(ptr, config.slot_size);
+                    continue;
+                }
+                SlotHandle handle = arena.allocate_handle();
+                if (!handle.valid()) {
+                    continue;
+                }
+                if (arena.resolve(handle) == NULL) {
+                    stale.fetch_add(1, std::memory_order_relaxed);
+                }
+                if (arena.free_handle(handle) != 0) {
+                    failed_frees.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    double ns_per_op = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() /
+                       (double)(OPS_PER_THREAD * threads.size());
+
+    printf("%.1f ns per allocate + free, %llu stale fresh handles, %llu failed handle frees, %lld slots in use\n",
+           ns_per_op, (unsigned long long)stale.load(), (unsigned long long)failed_frees.load(),
+           (long long)arena.slots_in_use.load());
+    check(stale.load() == 0, "every fresh handle resolves");
+    check(failed_frees.load() == 0, "every fresh handle frees");
+    check(arena.slots_in_use.load() == 0, "slots_in_use back at 0");
+}
+
+// Every page gets its id written into its first and last 8 bytes, the read back checks both survived eviction.
+void run_buffer_pool_benchmark(const BenchmarkConfig& config) {
+    const size_t NUM_FRAMES = 1024;
+    const uint64_t NUM_PAGES = 4 * NUM_FRAMES;
+    const size_t page_size = config.slot_size;
+
+    printf("\n=== Buffer Pool Eviction and Write Back (in-memory page store, single thread) ===\n");
+    printf("Frames: %zu, Pages: %llu, Page size: %zu KB\n\n", NUM_FRAMES, (unsigned long long)NUM_PAGES,
+           page_size / 1024);
+
+    std::unordered_map<uint64_t, std::vector<char>> store;
+    PageIO io;
+    io.read_page = [&](uint64_t page_id, char* data) {
+        auto it = store.find(page_id);
+        if (it == store.end()) {
+            std::memset(data, 0, page_size);
+        } else {
+            std::memcpy(data, it->second.data(), page_size);
         }
+        return true;
+    };
+    io.write_page = [&](uint64_t page_id, const char* data) { store[page_id].assign(data, data + page_size); };
+    BufferPool pool(NUM_FRAMES, page_size, io);
+
+    auto elapsed_ns = [](auto start) {
         auto end = std::chrono::high_resolution_clock::now();
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    };
+    auto start = std::chrono::high_resolution_clock::now();
+    size_t failed_fetches = 0;
+    for (uint64_t page_id = 0; page_id < NUM_PAGES; ++page_id) {
+        char* data = pool.fetch_page(page_id);
+        if (data == NULL) {
+            failed_fetches++;
+            continue;
+        }
+        std::memcpy(data, &page_id, sizeof(page_id));
+        std::memcpy(data + page_size - sizeof(page_id), &page_id, sizeof(page_id));
+        pool.unpin_page(data, true);
+    }
+    double miss_ns = elapsed_ns(start) / NUM_PAGES;
+
+    size_t wrong_pages = 0;
+    for (uint64_t page_id = 0; page_id < NUM_PAGES; ++page_id) {
+        char* data = pool.fetch_page(page_id);
+        if (data == NULL) {
+            failed_fetches++;
+            continue;
+        }
+        uint64_t head;
+        uint64_t tail;
+        std::memcpy(&head, data, sizeof(head));
+        std::memcpy(&tail, data + page_size - sizeof(tail), sizeof(tail));
+        wrong_pages += head != page_id || tail != page_id;
+        pool.unpin_page(data, false);
+    }
 
-        double time_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
-        sum2 += time_ms;
-        if (time_ms < min2)
-            min2 = time_ms;
-        if (time_ms > max2)
-            max2 = time_ms;
-
-        for (const auto& stats : thread_stats2) {
-            total_allocs2 += stats.allocations;
-            total_frees2 += stats.frees;
-        }
-    }
-    double avg2 = sum2 / NUM_ITERATIONS;
-    uint64_t avg_allocs2 = total_allocs2 / NUM_ITERATIONS;
-    uint64_t avg_frees2 = total_frees2 / NUM_ITERATIONS;
-    printf(" Done\n");
-    printf("  Avg: %.3f ms, Min: %.3f ms, Max: %.3f ms, Allocs: %llu, Frees: %llu\n\n", avg2, min2, max2,
-           (unsigned long long)avg_allocs2, (unsigned long long)avg_frees2);
-
-    // Phase 2b: Spin-Lock without Hint
-    printf("Phase 2b (Spin-Lock without Hint): Running...");
-    fflush(stdout);
-    double min2b = 1e9, max2b = 0, sum2b = 0;
-    uint64_t total_allocs2b = 0, total_frees2b = 0;
-    for (int iter = 0; iter < NUM_ITERATIONS; ++iter) {
-        global_allocated_count.store(0, std::memory_order_relaxed);
-        ArenaNoHintSpinLock arena2s(config.arena_capacity, config.slot_size);
-        std::vector<std::thread> threads2s;
-        std::vector<ThreadStats> thread_stats2s(config.num_threads, {0, 0});
+    uint64_t hot_page = NUM_PAGES - 1; // loaded last, still resident
+    start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < NUM_PAGES; ++i) {
+        pool.unpin_page(pool.fetch_page(hot_page), false);
+    }
+    double hit_ns = elapsed_ns(start) / NUM_PAGES;
+
+    char* pinned = pool.fetch_page(hot_page);
+    int first_unpin = pool.unpin_page(pinned, false);
+    int second_unpin = pool.unpin_page(pinned, false);
+    char outside = 0;
+    int foreign_unpin = pool.unpin_page(&outside, false);
+
+    printf("%.1f ns per fetch on a miss (with eviction), %.1f ns per fetch on a hit\n", miss_ns, hit_ns);
+    printf("%zu resident, %llu evictions, %llu write backs, %zu pages in the store\n", pool.resident_pages(),
+           (unsigned long long)pool.evictions.load(), (unsigned long long)pool.writebacks.load(), store.size());
+    check(failed_fetches == 0, "every fetch found a frame");
+    check(wrong_pages == 0, "every page read back as written");
+    // Not == NUM_FRAMES, ARENA_DEBUG guard slots are frames that are never handed out.
+    check(pool.resident_pages() <= pool.num_frames, "no more pages resident than frames");
+    check(pool.evictions.load() >= NUM_PAGES - NUM_FRAMES, "a page evicted for every page past the frame count");
+    check(pool.writebacks.load() >= NUM_PAGES - NUM_FRAMES, "every evicted dirty page written back");
+    check(first_unpin == 0 && second_unpin == 1, "double unpin returns 1");
+    check(foreign_unpin == -1, "unpin of a pointer that isn't a frame returns -1");
+}
 
-        auto start = std::chrono::high_resolution_clock::now();
-        for (uint32_t i = 0; i < config.num_threads; ++i) {
-            threads2s.emplace_back(worker_arena_nohint_spinlock, &arena2s, config.slot_size, &thread_stats2s[i]);
+// Every page gets its id in its first and last 8 bytes through one pool, a second pool on the same file reads them
+// back, half by readahead and half by single fetches.
+void run_uring_benchmark(const BenchmarkConfig& config) {
+    printf("\n=== Buffer Pool on io_uring (page file in the temp dir, single thread) ===\n");
+#ifdef ARENA_URING
+    const size_t NUM_FRAMES = 1024;
+    const uint64_t NUM_PAGES = 4 * NUM_FRAMES;
+    const size_t page_size = config.slot_size;
+    printf("Frames: %zu, Pages: %llu, Page size: %zu KB\n\n", NUM_FRAMES, (unsigned long long)NUM_PAGES,
+           page_size / 1024);
+    if (!IoUring::available()) {
+        printf("io_uring isn't available here, skipping\n");
+        return;
+    }
+    char path[] = "/tmp/arena_uring_benchmark.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        printf("mkstemp failed, skipping\n");
+        return;
+    }
+    close(fd);
+    auto elapsed_ns = [](auto start) {
+        auto end = std::chrono::high_resolution_clock::now();
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    };
+
+    try {
+        UringPageStore store(path, page_size, false);
+        size_t failed_fetches = 0;
+        size_t wrong_pages = 0;
+        double write_ns;
+        double read_ns;
+        size_t registered;
+        {
+            BufferPool pool(NUM_FRAMES, page_size, store.page_io());
+            registered = store.register_region(pool.arena.region);
+            auto start = std::chrono::high_resolution_clock::now();
+            for (uint64_t page_id = 0; page_id < NUM_PAGES; ++page_id) {
+                char* data = pool.fetch_page(page_id);
+                if (data == NULL) {
+                    failed_fetches++;
+                    continue;
+                }
+                std::memcpy(data, &page_id, sizeof(page_id));
+                std::memcpy(data + page_size - sizeof(page_id), &page_id, sizeof(page_id));
+                pool.unpin_page(data, true);
+            }
+            pool.flush_all();
+            write_ns = elapsed_ns(start) / NUM_PAGES;
+            // Before the pool's region goes, the next pool may well be mapped at the same address.
+            store.unregister_region();
+        }
+        {
+            BufferPool pool(NUM_FRAMES, page_size, store.page_io());
+            store.register_region(pool.arena.region);
+            std::vector<uint64_t> ahead;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (uint64_t first = 0; first < NUM_PAGES; first += NUM_FRAMES / 2) {
+                // The first half of every window comes in by readahead, the second half one fetch at a time.
+                ahead.clear();
+                for (uint64_t page_id = first; page_id < first + NUM_FRAMES / 4; ++page_id) {
+                    ahead.push_back(page_id);
+                }
+                pool.prefetch_pages(ahead.data(), ahead.size());
+                for (uint64_t page_id = first; page_id < first + NUM_FRAMES / 2; ++page_id) {
+                    char* data = pool.fetch_page(page_id);
+                    if (data == NULL) {
+                        failed_fetches++;
+                        continue;
+                    }
+                    uint64_t head;
+                    uint64_t tail;
+                    std::memcpy(&head, data, sizeof(head));
+                    std::memcpy(&tail, data + page_size - sizeof(tail), sizeof(tail));
+                    wrong_pages += head != page_id || tail != page_id;
+                    pool.unpin_page(data, false);
+                }
+            }
+            read_ns = elapsed_ns(start) / NUM_PAGES;
+            store.unregister_region();
         }
-        for (auto& t : threads2s) {
-            t.join();
+        size_t rings_idle = 0;
+        for (const std::unique_ptr<IoUring>& ring : store.rings) {
+            rings_idle += ring->queued == 0 && ring->in_flight == 0;
         }
-        auto end = std::chrono::high_resolution_clock::now();
 
-        double time_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
-        sum2b += time_ms;
-        if (time_ms < min2b)
-            min2b = time_ms;
-        if (time_ms > max2b)
-            max2b = time_ms;
-
-        for (const auto& stats : thread_stats2s) {
-            total_allocs2b += stats.allocations;
-            total_frees2b += stats.frees;
-        }
-    }
-    double avg2b = sum2b / NUM_ITERATIONS;
-    uint64_t avg_allocs2b = total_allocs2b / NUM_ITERATIONS;
-    uint64_t avg_frees2b = total_frees2b / NUM_ITERATIONS;
-    printf(" Done\n");
-    printf("  Avg: %.3f ms, Min: %.3f ms, Max: %.3f ms, Allocs: %llu, Frees: %llu\n\n", avg2b, min2b, max2b,
-           (unsigned long long)avg_allocs2b, (unsigned long long)avg_frees2b);
-
-    // Phase 3: Lock-Free without Hint
-    printf("Phase 3 (Lock-Free without Hint): Running...");
-    fflush(stdout);
-    double min3 = 1e9, max3 = 0, sum3 = 0;
-    uint64_t total_cas_retries3 = 0;
-    uint64_t total_allocs3 = 0, total_frees3 = 0;
-    for (int iter = 0; iter < NUM_ITERATIONS; ++iter) {
-        global_allocated_count.store(0, std::memory_order_relaxed);
-        ArenaLockFree arena3(config.arena_capacity, config.slot_size);
-        std::vector<std::thread> threads3;
-        std::vector<ThreadStats> thread_stats3(config.num_threads, {0, 0});
+        printf("%.1f ns per page written (eviction + flush_all), %.1f ns per page read back, fixed buffers on %zu of "
+               "%zu rings\n",
+               write_ns, read_ns, registered, store.rings.size());
+        check(failed_fetches == 0, "every fetch found a frame");
+        check(wrong_pages == 0, "every page read back as written");
+        check(store.io_errors.load() == 0, "no I/O errors");
+        check(rings_idle == store.rings.size(), "nothing left queued or in flight");
+    } catch (const std::exception& e) {
+        printf("setting up the store failed (%s), skipping\n", e.what());
+    }
+    unlink(path);
+#else
+    (void)config;
+    printf("built without <linux/io_uring.h>, skipping\n");
+#endif
+}
 
+// With the watermark the arena grows while the last segment still has room, so after filling exactly eight segments
+// a ninth is committed already. Without it growth only happens when a segment is full.
+void run_growable_benchmark(const BenchmarkConfig& config) {
+    const size_t SEGMENT_BYTES = 4 * 1024 * 1024;
+    const size_t FILLED_SEGMENTS = 8;
+    const size_t MAX_BYTES = 64 * 1024 * 1024;
+    const double WATERMARK = 0.75;
+
+    printf("\n=== Growable Arena (Lock-Free with Hint segments, single thread) ===\n");
+    printf("Segment: %zu MB, Max: %zu MB, Filled: %zu segments, Slot size: %zu KB\n\n", SEGMENT_BYTES / (1024 * 1024),
+           MAX_BYTES / (1024 * 1024), FILLED_SEGMENTS, config.slot_size / 1024);
+    printf("%-16s %14s %10s %16s\n", "Growth", "ns / allocate", "Segments", "Committed (MB)");
+
+    for (double watermark : {0.0, WATERMARK}) {
+        GrowableArena<> arena(MAX_BYTES, SEGMENT_BYTES, config.slot_size, watermark);
+        size_t slots_per_segment = arena.segments[0]->bitmap->num_slots;
+        std::vector<char*> slots;
+        slots.reserve(FILLED_SEGMENTS * slots_per_segment);
         auto start = std::chrono::high_resolution_clock::now();
-        for (uint32_t i = 0; i < config.num_threads; ++i) {
-            threads3.emplace_back(worker_phase3, &arena3, config.slot_size, &thread_stats3[i]);
-        }
-        for (auto& t : threads3) {
-            t.join();
+        for (size_t i = 0; i < FILLED_SEGMENTS * slots_per_segment; ++i) {
+            char* slot = arena.allocate(config.slot_size);
+            if (slot == NULL) {
+                break;
+            }
+            slot[0] = 1;
+            slots.push_back(slot);
         }
         auto end = std::chrono::high_resolution_clock::now();
+        double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() /
+                    (double)std::max<size_t>(1, slots.size());
+        size_t segments = arena.num_segments.load();
+        size_t committed = arena.committed_bytes();
+        int64_t filled = arena.total_slots_in_use();
+        for (char* slot : slots) {
+            arena.free(slot, config.slot_size);
+        }
+        char outside = 0;
+        arena.free(&outside, config.slot_size);
+
+        printf("%-16s %14.1f %10zu %16zu\n", watermark == 0.0 ? "on demand" : "watermark 75%", ns, segments,
+               committed / (1024 * 1024));
+        size_t expected_segments = FILLED_SEGMENTS + (watermark == 0.0 ? 0 : 1);
+        check(slots.size() == FILLED_SEGMENTS * slots_per_segment && filled == (int64_t)slots.size(),
+              "every allocation succeeded and is counted");
+        check(segments == expected_segments, watermark == 0.0 ? "grew only when full" : "grew one segment ahead");
+        check(committed == segments * arena.segment_bytes, "committed_bytes matches the segments");
+        check(arena.total_slots_in_use() == 0, "every free went back to its segment");
+    }
+}
 
-        double time_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
-        sum3 += time_ms;
-        if (time_ms < min3)
-            min3 = time_ms;
-        if (time_ms > max3)
-            max3 = time_ms;
-        total_cas_retries3 += arena3.get_cas_retries();
-
-        for (const auto& stats : thread_stats3) {
-            total_allocs3 += stats.allocations;
-            total_frees3 += stats.frees;
-        }
-    }
-    double avg3 = sum3 / NUM_ITERATIONS;
-    uint64_t avg_cas_retries3 = total_cas_retries3 / NUM_ITERATIONS;
-    uint64_t avg_allocs3 = total_allocs3 / NUM_ITERATIONS;
-    uint64_t avg_frees3 = total_frees3 / NUM_ITERATIONS;
-    printf(" Done\n");
-    printf("  Avg: %.3f ms, Min: %.3f ms, Max: %.3f ms, Allocs: %llu, Frees: %llu, CAS Retries: %llu\n\n", avg3, min3,
-           max3, (unsigned long long)avg_allocs3, (unsigned long long)avg_frees3, (unsigned long long)avg_cas_retries3);
-
-    // Phase 4: Lock-Free with Hint
-    printf("Phase 4 (Lock-Free with Hint): Running...");
-    fflush(stdout);
-    double min4 = 1e9, max4 = 0, sum4 = 0;
-    uint64_t total_cas_retries4 = 0;
-    uint64_t total_allocs4 = 0, total_frees4 = 0;
-    for (int iter = 0; iter < NUM_ITERATIONS; ++iter) {
-        global_allocated_count.store(0, std::memory_order_relaxed);
-        ArenaLockFreeHint arena4(config.arena_capacity, config.slot_size);
-        std::vector<std::thread> threads4;
-        std::vector<ThreadStats> thread_stats4(config.num_threads, {0, 0});
-
-        auto start = std::chrono::high_resolution_clock::now();
-        for (uint32_t i = 0; i < config.num_threads; ++i) {
-            threads4.emplace_back(worker_phase4, &arena4, config.slot_size, &thread_stats4[i]);
+void run_size_class_benchmark() {
+    const std::vector<size_t> classes = {4096, 8192, 16384, 65536};
+    const size_t CAPACITY_PER_CLASS = 16 * 1024 * 1024;
+    const size_t SMALL_CAPACITY = 16 * 1024 * 1024;
+    const int ROUNDS = 100000;
+
+    printf("\n=== Size Classes (4/8/16/64 KB page classes + small object slabs, single thread) ===\n");
+    printf("Capacity per class: %zu MB, Slabs: %zu MB\n\n", CAPACITY_PER_CLASS / (1024 * 1024),
+           SMALL_CAPACITY / (1024 * 1024));
+
+    SizeClassArena<> arena(classes, CAPACITY_PER_CLASS, SMALL_CAPACITY);
+    const size_t slab_max = classes.front() / 2;
+    struct Boundary {
+        size_t request;
+        size_t expected; // usable size, 0 = has to fail
+    };
+    const Boundary boundaries[] = {
+        {1, SizeClassArena<>::MIN_OBJECT_SIZE}, {slab_max, slab_max}, {slab_max + 1, 4096}, {4096, 4096},
+        {4097, 8192}, {8192, 8192}, {16384, 16384}, {16385, 65536}, {65536, 65536}, {65537, 0},
+    };
+
+    printf("%-10s %10s %14s\n", "Request", "Usable", "ns / pair");
+    bool sizes_ok = true;
+    for (const Boundary& boundary : boundaries) {
+        char* ptr = arena.allocate(boundary.request);
+        size_t usable = ptr == NULL ? 0 : arena.size_of(ptr);
+        sizes_ok &= usable == boundary.expected;
+        arena.free(ptr);
+        double ns = 0;
+        if (ptr != NULL) {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int round = 0; round < ROUNDS; ++round) {
+                arena.free(arena.allocate(boundary.request));
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (double)ROUNDS;
         }
-        for (auto& t : threads4) {
-            t.join();
+        printf("%-10zu %10zu %14.1f\n", boundary.request, usable, ns);
+    }
+    check(sizes_ok, "every request got the class it should");
+
+    if constexpr (ArenaDebugType::enabled) {
+        printf("  invalid frees abort with ARENA_DEBUG, skipped\n");
+        return;
+    }
+    ArenaStatsSnapshot before = arena.slabs->stats_snapshot();
+    char* first = arena.allocate(64);
+    char* second = arena.allocate(64);
+    std::memset(first, 1, 64);
+    std::memset(second, 2, 64);
+    arena.free(first + 8);                                         // misaligned
+    arena.free(arena.slabs->base + (arena.slabs->capacity - 4096)); // a slab nobody has
+    arena.free(second);
+    arena.free(second); // double
+    char* third = arena.allocate(64);
+    std::memset(third, 3, 64);
+    bool intact = first[0] == 1 && first[63] == 1 && third != first;
+    ArenaStatsSnapshot after = arena.slabs->stats_snapshot();
+    arena.free(first);
+    arena.free(third);
+
+    check(intact, "bad frees left the live objects alone");
+    if constexpr (ArenaStatsType::enabled) {
+        check(after[ArenaCounter::InvalidFrees] - before[ArenaCounter::InvalidFrees] == 2, "2 invalid frees counted");
+        check(after[ArenaCounter::DoubleFrees] - before[ArenaCounter::DoubleFrees] == 1, "1 double free counted");
+    }
+    check(arena.slabs->slots_in_use.load() == 0, "every slab back in the slab arena");
+}
+
+static std::vector<std::string> split_list(const char* list) {
+    std::vector<std::string> items;
+    std::string item;
+    for (const char* c = list;; ++c) {
+        if (*c == ',' || *c == '\0') {
+            if (!item.empty()) {
+                items.push_back(item);
+            }
+            item.clear();
+            if (*c == '\0') {
+                break;
+            }
+        } else {
+            item += *c;
         }
-        auto end = std::chrono::high_resolution_clock::now();
+    }
+    return items;
+}
 
-        double time_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
-        sum4 += time_ms;
-        if (time_ms < min4)
-            min4 = time_ms;
-        if (time_ms > max4)
-            max4 = time_ms;
-        total_cas_retries4 += arena4.get_cas_retries();
-
-        for (const auto& stats : thread_stats4) {
-            total_allocs4 += stats.allocations;
-            total_frees4 += stats.frees;
-        }
-    }
-    double avg4 = sum4 / NUM_ITERATIONS;
-    uint64_t avg_cas_retries4 = total_cas_retries4 / NUM_ITERATIONS;
-    uint64_t avg_allocs4 = total_allocs4 / NUM_ITERATIONS;
-    uint64_t avg_frees4 = total_frees4 / NUM_ITERATIONS;
-    printf(" Done\n");
-    printf("  Avg: %.3f ms, Min: %.3f ms, Max: %.3f ms, Allocs: %llu, Frees: %llu, CAS Retries: %llu\n\n", avg4, min4,
-           max4, (unsigned long long)avg_allocs4, (unsigned long long)avg_frees4, (unsigned long long)avg_cas_retries4);
-
-    // Performance Summary Table
-    printf("=== Performance Summary Table (Average Times) ===\n");
-
-    // Find the best performer
-    double best_time = avg1;
-    if (avg1b < best_time)
-        best_time = avg1b;
-    if (avg2 < best_time)
-        best_time = avg2;
-    if (avg2b < best_time)
-        best_time = avg2b;
-    if (avg3 < best_time)
-        best_time = avg3;
-    if (avg4 < best_time)
-        best_time = avg4;
+static void print_usage(const char* argv0) {
+    printf("usage: %s [threads] [free_remaining]          the whole benchmark, runs 1 to 19\n", argv0);
+    printf("       %s --flag=value ...                    only the allocator harness\n\n", argv0);
+    printf("  --threads=N[,N...]     thread counts to sweep (default 4)\n");
+    printf("  --workload=W[,W...]    steady, fill-drain, producer-consumer, bursty or all (default steady)\n");
+    printf("  --drivers=D[,D...]     allocators to run or all (default all), --list shows them\n");
+    printf("  --reps=N --warmup=N    measured and discarded repetitions (default 20 and 2)\n");
+    printf("  --ops=N                operations per thread (default 10000)\n");
+    printf("  --alloc-percent=N      steady state allocate share (default 60)\n");
+    printf("  --writes               write into every allocated slot\n");
+    printf("  --free-at-end          free what's still live before the clock stops\n");
+    printf("  --pin                  pin worker i to the i-th allowed CPU\n");
+    printf("  --latency              time every allocate / free, percentiles overall and by arena fill level\n");
+    printf("  --seed=N               base seed of the per-thread generators (default 42)\n");
+    printf("  --format=F             table, csv or json (default table)\n");
+    printf("  --out=FILE             write the results there instead of stdout\n");
+}
 
-    printf("\n");
-    printf("┌────────┬─────────────────────────────────┬──────────────┬──────────────┬──────────────┬──────────────┬───"
-           "───────────┐\n");
-    printf("│ Phase  │ Implementation                  │ Avg (ms)     │ vs Best      │ Allocs       │ Frees        │ "
-           "CAS Retries  │\n");
-    printf("├────────┼─────────────────────────────────┼──────────────┼──────────────┼──────────────┼──────────────┼───"
-           "───────────┤\n");
-
-    printf("│   1    │ Mutex with Hint                 │ %9.3f    │     %7.2fx │ %12llu │ %12llu │            - │\n",
-           avg1, avg1 / best_time, (unsigned long long)avg_allocs1, (unsigned long long)avg_frees1);
-    printf("│   1b   │ Spin-Lock with Hint             │ %9.3f    │     %7.2fx │ %12llu │ %12llu │            - │\n",
-           avg1b, avg1b / best_time, (unsigned long long)avg_allocs1b, (unsigned long long)avg_frees1b);
-    printf("│   2    │ Mutex without Hint              │ %9.3f    │     %7.2fx │ %12llu │ %12llu │            - │\n",
-           avg2, avg2 / best_time, (unsigned long long)avg_allocs2, (unsigned long long)avg_frees2);
-    printf("│   2b   │ Spin-Lock without Hint          │ %9.3f    │     %7.2fx │ %12llu │ %12llu │            - │\n",
-           avg2b, avg2b / best_time, (unsigned long long)avg_allocs2b, (unsigned long long)avg_frees2b);
-    printf("│   3    │ Lock-Free without Hint          │ %9.3f    │     %7.2fx │ %12llu │ %12llu │ %12llu │\n", avg3,
-           avg3 / best_time, (unsigned long long)avg_allocs3, (unsigned long long)avg_frees3,
-           (unsigned long long)avg_cas_retries3);
-    printf("│   4    │ Lock-Free with Hint             │ %9.3f    │     %7.2fx │ %12llu │ %12llu │ %12llu │\n", avg4,
-           avg4 / best_time, (unsigned long long)avg_allocs4, (unsigned long long)avg_frees4,
-           (unsigned long long)avg_cas_retries4);
-
-    printf("└────────┴─────────────────────────────────┴──────────────┴──────────────┴──────────────┴──────────────┴───"
-           "───────────┘\n");
-
-    printf("\n=== Min/Max Times ===\n");
-    printf("Phase 1 (Mutex with Hint):         Min: %.3f ms, Max: %.3f ms\n", min1, max1);
-    printf("Phase 1b (Spin-Lock with Hint):    Min: %.3f ms, Max: %.3f ms\n", min1b, max1b);
-    printf("Phase 2 (Mutex without Hint):      Min: %.3f ms, Max: %.3f ms\n", min2, max2);
-    printf("Phase 2b (Spin-Lock without Hint): Min: %.3f ms, Max: %.3f ms\n", min2b, max2b);
-    printf("Phase 3 (Lock-Free without Hint):  Min: %.3f ms, Max: %.3f ms\n", min3, max3);
-    printf("Phase 4 (Lock-Free with Hint):     Min: %.3f ms, Max: %.3f ms\n", min4, max4);
-
-    printf("\n=== Direct Comparisons (Average Times) ===\n");
-    printf("Mutex vs Spin-Lock (with Hint):     %.2fx %s\n", avg1b / avg1,
-           avg1 < avg1b ? "faster with mutex" : "faster with spin-lock");
-    printf("Mutex vs Spin-Lock (without Hint):  %.2fx %s\n", avg2b / avg2,
-           avg2 < avg2b ? "faster with mutex" : "faster with spin-lock");
-    printf("Hint vs No-Hint (Mutex):             %.2fx %s\n", avg2 / avg1,
-           avg1 < avg2 ? "faster with hint" : "faster without hint");
-    printf("Hint vs No-Hint (Spin-Lock):         %.2fx %s\n", avg2b / avg1b,
-           avg1b < avg2b ? "faster with hint" : "faster without hint");
-    printf("Hint vs No-Hint (Lock-Free):         %.2fx %s (CAS: %llu vs %llu)\n", avg3 / avg4,
-           avg4 < avg3 ? "faster with hint" : "faster without hint", (unsigned long long)avg_cas_retries4,
-           (unsigned long long)avg_cas_retries3);
+// Flag mode: threads x workloads x drivers through the harness, nothing else, results in one format.
+static int run_harness(HarnessConfig harness, int argc, char* argv[]) {
+    std::vector<uint32_t> thread_counts = {harness.num_threads};
+    std::vector<Workload> workloads = {Workload::SteadyState};
+    std::vector<const DriverEntry*> drivers;
+    for (const DriverEntry& entry : all_drivers()) {
+        drivers.push_back(&entry);
+    }
+    std::string format = "table";
+    std::string out_path;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if (key == "--threads") {
+            thread_counts.clear();
+            for (const std::string& count : split_list(value.c_str())) {
+                thread_counts.push_back(static_cast<uint32_t>(std::max(1, atoi(count.c_str()))));
+            }
+        } else if (key == "--workload") {
+            workloads.clear();
+            for (const std::string& name : split_list(value.c_str())) {
+                Workload workload;
+                if (name == "all") {
+                    workloads = {Workload::SteadyState, Workload::FillDrain, Workload::ProducerConsumer,
+                                 Workload::Bursty};
+                } else if (parse_workload(name.c_str(), workload)) {
+                    workloads.push_back(workload);
+                } else {
+                    fprintf(stderr, "unknown workload: %s\n", name.c_str());
+                    return 1;
+                }
+            }
+        } else if (key == "--drivers") {
+            drivers.clear();
+            for (const std::string& id : split_list(value.c_str())) {
+                if (id == "all") {
+                    for (const DriverEntry& entry : all_drivers()) {
+                        drivers.push_back(&entry);
+                    }
+                } else if (const DriverEntry* entry = find_driver(id.c_str())) {
+                    drivers.push_back(entry);
+                } else {
+                    fprintf(stderr, "unknown driver: %s (see --list)\n", id.c_str());
+                    return 1;
+                }
+            }
+        } else if (key == "--reps") {
+            harness.reps = std::max(1, atoi(value.c_str()));
+        } else if (key == "--warmup") {
+            harness.warmup = std::max(0, atoi(value.c_str()));
+        } else if (key == "--ops") {
+            harness.ops_per_thread = static_cast<uint32_t>(std::max(1, atoi(value.c_str())));
+        } else if (key == "--alloc-percent") {
+            harness.alloc_percent = static_cast<uint32_t>(std::clamp(atoi(value.c_str()), 0, 100));
+        } else if (key == "--writes") {
+            harness.write_to_slots = true;
+        } else if (key == "--free-at-end") {
+            harness.free_at_end = true;
+        } else if (key == "--pin") {
+            harness.pin_threads = true;
+        } else if (key == "--latency") {
+            harness.record_latency = true;
+        } else if (key == "--seed") {
+            harness.seed = strtoull(value.c_str(), NULL, 10);
+        } else if (key == "--format" && (value == "table" || value == "csv" || value == "json")) {
+            format = value;
+        } else if (key == "--out") {
+            out_path = value;
+        } else if (key == "--list") {
+            for (const DriverEntry& entry : all_drivers()) {
+                printf("%-28s %s\n", entry.id, entry.name);
+            }
+            return 0;
+        } else {
+            print_usage(argv[0]);
+            return key == "--help" ? 0 : 1;
+        }
+    }
 
-    printf("\n");
+    FILE* out = stdout;
+    if (!out_path.empty() && (out = fopen(out_path.c_str(), "w")) == NULL) {
+        perror(out_path.c_str());
+        return 1;
+    }
+    std::vector<BenchResult> results;
+    for (uint32_t num_threads : thread_counts) {
+        for (Workload workload : workloads) {
+            for (const DriverEntry* entry : drivers) {
+                HarnessConfig run_config = harness;
+                run_config.num_threads = num_threads;
+                run_config.workload = workload;
+                fprintf(stderr, "%s / %s / %u threads...\n", entry->name, workload_name(workload), num_threads);
+                results.push_back(entry->run(entry->id, entry->name, run_config));
+                results.back().label = "harness";
+            }
+        }
+    }
+    if (format == "csv") {
+        write_results_csv(out, results);
+    } else if (format == "json") {
+        write_results_json(out, results);
+    } else {
+        write_results_table(out, results);
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
@@ -750,6 +1348,15 @@ int main(int argc, char* argv[]) {
     config.slot_size = 4 * 1024;               // 4 KB
     config.num_threads = 4;                    // Default to 4 threads
 
+    HarnessConfig harness;
+    harness.arena_capacity = config.arena_capacity;
+    harness.slot_size = config.slot_size;
+    harness.num_threads = config.num_threads;
+
+    if (argc > 1 && strncmp(argv[1], "--", 2) == 0) {
+        return run_harness(harness, argc, argv);
+    }
+
     // Allow user to specify number of threads via command line
     if (argc > 1) {
         config.num_threads = static_cast<uint32_t>(atoi(argv[1]));
@@ -757,30 +1364,137 @@ int main(int argc, char* argv[]) {
             printf("Invalid number of threads. Using default: 4\n");
             config.num_threads = 4;
         }
+        harness.num_threads = config.num_threads;
     }
 
     // Allow user to specify whether to free remaining pages
     if (argc > 2) {
-        g_free_remaining_pages = (atoi(argv[2]) != 0);
+        harness.free_at_end = (atoi(argv[2]) != 0);
     }
 
-    printf("Free Remaining Pages: %s\n", g_free_remaining_pages ? "Yes" : "No");
+    printf("Free Remaining Pages: %s\n", harness.free_at_end ? "Yes" : "No");
+
+    // The full comparison keeps the old iteration count, it's what the checked in results were taken with.
+    harness.reps = 1000;
+    harness.warmup = 10;
 
     // Run benchmark without writes
     printf("\n");
     printf("================================================================================\n");
     printf("                        BENCHMARK RUN 1: WITHOUT WRITES                        \n");
     printf("================================================================================\n");
-    g_write_to_slots = false;
-    run_benchmark(config);
+    harness.write_to_slots = false;
+    run_benchmark(harness);
 
     // Run benchmark with writes
     printf("\n");
     printf("================================================================================\n");
     printf("                         BENCHMARK RUN 2: WITH WRITES                          \n");
     printf("================================================================================\n");
-    g_write_to_slots = true;
-    run_benchmark(config);
+    harness.write_to_slots = true;
+    run_benchmark(harness);
 
-    return 0;
+    printf("\n");
+    printf("================================================================================\n");
+    printf("                      BENCHMARK RUN 3: NEAR-FULL BITMAP SCAN                    \n");
+    printf("================================================================================\n");
+    run_scan_benchmark();
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("                    BENCHMARK RUN 4: TLB-SENSITIVE SLOT ACCESS                  \n");
+    printf("================================================================================\n");
+    run_tlb_benchmark(config);
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("                     BENCHMARK RUN 5: BITMAP WORD LAYOUTS                       \n");
+    printf("================================================================================\n");
+    run_layout_benchmark(harness);
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("                    BENCHMARK RUN 6: BATCH ALLOCATE / FREE                      \n");
+    printf("================================================================================\n");
+    run_batch_benchmark(config);
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("                     BENCHMARK RUN 7: IDLE PAGE RECLAMATION                     \n");
+    printf("================================================================================\n");
+    run_reclaim_benchmark(config);
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("                   BENCHMARK RUN 8: PREFAULTED FIRST TOUCH                      \n");
+    printf("================================================================================\n");
+    run_prefault_benchmark(config);
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("                   BENCHMARK RUN 9: PERSISTENT ARENA RESTART                    \n");
+    printf("================================================================================\n");
+    run_persistent_benchmark(config);
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("                     BENCHMARK RUN 10: PLACEMENT POLICIES                       \n");
+    printf("================================================================================\n");
+    run_placement_benchmark(config);
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("                       BENCHMARK RUN 11: LOCK POLICIES                          \n");
+    printf("================================================================================\n");
+    run_lock_benchmark(harness);
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("                     BENCHMARK RUN 12: PER-QUERY CONTAINERS                     \n");
+    printf("================================================================================\n");
+    run_resource_benchmark(config);
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("                     BENCHMARK RUN 13: FREE LIST VS BITMAP                      \n");
+    printf("================================================================================\n");
+    run_free_list_benchmark(harness);
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("                       BENCHMARK RUN 14: CHECKPOINT SCAN                        \n");
+    printf("================================================================================\n");
+    run_checkpoint_benchmark(config);
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("                  BENCHMARK RUN 15: SLOT HANDLES WITH POINTERS                  \n");
+    printf("================================================================================\n");
+    run_handle_benchmark(config);
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("                     BENCHMARK RUN 16: BUFFER POOL EVICTION                     \n");
+    printf("================================================================================\n");
+    run_buffer_pool_benchmark(config);
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("                     BENCHMARK RUN 17: BUFFER POOL ON IO_URING                  \n");
+    printf("================================================================================\n");
+    run_uring_benchmark(config);
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("                       BENCHMARK RUN 18: GROWABLE ARENA                         \n");
+    printf("================================================================================\n");
+    run_growable_benchmark(config);
+
+    printf("\n");
+    printf("================================================================================\n");
+    printf("                         BENCHMARK RUN 19: SIZE CLASSES                         \n");
+    printf("================================================================================\n");
+    run_size_class_benchmark();
+
+    return failed_checks == 0 ? 0 : 1;
 }
@@ -8,6 +8,7 @@
 //
 // Oh and of course Bitmaps require bit manipulation and I suck at bit manipulation. :pulling_out_hair:
 
+#include <algorithm>
 #include <atomic>
 #include <bit>
 #include <cerrno>
@@ -16,9 +17,344 @@
 #include <cstdio>
 #include <cstdlib>
 #include <stdexcept>
+#include <tuple>
 #include <utility>
 #include <vector>
 
+#include "cas_contention.h"
+#include "placement.h"
+#include "simd_scan.h"
+#include "summary_bitmap.h"
+#include "word_layout.h"
+
+// Word level helpers for the contiguous run search, shared by every bitmap below. They only ever look at the bits of
+// plain uint64_t values so the lock-free bitmaps can feed them whatever they loaded atomically.
+
+/// Mask with `count` bits set starting at `first_bit`. count is in [1, 64] and first_bit + count <= 64.
+inline uint64_t bit_range_mask(uint32_t first_bit, uint32_t count) {
+    uint64_t ones = count >= 64 ? UINT64_MAX : ((1ULL << count) - 1);
+    return ones << first_bit;
+}
+
+/// Returns a mask with bit i set iff bits [i, i + run_length) of word are all set (free), run_length in [1, 64].
+/// Shift-AND cascade: after a step with length len, bit i says "len free bits start at i". Doubling len each step gets
+/// us to run_length in O(log run_length) operations instead of testing every bit. Zeros get shifted in from the top so
+/// runs never wrap past bit 63.
+inline uint64_t run_start_mask(uint64_t word, uint32_t run_length) {
+    uint32_t len = 1;
+    while (len * 2 <= run_length) {
+        word &= word >> len;
+        len *= 2;
+    }
+    if (len < run_length) {
+        word &= word >> (run_length - len);
+    }
+    return word;
+}
+
+/// Finds the first run of `run_length` free slots that starts in a word in [begin_word, end_word).
+/// Runs may cross word boundaries: the free bits at the top of a word (countl_one) are carried into the next word and
+/// joined with its free bits at the bottom (countr_one). Inside a single word run_start_mask does the work.
+/// load_word(word_idx) returns the current value of that word. next_not_full(word_idx, end) returns the first word in
+/// [word_idx, end) that isn't fully allocated (end if none), so stretches of full words that can't start a run are
+/// skipped in one go (SIMD scan for the plain bitmaps, summary lookup for the lock-free ones).
+/// Returns the starting slot index, -1 if there is none.
+template <typename LoadWord, typename NextNotFull>
+inline int64_t find_free_run(size_t begin_word, size_t end_word, size_t num_words, uint32_t run_length,
+                             LoadWord&& load_word, NextNotFull&& next_not_full) {
+    constexpr uint32_t WORD_LENGTH = 64;
+    size_t carry_start = 0; // first slot of the free run touching the top of the previous word
+    size_t carry_len = 0;   // 0 if the previous word's top bit was allocated
+
+    // A run that started at or after begin_word may run past end_word, allow the scan to continue until it's settled.
+    for (size_t word_idx = begin_word; word_idx < num_words; ++word_idx) {
+        if (carry_len == 0) {
+            if (word_idx >= end_word) {
+                break;
+            }
+            word_idx = next_not_full(word_idx, end_word);
+            if (word_idx >= end_word) {
+                break;
+            }
+        }
+        uint64_t word = load_word(word_idx);
+
+        if (carry_len > 0) {
+            uint32_t low = static_cast<uint32_t>(std::countr_one(word));
+            if (carry_len + low >= run_length) {
+                return static_cast<int64_t>(carry_start);
+            }
+            if (low == WORD_LENGTH) {
+                carry_len += WORD_LENGTH;
+                continue;
+            }
+            carry_len = 0;
+            if (word_idx >= end_word) {
+                break;
+            }
+        }
+
+        if (word == 0) {
+            continue;
+        }
+        if (run_length <= WORD_LENGTH) {
+            uint64_t starts = run_start_mask(word, run_length);
+            if (starts != 0) {
+                return static_cast<int64_t>((word_idx * WORD_LENGTH) + std::countr_zero(starts));
+            }
+        }
+        uint32_t high = static_cast<uint32_t>(std::countl_one(word));
+        if (high > 0) {
+            carry_start = (word_idx * WORD_LENGTH) + WORD_LENGTH - high;
+            carry_len = high;
+        }
+    }
+    return -1;
+}
+
+/// Calls fn(word_idx, mask) for every word covered by the slot range [first_slot, first_slot + count), in order.
+/// Stops early and returns false as soon as fn returns false.
+template <typename Fn>
+inline bool for_each_word_in_range(size_t first_slot, size_t count, Fn&& fn) {
+    constexpr uint32_t WORD_LENGTH = 64;
+    while (count > 0) {
+        size_t word_idx = first_slot / WORD_LENGTH;
+        uint32_t bit_idx = static_cast<uint32_t>(first_slot % WORD_LENGTH);
+        uint32_t bits = static_cast<uint32_t>(std::min<size_t>(count, WORD_LENGTH - bit_idx));
+        if (!fn(word_idx, bit_range_mask(bit_idx, bits))) {
+            return false;
+        }
+        first_slot += bits;
+        count -= bits;
+    }
+    return true;
+}
+
+/// Lock-free claim of the slot range [first_slot, first_slot + count) using claim-then-rollback.
+/// Words are claimed one at a time in address order with a CAS that only succeeds if every bit of the range in that
+/// word is still free. If some word no longer has all its bits free (another thread got there first) the words already
+/// claimed are released again and false is returned, the caller goes back to searching. Other threads only ever see
+/// the transient claim as "allocated", which is the conservative direction.
+/// The summary is kept in sync the same way as for single slots: words we fill up get cleared, words a rollback makes
+/// non-empty again get set.
+template <typename Words>
+inline bool try_claim_run_lock_free(Words& words, SummaryBitmapLockFree& summary, size_t first_slot, size_t count,
+                                    std::atomic<uint64_t>& cas_retries) {
+    size_t claimed_upto = first_slot; // slots in [first_slot, claimed_upto) are ours
+    bool claimed = for_each_word_in_range(first_slot, count, [&](size_t word_idx, uint64_t mask) {
+        uint64_t observed = words[word_idx].load(std::memory_order_acquire);
+        while ((observed & mask) == mask) {
+            if (words[word_idx].compare_exchange_weak(observed, observed & ~mask, std::memory_order_acq_rel,
+                                                      std::memory_order_acquire)) {
+                if ((observed & ~mask) == 0) {
+                    summary.clear_if_empty(word_idx, words[word_idx]);
+                }
+                claimed_upto += std::popcount(mask);
+                return true;
+            }
+            cas_retries.fetch_add(1, std::memory_order_relaxed);
+        }
+        return false;
+    });
+    if (!claimed && claimed_upto > first_slot) {
+        for_each_word_in_range(first_slot, claimed_upto - first_slot, [&](size_t word_idx, uint64_t mask) {
+            if (words[word_idx].fetch_or(mask, std::memory_order_release) == 0) {
+                summary.set(word_idx);
+            }
+            return true;
+        });
+    }
+    return claimed;
+}
+
+/// Picks up to `count` free bits of word to hand out, highest first like allocate_one. The whole word if it fits.
+inline uint64_t take_highest_bits(uint64_t word, uint32_t count) {
+    if (static_cast<uint32_t>(std::popcount(word)) <= count) {
+        return word;
+    }
+    uint64_t mask = 0;
+    for (; count > 0; --count) {
+        uint64_t bit = 1ULL << (63 - std::countl_zero(word));
+        mask |= bit;
+        word &= ~bit;
+    }
+    return mask;
+}
+
+/// Batch claim for the plain bitmaps, the caller holds whatever lock guards them.
+/// Drains the words the summary points at, starting at start_word and wrapping around once, until `count` slots are
+/// taken. emit(word_idx, mask) gets every word's worth of claimed slots. Returns the number of slots taken.
+template <typename Emit>
+inline uint32_t claim_batch_plain(uint64_t* words, SummaryBitmap& summary, size_t start_word, uint32_t count,
+                                  Emit&& emit) {
+    uint32_t taken = 0;
+    bool wrapped = start_word == 0;
+    size_t word_idx = summary.find_next(start_word);
+    while (taken < count) {
+        if (word_idx == SummaryBitmap::NOT_FOUND) {
+            if (wrapped) {
+                break;
+            }
+            // Every word from start_word on got drained, so whatever the summary still has is below start_word.
+            wrapped = true;
+            word_idx = summary.find_next(0);
+            continue;
+        }
+        uint64_t mask = take_highest_bits(words[word_idx], count - taken);
+        words[word_idx] &= ~mask;
+        if (words[word_idx] == 0) {
+            summary.clear(word_idx);
+        }
+        taken += static_cast<uint32_t>(std::popcount(mask));
+        emit(word_idx, mask);
+        word_idx = summary.find_next(word_idx + 1);
+    }
+    return taken;
+}
+
+/// Batch claim for the lock-free bitmaps, same contract as claim_batch_plain.
+/// One fetch_and per word instead of a CAS per slot: fetch_and can't fail, it returns the old value and the bits of our
+/// mask that were still set in it are ours, whatever another thread took in the meantime. When the batch needs all of
+/// a word that's a single fetch_and over the entire word. If a race left us short on a word that had more free bits,
+/// the same word is tried again.
+template <typename Words, typename Emit>
+inline uint32_t claim_batch_lock_free(Words& words, SummaryBitmapLockFree& summary, size_t start_word, uint32_t count,
+                                      Emit&& emit) {
+    uint32_t taken = 0;
+    bool wrapped = start_word == 0;
+    size_t word_idx = summary.find_next(start_word);
+    while (taken < count) {
+        if (word_idx == SummaryBitmapLockFree::NOT_FOUND || (wrapped && start_word != 0 && word_idx >= start_word)) {
+            if (wrapped) {
+                break;
+            }
+            wrapped = true;
+            word_idx = summary.find_next(0);
+            continue;
+        }
+        uint64_t observed = words[word_idx].load(std::memory_order_acquire);
+        if (observed == 0) {
+            summary.clear_if_empty(word_idx, words[word_idx]);
+            word_idx = summary.find_next(word_idx + 1);
+            continue;
+        }
+        uint64_t want = take_highest_bits(observed, count - taken);
+        uint64_t old = words[word_idx].fetch_and(~want, std::memory_order_acq_rel);
+        uint64_t got = old & want;
+        if ((old & ~want) == 0) {
+            summary.clear_if_empty(word_idx, words[word_idx]);
+        }
+        if (got != 0) {
+            taken += static_cast<uint32_t>(std::popcount(got));
+            emit(word_idx, got);
+        }
+        if ((old & ~want) == 0) {
+            word_idx = summary.find_next(word_idx + 1);
+        }
+    }
+    return taken;
+}
+
+/// Single-slot claim for the lock-free bitmaps, see cas_contention.h for how collisions are handled.
+/// Visits the words the summary points at from start_word to the end, then from 0 up to start_word, and clears one
+/// free bit with fetch_and: the highest one while there has been no collision in this call, a random one after. A
+/// collision restarts the search from a different word. Returns the slot index, -1 once a whole pass found nothing.
+template <typename Words>
+inline int claim_one_lock_free(Words& words, SummaryBitmapLockFree& summary, size_t num_words, size_t start_word,
+                               std::atomic<uint64_t>& cas_retries, CasRetryHistogram& retry_histogram) {
+    constexpr uint32_t WORD_SHIFT = 6;
+    uint32_t collisions = 0;
+    auto finish = [&](int slot_idx) {
+        if (collisions != 0) {
+            cas_retries.fetch_add(collisions, std::memory_order_relaxed);
+            retry_histogram.record(collisions);
+        }
+        return slot_idx;
+    };
+    for (;;) {
+        bool collided = false;
+        bool wrapped = start_word == 0;
+        size_t word_idx = summary.find_next(start_word);
+        while (!collided) {
+            if (word_idx == SummaryBitmapLockFree::NOT_FOUND ||
+                (wrapped && start_word != 0 && word_idx >= start_word)) {
+                if (wrapped) {
+                    return finish(-1);
+                }
+                wrapped = true;
+                word_idx = summary.find_next(0);
+                continue;
+            }
+            uint64_t observed = words[word_idx].load(std::memory_order_acquire);
+            if (observed != 0) {
+                uint32_t bit_idx = collisions == 0 ? static_cast<uint32_t>(63 - std::countl_zero(observed))
+                                                   : CasContention::random_set_bit(observed);
+                uint64_t mask = 1ULL << bit_idx;
+                uint64_t old = words[word_idx].fetch_and(~mask, std::memory_order_acq_rel);
+                if ((old & ~mask) == 0) {
+                    summary.clear_if_empty(word_idx, words[word_idx]);
+                }
+                if (old & mask) {
+                    return finish(static_cast<int>((word_idx << WORD_SHIFT) | bit_idx));
+                }
+                collided = true;
+                break;
+            }
+            // Full by now (or the summary bit was stale), let the summary know
+            summary.clear_if_empty(word_idx, words[word_idx]);
+            word_idx = summary.find_next(word_idx + 1);
+        }
+        collisions++;
+        CasContention::backoff(collisions);
+        start_word = CasContention::jump_target(collisions, num_words);
+    }
+}
+
+/// Single-slot claim for the plain bitmaps under a non-Default placement, see placement_pick. The caller holds the
+/// lock, so the pick is exact and -1 means the bitmap is full.
+inline int claim_placed_plain(uint64_t* words, SummaryBitmap& summary, Placement placement, size_t start_word) {
+    int64_t slot_idx = placement_pick(
+        placement, start_word, [&](size_t word_idx) { return summary.find_next(word_idx); },
+        [&](size_t word_idx) { return words[word_idx]; });
+    if (slot_idx == -1) {
+        return -1;
+    }
+    size_t word_idx = static_cast<size_t>(slot_idx) >> 6;
+    words[word_idx] &= ~(1ULL << (slot_idx & 63));
+    if (words[word_idx] == 0) {
+        summary.clear(word_idx);
+    }
+    return static_cast<int>(slot_idx);
+}
+
+/// Same for the lock-free bitmaps: pick on a racy view, then fetch_and the picked bit. A lost race picks again once,
+/// after that (or when the pick saw nothing) it returns -1 and the caller falls back to claim_one_lock_free, which
+/// handles contention and is the one that decides the bitmap is really full.
+template <typename Words>
+inline int claim_placed_lock_free(Words& words, SummaryBitmapLockFree& summary, Placement placement, size_t start_word,
+                                  std::atomic<uint64_t>& cas_retries) {
+    constexpr int ATTEMPTS = 2;
+    for (int attempt = 0; attempt < ATTEMPTS; ++attempt) {
+        int64_t slot_idx = placement_pick(
+            placement, start_word, [&](size_t word_idx) { return summary.find_next(word_idx); },
+            [&](size_t word_idx) { return words[word_idx].load(std::memory_order_acquire); });
+        if (slot_idx == -1) {
+            return -1;
+        }
+        size_t word_idx = static_cast<size_t>(slot_idx) >> 6;
+        uint64_t mask = 1ULL << (slot_idx & 63);
+        uint64_t old = words[word_idx].fetch_and(~mask, std::memory_order_acq_rel);
+        if ((old & ~mask) == 0) {
+            summary.clear_if_empty(word_idx, words[word_idx]);
+        }
+        if (old & mask) {
+            return static_cast<int>(slot_idx);
+        }
+        cas_retries.fetch_add(1, std::memory_order_relaxed);
+    }
+    return -1;
+}
+
 // BitMap the track the usage of slots in the arena_allocator.
 // 1 means free, 0 means allocated.
 // I was actually going to go for 1 as free and 0 as allocated, but it turns out that we've got hardware support for
@@ -35,8 +371,13 @@ struct Bitmap {
 
     uint32_t num_slots;
     std::vector<uint64_t> words;
+    // One bit per word, set while the word has at least one free slot. Lets allocate_one jump straight to a word with
+    // room instead of walking the words array.
+    SummaryBitmap summary;
+    // Where allocate_one puts things, see placement.h. Set once before the bitmap is used.
+    Placement placement = Placement::Default;
 
-    explicit Bitmap(uint32_t num_slots) : num_slots(num_slots) {
+    explicit Bitmap(uint32_t num_slots) : num_slots(num_slots), summary(num_slots / WORD_LENGTH, true) {
         if (num_slots % WORD_LENGTH != 0) {
             throw std::invalid_argument("number of slots must be a multiple of 64");
         }
@@ -53,6 +394,11 @@ struct Bitmap {
     int allocate_one();
     int allocate_many(uint32_t num_slots);
     int free_slot(uint32_t slot_idx);
+    int free_many(uint32_t slot_idx, uint32_t num_slots);
+    template <typename Emit>
+    uint32_t allocate_batch(uint32_t count, Emit&& emit);
+    uint64_t release_bits(size_t word_idx, uint64_t mask);
+    bool park_word(size_t word_idx);
 };
 
 /// Returns the word and bit index given the slot index.
@@ -74,58 +420,72 @@ inline size_t Bitmap::get_slot_index_from_word_and_bit_index(size_t word_idx, ui
 inline int Bitmap::allocate_one() {
     // Load hint once; this is a non-lock-free bitmap used under external synchronization.
     size_t hint = allocation_hint.load(std::memory_order_relaxed);
-    for (size_t word_idx = hint; word_idx < words.size(); ++word_idx) {
-        uint64_t word = words[word_idx];
-        if (word != FULLY_ALLOCATED) {
-            // Count leading zeros from the MSB side, subtract from 63 to get the bit index from the right.
-            // This allocates from the highest free bit position (MSB side).
-            // For example consider a word with bit 62 set (counting from LSB = bit 0):
-            // 0100...0 has 1 leading zero, so bit_idx = 63 - 1 = 62
-            int bit_idx = MAX_IDX - std::countl_zero(word);
-            // Validate bit_idx is in valid range
-            if (bit_idx < 0 || bit_idx > 63) {
-                continue;
-            }
-            // Since we're allocating the slot, we need to set it to 0.
-            words[word_idx] &= ~(1ULL << bit_idx);
-            // Just some hints for the next allocation request to start looking from.
-            if (word == FULLY_ALLOCATED) {
-                allocation_hint.store((word_idx + 1) % words.size(), std::memory_order_relaxed);
-            } else {
-                allocation_hint.store(word_idx, std::memory_order_relaxed);
-            }
-            return get_slot_index_from_word_and_bit_index(word_idx, bit_idx);
-        }
+    if (placement != Placement::Default) {
+        return claim_placed_plain(words.data(), summary, placement, placement == Placement::AddressOrdered ? 0 : hint);
     }
-
-    for (size_t word_idx = 0; word_idx < hint; ++word_idx) {
-        uint64_t word = words[word_idx];
-        if (word != FULLY_ALLOCATED) {
-            // Count leading zeros from the MSB side, subtract from 63 to get the bit index from the right.
-            // This allocates from the highest free bit position (MSB side).
-            // For example consider a word with bit 62 set (counting from LSB = bit 0):
-            // 0100...0 has 1 leading zero, so bit_idx = 63 - 1 = 62
-            int bit_idx = MAX_IDX - std::countl_zero(word);
-            // Validate bit_idx is in valid range
-            if (bit_idx < 0 || bit_idx > 63) {
-                continue;
-            }
-            // Since we're allocating the slot, we need to set it to 0.
-            words[word_idx] &= ~(1ULL << bit_idx);
-            // Just some hints for the next allocation request to start looking from.
-            if (word == FULLY_ALLOCATED) {
-                allocation_hint.store((word_idx + 1) % words.size());
-            } else {
-                allocation_hint.store(word_idx);
-            }
-            return get_slot_index_from_word_and_bit_index(word_idx, bit_idx);
+    // The summary tells us the first word at or after the hint with a free slot, wrapping around once.
+    size_t word_idx = summary.find_next(hint);
+    if (word_idx == SummaryBitmap::NOT_FOUND) {
+        word_idx = summary.find_next(0);
+        if (word_idx == SummaryBitmap::NOT_FOUND) {
+            return -1;
         }
     }
-    return -1;
+    uint64_t word = words[word_idx];
+    // Count leading zeros from the MSB side, subtract from 63 to get the bit index from the right.
+    // This allocates from the highest free bit position (MSB side).
+    // For example consider a word with bit 62 set (counting from LSB = bit 0):
+    // 0100...0 has 1 leading zero, so bit_idx = 63 - 1 = 62
+    int bit_idx = MAX_IDX - std::countl_zero(word);
+    // Since we're allocating the slot, we need to set it to 0.
+    words[word_idx] &= ~(1ULL << bit_idx);
+    // Just some hints for the next allocation request to start looking from.
+    if (words[word_idx] == FULLY_ALLOCATED) {
+        summary.clear(word_idx);
+        allocation_hint.store((word_idx + 1) % words.size(), std::memory_order_relaxed);
+    } else {
+        allocation_hint.store(word_idx, std::memory_order_relaxed);
+    }
+    return get_slot_index_from_word_and_bit_index(word_idx, bit_idx);
 }
 
+/// Allocates num_slots contiguous slots, returns the index of the first one, -1 if there is no run that long.
+/// Starts looking at the hinted word and wraps around once, same as allocate_one.
 inline int Bitmap::allocate_many(uint32_t num_slots) {
-    return -1;
+    if (num_slots == 0 || num_slots > this->num_slots) {
+        return -1;
+    }
+    if (num_slots == 1) {
+        return allocate_one();
+    }
+    auto load_word = [this](size_t word_idx) { return words[word_idx]; };
+    auto next_not_full = [this](size_t word_idx, size_t end) {
+        return scan_first_not_equal(words.data(), word_idx, end, FULLY_ALLOCATED);
+    };
+    size_t hint = placement == Placement::AddressOrdered ? 0 : allocation_hint.load(std::memory_order_relaxed);
+    int64_t start = find_free_run(hint, words.size(), words.size(), num_slots, load_word, next_not_full);
+    if (start == -1 && hint > 0) {
+        // Runs starting before the hint may reach into it, so the second pass goes a little past the hint.
+        size_t end = std::min(words.size(), hint + (num_slots + WORD_LENGTH - 1) / WORD_LENGTH);
+        start = find_free_run(0, end, words.size(), num_slots, load_word, next_not_full);
+    }
+    if (start == -1) {
+        return -1;
+    }
+
+    size_t last_word = 0;
+    for_each_word_in_range(static_cast<size_t>(start), num_slots, [&](size_t word_idx, uint64_t mask) {
+        words[word_idx] &= ~mask;
+        if (words[word_idx] == FULLY_ALLOCATED) {
+            summary.clear(word_idx);
+        }
+        last_word = word_idx;
+        return true;
+    });
+    // The run's last word is the most likely one to still have room.
+    allocation_hint.store(words[last_word] == FULLY_ALLOCATED ? (last_word + 1) % words.size() : last_word,
+                          std::memory_order_relaxed);
+    return static_cast<int>(start);
 }
 
 inline int Bitmap::free_slot(uint32_t slot_idx) {
@@ -135,6 +495,12 @@ inline int Bitmap::free_slot(uint32_t slot_idx) {
     size_t word_idx, bit_idx;
     std::tie(word_idx, bit_idx) = get_word_and_bit_index_from_slot_index(slot_idx);
     // word_idx is guaranteed in range if slot_idx < num_slots
+    if (words[word_idx] & (1ULL << bit_idx)) {
+        return 1; // double free
+    }
+    if (words[word_idx] == FULLY_ALLOCATED) {
+        summary.set(word_idx);
+    }
     words[word_idx] |= (1ULL << bit_idx);
     // Update hint to point to the word where we just freed a slot
     // This helps allocations find free slots faster
@@ -142,9 +508,71 @@ inline int Bitmap::free_slot(uint32_t slot_idx) {
     return 0;
 }
 
+/// Frees num_slots contiguous slots starting at slot_idx.
+/// Returns -1 if the range is out of bounds, 1 if any slot in it is already free (nothing changes then), 0 otherwise.
+inline int Bitmap::free_many(uint32_t slot_idx, uint32_t num_slots) {
+    if (num_slots == 0 || slot_idx >= this->num_slots || num_slots > this->num_slots - slot_idx) {
+        return -1;
+    }
+    bool all_allocated = for_each_word_in_range(slot_idx, num_slots, [this](size_t word_idx, uint64_t mask) {
+        return (words[word_idx] & mask) == 0;
+    });
+    if (!all_allocated) {
+        return 1;
+    }
+    for_each_word_in_range(slot_idx, num_slots, [this](size_t word_idx, uint64_t mask) {
+        if (words[word_idx] == FULLY_ALLOCATED) {
+            summary.set(word_idx);
+        }
+        words[word_idx] |= mask;
+        return true;
+    });
+    allocation_hint.store(slot_idx >> WORD_SHIFT, std::memory_order_relaxed);
+    return 0;
+}
+
+/// Claims up to `count` free slots in one go, see claim_batch_plain. Starts at the hint and leaves it at the last word
+/// touched. Returns the number of slots claimed.
+template <typename Emit>
+inline uint32_t Bitmap::allocate_batch(uint32_t count, Emit&& emit) {
+    size_t last_word = allocation_hint.load(std::memory_order_relaxed);
+    uint32_t taken = claim_batch_plain(words.data(), summary, last_word, count, [&](size_t word_idx, uint64_t mask) {
+        last_word = word_idx;
+        emit(word_idx, mask);
+    });
+    allocation_hint.store(last_word, std::memory_order_relaxed);
+    return taken;
+}
+
+/// Frees every slot in mask of one word. Slots that were already free are left alone and returned, 0 means the whole
+/// mask was released cleanly.
+inline uint64_t Bitmap::release_bits(size_t word_idx, uint64_t mask) {
+    uint64_t already_free = words[word_idx] & mask;
+    if (words[word_idx] == FULLY_ALLOCATED) {
+        summary.set(word_idx);
+    }
+    words[word_idx] |= mask;
+    allocation_hint.store(word_idx, std::memory_order_relaxed);
+    return already_free;
+}
+
+/// Takes a completely free word out of circulation in one go (all its slots look allocated afterwards), so its pages
+/// can be handed back to the kernel without anyone allocating from it meanwhile. false if any slot in it is in use.
+/// release_bits(word_idx, FULLY_FREE) puts it back.
+inline bool Bitmap::park_word(size_t word_idx) {
+    if (words[word_idx] != FULLY_FREE) {
+        return false;
+    }
+    words[word_idx] = FULLY_ALLOCATED;
+    summary.clear(word_idx);
+    return true;
+}
+
 // Lock-free bitmap using atomic operations and compare-and-swap for thread-safe allocation.
 // 1 means free, 0 means allocated (same convention as Bitmap).
-struct BitmapLockFree {
+// Words picks the memory layout of the atomic words, see word_layout.h. BitmapLockFree is the dense one.
+template <typename Words = DenseWords>
+struct BasicBitmapLockFree {
     static constexpr std::uint32_t WORD_SHIFT = 6;
     static constexpr std::uint32_t WORD_LENGTH = 64;
     static constexpr std::uint32_t WORD_MASK = WORD_LENGTH - 1;
@@ -154,117 +582,111 @@ struct BitmapLockFree {
 
     uint32_t num_slots;
     size_t num_words;
-    std::atomic<std::uint64_t>* words;
-    std::atomic<uint64_t> cas_retries; // Counter for CAS retry attempts
+    Words words;
+    // Written under contention only, but still kept off the line of the read-mostly fields above.
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> cas_retries; // Counter for CAS retry attempts
+    // How many retries the contended single-slot allocations took, see CasRetryHistogram.
+    CasRetryHistogram retry_histogram;
+    // One bit per word that (probably) has a free slot, see SummaryBitmapLockFree for the rules.
+    SummaryBitmapLockFree summary;
+    // See Bitmap::placement.
+    Placement placement = Placement::Default;
 
-    explicit BitmapLockFree(uint32_t num_slots) : num_slots(num_slots), cas_retries(0) {
+    explicit BasicBitmapLockFree(uint32_t num_slots)
+        : num_slots(num_slots), num_words(num_slots / WORD_LENGTH), words(num_words), cas_retries(0),
+          summary(num_slots / WORD_LENGTH, true) {
         if (num_slots % WORD_LENGTH != 0) {
             throw std::invalid_argument("number of slots must be a multiple of 64");
         }
 
-        num_words = num_slots / WORD_LENGTH;
-        // Use raw array allocation since std::vector doesn't work with non-moveable atomics
-        words = new std::atomic<std::uint64_t>[num_words];
         for (size_t i = 0; i < num_words; ++i) {
             words[i].store(FULLY_FREE, std::memory_order_relaxed);
         }
     }
 
-    ~BitmapLockFree() {
-        delete[] words;
-    }
-
     std::pair<size_t, uint32_t> get_word_and_bit_index_from_slot_index(uint32_t slot_idx) const;
     size_t get_slot_index_from_word_and_bit_index(size_t word_idx, uint32_t bit_idx) const;
     int allocate_one();
+    int allocate_many(uint32_t num_slots);
     int free_slot(uint32_t slot_idx);
+    int free_many(uint32_t slot_idx, uint32_t num_slots);
+    template <typename Emit>
+    uint32_t allocate_batch(uint32_t count, Emit&& emit);
+    uint64_t release_bits(size_t word_idx, uint64_t mask);
+    bool park_word(size_t word_idx);
     uint64_t get_cas_retries() const {
         return cas_retries.load(std::memory_order_relaxed);
     }
+    std::array<uint64_t, CasRetryHistogram::NUM_BUCKETS> get_cas_retry_histogram() const {
+        return retry_histogram.snapshot();
+    }
 };
 
 /// Returns the word and bit index given the slot index.
-inline std::pair<size_t, uint32_t> BitmapLockFree::get_word_and_bit_index_from_slot_index(uint32_t slot_idx) const {
+template <typename Words>
+inline std::pair<size_t, uint32_t>
+BasicBitmapLockFree<Words>::get_word_and_bit_index_from_slot_index(uint32_t slot_idx) const {
     return {slot_idx >> WORD_SHIFT, slot_idx & WORD_MASK};
 }
 
 /// Returns the slot_index given the word, and bit index
-inline size_t BitmapLockFree::get_slot_index_from_word_and_bit_index(size_t word_idx, uint32_t bit_idx) const {
+template <typename Words>
+inline size_t
+BasicBitmapLockFree<Words>::get_slot_index_from_word_and_bit_index(size_t word_idx, uint32_t bit_idx) const {
     return (word_idx << WORD_SHIFT) | bit_idx;
 }
 
-/// Lock-free single-slot allocation using atomic compare-and-swap (CAS).
-///
-/// Algorithm:
-/// 1. Scan through words to find one that has at least one free bit (1).
-/// 2. For each word with free bits, enter a CAS retry loop:
-///    - Pick one free bit from the locally observed word value
-///    - Compute new_word by clearing that bit (1 -> 0)
-///    - Attempt CAS to atomically update from observed to new_word
-///    - If CAS succeeds, return the slot index
-///    - If CAS fails, the observed value is updated to current word value; retry with new value
-/// 3. If all words are fully allocated, return -1
+/// Lock-free single-slot allocation, first fit: the search starts at word 0 every time, see claim_one_lock_free.
 ///
 /// Correctness guarantees:
-/// - Only one thread can successfully claim a specific bit via CAS, preventing double allocation
-/// - CAS failure means another thread modified the word; we retry with the updated value
-/// - Never clear a bit that wasn't 1 in the value we observed (CAS ensures atomicity)
+/// - The claim is a fetch_and clearing one bit we saw free. Only the thread whose fetch_and returned the bit still set
+///   owns the slot, a thread that lost the race cleared a bit that was already clear, which changes nothing
 /// - Memory ordering (acquire/release) ensures proper synchronization with free_slot
 ///
 /// Lock-free progress:
-/// - At least one competing thread will succeed in its CAS if free slots exist
-/// - Failed threads observe progress (word changes) and retry with updated state
-/// - No thread can block others indefinitely (no locks, no waiting)
-inline int BitmapLockFree::allocate_one() {
-    // Scan all words looking for one with free bits
-    for (size_t word_idx = 0; word_idx < num_words; ++word_idx) {
-        // Load the current word value with acquire semantics to see any prior frees
-        uint64_t observed = words[word_idx].load(std::memory_order_acquire);
-
-        // CAS retry loop for this word
-        while (observed != FULLY_ALLOCATED) {
-            // Find the highest free bit (1) in the observed word
-            // countl_zero returns number of leading zeros, subtract from 63 to get bit index from the right
-            int bit_idx = static_cast<int>(MAX_IDX - std::countl_zero(observed));
-            // Validate bit_idx is in valid range
-            if (bit_idx < 0 || bit_idx > 63) {
-                break;
-            }
-            uint64_t bit_mask = (1ULL << bit_idx);
-
-            // Compute the new word value with the chosen bit cleared (allocated)
-            uint64_t new_word = observed & ~bit_mask;
-
-            // Attempt to atomically claim the bit
-            // compare_exchange_weak returns true if CAS succeeded, false otherwise
-            // On failure, observed is updated to the current word value
-            if (words[word_idx].compare_exchange_weak(
-                    observed,                  // expected value (updated on failure)
-                    new_word,                  // desired new value
-                    std::memory_order_acq_rel, // success: acquire+release for synchronization
-                    std::memory_order_acquire  // failure: acquire to see concurrent updates
-                    )) {
-                // CAS succeeded: we atomically claimed the slot
-                return static_cast<int>(
-                    get_slot_index_from_word_and_bit_index(word_idx, static_cast<uint32_t>(bit_idx)));
-            }
+/// - A failed claim means another thread just took that slot
+/// - After a failure the thread moves on to another word (and eventually backs off), it doesn't keep retrying the word
+///   everybody else is on
+template <typename Words>
+inline int BasicBitmapLockFree<Words>::allocate_one() {
+    if (placement != Placement::Default) {
+        int slot_idx = claim_placed_lock_free(words, summary, placement, 0, cas_retries);
+        if (slot_idx != -1) {
+            return slot_idx;
+        }
+    }
+    return claim_one_lock_free(words, summary, num_words, 0, cas_retries, retry_histogram);
+}
 
-            // CAS failed due to contention or spurious failure
-            // Increment retry counter for benchmarking
-            cas_retries.fetch_add(1, std::memory_order_relaxed);
-            // observed now contains the updated word value, loop to try again
-            // If another thread allocated our target bit, observed may still have other free bits
-            // If another thread allocated all bits, observed == FULLY_ALLOCATED and we exit loop
+/// Lock-free allocation of num_slots contiguous slots, returns the index of the first one, -1 if there is no run.
+/// The run search works on a racy view of the words, try_claim_run_lock_free then either claims the whole run
+/// atomically word by word or rolls back, in which case we search again with fresh values. Every failed attempt means
+/// some other thread allocated in the meantime, so we stay lock-free.
+template <typename Words>
+inline int BasicBitmapLockFree<Words>::allocate_many(uint32_t num_slots) {
+    if (num_slots == 0 || num_slots > this->num_slots) {
+        return -1;
+    }
+    if (num_slots == 1) {
+        return allocate_one();
+    }
+    auto load_word = [this](size_t word_idx) { return words[word_idx].load(std::memory_order_acquire); };
+    auto next_not_full = [this](size_t word_idx, size_t end) { return std::min(summary.find_next(word_idx), end); };
+    for (;;) {
+        int64_t start = find_free_run(0, num_words, num_words, num_slots, load_word, next_not_full);
+        if (start == -1) {
+            return -1;
+        }
+        if (try_claim_run_lock_free(words, summary, static_cast<size_t>(start), num_slots, cas_retries)) {
+            return static_cast<int>(start);
         }
-        // This word is now fully allocated, move to next word
     }
-    // No free slots found in any word
-    return -1;
 }
 
 /// Free a previously allocated slot, making it available for reuse.
 /// Uses atomic fetch_or with release semantics to ensure proper memory ordering.
-inline int BitmapLockFree::free_slot(uint32_t slot_idx) {
+template <typename Words>
+inline int BasicBitmapLockFree<Words>::free_slot(uint32_t slot_idx) {
     if (slot_idx >= num_slots) {
         return -1;
     }
@@ -277,6 +699,10 @@ inline int BitmapLockFree::free_slot(uint32_t slot_idx) {
     // the next thread that allocates it (via acquire in allocate_one_lock_free)
     uint64_t mask = (1ULL << bit_idx);
     uint64_t old = words[word_idx].fetch_or(mask, std::memory_order_release);
+    if (old == FULLY_ALLOCATED) {
+        // First free slot in this word, make it visible to the summary search
+        summary.set(word_idx);
+    }
     if (old & mask) {
         // Bit was already 1 -> double free detected
         return 1;
@@ -285,9 +711,60 @@ inline int BitmapLockFree::free_slot(uint32_t slot_idx) {
     }
 }
 
+/// Frees num_slots contiguous slots starting at slot_idx, one fetch_or per word.
+/// Returns -1 if the range is out of bounds, 1 if any slot in it was already free (double free), 0 otherwise.
+/// Unlike the locked bitmaps, a double free can't be rejected up front without racing, so the rest of the range is
+/// still released.
+template <typename Words>
+inline int BasicBitmapLockFree<Words>::free_many(uint32_t slot_idx, uint32_t num_slots) {
+    if (num_slots == 0 || slot_idx >= this->num_slots || num_slots > this->num_slots - slot_idx) {
+        return -1;
+    }
+    uint64_t already_free = 0;
+    for_each_word_in_range(slot_idx, num_slots, [&](size_t word_idx, uint64_t mask) {
+        uint64_t old = words[word_idx].fetch_or(mask, std::memory_order_release);
+        if (old == FULLY_ALLOCATED) {
+            summary.set(word_idx);
+        }
+        already_free |= old & mask;
+        return true;
+    });
+    return already_free != 0 ? 1 : 0;
+}
+
+/// Claims up to `count` free slots with one fetch_and per word, see claim_batch_lock_free.
+template <typename Words>
+template <typename Emit>
+inline uint32_t BasicBitmapLockFree<Words>::allocate_batch(uint32_t count, Emit&& emit) {
+    return claim_batch_lock_free(words, summary, 0, count, emit);
+}
+
+/// Frees every slot in mask of one word with a single fetch_or, returns the ones that were already free.
+template <typename Words>
+inline uint64_t BasicBitmapLockFree<Words>::release_bits(size_t word_idx, uint64_t mask) {
+    uint64_t old = words[word_idx].fetch_or(mask, std::memory_order_release);
+    if (old == FULLY_ALLOCATED) {
+        summary.set(word_idx);
+    }
+    return old & mask;
+}
+
+/// Lock-free version of Bitmap::park_word, a single CAS from FULLY_FREE so it only ever wins on a word nobody uses.
+template <typename Words>
+inline bool BasicBitmapLockFree<Words>::park_word(size_t word_idx) {
+    uint64_t expected = FULLY_FREE;
+    if (!words[word_idx].compare_exchange_strong(expected, FULLY_ALLOCATED, std::memory_order_acq_rel)) {
+        return false;
+    }
+    summary.clear_if_empty(word_idx, words[word_idx]);
+    return true;
+}
+
 // Lock-free bitmap with hint mechanism using thread-local counter
 // 1 means free, 0 means allocated (same convention as BitmapLockFree).
-struct BitmapLockFreeHint {
+// Words picks the memory layout of the atomic words, see word_layout.h. BitmapLockFreeHint is the dense one.
+template <typename Words = DenseWords>
+struct BasicBitmapLockFreeHint {
     static constexpr std::uint32_t WORD_SHIFT = 6;
     static constexpr std::uint32_t WORD_LENGTH = 64;
     static constexpr std::uint32_t WORD_MASK = WORD_LENGTH - 1;
@@ -298,105 +775,91 @@ struct BitmapLockFreeHint {
     uint32_t num_slots;
     size_t num_words;
     bool num_words_is_pow2;
-    std::atomic<std::uint64_t>* words;
-    std::atomic<uint64_t> cas_retries; // Counter for CAS retry attempts
+    Words words;
+    // Written under contention only, but still kept off the line of the read-mostly fields above.
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> cas_retries; // Counter for CAS retry attempts
+    // How many retries the contended single-slot allocations took, see CasRetryHistogram.
+    CasRetryHistogram retry_histogram;
+    // One bit per word that (probably) has a free slot, see SummaryBitmapLockFree for the rules.
+    SummaryBitmapLockFree summary;
+    // See Bitmap::placement.
+    Placement placement = Placement::Default;
 
-    // Atomic hint counter - each thread increments atomically
-    std::atomic<size_t> allocation_hint;
+    // Atomic hint counter - each thread increments atomically. Bumped on every allocation, so it gets its own line.
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> allocation_hint;
 
-    explicit BitmapLockFreeHint(uint32_t num_slots) : num_slots(num_slots), cas_retries(0), allocation_hint(0) {
+    explicit BasicBitmapLockFreeHint(uint32_t num_slots)
+        : num_slots(num_slots), num_words(num_slots / WORD_LENGTH),
+          num_words_is_pow2((num_words & (num_words - 1)) == 0), words(num_words), cas_retries(0),
+          summary(num_slots / WORD_LENGTH, true), allocation_hint(0) {
         if (num_slots % WORD_LENGTH != 0) {
             throw std::invalid_argument("number of slots must be a multiple of 64");
         }
 
-        num_words = num_slots / WORD_LENGTH;
-        num_words_is_pow2 = (num_words & (num_words - 1)) == 0;
-        words = new std::atomic<std::uint64_t>[num_words];
         for (size_t i = 0; i < num_words; ++i) {
             words[i].store(FULLY_FREE, std::memory_order_relaxed);
         }
     }
 
-    ~BitmapLockFreeHint() {
-        delete[] words;
-    }
-
     std::pair<size_t, uint32_t> get_word_and_bit_index_from_slot_index(uint32_t slot_idx) const;
     size_t get_slot_index_from_word_and_bit_index(size_t word_idx, uint32_t bit_idx) const;
     int allocate_one();
+    int allocate_many(uint32_t num_slots);
     int free_slot(uint32_t slot_idx);
+    int free_many(uint32_t slot_idx, uint32_t num_slots);
+    template <typename Emit>
+    uint32_t allocate_batch(uint32_t count, Emit&& emit);
+    std::pair<size_t, uint64_t> claim_word();
+    uint64_t release_bits(size_t word_idx, uint64_t mask);
+    bool park_word(size_t word_idx);
     uint64_t get_cas_retries() const {
         return cas_retries.load(std::memory_order_relaxed);
     }
+    std::array<uint64_t, CasRetryHistogram::NUM_BUCKETS> get_cas_retry_histogram() const {
+        return retry_histogram.snapshot();
+    }
 };
 
 /// Returns the word and bit index given the slot index.
-inline std::pair<size_t, uint32_t> BitmapLockFreeHint::get_word_and_bit_index_from_slot_index(uint32_t slot_idx) const {
+template <typename Words>
+inline std::pair<size_t, uint32_t>
+BasicBitmapLockFreeHint<Words>::get_word_and_bit_index_from_slot_index(uint32_t slot_idx) const {
     return {slot_idx >> WORD_SHIFT, slot_idx & WORD_MASK};
 }
 
 /// Returns the slot_index given the word, and bit index
-inline size_t BitmapLockFreeHint::get_slot_index_from_word_and_bit_index(size_t word_idx, uint32_t bit_idx) const {
+template <typename Words>
+inline size_t
+BasicBitmapLockFreeHint<Words>::get_slot_index_from_word_and_bit_index(size_t word_idx, uint32_t bit_idx) const {
     return (word_idx << WORD_SHIFT) | bit_idx;
 }
 
 /// Lock-free single-slot allocation with atomic hint for starting position.
-/// The hint counter uses atomic fetch_add to safely increment across threads.
-inline int BitmapLockFreeHint::allocate_one() {
+/// The hint counter uses atomic fetch_add to safely increment across threads, the claim itself is claim_one_lock_free.
+template <typename Words>
+inline int BasicBitmapLockFreeHint<Words>::allocate_one() {
+    // Address ordered doesn't need the hint, no point bumping the shared counter for it.
+    if (placement == Placement::AddressOrdered) {
+        int slot_idx = claim_placed_lock_free(words, summary, placement, 0, cas_retries);
+        if (slot_idx != -1) {
+            return slot_idx;
+        }
+    }
     // Atomically increment hint and keep it bounded with modulo or bitmask
     size_t old = allocation_hint.fetch_add(1, std::memory_order_relaxed);
     size_t hint = num_words_is_pow2 ? (old & (num_words - 1)) : (old % num_words);
-    size_t start_idx = hint;
-
-    // Scan from start_idx to end of array
-    for (size_t word_idx = start_idx; word_idx < num_words; ++word_idx) {
-        uint64_t observed = words[word_idx].load(std::memory_order_acquire);
-
-        while (observed != FULLY_ALLOCATED) {
-            int bit_idx = static_cast<int>(MAX_IDX - std::countl_zero(observed));
-            if (bit_idx < 0 || bit_idx > 63) {
-                break;
-            }
-            uint64_t bit_mask = (1ULL << bit_idx);
-            uint64_t new_word = observed & ~bit_mask;
-
-            if (words[word_idx].compare_exchange_weak(observed, new_word, std::memory_order_acq_rel,
-                                                      std::memory_order_acquire)) {
-                return static_cast<int>(
-                    get_slot_index_from_word_and_bit_index(word_idx, static_cast<uint32_t>(bit_idx)));
-            }
-
-            cas_retries.fetch_add(1, std::memory_order_relaxed);
-        }
-    }
-
-    // Wrap around: scan from beginning to start_idx
-    for (size_t word_idx = 0; word_idx < start_idx; ++word_idx) {
-        uint64_t observed = words[word_idx].load(std::memory_order_acquire);
-
-        while (observed != FULLY_ALLOCATED) {
-            int bit_idx = static_cast<int>(MAX_IDX - std::countl_zero(observed));
-            if (bit_idx < 0 || bit_idx > 63) {
-                break;
-            }
-            uint64_t bit_mask = (1ULL << bit_idx);
-            uint64_t new_word = observed & ~bit_mask;
-
-            if (words[word_idx].compare_exchange_weak(observed, new_word, std::memory_order_acq_rel,
-                                                      std::memory_order_acquire)) {
-                return static_cast<int>(
-                    get_slot_index_from_word_and_bit_index(word_idx, static_cast<uint32_t>(bit_idx)));
-            }
-
-            cas_retries.fetch_add(1, std::memory_order_relaxed);
+    if (placement == Placement::FullestWord || placement == Placement::BestFit) {
+        int slot_idx = claim_placed_lock_free(words, summary, placement, hint, cas_retries);
+        if (slot_idx != -1) {
+            return slot_idx;
         }
     }
-
-    return -1;
+    return claim_one_lock_free(words, summary, num_words, hint, cas_retries, retry_histogram);
 }
 
 /// Free a previously allocated slot.
-inline int BitmapLockFreeHint::free_slot(uint32_t slot_idx) {
+template <typename Words>
+inline int BasicBitmapLockFreeHint<Words>::free_slot(uint32_t slot_idx) {
     if (slot_idx >= num_slots) {
         return -1;
     }
@@ -405,6 +868,10 @@ inline int BitmapLockFreeHint::free_slot(uint32_t slot_idx) {
     std::tie(word_idx, bit_idx) = get_word_and_bit_index_from_slot_index(slot_idx);
     uint64_t mask = (1ULL << bit_idx);
     uint64_t old = words[word_idx].fetch_or(mask, std::memory_order_release);
+    if (old == FULLY_ALLOCATED) {
+        // First free slot in this word, make it visible to the summary search
+        summary.set(word_idx);
+    }
     if (old & mask) {
         return 1;
     } else {
@@ -412,6 +879,126 @@ inline int BitmapLockFreeHint::free_slot(uint32_t slot_idx) {
     }
 }
 
+/// Lock-free allocation of num_slots contiguous slots, see BasicBitmapLockFree::allocate_many.
+/// The search starts at the current hint word and wraps around once. The hint is only read here, not bumped: run
+/// allocations are rare enough that spreading them out isn't worth another shared fetch_add.
+template <typename Words>
+inline int BasicBitmapLockFreeHint<Words>::allocate_many(uint32_t num_slots) {
+    if (num_slots == 0 || num_slots > this->num_slots) {
+        return -1;
+    }
+    if (num_slots == 1) {
+        return allocate_one();
+    }
+    auto load_word = [this](size_t word_idx) { return words[word_idx].load(std::memory_order_acquire); };
+    auto next_not_full = [this](size_t word_idx, size_t end) { return std::min(summary.find_next(word_idx), end); };
+    size_t current = placement == Placement::AddressOrdered ? 0 : allocation_hint.load(std::memory_order_relaxed);
+    size_t hint = num_words_is_pow2 ? (current & (num_words - 1)) : (current % num_words);
+    size_t wrap_end = std::min(num_words, hint + (num_slots + WORD_LENGTH - 1) / WORD_LENGTH);
+    for (;;) {
+        int64_t start = find_free_run(hint, num_words, num_words, num_slots, load_word, next_not_full);
+        if (start == -1 && hint > 0) {
+            start = find_free_run(0, wrap_end, num_words, num_slots, load_word, next_not_full);
+        }
+        if (start == -1) {
+            return -1;
+        }
+        if (try_claim_run_lock_free(words, summary, static_cast<size_t>(start), num_slots, cas_retries)) {
+            return static_cast<int>(start);
+        }
+    }
+}
+
+/// Frees num_slots contiguous slots starting at slot_idx, see BasicBitmapLockFree::free_many.
+template <typename Words>
+inline int BasicBitmapLockFreeHint<Words>::free_many(uint32_t slot_idx, uint32_t num_slots) {
+    if (num_slots == 0 || slot_idx >= this->num_slots || num_slots > this->num_slots - slot_idx) {
+        return -1;
+    }
+    uint64_t already_free = 0;
+    for_each_word_in_range(slot_idx, num_slots, [&](size_t word_idx, uint64_t mask) {
+        uint64_t old = words[word_idx].fetch_or(mask, std::memory_order_release);
+        if (old == FULLY_ALLOCATED) {
+            summary.set(word_idx);
+        }
+        already_free |= old & mask;
+        return true;
+    });
+    return already_free != 0 ? 1 : 0;
+}
+
+/// Claims every free bit of one word in a single atomic exchange, starting the search at the hint.
+/// Returns the word index and the mask of slots that now belong to the caller, the mask is 0 if the bitmap is full.
+///
+/// This is the refill path for the per-thread slot caches. Unlike allocate_one there is no CAS loop: exchange always
+/// succeeds and hands back exactly the bits that were free at that instant, any concurrent free_slot either lands
+/// before the exchange (and is claimed) or after it (and stays in the bitmap).
+template <typename Words>
+inline std::pair<size_t, uint64_t> BasicBitmapLockFreeHint<Words>::claim_word() {
+    size_t old = allocation_hint.fetch_add(1, std::memory_order_relaxed);
+    size_t start_idx = num_words_is_pow2 ? (old & (num_words - 1)) : (old % num_words);
+
+    // Same search as allocate_one: summary from the hint to the end, then wrap around once.
+    size_t word_idx = summary.find_next(start_idx);
+    bool wrapped = false;
+    for (;;) {
+        if (word_idx == SummaryBitmapLockFree::NOT_FOUND || (wrapped && word_idx >= start_idx)) {
+            if (wrapped) {
+                return {0, FULLY_ALLOCATED};
+            }
+            wrapped = true;
+            word_idx = summary.find_next(0);
+            continue;
+        }
+        // Cheap read first so we don't pull fully allocated words into exclusive state.
+        if (words[word_idx].load(std::memory_order_relaxed) != FULLY_ALLOCATED) {
+            uint64_t claimed = words[word_idx].exchange(FULLY_ALLOCATED, std::memory_order_acq_rel);
+            summary.clear_if_empty(word_idx, words[word_idx]);
+            if (claimed != FULLY_ALLOCATED) {
+                return {word_idx, claimed};
+            }
+        } else {
+            summary.clear_if_empty(word_idx, words[word_idx]);
+        }
+        word_idx = summary.find_next(word_idx + 1);
+    }
+}
+
+/// Returns a whole batch of slots living in the same word with one fetch_or.
+/// Returns the subset of mask that was already free, i.e. the double frees, 0 if everything was released cleanly.
+template <typename Words>
+inline uint64_t BasicBitmapLockFreeHint<Words>::release_bits(size_t word_idx, uint64_t mask) {
+    uint64_t old = words[word_idx].fetch_or(mask, std::memory_order_release);
+    if (old == FULLY_ALLOCATED) {
+        summary.set(word_idx);
+    }
+    return old & mask;
+}
+
+/// See BasicBitmapLockFree::park_word.
+template <typename Words>
+inline bool BasicBitmapLockFreeHint<Words>::park_word(size_t word_idx) {
+    uint64_t expected = FULLY_FREE;
+    if (!words[word_idx].compare_exchange_strong(expected, FULLY_ALLOCATED, std::memory_order_acq_rel)) {
+        return false;
+    }
+    summary.clear_if_empty(word_idx, words[word_idx]);
+    return true;
+}
+
+/// Claims up to `count` free slots with one fetch_and per word, see claim_batch_lock_free. The hint is bumped once per
+/// batch, not once per slot.
+template <typename Words>
+template <typename Emit>
+inline uint32_t BasicBitmapLockFreeHint<Words>::allocate_batch(uint32_t count, Emit&& emit) {
+    size_t old = allocation_hint.fetch_add(1, std::memory_order_relaxed);
+    size_t start_idx = num_words_is_pow2 ? (old & (num_words - 1)) : (old % num_words);
+    return claim_batch_lock_free(words, summary, start_idx, count, emit);
+}
+
+using BitmapLockFree = BasicBitmapLockFree<DenseWords>;
+using BitmapLockFreeHint = BasicBitmapLockFreeHint<DenseWords>;
+
 // Bitmap without hint mechanism - always scans from the beginning
 // 1 means free, 0 means allocated (same convention as Bitmap).
 struct BitmapNoHint {
@@ -424,8 +1011,12 @@ struct BitmapNoHint {
 
     uint32_t num_slots;
     std::vector<uint64_t> words;
+    // One bit per word with a free slot, see Bitmap::summary.
+    SummaryBitmap summary;
+    // See Bitmap::placement.
+    Placement placement = Placement::Default;
 
-    explicit BitmapNoHint(uint32_t num_slots) : num_slots(num_slots) {
+    explicit BitmapNoHint(uint32_t num_slots) : num_slots(num_slots), summary(num_slots / WORD_LENGTH, true) {
         if (num_slots % WORD_LENGTH != 0) {
             throw std::invalid_argument("number of slots must be a multiple of 64");
         }
@@ -439,6 +1030,11 @@ struct BitmapNoHint {
     int allocate_one();
     int allocate_many(uint32_t num_slots);
     int free_slot(uint32_t slot_idx);
+    int free_many(uint32_t slot_idx, uint32_t num_slots);
+    template <typename Emit>
+    uint32_t allocate_batch(uint32_t count, Emit&& emit);
+    uint64_t release_bits(size_t word_idx, uint64_t mask);
+    bool park_word(size_t word_idx);
 };
 
 /// Returns the word and bit index given the slot index.
@@ -452,24 +1048,49 @@ inline size_t BitmapNoHint::get_slot_index_from_word_and_bit_index(size_t word_i
 }
 
 /// Allocates one free slot from the bitmap, returns the index of the bitmap if allocation was successful, -1 otherwise.
-/// Always scans from the beginning (no hint mechanism).
+/// Always searches from the beginning (no hint mechanism).
 inline int BitmapNoHint::allocate_one() {
-    for (size_t word_idx = 0; word_idx < words.size(); ++word_idx) {
-        uint64_t word = words[word_idx];
-        if (word != FULLY_ALLOCATED) {
-            int bit_idx = MAX_IDX - std::countl_zero(word);
-            if (bit_idx < 0 || bit_idx > 63) {
-                continue;
-            }
-            words[word_idx] &= ~(1ULL << bit_idx);
-            return get_slot_index_from_word_and_bit_index(word_idx, bit_idx);
-        }
+    if (placement != Placement::Default) {
+        return claim_placed_plain(words.data(), summary, placement, 0);
     }
-    return -1;
+    // Lowest word with a free slot, straight from the summary instead of scanning from word 0.
+    size_t word_idx = summary.find_next(0);
+    if (word_idx == SummaryBitmap::NOT_FOUND) {
+        return -1;
+    }
+    int bit_idx = MAX_IDX - std::countl_zero(words[word_idx]);
+    words[word_idx] &= ~(1ULL << bit_idx);
+    if (words[word_idx] == FULLY_ALLOCATED) {
+        summary.clear(word_idx);
+    }
+    return get_slot_index_from_word_and_bit_index(word_idx, bit_idx);
 }
 
+/// Allocates num_slots contiguous slots, returns the index of the first one, -1 if there is no run that long.
+/// Always scans from the beginning, so this is a first fit.
 inline int BitmapNoHint::allocate_many(uint32_t num_slots) {
-    return -1;
+    if (num_slots == 0 || num_slots > this->num_slots) {
+        return -1;
+    }
+    if (num_slots == 1) {
+        return allocate_one();
+    }
+    int64_t start = find_free_run(
+        0, words.size(), words.size(), num_slots, [this](size_t word_idx) { return words[word_idx]; },
+        [this](size_t word_idx, size_t end) {
+            return scan_first_not_equal(words.data(), word_idx, end, FULLY_ALLOCATED);
+        });
+    if (start == -1) {
+        return -1;
+    }
+    for_each_word_in_range(static_cast<size_t>(start), num_slots, [this](size_t word_idx, uint64_t mask) {
+        words[word_idx] &= ~mask;
+        if (words[word_idx] == FULLY_ALLOCATED) {
+            summary.clear(word_idx);
+        }
+        return true;
+    });
+    return static_cast<int>(start);
 }
 
 inline int BitmapNoHint::free_slot(uint32_t slot_idx) {
@@ -478,8 +1099,62 @@ inline int BitmapNoHint::free_slot(uint32_t slot_idx) {
     }
     size_t word_idx, bit_idx;
     std::tie(word_idx, bit_idx) = get_word_and_bit_index_from_slot_index(slot_idx);
+    if (words[word_idx] & (1ULL << bit_idx)) {
+        return 1; // double free
+    }
+    if (words[word_idx] == FULLY_ALLOCATED) {
+        summary.set(word_idx);
+    }
     words[word_idx] |= (1ULL << bit_idx);
     return 0;
 }
 
+/// Frees num_slots contiguous slots starting at slot_idx.
+/// Returns -1 if the range is out of bounds, 1 if any slot in it is already free (nothing changes then), 0 otherwise.
+inline int BitmapNoHint::free_many(uint32_t slot_idx, uint32_t num_slots) {
+    if (num_slots == 0 || slot_idx >= this->num_slots || num_slots > this->num_slots - slot_idx) {
+        return -1;
+    }
+    bool all_allocated = for_each_word_in_range(slot_idx, num_slots, [this](size_t word_idx, uint64_t mask) {
+        return (words[word_idx] & mask) == 0;
+    });
+    if (!all_allocated) {
+        return 1;
+    }
+    for_each_word_in_range(slot_idx, num_slots, [this](size_t word_idx, uint64_t mask) {
+        if (words[word_idx] == FULLY_ALLOCATED) {
+            summary.set(word_idx);
+        }
+        words[word_idx] |= mask;
+        return true;
+    });
+    return 0;
+}
+
+/// Claims up to `count` free slots in one go, always scanning from the start, see claim_batch_plain.
+template <typename Emit>
+inline uint32_t BitmapNoHint::allocate_batch(uint32_t count, Emit&& emit) {
+    return claim_batch_plain(words.data(), summary, 0, count, emit);
+}
+
+/// Frees every slot in mask of one word, returns the ones that were already free.
+inline uint64_t BitmapNoHint::release_bits(size_t word_idx, uint64_t mask) {
+    uint64_t already_free = words[word_idx] & mask;
+    if (words[word_idx] == FULLY_ALLOCATED) {
+        summary.set(word_idx);
+    }
+    words[word_idx] |= mask;
+    return already_free;
+}
+
+/// See Bitmap::park_word.
+inline bool BitmapNoHint::park_word(size_t word_idx) {
+    if (words[word_idx] != FULLY_FREE) {
+        return false;
+    }
+    words[word_idx] = FULLY_ALLOCATED;
+    summary.clear(word_idx);
+    return true;
+}
+
 #endif // BITMAP_H
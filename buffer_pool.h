@@ -0,0 +1,513 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+// The buffer pool the arena was built for: page ids mapped to frames (arena slots), pin counts, dirty bits and
+// eviction when every frame is taken.
+//
+//   - Page table: page id -> frame index, split into stripes by a hash of the page id, every stripe its own SpinLock
+//     and map on its own cache line. A hit holds one stripe lock for a lookup and a pin, nothing global.
+//   - Frames: one Frame per arena slot in a side array indexed by slot, 24 bytes each, so the pin count, dirty bit and
+//     access history of a frame are one line apart at most from its neighbours' and never inside the page data.
+//   - Replacement: LRU-2 with sampling. Every frame remembers the clock values of its last two accesses, the clock only
+//     moves on evictions so a hit is a relaxed read of it plus (at most once per tick) two relaxed stores to the
+//     frame. The evictor samples a few unpinned frames from a clock hand and takes the one whose second-to-last
+//     access is oldest; a frame only hit once since it was loaded counts as infinitely old, which is what keeps one
+//     big scan from flushing the hot set.
+//
+// Frame states, all in Frame::pins: EXCLUSIVE while a frame is free (sitting in the arena), being loaded or being
+// evicted, otherwise the number of pins. Hitters that find EXCLUSIVE back off and retry, a loader publishes the frame
+// by storing 1, the evictor claims a frame by CASing 0 to EXCLUSIVE. Dirty frames are written back before their page
+// table entry goes away, so nobody can read the page from disk while the newer copy is still in memory.
+//
+// I/O goes through PageIO. With the batch callbacks set, prefetch_pages and flush_all hand the pool whole batches of
+// page reads or writes at once, what an async engine (uring_page_io.h) needs to get anything out of queue depth.
+//
+// Page latching is not part of this: two threads pinning the same page see the same bytes and have to coordinate
+// writes themselves.
+
+#include "arena_allocator.h"
+#include "lock_policies.h"
+#include "sharded_counter.h"
+#include "word_layout.h"
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// Where pages come from and go to. Either can be empty: missing read_page zero-fills, missing write_page drops dirty
+// pages on eviction. The reads return false when a page couldn't be read (read_pages: any page of the batch), the
+// pool then doesn't map it, the frame holds nothing anybody should see.
+struct PageIO {
+    std::function<bool(uint64_t page_id, char* data)> read_page;
+    std::function<void(uint64_t page_id, const char* data)> write_page;
+    // Optional batch versions for prefetch_pages and flush_all, one submission for the whole batch instead of one
+    // blocking call per page. Without them the single-page callbacks are called in a loop.
+    std::function<bool(const uint64_t* page_ids, char* const* data, size_t n)> read_pages;
+    std::function<void(const uint64_t* page_ids, const char* const* data, size_t n)> write_pages;
+};
+
+struct BufferPool {
+    static constexpr uint32_t EXCLUSIVE = UINT32_MAX;
+    static constexpr uint32_t NO_FRAME = UINT32_MAX;
+    // map_new_frame lost to another thread loading the same page.
+    static constexpr uint32_t RACED = UINT32_MAX - 1;
+    // Pages per read_pages / write_pages call.
+    static constexpr size_t IO_BATCH = 64;
+    static constexpr uint64_t NO_PAGE = UINT64_MAX;
+    // Unpinned frames looked at per eviction.
+    static constexpr uint32_t EVICTION_SAMPLE = 8;
+
+    struct Frame {
+        std::atomic<uint64_t> page_id;
+        std::atomic<uint32_t> pins;
+        std::atomic<uint32_t> dirty;
+        // Clock values of the last two accesses, 0 = none.
+        std::atomic<uint32_t> last_access;
+        std::atomic<uint32_t> prev_access;
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Stripe {
+        SpinLock lock;
+        std::unordered_map<uint64_t, uint32_t> pages;
+    };
+
+    ArenaLockFreeHint arena;
+    PageIO io;
+    size_t num_frames;
+    std::unique_ptr<Frame[]> frames;
+    std::unique_ptr<Stripe[]> stripes;
+    size_t stripe_mask;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> access_clock;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> clock_hand;
+
+    ShardedCounter hits;
+    ShardedCounter misses;
+    std::atomic<uint64_t> evictions;
+    std::atomic<uint64_t> writebacks;
+    // Loads whose read failed, a failed batch counts once.
+    std::atomic<uint64_t> read_failures;
+
+    /// num_frames is rounded up like any arena's slot count. num_stripes 0 picks 4 per hardware thread.
+    BufferPool(size_t num_frames, size_t page_size, PageIO io = PageIO(), size_t num_stripes = 0,
+               const ArenaOptions& options = ArenaOptions());
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    char* fetch_page(uint64_t page_id);
+    size_t prefetch_pages(const uint64_t* page_ids, size_t n);
+    int unpin_page(char* data, bool dirty);
+    bool flush_page(uint64_t page_id);
+    void flush_all();
+    size_t resident_pages() const;
+
+    Stripe& stripe_of(uint64_t page_id) const {
+        // Fibonacci hashing, page ids tend to be sequential.
+        return stripes[((page_id * 0x9E3779B97F4A7C15ULL) >> 32) & stripe_mask];
+    }
+    char* frame_data(uint32_t frame_idx) const {
+        return arena.base + arena.slot_offset(frame_idx);
+    }
+    uint32_t frame_of(const char* data) const;
+    static bool try_pin(Frame& frame);
+    void record_access(Frame& frame);
+    uint32_t acquire_frame();
+    uint32_t map_new_frame(uint64_t page_id);
+    bool load_frames(const uint64_t* page_ids, const uint32_t* frame_idxs, size_t n);
+    void unmap_frame(uint64_t page_id, uint32_t frame_idx);
+    void publish_frame(uint32_t frame_idx, uint32_t pins);
+    uint32_t pick_victim();
+    void write_back(uint32_t frame_idx);
+    void release_frame(uint32_t frame_idx);
+};
+
+inline BufferPool::BufferPool(size_t num_frames, size_t page_size, PageIO io, size_t num_stripes,
+                              const ArenaOptions& options)
+    : arena(num_frames * page_size, page_size, options), io(std::move(io)), access_clock(1), clock_hand(0),
+      evictions(0), writebacks(0), read_failures(0) {
+    this->num_frames = arena.bitmap->num_slots;
+    frames = std::make_unique<Frame[]>(this->num_frames);
+    for (size_t i = 0; i < this->num_frames; ++i) {
+        frames[i].page_id.store(NO_PAGE, std::memory_order_relaxed);
+        frames[i].pins.store(EXCLUSIVE, std::memory_order_relaxed); // free, owned by the arena
+    }
+    if (num_stripes == 0) {
+        num_stripes = 4 * std::max(1u, std::thread::hardware_concurrency());
+    }
+    num_stripes = std::bit_ceil(num_stripes);
+    stripe_mask = num_stripes - 1;
+    stripes = std::make_unique<Stripe[]>(num_stripes);
+}
+
+inline BufferPool::~BufferPool() {
+    flush_all();
+}
+
+/// Frame index of a pointer fetch_page returned, NO_FRAME for anything else.
+inline uint32_t BufferPool::frame_of(const char* data) const {
+    if (data < arena.base || data >= arena.base + arena.capacity) {
+        return NO_FRAME;
+    }
+    size_t offset = static_cast<size_t>(data - arena.base);
+    if (!arena.is_slot_aligned(offset)) {
+        return NO_FRAME;
+    }
+    return static_cast<uint32_t>(arena.slot_index_of_offset(offset));
+}
+
+/// One more pin unless the frame is exclusively held.
+inline bool BufferPool::try_pin(Frame& frame) {
+    uint32_t pins = frame.pins.load(std::memory_order_relaxed);
+    while (pins != EXCLUSIVE) {
+        if (frame.pins.compare_exchange_weak(pins, pins + 1, std::memory_order_acquire)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// LRU-2 history. At most one update per clock tick, and the second access of a freshly loaded page always counts.
+inline void BufferPool::record_access(Frame& frame) {
+    uint32_t now = access_clock.load(std::memory_order_relaxed);
+    uint32_t last = frame.last_access.load(std::memory_order_relaxed);
+    if (last != now || frame.prev_access.load(std::memory_order_relaxed) == 0) {
+        frame.prev_access.store(last, std::memory_order_relaxed);
+        frame.last_access.store(now, std::memory_order_relaxed);
+    }
+}
+
+/// Pinned pointer to the page, loaded through io.read_page on a miss. NULL when every frame is pinned or the read
+/// failed. Every successful fetch needs an unpin_page.
+inline char* BufferPool::fetch_page(uint64_t page_id) {
+    Stripe& stripe = stripe_of(page_id);
+    for (;;) {
+        uint32_t frame_idx = NO_FRAME;
+        bool pinned = false;
+        {
+            std::lock_guard<SpinLock> lock(stripe.lock);
+            auto it = stripe.pages.find(page_id);
+            if (it != stripe.pages.end()) {
+                frame_idx = it->second;
+                pinned = try_pin(frames[frame_idx]);
+            }
+        }
+        if (frame_idx != NO_FRAME) {
+            if (pinned) {
+                record_access(frames[frame_idx]);
+                hits.add(1);
+                return frame_data(frame_idx);
+            }
+            // Being loaded or evicted right now, either way it's a matter of one I/O.
+            std::this_thread::yield();
+            continue;
+        }
+
+        frame_idx = map_new_frame(page_id);
+        if (frame_idx == NO_FRAME) {
+            return NULL;
+        }
+        if (frame_idx == RACED) {
+            continue; // somebody else loaded it while we were finding a frame, use theirs
+        }
+        misses.add(1);
+        if (!load_frames(&page_id, &frame_idx, 1)) {
+            unmap_frame(page_id, frame_idx);
+            return NULL;
+        }
+        publish_frame(frame_idx, 1);
+        return frame_data(frame_idx);
+    }
+}
+
+/// Readahead: loads the pages that aren't resident yet with as few read_pages calls as possible and leaves them
+/// unpinned. Returns how many pages it loaded, fewer than asked when frames run out or reads fail. A failed batch read
+/// drops the whole batch, it's only readahead.
+inline size_t BufferPool::prefetch_pages(const uint64_t* page_ids, size_t n) {
+    uint64_t batch_ids[IO_BATCH];
+    uint32_t batch_frames[IO_BATCH];
+    size_t batched = 0;
+    size_t loaded = 0;
+    auto load_batch = [&]() {
+        bool ok = load_frames(batch_ids, batch_frames, batched);
+        for (size_t i = 0; i < batched; ++i) {
+            if (ok) {
+                publish_frame(batch_frames[i], 0);
+            } else {
+                unmap_frame(batch_ids[i], batch_frames[i]);
+            }
+        }
+        loaded += ok ? batched : 0;
+        batched = 0;
+    };
+
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t frame_idx = map_new_frame(page_ids[i]);
+        if (frame_idx == NO_FRAME) {
+            break;
+        }
+        if (frame_idx == RACED) {
+            continue; // resident already
+        }
+        misses.add(1);
+        batch_ids[batched] = page_ids[i];
+        batch_frames[batched] = frame_idx;
+        if (++batched == IO_BATCH) {
+            load_batch();
+        }
+    }
+    if (batched != 0) {
+        load_batch();
+    }
+    return loaded;
+}
+
+/// A frame mapped to page_id and still EXCLUSIVE, for the caller to load. NO_FRAME when every frame is pinned, RACED
+/// when the page is (or just became) resident.
+inline uint32_t BufferPool::map_new_frame(uint64_t page_id) {
+    Stripe& stripe = stripe_of(page_id);
+    {
+        std::lock_guard<SpinLock> lock(stripe.lock);
+        if (stripe.pages.count(page_id) != 0) {
+            return RACED;
+        }
+    }
+    uint32_t frame_idx = acquire_frame();
+    if (frame_idx == NO_FRAME) {
+        return NO_FRAME;
+    }
+    bool raced = false;
+    {
+        std::lock_guard<SpinLock> lock(stripe.lock);
+        raced = !stripe.pages.emplace(page_id, frame_idx).second;
+        if (!raced) {
+            frames[frame_idx].page_id.store(page_id, std::memory_order_relaxed);
+        }
+    }
+    if (raced) {
+        release_frame(frame_idx);
+        return RACED;
+    }
+    return frame_idx;
+}
+
+/// Reads the pages into their frames, false if any read failed.
+inline bool BufferPool::load_frames(const uint64_t* page_ids, const uint32_t* frame_idxs, size_t n) {
+    bool ok = true;
+    if (n > 1 && io.read_pages) {
+        char* data[IO_BATCH];
+        for (size_t i = 0; i < n; ++i) {
+            data[i] = frame_data(frame_idxs[i]);
+        }
+        ok = io.read_pages(page_ids, data, n);
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            char* data = frame_data(frame_idxs[i]);
+            if (io.read_page) {
+                ok &= io.read_page(page_ids[i], data);
+            } else {
+                std::memset(data, 0, arena.slot_size);
+            }
+        }
+    }
+    if (!ok) {
+        read_failures.fetch_add(1, std::memory_order_relaxed);
+    }
+    return ok;
+}
+
+/// Undoes map_new_frame for a load that failed: the page table entry goes and the frame, never published, goes back
+/// to the arena. Anybody who found the entry meanwhile saw EXCLUSIVE and retries, and then tries the read itself.
+inline void BufferPool::unmap_frame(uint64_t page_id, uint32_t frame_idx) {
+    {
+        Stripe& stripe = stripe_of(page_id);
+        std::lock_guard<SpinLock> lock(stripe.lock);
+        stripe.pages.erase(page_id);
+    }
+    release_frame(frame_idx);
+}
+
+/// Makes a freshly loaded frame visible with `pins` pins, as a first access in LRU-2 terms.
+inline void BufferPool::publish_frame(uint32_t frame_idx, uint32_t pins) {
+    Frame& frame = frames[frame_idx];
+    frame.dirty.store(0, std::memory_order_relaxed);
+    frame.prev_access.store(0, std::memory_order_relaxed);
+    frame.last_access.store(access_clock.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    frame.pins.store(pins, std::memory_order_release);
+}
+
+/// Drops one pin, dirty marks the page for write back. -1 for pointers that aren't frames, 1 if the frame wasn't
+/// pinned, 0 otherwise.
+inline int BufferPool::unpin_page(char* data, bool dirty) {
+    uint32_t frame_idx = frame_of(data);
+    if (frame_idx == NO_FRAME) {
+        return -1;
+    }
+    Frame& frame = frames[frame_idx];
+    // The dirty bit goes first so it's set before the pin that protects the frame goes. An unpin that then turns out
+    // to be one too many leaves the bit set, which costs a write back at worst.
+    if (dirty && frame.dirty.load(std::memory_order_relaxed) == 0) {
+        frame.dirty.store(1, std::memory_order_relaxed);
+    }
+    // A CAS, not a check and a fetch_sub: two racing extra unpins would both pass the check and take 0 round to
+    // EXCLUSIVE, and nothing would ever get the frame back. Release so the evictor's acquire CAS sees both the page
+    // writes and the dirty bit.
+    uint32_t pins = frame.pins.load(std::memory_order_relaxed);
+    do {
+        if (pins == 0 || pins == EXCLUSIVE) {
+            return 1;
+        }
+    } while (!frame.pins.compare_exchange_weak(pins, pins - 1, std::memory_order_release, std::memory_order_relaxed));
+    return 0;
+}
+
+/// A free frame from the arena if there is one, otherwise an evicted one. Comes back EXCLUSIVE and unmapped.
+inline uint32_t BufferPool::acquire_frame() {
+    char* fresh = arena.allocate(arena.slot_size);
+    if (fresh != NULL) {
+        return frame_of(fresh);
+    }
+    // Every frame pinned is the only way out of here, give up after the hand went around twice.
+    for (size_t attempt = 0; attempt < 2 * num_frames / EVICTION_SAMPLE + 1; ++attempt) {
+        uint32_t victim = pick_victim();
+        if (victim == NO_FRAME) {
+            continue;
+        }
+        uint32_t expected = 0;
+        Frame& frame = frames[victim];
+        if (!frame.pins.compare_exchange_strong(expected, EXCLUSIVE, std::memory_order_acquire)) {
+            continue; // pinned since we looked
+        }
+        uint64_t old_page = frame.page_id.load(std::memory_order_relaxed);
+        write_back(victim);
+        {
+            Stripe& stripe = stripe_of(old_page);
+            std::lock_guard<SpinLock> lock(stripe.lock);
+            stripe.pages.erase(old_page);
+        }
+        frame.page_id.store(NO_PAGE, std::memory_order_relaxed);
+        evictions.fetch_add(1, std::memory_order_relaxed);
+        access_clock.fetch_add(1, std::memory_order_relaxed);
+        return victim;
+    }
+    return NO_FRAME;
+}
+
+/// Best of EVICTION_SAMPLE frames from the clock hand: oldest second-to-last access, then oldest last access.
+inline uint32_t BufferPool::pick_victim() {
+    uint64_t start = clock_hand.fetch_add(EVICTION_SAMPLE, std::memory_order_relaxed);
+    uint32_t best = NO_FRAME;
+    uint32_t best_prev = UINT32_MAX;
+    uint32_t best_last = UINT32_MAX;
+    for (uint32_t i = 0; i < EVICTION_SAMPLE; ++i) {
+        // Scattered, loads tend to fill neighbouring frames and a window of neighbours is likely all the same age.
+        uint32_t frame_idx = static_cast<uint32_t>((((start + i) * 0x9E3779B97F4A7C15ULL) >> 32) % num_frames);
+        Frame& frame = frames[frame_idx];
+        if (frame.pins.load(std::memory_order_relaxed) != 0) {
+            continue;
+        }
+        uint32_t prev = frame.prev_access.load(std::memory_order_relaxed);
+        uint32_t last = frame.last_access.load(std::memory_order_relaxed);
+        if (prev < best_prev || (prev == best_prev && last < best_last)) {
+            best = frame_idx;
+            best_prev = prev;
+            best_last = last;
+        }
+    }
+    return best;
+}
+
+/// Caller holds the frame pinned or exclusively.
+inline void BufferPool::write_back(uint32_t frame_idx) {
+    Frame& frame = frames[frame_idx];
+    if (frame.dirty.exchange(0, std::memory_order_acq_rel) == 0) {
+        return;
+    }
+    if (io.write_page) {
+        io.write_page(frame.page_id.load(std::memory_order_relaxed), frame_data(frame_idx));
+    }
+    writebacks.fetch_add(1, std::memory_order_relaxed);
+}
+
+/// Back to the arena, still EXCLUSIVE so the evictor never picks it.
+inline void BufferPool::release_frame(uint32_t frame_idx) {
+    frames[frame_idx].page_id.store(NO_PAGE, std::memory_order_relaxed);
+    arena.free(frame_data(frame_idx), arena.slot_size);
+}
+
+/// Writes the page back if it is resident and dirty, false if it isn't resident.
+inline bool BufferPool::flush_page(uint64_t page_id) {
+    Stripe& stripe = stripe_of(page_id);
+    uint32_t frame_idx = NO_FRAME;
+    {
+        std::lock_guard<SpinLock> lock(stripe.lock);
+        auto it = stripe.pages.find(page_id);
+        if (it == stripe.pages.end() || !try_pin(frames[it->second])) {
+            return false;
+        }
+        frame_idx = it->second;
+    }
+    write_back(frame_idx);
+    frames[frame_idx].pins.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+/// Writes back every dirty resident page, IO_BATCH pages per write_pages call when there is one. Frames that are being
+/// loaded or evicted are skipped.
+inline void BufferPool::flush_all() {
+    uint64_t batch_ids[IO_BATCH];
+    const char* batch_data[IO_BATCH];
+    uint32_t batch_frames[IO_BATCH];
+    size_t batched = 0;
+    auto write_batch = [&]() {
+        io.write_pages(batch_ids, batch_data, batched);
+        for (size_t i = 0; i < batched; ++i) {
+            frames[batch_frames[i]].pins.fetch_sub(1, std::memory_order_release);
+        }
+        writebacks.fetch_add(batched, std::memory_order_relaxed);
+        batched = 0;
+    };
+
+    for (size_t i = 0; i < num_frames; ++i) {
+        Frame& frame = frames[i];
+        if (frame.dirty.load(std::memory_order_relaxed) == 0 || !try_pin(frame)) {
+            continue;
+        }
+        uint32_t frame_idx = static_cast<uint32_t>(i);
+        if (!io.write_pages) {
+            write_back(frame_idx);
+            frame.pins.fetch_sub(1, std::memory_order_release);
+            continue;
+        }
+        if (frame.dirty.exchange(0, std::memory_order_acq_rel) == 0) {
+            frame.pins.fetch_sub(1, std::memory_order_release);
+            continue;
+        }
+        batch_ids[batched] = frame.page_id.load(std::memory_order_relaxed);
+        batch_data[batched] = frame_data(frame_idx);
+        batch_frames[batched] = frame_idx;
+        if (++batched == IO_BATCH) {
+            write_batch();
+        }
+    }
+    if (batched != 0) {
+        write_batch();
+    }
+}
+
+inline size_t BufferPool::resident_pages() const {
+    size_t total = 0;
+    for (size_t i = 0; i <= stripe_mask; ++i) {
+        std::lock_guard<SpinLock> lock(stripes[i].lock);
+        total += stripes[i].pages.size();
+    }
+    return total;
+}
+
+#endif // BUFFER_POOL_H
@@ -0,0 +1,112 @@
+#ifndef CAS_CONTENTION_H
+#define CAS_CONTENTION_H
+
+// Contention handling for the lock-free bitmaps' single-slot path (claim_one_lock_free in bitmap.h) and the retry
+// histogram it reports into.
+//
+// A single-slot claim is a fetch_and clearing one bit, not a CAS on the whole word. A CAS fails whenever anything in
+// the word changed since we loaded it, a neighbour's allocate or free included. fetch_and only loses when another
+// thread took that same bit, and clearing a bit that's already clear changes nothing, so there is nothing to undo.
+// Collisions that do happen escalate, counted per call:
+//   - 1st collision: leave the word for the thread's home word (picked at random once per thread), and from now
+//     on pick a random free bit of a word instead of the highest, so threads that meet on a word stop picking the
+//     same bit.
+//   - later collisions: a random word each time.
+//   - from BACKOFF_AFTER on: spin 2^n cpu_relax() before the next attempt, n capped at MAX_BACKOFF_SHIFT.
+// Every failed attempt still means some other thread got a slot, so this stays lock-free, it just stops a group of
+// threads from hammering the same line in lockstep.
+
+#include "word_layout.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/// One spin-wait hint to the core, lets the sibling hyperthread run and saves power while we wait.
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+struct CasContention {
+    static constexpr uint32_t BACKOFF_AFTER = 4;
+    static constexpr uint32_t MAX_BACKOFF_SHIFT = 8;
+
+    /// Per-thread xorshift64, good enough to scatter words and bits and costs no shared state.
+    static uint64_t next_random();
+    /// Where the calling thread goes after its first collision, a fixed word per thread.
+    static size_t home_word(size_t num_words);
+    /// Word to jump to after `collisions` collisions in one call.
+    static size_t jump_target(uint32_t collisions, size_t num_words) {
+        return collisions <= 1 ? home_word(num_words) : static_cast<size_t>(next_random() % num_words);
+    }
+    /// A random set bit of word (non-zero): the first one at or above a random position, wrapping to the lowest.
+    static uint32_t random_set_bit(uint64_t word) {
+        uint64_t above = word & (~0ULL << (next_random() & 63));
+        return static_cast<uint32_t>(std::countr_zero(above != 0 ? above : word));
+    }
+    static void backoff(uint32_t collisions) {
+        if (collisions < BACKOFF_AFTER) {
+            return;
+        }
+        uint32_t shift = std::min(collisions - BACKOFF_AFTER, MAX_BACKOFF_SHIFT);
+        for (uint32_t i = 0; i < (1u << shift); ++i) {
+            cpu_relax();
+        }
+    }
+};
+
+inline uint64_t CasContention::next_random() {
+    // Seeded from the address of the thread_local itself, distinct per thread without touching any shared counter.
+    thread_local uint64_t state = reinterpret_cast<uintptr_t>(&state) * 0x9E3779B97F4A7C15ULL | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+inline size_t CasContention::home_word(size_t num_words) {
+    thread_local uint64_t home = next_random();
+    return static_cast<size_t>(home % num_words);
+}
+
+// How many retries the calls that needed any took, in power of two buckets: bucket i counts calls with
+// [2^i, 2^(i+1)) retries, the last one everything from 2^(NUM_BUCKETS-1) up. Calls that got through first time aren't
+// recorded here, that would put a shared increment on the fast path, so the histogram only costs anything when there
+// was contention anyway.
+struct CasRetryHistogram {
+    static constexpr size_t NUM_BUCKETS = 8;
+
+    alignas(CACHE_LINE_SIZE) std::array<std::atomic<uint64_t>, NUM_BUCKETS> buckets{};
+
+    void record(uint32_t retries) {
+        if (retries == 0) {
+            return;
+        }
+        size_t bucket = std::min<size_t>(std::bit_width(retries) - 1, NUM_BUCKETS - 1);
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+    std::array<uint64_t, NUM_BUCKETS> snapshot() const {
+        std::array<uint64_t, NUM_BUCKETS> counts;
+        for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+            counts[i] = buckets[i].load(std::memory_order_relaxed);
+        }
+        return counts;
+    }
+    /// Smallest retry count bucket i holds.
+    static uint64_t bucket_floor(size_t bucket) {
+        return 1ULL << bucket;
+    }
+};
+
+#endif // CAS_CONTENTION_H
@@ -0,0 +1,281 @@
+#ifndef EPOCH_RECLAIM_H
+#define EPOCH_RECLAIM_H
+
+// Epoch based deferred free for arenas with latch-free readers.
+//
+// arena.free() puts a slot straight back into the bitmap, so a reader that is still looking at the page through a
+// pointer it loaded a moment ago may be reading somebody else's data the next instant. The usual way out is a latch
+// per page, which puts an atomic RMW (two, with the release) on every read. EpochArena is the other way out, the one
+// from Fraser's thesis that crossbeam-epoch uses too:
+//
+//   - readers pin() before they load a page pointer and unpin() when they're done with the page. A pin is one store of
+//     the global epoch into the thread's own record plus a fence, nothing shared gets written.
+//   - writers unlink the page (take it out of whatever readers find it through) and retire() it instead of freeing.
+//     The slot goes on the thread's retire list, tagged with the global epoch.
+//   - the global epoch only moves on from E once every pinned thread has seen E. A reader pinned at E' can only hold
+//     pages retired at E' or later, so once the epoch is two past a page's tag no pin that could still see it is left,
+//     and the slot goes back to the arena with the rest of the batch, via free_batch.
+//
+// Every thread that pins or retires needs its own Participant (one of max_threads records, claimed in the constructor,
+// given back in the destructor). Participants batch: a retire list is only looked at every RETIRE_BATCH retires, or
+// when allocate() would fail otherwise. A thread that leaves with slots still too young hands them to the EpochArena,
+// where the next collect() picks them up. Slots waiting on a retire list still count as in use for the arena.
+//
+// A thread that stays pinned holds up reclamation for everybody (that's the price), so pin around one page visit, not
+// around a whole transaction. Any BasicArena works, it's meant for the lock-free ones, where the bitmap itself has no
+// lock a reader could have used instead.
+
+#include "word_layout.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+template <typename ArenaT>
+struct EpochArena {
+    static constexpr size_t DEFAULT_MAX_THREADS = 128;
+    // Retires between two attempts at reclaiming.
+    static constexpr size_t RETIRE_BATCH = 64;
+    // Epochs go up in twos so the low bit of a record can say "pinned".
+    static constexpr uint64_t PINNED = 1;
+    static constexpr uint64_t EPOCH_STEP = 2;
+
+    struct Retired {
+        char* ptr;
+        size_t size;
+        uint64_t epoch;
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Record {
+        // epoch | PINNED while the owner is pinned, 0 otherwise.
+        std::atomic<uint64_t> epoch{0};
+        std::atomic<bool> claimed{false};
+    };
+
+    struct Participant;
+
+    ArenaT* arena;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> global_epoch{EPOCH_STEP};
+    size_t num_records;
+    std::unique_ptr<Record[]> records;
+    // Left behind by participants that went away, oldest first.
+    std::mutex orphans_lock;
+    std::vector<Retired> orphans;
+    std::atomic<size_t> num_orphans{0};
+
+    /// The arena is borrowed and has to outlive this. max_threads is how many Participants can exist at once.
+    explicit EpochArena(ArenaT* arena, size_t max_threads = DEFAULT_MAX_THREADS);
+    /// Frees whatever is still deferred. Every Participant has to be gone (and nobody reading) by then.
+    ~EpochArena();
+    EpochArena(const EpochArena&) = delete;
+    EpochArena& operator=(const EpochArena&) = delete;
+
+    bool try_advance();
+    bool is_safe(uint64_t retired_epoch) const;
+    size_t collect_orphans();
+    size_t release(Retired* begin, Retired* end);
+};
+
+// One thread's view of an EpochArena. Owned by exactly one thread, like a SlotCache, and has to go before the
+// EpochArena does.
+template <typename ArenaT>
+struct EpochArena<ArenaT>::Participant {
+    EpochArena* domain;
+    Record* record;
+    uint32_t pin_depth;
+    std::vector<Retired> retired;
+    uint64_t reclaimed; // slots this participant has given back to the arena so far
+
+    /// Throws std::runtime_error when all max_threads records are taken.
+    explicit Participant(EpochArena& domain);
+    ~Participant();
+    Participant(const Participant&) = delete;
+    Participant& operator=(const Participant&) = delete;
+
+    void pin();
+    void unpin();
+    char* allocate(size_t size);
+    void retire(char* ptr, size_t size);
+    size_t collect();
+};
+
+// pin() for a scope.
+template <typename ArenaT>
+struct EpochGuard {
+    typename EpochArena<ArenaT>::Participant& participant;
+
+    explicit EpochGuard(typename EpochArena<ArenaT>::Participant& participant) : participant(participant) {
+        participant.pin();
+    }
+    ~EpochGuard() {
+        participant.unpin();
+    }
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+template <typename ArenaT>
+EpochArena<ArenaT>::EpochArena(ArenaT* arena, size_t max_threads)
+    : arena(arena), num_records(std::max<size_t>(1, max_threads)), records(new Record[num_records]) {
+}
+
+template <typename ArenaT>
+EpochArena<ArenaT>::~EpochArena() {
+    release(orphans.data(), orphans.data() + orphans.size());
+}
+
+/// Moves the global epoch on if every pinned record has seen the current one. true if it moved, by us or somebody
+/// else in the meantime.
+template <typename ArenaT>
+bool EpochArena<ArenaT>::try_advance() {
+    uint64_t epoch = global_epoch.load(std::memory_order_relaxed);
+    // Pairs with the fence in pin(): either we see the pin, or the pinned thread sees what was unlinked before now.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (size_t i = 0; i < num_records; ++i) {
+        uint64_t seen = records[i].epoch.load(std::memory_order_relaxed);
+        if ((seen & PINNED) != 0 && (seen & ~PINNED) != epoch) {
+            return false;
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return global_epoch.compare_exchange_strong(epoch, epoch + EPOCH_STEP, std::memory_order_release,
+                                                std::memory_order_relaxed) ||
+           epoch != global_epoch.load(std::memory_order_relaxed);
+}
+
+template <typename ArenaT>
+inline bool EpochArena<ArenaT>::is_safe(uint64_t retired_epoch) const {
+    return global_epoch.load(std::memory_order_acquire) >= retired_epoch + 2 * EPOCH_STEP;
+}
+
+/// Gives [begin, end) back to the arena: single slots sorted by address and freed in one free_batch, so slots that
+/// share a bitmap word go back together, runs one by one. Returns the slots freed.
+template <typename ArenaT>
+size_t EpochArena<ArenaT>::release(Retired* begin, Retired* end) {
+    std::vector<char*> singles;
+    size_t slots = 0;
+    for (Retired* r = begin; r != end; ++r) {
+        if (r->size <= arena->slot_size) {
+            singles.push_back(r->ptr);
+            slots++;
+        } else {
+            arena->free(r->ptr, r->size);
+            slots += (r->size + arena->slot_size - 1) / arena->slot_size;
+        }
+    }
+    std::sort(singles.begin(), singles.end());
+    arena->free_batch(singles.data(), singles.size());
+    return slots;
+}
+
+/// Frees the orphans that are old enough, if nobody else is at it already.
+template <typename ArenaT>
+size_t EpochArena<ArenaT>::collect_orphans() {
+    if (num_orphans.load(std::memory_order_relaxed) == 0) {
+        return 0;
+    }
+    std::unique_lock<std::mutex> lock(orphans_lock, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return 0;
+    }
+    // Retired in epoch order per participant, but orphans from several of them interleave, so no prefix trick here.
+    auto young =
+        std::stable_partition(orphans.begin(), orphans.end(), [this](const Retired& r) { return is_safe(r.epoch); });
+    size_t freed = release(orphans.data(), orphans.data() + (young - orphans.begin()));
+    orphans.erase(orphans.begin(), young);
+    num_orphans.store(orphans.size(), std::memory_order_relaxed);
+    return freed;
+}
+
+template <typename ArenaT>
+EpochArena<ArenaT>::Participant::Participant(EpochArena& domain)
+    : domain(&domain), record(NULL), pin_depth(0), reclaimed(0) {
+    for (size_t i = 0; i < domain.num_records && record == NULL; ++i) {
+        bool expected = false;
+        if (domain.records[i].claimed.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            record = &domain.records[i];
+        }
+    }
+    if (record == NULL) {
+        throw std::runtime_error("EpochArena: more participants than max_threads");
+    }
+    retired.reserve(RETIRE_BATCH);
+}
+
+/// Frees what it can, orphans the rest and gives the record back.
+template <typename ArenaT>
+EpochArena<ArenaT>::Participant::~Participant() {
+    record->epoch.store(0, std::memory_order_release);
+    collect();
+    if (!retired.empty()) {
+        std::lock_guard<std::mutex> lock(domain->orphans_lock);
+        domain->orphans.insert(domain->orphans.end(), retired.begin(), retired.end());
+        domain->num_orphans.store(domain->orphans.size(), std::memory_order_relaxed);
+    }
+    record->claimed.store(false, std::memory_order_release);
+}
+
+/// Nests, only the outermost pin/unpin pair does anything.
+template <typename ArenaT>
+inline void EpochArena<ArenaT>::Participant::pin() {
+    if (pin_depth++ != 0) {
+        return;
+    }
+    record->epoch.store(domain->global_epoch.load(std::memory_order_relaxed) | PINNED, std::memory_order_relaxed);
+    // The pin has to be visible before any page pointer is loaded, that's the one fence on the read side.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+template <typename ArenaT>
+inline void EpochArena<ArenaT>::Participant::unpin() {
+    if (--pin_depth == 0) {
+        record->epoch.store(0, std::memory_order_release);
+    }
+}
+
+/// arena->allocate, and if the arena is full, collect() and try again once.
+template <typename ArenaT>
+inline char* EpochArena<ArenaT>::Participant::allocate(size_t size) {
+    char* ptr = domain->arena->allocate(size);
+    if (ptr == NULL && collect() != 0) {
+        ptr = domain->arena->allocate(size);
+    }
+    return ptr;
+}
+
+/// Deferred arena->free(ptr, size). ptr must already be unreachable for readers that pin from now on. Same argument
+/// checks as free() happen when the slot is finally released.
+template <typename ArenaT>
+inline void EpochArena<ArenaT>::Participant::retire(char* ptr, size_t size) {
+    if (ptr == NULL || size == 0) {
+        return;
+    }
+    retired.push_back(Retired{ptr, size, domain->global_epoch.load(std::memory_order_acquire)});
+    if (retired.size() % RETIRE_BATCH == 0) {
+        collect();
+    }
+}
+
+/// Tries to move the epoch on (twice, which is what it takes for the newest retire to become safe when nobody else is
+/// pinned) and frees the retired slots that are old enough, orphans included. Returns the slots freed.
+template <typename ArenaT>
+size_t EpochArena<ArenaT>::Participant::collect() {
+    if (domain->try_advance()) {
+        domain->try_advance();
+    }
+    // Ours are in epoch order, the safe ones are a prefix.
+    auto young = std::find_if(retired.begin(), retired.end(),
+                              [this](const Retired& r) { return !domain->is_safe(r.epoch); });
+    size_t freed = domain->release(retired.data(), retired.data() + (young - retired.begin()));
+    retired.erase(retired.begin(), young);
+    freed += domain->collect_orphans();
+    reclaimed += freed;
+    return freed;
+}
+
+#endif // EPOCH_RECLAIM_H
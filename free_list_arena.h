@@ -0,0 +1,193 @@
+#ifndef FREE_LIST_ARENA_H
+#define FREE_LIST_ARENA_H
+
+// Bitmap-free arena for single-slot workloads: an intrusive lock-free free list (a Treiber stack).
+//
+// Even with the hint, a bitmap allocation finds a word with a free bit, picks a bit and claims it, and a free sets it
+// again. When every allocation is exactly one slot none of that searching is needed: a free slot is free because it's
+// on the list, and it stores the index of the next free slot in its own first four bytes. allocate pops the head,
+// free pushes onto it, both one CAS on one 64-bit word, O(1) however full the arena is.
+//
+// The head is the index of the top slot in the low 32 bits and a tag in the high 32 that every pop and push bumps.
+// Without the tag a pop could read `next` off the top slot A, lose the CPU while others pop A, pop B and push A back,
+// and then still succeed with its stale `next` (B, which is out on loan) because the head is A again. With the tag the
+// head isn't the same value any more and the CAS fails. 2^32 operations have to happen between a pop's load and its
+// CAS for the tag to come round again, which doesn't.
+//
+// That pop reads `next` out of a slot that another thread may have just popped and be writing to. The value is thrown
+// away with the failed CAS, and the memory is never unmapped while the arena lives, so that read is harmless, but it
+// is what a race detector will point at. (It's the usual Treiber stack caveat, the bitmap arenas don't have it.)
+//
+// Slots that were never handed out aren't on the list, they're behind `frontier`, which the allocations walk through
+// once while the arena fills up. That way building the arena doesn't have to write a link into every slot, which would
+// fault in every page of the mapping up front.
+//
+// A byte per slot says whether it's out, so double frees are caught (and counted) like the bitmaps catch them instead
+// of putting the slot on the list twice. Multi-slot allocations aren't supported, allocate() of more than one slot
+// returns NULL, and there's no batch, placement, reclaim or handle support either. That's what the bitmap arenas are
+// for.
+
+#include "arena_allocator.h"
+#include "cas_contention.h"
+#include "sharded_counter.h"
+#include "word_layout.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+struct ArenaFreeList {
+    static constexpr uint32_t NIL = UINT32_MAX;
+
+    size_t capacity;
+    char* base;
+    size_t slot_size;
+    uint32_t num_slots;
+    ArenaRegion region;
+    // (tag << 32) | index of the top free slot, NIL when the list is empty.
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head;
+    // Slots at and above this one have never been handed out.
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> frontier;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> cas_retries;
+    CasRetryHistogram retry_histogram;
+    // 1 while the slot is handed out.
+    std::unique_ptr<std::atomic<uint8_t>[]> allocated;
+    ShardedCounter slots_in_use;
+    ArenaStatsType stats;
+
+    /// Same capacity rounding as the bitmap arenas. Throws std::invalid_argument for slots too small to hold a link
+    /// (or not 4 byte aligned) and for more slots than 32-bit indices cover.
+    explicit ArenaFreeList(size_t capacity, size_t page_size, const ArenaOptions& options = ArenaOptions());
+    ~ArenaFreeList();
+    ArenaFreeList(const ArenaFreeList&) = delete;
+    ArenaFreeList& operator=(const ArenaFreeList&) = delete;
+
+    char* allocate(size_t size);
+    void free(char* ptr, size_t size);
+    ArenaStatsSnapshot stats_snapshot() const;
+
+    uint64_t get_cas_retries() const {
+        return cas_retries.load(std::memory_order_relaxed);
+    }
+    std::array<uint64_t, CasRetryHistogram::NUM_BUCKETS> get_cas_retry_histogram() const {
+        return retry_histogram.snapshot();
+    }
+
+    std::atomic_ref<uint32_t> link_of(uint32_t slot_idx) const {
+        return std::atomic_ref<uint32_t>(*reinterpret_cast<uint32_t*>(base + slot_idx * slot_size));
+    }
+    uint32_t pop();
+    void push(uint32_t slot_idx);
+};
+
+inline ArenaFreeList::ArenaFreeList(size_t capacity, size_t page_size, const ArenaOptions& options)
+    : head(NIL), frontier(0), cas_retries(0) {
+    if (page_size < sizeof(uint32_t) || page_size % alignof(uint32_t) != 0) {
+        throw std::invalid_argument("slots must hold a 4 byte aligned free list link");
+    }
+    size_t slots = arena_slot_count(capacity, page_size);
+    if (slots >= NIL) {
+        throw std::invalid_argument("too many slots for 32-bit free list indices");
+    }
+    this->region = arena_map_region(slots * page_size, options);
+    this->capacity = slots * page_size;
+    this->slot_size = page_size;
+    this->base = region.base;
+    this->num_slots = static_cast<uint32_t>(slots);
+    this->allocated = std::make_unique<std::atomic<uint8_t>[]>(slots);
+}
+
+inline ArenaFreeList::~ArenaFreeList() {
+    arena_unmap_region(region);
+}
+
+/// Top of the free list, or the next never used slot once the list is empty. NIL when there's neither.
+inline uint32_t ArenaFreeList::pop() {
+    uint64_t old_head = head.load(std::memory_order_acquire);
+    uint32_t top = NIL;
+    uint32_t retries = 0;
+    while (static_cast<uint32_t>(old_head) != NIL) {
+        top = static_cast<uint32_t>(old_head);
+        uint32_t next = link_of(top).load(std::memory_order_relaxed);
+        uint64_t new_head = (((old_head >> 32) + 1) << 32) | next;
+        if (head.compare_exchange_weak(old_head, new_head, std::memory_order_acquire, std::memory_order_acquire)) {
+            break;
+        }
+        top = NIL;
+        CasContention::backoff(++retries);
+    }
+    if (retries != 0) {
+        cas_retries.fetch_add(retries, std::memory_order_relaxed);
+        retry_histogram.record(retries);
+    }
+    if (top != NIL) {
+        return top;
+    }
+    // Checked first so a full arena doesn't keep pushing the frontier up.
+    if (frontier.load(std::memory_order_relaxed) >= num_slots) {
+        return NIL;
+    }
+    uint64_t fresh = frontier.fetch_add(1, std::memory_order_relaxed);
+    return fresh < num_slots ? static_cast<uint32_t>(fresh) : NIL;
+}
+
+inline void ArenaFreeList::push(uint32_t slot_idx) {
+    uint64_t old_head = head.load(std::memory_order_relaxed);
+    uint64_t new_head;
+    do {
+        link_of(slot_idx).store(static_cast<uint32_t>(old_head), std::memory_order_relaxed);
+        new_head = (((old_head >> 32) + 1) << 32) | slot_idx;
+    } while (!head.compare_exchange_weak(old_head, new_head, std::memory_order_release, std::memory_order_relaxed));
+}
+
+/// One slot, NULL when the arena is full or size doesn't fit in a slot.
+inline char* ArenaFreeList::allocate(size_t size) {
+    uint32_t slot_idx = size == 0 || size > slot_size ? NIL : pop();
+    if (slot_idx == NIL) {
+        stats.add_allocation(0, 0, 0, 1);
+        return NULL;
+    }
+    allocated[slot_idx].store(1, std::memory_order_relaxed);
+    slots_in_use.add(1);
+    stats.add_allocation(0, 1, 1, 0);
+    return base + slot_idx * slot_size;
+}
+
+/// Out of range, misaligned, bigger than a slot and double frees are ignored (and counted), same as BasicArena::free.
+inline void ArenaFreeList::free(char* ptr, size_t size) {
+    if (ptr == NULL || size == 0) {
+        return;
+    }
+    if (ptr < base || ptr >= base + capacity || size > slot_size) {
+        stats.add(ArenaCounter::InvalidFrees);
+        return;
+    }
+    size_t offset = static_cast<size_t>(ptr - base);
+    if (offset % slot_size != 0) {
+        stats.add(ArenaCounter::InvalidFrees);
+        return;
+    }
+    uint32_t slot_idx = static_cast<uint32_t>(offset / slot_size);
+    if (allocated[slot_idx].exchange(0, std::memory_order_relaxed) == 0) {
+        stats.add(ArenaCounter::DoubleFrees);
+        return;
+    }
+    push(slot_idx);
+    slots_in_use.sub(1);
+    stats.add_free(1, 1);
+}
+
+inline ArenaStatsSnapshot ArenaFreeList::stats_snapshot() const {
+    ArenaStatsSnapshot snapshot;
+    stats.snapshot(snapshot);
+    snapshot.slots_in_use = static_cast<uint64_t>(std::max<int64_t>(0, slots_in_use.load()));
+    snapshot.num_slots = num_slots;
+    snapshot.cas_retries = get_cas_retries();
+    return snapshot;
+}
+
+#endif // FREE_LIST_ARENA_H
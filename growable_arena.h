@@ -0,0 +1,204 @@
+#ifndef GROWABLE_ARENA_H
+#define GROWABLE_ARENA_H
+
+// An arena that starts small and grows segment by segment up to a maximum, instead of failing the moment its one
+// fixed region is full.
+//
+// The whole maximum is reserved as address space up front (arena_reserve_region, PROT_NONE and MAP_NORESERVE, so it
+// costs nothing but page table space once used) and cut into equal segments. Growing commits the next segment with
+// mprotect and puts a regular arena with its own bitmap on top of it (the borrowed-region BasicArena constructor).
+// Because the segments sit back to back in one reservation:
+//   - free() finds the owning segment with one subtraction and one division, no search.
+//   - Committed segments never move or go away, so allocators and freers on existing segments never wait for a grow.
+//     Growing takes grow_mutex, but that only serializes growers, and num_segments is published with release after
+//     the new segment is fully built.
+//   - With a grow_watermark, the allocation that takes the newest segment past that fill level grows ahead of need
+//     (try_lock, whoever loses the race just carries on), so bursts find a committed segment waiting instead of paying
+//     for the mprotect + bitmap setup inline.
+// A request has to fit in one segment, runs don't span segment boundaries.
+
+#include "arena_allocator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unistd.h>
+#include <vector>
+
+template <typename ArenaT = ArenaLockFreeHint>
+struct GrowableArena {
+    ArenaOptions options;
+    ArenaRegion reservation;
+    size_t slot_size;
+    size_t segment_bytes;
+    size_t max_segments;
+    // Fill level of the newest segment that triggers growing ahead, 0 means only grow when allocation fails.
+    double grow_watermark;
+    int64_t watermark_slots;
+
+    // max_segments entries, never resized. Entries below num_segments are immutable once published.
+    std::vector<std::unique_ptr<ArenaT>> segments;
+    std::atomic<size_t> num_segments;
+    // Segment allocation tries first, the last one that had room.
+    std::atomic<size_t> current_segment;
+    std::mutex grow_mutex;
+
+    /// Reserves max_capacity, commits the first segment right away. segment_capacity is rounded up to whole bitmap
+    /// words of slots and whole (huge) pages.
+    GrowableArena(size_t max_capacity, size_t segment_capacity, size_t page_size, double grow_watermark = 0.0,
+                  const ArenaOptions& options = ArenaOptions());
+    ~GrowableArena();
+    GrowableArena(const GrowableArena&) = delete;
+    GrowableArena& operator=(const GrowableArena&) = delete;
+
+    char* allocate(size_t size);
+    void free(char* ptr, size_t size);
+    ArenaT* segment_of(char* ptr) const;
+    bool grow();
+    size_t committed_bytes() const {
+        return num_segments.load(std::memory_order_acquire) * segment_bytes;
+    }
+    int64_t total_slots_in_use() const;
+
+    bool grow_locked(size_t expected_segments);
+    bool past_watermark(const ArenaT* segment) const;
+};
+
+template <typename ArenaT>
+GrowableArena<ArenaT>::GrowableArena(size_t max_capacity, size_t segment_capacity, size_t page_size,
+                                     double grow_watermark, const ArenaOptions& options)
+    : options(options), slot_size(page_size), grow_watermark(grow_watermark), num_segments(0), current_segment(0) {
+    if (page_size == 0) {
+        throw std::invalid_argument("page_size must be non-zero");
+    }
+    if (grow_watermark < 0.0 || grow_watermark > 1.0) {
+        throw std::invalid_argument("grow_watermark must be within [0, 1]");
+    }
+    // mprotect works in system pages, and THP needs 2 MB aligned segments to use huge pages at all.
+    size_t granule = options.pages == PageBacking::Default ? static_cast<size_t>(sysconf(_SC_PAGESIZE)) : 2ULL << 20;
+    size_t slot_bytes = arena_slot_count(segment_capacity, page_size) * page_size;
+    segment_bytes = (slot_bytes + granule - 1) / granule * granule;
+    max_segments = std::max<size_t>(1, (max_capacity + segment_bytes - 1) / segment_bytes);
+    watermark_slots = static_cast<int64_t>(grow_watermark * static_cast<double>(slot_bytes / page_size));
+
+    reservation = arena_reserve_region(max_segments * segment_bytes, options);
+    segments.resize(max_segments);
+    if (!grow_locked(0)) {
+        arena_unmap_region(reservation);
+        throw std::runtime_error("committing the first segment failed");
+    }
+}
+
+template <typename ArenaT>
+GrowableArena<ArenaT>::~GrowableArena() {
+    // The segments only borrow the reservation, they have to go first.
+    segments.clear();
+    arena_unmap_region(reservation);
+}
+
+/// Commits segment number expected_segments, false if it exists already (somebody else grew), at the maximum or the
+/// mprotect failed. Caller holds grow_mutex.
+template <typename ArenaT>
+bool GrowableArena<ArenaT>::grow_locked(size_t expected_segments) {
+    size_t n = num_segments.load(std::memory_order_relaxed);
+    if (n != expected_segments || n == max_segments) {
+        return false;
+    }
+    ArenaRegion piece = arena_commit_region(reservation, n * segment_bytes, segment_bytes, options);
+    if (piece.base == NULL) {
+        return false;
+    }
+    segments[n] = std::make_unique<ArenaT>(piece, slot_size, options);
+    num_segments.store(n + 1, std::memory_order_release);
+    return true;
+}
+
+/// One more segment, false once the reservation is used up.
+template <typename ArenaT>
+inline bool GrowableArena<ArenaT>::grow() {
+    std::lock_guard<std::mutex> lock(grow_mutex);
+    return grow_locked(num_segments.load(std::memory_order_relaxed));
+}
+
+/// Tries the segment that last had room, then the others. Out of room everywhere means growing (or waiting for
+/// whoever is growing already) and trying again, NULL once the maximum is reached.
+template <typename ArenaT>
+char* GrowableArena<ArenaT>::allocate(size_t size) {
+    if (size > segments[0]->capacity) {
+        return NULL; // wouldn't fit any segment, growing won't help
+    }
+    for (;;) {
+        size_t committed = num_segments.load(std::memory_order_acquire);
+        size_t start = current_segment.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < committed; ++i) {
+            size_t segment_idx = start + i < committed ? start + i : start + i - committed;
+            ArenaT* segment = segments[segment_idx].get();
+            char* ptr = segment->allocate(size);
+            if (ptr == NULL) {
+                continue;
+            }
+            if (segment_idx != start) {
+                current_segment.store(segment_idx, std::memory_order_relaxed);
+            }
+            if (watermark_slots > 0 && segment_idx == committed - 1 && past_watermark(segment) &&
+                grow_mutex.try_lock()) {
+                grow_locked(committed);
+                grow_mutex.unlock();
+            }
+            return ptr;
+        }
+
+        std::lock_guard<std::mutex> lock(grow_mutex);
+        if (!grow_locked(committed) && num_segments.load(std::memory_order_relaxed) == committed) {
+            return NULL;
+        }
+    }
+}
+
+/// Whether the segment holds watermark_slots or more. The central count alone can be off by more than a whole small
+/// segment (num_shards * (BATCH - 1) slots, 1984 with 64 shards), so it only rules out segments that are clearly
+/// below, anything that might be past gets the exact sum over the shards.
+template <typename ArenaT>
+inline bool GrowableArena<ArenaT>::past_watermark(const ArenaT* segment) const {
+    const ShardedCounter& in_use = segment->slots_in_use;
+    int64_t drift = static_cast<int64_t>(in_use.num_shards()) * (ShardedCounter::BATCH - 1);
+    return in_use.load_approx() + drift >= watermark_slots && in_use.load() >= watermark_slots;
+}
+
+/// O(1): the segments are equal slices of one reservation.
+template <typename ArenaT>
+inline ArenaT* GrowableArena<ArenaT>::segment_of(char* ptr) const {
+    if (ptr < reservation.base) {
+        return NULL;
+    }
+    size_t segment_idx = static_cast<size_t>(ptr - reservation.base) / segment_bytes;
+    if (segment_idx >= num_segments.load(std::memory_order_acquire)) {
+        return NULL;
+    }
+    return segments[segment_idx].get();
+}
+
+template <typename ArenaT>
+inline void GrowableArena<ArenaT>::free(char* ptr, size_t size) {
+    ArenaT* segment = segment_of(ptr);
+    if (segment == NULL) {
+        return;
+    }
+    segment->free(ptr, size);
+}
+
+template <typename ArenaT>
+inline int64_t GrowableArena<ArenaT>::total_slots_in_use() const {
+    int64_t total = 0;
+    size_t committed = num_segments.load(std::memory_order_acquire);
+    for (size_t i = 0; i < committed; ++i) {
+        total += segments[i]->slots_in_use.load();
+    }
+    return total;
+}
+
+#endif // GROWABLE_ARENA_H
@@ -0,0 +1,260 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+// Per-call latency capture: a cycle counter read and an HDR style histogram to put the readings in.
+//
+//   - read_cycle_counter(): rdtsc (behind an lfence so it doesn't get hoisted above the call it times) on x86,
+//     cntvct_el0 on arm64, steady_clock elsewhere. ~20-30 cycles per read, so timing a call costs two of those.
+//     cycle_counter_ns() converts, the rdtsc rate is calibrated once against steady_clock.
+//   - LatencyHistogram: log-linear buckets, SUB_BUCKETS per power of two, so every recorded value is kept to within
+//     1/SUB_BUCKETS (~6%) of itself from 1 cycle up to minutes, in a fixed 4.7 KB. Not thread safe, one per thread,
+//     merge() them afterwards.
+//   - LatencyRecorder: the same, sharded by ShardedCounter::thread_slot(), for recording from any thread into one
+//     place. Two threads sharing a shard can lose the odd count (plain relaxed load + store, no lock prefix), that is
+//     the price of not putting an atomic RMW on the path being measured.
+//   - TimedArena: any arena with its allocate/free timed into LatencyRecorders, allocations split up by how full the
+//     arena was at the time, that's where the long scans are.
+
+#include "sharded_counter.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/// Current value of the cheapest monotonic counter the CPU has, in its own ticks.
+inline uint64_t read_cycle_counter() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_lfence();
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    asm volatile("isb; mrs %0, cntvct_el0" : "=r"(ticks)::"memory");
+    return ticks;
+#else
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+#endif
+}
+
+/// Counter ticks per nanosecond. arm64 says so in cntfrq_el0, rdtsc gets timed against steady_clock for ~10 ms on
+/// the first call (constant_tsc is assumed, every x86 of the last 15 years has it).
+inline double cycle_counter_ticks_per_ns() {
+    static const double ticks_per_ns = [] {
+#if defined(__x86_64__) || defined(__i386__)
+        auto start = std::chrono::steady_clock::now();
+        uint64_t start_ticks = read_cycle_counter();
+        while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(10)) {
+        }
+        uint64_t ticks = read_cycle_counter() - start_ticks;
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        return ticks / ns;
+#elif defined(__aarch64__)
+        uint64_t frequency;
+        asm volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+        return frequency / 1e9;
+#else
+        return 1.0;
+#endif
+    }();
+    return ticks_per_ns;
+}
+
+inline double cycle_counter_ns(uint64_t ticks) {
+    return ticks / cycle_counter_ticks_per_ns();
+}
+
+struct LatencyHistogram {
+    static constexpr uint32_t SUB_BUCKET_BITS = 4;
+    static constexpr uint32_t SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+    // Values up to 2^MAX_VALUE_BITS ticks get their own bucket, anything above lands in the last one.
+    static constexpr uint32_t MAX_VALUE_BITS = 40;
+    static constexpr size_t NUM_BUCKETS = SUB_BUCKETS * (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1);
+
+    std::array<uint64_t, NUM_BUCKETS> counts{};
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t min_value = UINT64_MAX;
+    uint64_t max_value = 0;
+
+    /// Values below SUB_BUCKETS are exact, above that bucket e * SUB_BUCKETS + s holds [SUB_BUCKETS + s, SUB_BUCKETS +
+    /// s + 1) << (e - 1).
+    static size_t bucket_of(uint64_t value) {
+        uint32_t width = static_cast<uint32_t>(std::bit_width(value));
+        if (width <= SUB_BUCKET_BITS) {
+            return static_cast<size_t>(value);
+        }
+        uint32_t exponent = width - SUB_BUCKET_BITS;
+        size_t bucket = exponent * SUB_BUCKETS + ((value >> (exponent - 1)) - SUB_BUCKETS);
+        return std::min(bucket, NUM_BUCKETS - 1);
+    }
+    /// Largest value that lands in bucket, what a percentile falling in it reports (HDR does the same).
+    static uint64_t bucket_upper(size_t bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return bucket;
+        }
+        uint32_t exponent = static_cast<uint32_t>(bucket / SUB_BUCKETS);
+        uint64_t sub = bucket % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << (exponent - 1)) - 1;
+    }
+
+    void record(uint64_t value) {
+        counts[bucket_of(value)]++;
+        total++;
+        sum += value;
+        min_value = std::min(min_value, value);
+        max_value = std::max(max_value, value);
+    }
+    void merge(const LatencyHistogram& other) {
+        for (size_t b = 0; b < NUM_BUCKETS; ++b) {
+            counts[b] += other.counts[b];
+        }
+        total += other.total;
+        sum += other.sum;
+        min_value = std::min(min_value, other.min_value);
+        max_value = std::max(max_value, other.max_value);
+    }
+    /// Value at or below which percentile% of the recorded values lie, 0 if nothing was recorded.
+    uint64_t percentile(double percentile) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(percentile / 100.0 * total + 0.5));
+        uint64_t seen = 0;
+        for (size_t b = 0; b < NUM_BUCKETS; ++b) {
+            seen += counts[b];
+            if (seen >= rank) {
+                // The last bucket has no upper end, everything it holds is somewhere up to max_value.
+                return b + 1 == NUM_BUCKETS ? max_value : std::clamp(bucket_upper(b), min_value, max_value);
+            }
+        }
+        return max_value;
+    }
+    double mean() const {
+        return total == 0 ? 0.0 : static_cast<double>(sum) / total;
+    }
+};
+
+struct LatencyRecorder {
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        LatencyHistogram histogram;
+    };
+
+    size_t shard_mask;
+    std::unique_ptr<Shard[]> shards;
+
+    /// num_shards as for ShardedCounter: 0 is one per hardware thread, rounded up to a power of two, capped.
+    explicit LatencyRecorder(size_t num_shards = 0) {
+        if (num_shards == 0) {
+            num_shards = std::max(1u, std::thread::hardware_concurrency());
+        }
+        num_shards = std::bit_ceil(std::min(num_shards, ShardedCounter::MAX_SHARDS));
+        shard_mask = num_shards - 1;
+        shards = std::make_unique<Shard[]>(num_shards);
+    }
+
+    void record(uint64_t value);
+    /// All shards merged. Racy against concurrent record()s, each field is read atomically but not all together.
+    LatencyHistogram snapshot() const;
+};
+
+inline void LatencyRecorder::record(uint64_t value) {
+    LatencyHistogram& h = shards[ShardedCounter::thread_slot() & shard_mask].histogram;
+    auto bump = [](uint64_t& field, uint64_t next) {
+        std::atomic_ref<uint64_t>(field).store(next, std::memory_order_relaxed);
+    };
+    auto load = [](uint64_t& field) {
+        return std::atomic_ref<uint64_t>(field).load(std::memory_order_relaxed);
+    };
+    uint64_t& count = h.counts[LatencyHistogram::bucket_of(value)];
+    bump(count, load(count) + 1);
+    bump(h.total, load(h.total) + 1);
+    bump(h.sum, load(h.sum) + value);
+    if (value < load(h.min_value)) {
+        bump(h.min_value, value);
+    }
+    if (value > load(h.max_value)) {
+        bump(h.max_value, value);
+    }
+}
+
+inline LatencyHistogram LatencyRecorder::snapshot() const {
+    LatencyHistogram merged;
+    for (size_t i = 0; i <= shard_mask; ++i) {
+        const LatencyHistogram& h = shards[i].histogram;
+        auto load = [](const uint64_t& field) {
+            return std::atomic_ref<uint64_t>(const_cast<uint64_t&>(field)).load(std::memory_order_relaxed);
+        };
+        for (size_t b = 0; b < LatencyHistogram::NUM_BUCKETS; ++b) {
+            merged.counts[b] += load(h.counts[b]);
+        }
+        merged.total += load(h.total);
+        merged.sum += load(h.sum);
+        merged.min_value = std::min(merged.min_value, load(h.min_value));
+        merged.max_value = std::max(merged.max_value, load(h.max_value));
+    }
+    return merged;
+}
+
+// Arena fill levels allocations are split by, in percent of the slots in use when the call started: [0, 50), [50, 75),
+// [75, 90), [90, 99), [99, 100].
+inline constexpr size_t NUM_FILL_LEVELS = 5;
+inline constexpr uint32_t FILL_LEVEL_FLOOR[NUM_FILL_LEVELS] = {0, 50, 75, 90, 99};
+
+inline size_t fill_level_of(uint64_t used, uint64_t capacity) {
+    uint64_t percent = capacity == 0 ? 0 : used * 100 / capacity;
+    size_t level = 0;
+    while (level + 1 < NUM_FILL_LEVELS && percent >= FILL_LEVEL_FLOOR[level + 1]) {
+        level++;
+    }
+    return level;
+}
+
+// Any BasicArena with allocate and free timed. The arena is the caller's, TimedArena only borrows it, calls that
+// don't go through here (batches, handles) aren't timed. Latencies are in cycle counter ticks, cycle_counter_ns()
+// turns them into time.
+template <typename ArenaT>
+struct TimedArena {
+    ArenaT* arena;
+    LatencyRecorder free_latency;
+    std::array<LatencyRecorder, NUM_FILL_LEVELS> allocate_latency;
+
+    explicit TimedArena(ArenaT* arena) : arena(arena) {
+    }
+
+    char* allocate(size_t size) {
+        // The exact count, the approximate one is off by up to a word's worth of slots per shard. It's read outside
+        // the timed window anyway.
+        uint64_t used = static_cast<uint64_t>(std::max<int64_t>(0, arena->slots_in_use.load()));
+        size_t level = fill_level_of(used, arena->bitmap->num_slots);
+        uint64_t start = read_cycle_counter();
+        char* ptr = arena->allocate(size);
+        allocate_latency[level].record(read_cycle_counter() - start);
+        return ptr;
+    }
+    void free(char* ptr, size_t size) {
+        uint64_t start = read_cycle_counter();
+        arena->free(ptr, size);
+        free_latency.record(read_cycle_counter() - start);
+    }
+    /// Allocations at every fill level together.
+    LatencyHistogram allocate_snapshot() const {
+        LatencyHistogram merged;
+        for (const LatencyRecorder& recorder : allocate_latency) {
+            merged.merge(recorder.snapshot());
+        }
+        return merged;
+    }
+};
+
+#endif // LATENCY_HISTOGRAM_H
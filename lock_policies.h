@@ -0,0 +1,339 @@
+#ifndef LOCK_POLICIES_H
+#define LOCK_POLICIES_H
+
+// Lock policies for BasicArena. Anything with lock()/unlock() works, so std::lock_guard can drive all of them.
+// Lock-free bitmaps pair with NoLock, which compiles away entirely. try_lock() (and lock_counting_spins()) are only
+// there for the contention counters, see arena_stats.h.
+//
+// Which spin lock for the bitmap:
+//   - SpinLock: test_and_set in a loop. Every spin is a write, so past a handful of threads the waiters keep stealing
+//     the line from each other and from the holder. Kept as the baseline.
+//   - TtasLock: spins on a load, only goes for the exchange when the lock looks free, with exponential cpu_relax()
+//     backoff and a yield once that's not enough. Cheapest when the lock is mostly uncontended, not fair.
+//   - TicketLock: FIFO, one fetch_add per acquisition and waiters only read. Fair, but everyone still spins on the
+//     same line, and handing the lock to a waiter that isn't running stalls everyone behind it.
+//   - McsLock: FIFO queue where every waiter spins on its own node, the handoff touches one other cache line no
+//     matter how many are waiting. For many cores hammering one arena.
+//   - FutexLock: spins briefly, then sleeps in std::atomic::wait (a futex on Linux) until unlock wakes it. For hosts
+//     with more threads than cores, where spinning just burns the holder's time slice.
+// run 11 of benchmark.cpp compares them at growing thread counts.
+
+#include "cas_contention.h"
+#include "word_layout.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+// Plain std::mutex, what Arena and ArenaNoHint always used.
+struct MutexLock {
+    std::mutex mutex;
+
+    void lock() {
+        mutex.lock();
+    }
+    bool try_lock() {
+        return mutex.try_lock();
+    }
+    void unlock() {
+        mutex.unlock();
+    }
+};
+
+// test_and_set spin lock that yields while it waits, what ArenaSpinLock and ArenaNoHintSpinLock always used.
+struct SpinLock {
+    std::atomic_flag flag = ATOMIC_FLAG_INIT;
+
+    void lock() {
+        lock_counting_spins();
+    }
+    bool try_lock() {
+        return !flag.test_and_set(std::memory_order_acquire);
+    }
+    /// lock() that says how many times it had to wait, for the arena stats.
+    uint64_t lock_counting_spins() {
+        uint64_t spins = 0;
+        while (flag.test_and_set(std::memory_order_acquire)) {
+            std::this_thread::yield();
+            spins++;
+        }
+        return spins;
+    }
+    void unlock() {
+        flag.clear(std::memory_order_release);
+    }
+};
+
+// Wait between two looks at a contended lock: 2^round cpu_relax() up to 2^MAX_BACKOFF_SHIFT, from YIELD_AFTER rounds
+// on give the core away instead, the holder may be waiting for it.
+struct LockBackoff {
+    static constexpr uint32_t MAX_BACKOFF_SHIFT = 6;
+    static constexpr uint64_t YIELD_AFTER = 16;
+
+    static void wait(uint64_t round) {
+        if (round >= YIELD_AFTER) {
+            std::this_thread::yield();
+            return;
+        }
+        uint32_t pauses = 1u << std::min<uint64_t>(round, MAX_BACKOFF_SHIFT);
+        for (uint32_t i = 0; i < pauses; ++i) {
+            cpu_relax();
+        }
+    }
+};
+
+// Test and test-and-set with backoff.
+struct TtasLock {
+    std::atomic<bool> locked{false};
+
+    void lock() {
+        lock_counting_spins();
+    }
+    bool try_lock() {
+        return !locked.load(std::memory_order_relaxed) && !locked.exchange(true, std::memory_order_acquire);
+    }
+    uint64_t lock_counting_spins() {
+        uint64_t spins = 0;
+        while (locked.exchange(true, std::memory_order_acquire)) {
+            // Read-only until it looks free, the line stays shared and the holder keeps it warm.
+            do {
+                LockBackoff::wait(spins++);
+            } while (locked.load(std::memory_order_relaxed));
+        }
+        return spins;
+    }
+    void unlock() {
+        locked.store(false, std::memory_order_release);
+    }
+};
+
+// Ticket lock: take a number, wait until it's called. The counters sit on their own lines so arrivals (next_ticket)
+// don't disturb the waiters reading now_serving. Only the waiter whose number is next spins (and yields once that
+// takes a while), everyone further back sleeps on wait_slots[ticket % WAIT_SLOTS], the waiting array of Dice and
+// Kogan's TWA. unlock wakes the slot of the number after the one it just called, so that waiter is up and spinning by
+// the time its turn comes, and nobody else: without this, more threads than cores means every handoff waits for the
+// scheduler to get round to the one thread whose number is up. unlock only pays for a wake-up when somebody sleeps,
+// numbers WAIT_SLOTS apart share a slot and wake each other for nothing.
+struct TicketLock {
+    static constexpr uint32_t WAIT_SLOTS = 32;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> next_ticket{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> now_serving{0};
+    std::atomic<uint32_t> sleepers{0};
+    std::array<std::atomic<uint32_t>, WAIT_SLOTS> wait_slots{}; // bumped to wake whoever sleeps on them
+
+    void lock() {
+        lock_counting_spins();
+    }
+    bool try_lock() {
+        // acquire here, not on the CAS: the previous holder's release was on now_serving.
+        uint32_t serving = now_serving.load(std::memory_order_acquire);
+        uint32_t expected = serving;
+        return next_ticket.compare_exchange_strong(expected, serving + 1, std::memory_order_relaxed);
+    }
+    uint64_t lock_counting_spins();
+    void unlock();
+};
+
+inline uint64_t TicketLock::lock_counting_spins() {
+    uint32_t ticket = next_ticket.fetch_add(1, std::memory_order_relaxed);
+    uint64_t spins = 0;
+    for (;;) {
+        uint32_t serving = now_serving.load(std::memory_order_acquire);
+        if (serving == ticket) {
+            return spins;
+        }
+        if (ticket - serving == 1) {
+            if (++spins < LockBackoff::YIELD_AFTER) {
+                cpu_relax();
+            } else {
+                std::this_thread::yield();
+            }
+            continue;
+        }
+        // seq_cst against unlock: either it sees us in sleepers, or we see its now_serving, or the slot moved before
+        // we got to wait on it.
+        std::atomic<uint32_t>& slot = wait_slots[ticket % WAIT_SLOTS];
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        uint32_t generation = slot.load(std::memory_order_seq_cst);
+        if (ticket - now_serving.load(std::memory_order_seq_cst) > 1) {
+            slot.wait(generation, std::memory_order_seq_cst);
+            spins++;
+        }
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+inline void TicketLock::unlock() {
+    // Only the holder writes now_serving.
+    uint32_t serving = now_serving.load(std::memory_order_relaxed) + 1;
+    now_serving.store(serving, std::memory_order_seq_cst);
+    if (sleepers.load(std::memory_order_seq_cst) != 0) {
+        std::atomic<uint32_t>& slot = wait_slots[(serving + 1) % WAIT_SLOTS];
+        slot.fetch_add(1, std::memory_order_seq_cst);
+        slot.notify_all();
+    }
+}
+
+// MCS queue lock. Every thread queues a node of its own and spins on that node's flag, the previous holder flips it
+// on unlock, so a handoff touches one other cache line however long the queue is. A waiter that has spun for
+// YIELD_AFTER rounds marks its node and sleeps on it, unlock then wakes just that one thread.
+// lock()/unlock() have nowhere to keep a node between them, so each thread has a few thread_local ones (the arena
+// never holds more than one lock at a time, MAX_HELD leaves room for callers nesting arenas) and a thread holding more
+// than that gets a heap node.
+struct McsLock {
+    // Node::state
+    static constexpr uint32_t GRANTED = 0;
+    static constexpr uint32_t WAITING = 1;
+    static constexpr uint32_t SLEEPING = 2;
+
+    struct alignas(CACHE_LINE_SIZE) Node {
+        std::atomic<Node*> next{NULL};
+        std::atomic<uint32_t> state{GRANTED};
+        bool in_use = false; // by the owning thread, in its thread_local pool
+        bool on_heap = false;
+    };
+    static constexpr size_t MAX_HELD = 4;
+
+    std::atomic<Node*> tail{NULL};
+    Node* holder = NULL; // node of the thread holding the lock, only ever touched by that thread
+
+    static Node* take_node();
+    static void give_node(Node* node);
+
+    void lock() {
+        lock_counting_spins();
+    }
+    bool try_lock();
+    uint64_t lock_counting_spins();
+    void unlock();
+};
+
+inline McsLock::Node* McsLock::take_node() {
+    static thread_local Node pool[MAX_HELD];
+    for (Node& node : pool) {
+        if (!node.in_use) {
+            node.in_use = true;
+            return &node;
+        }
+    }
+    Node* node = new Node;
+    node->in_use = true;
+    node->on_heap = true;
+    return node;
+}
+
+inline void McsLock::give_node(Node* node) {
+    if (node->on_heap) {
+        delete node;
+    } else {
+        node->in_use = false;
+    }
+}
+
+inline bool McsLock::try_lock() {
+    if (tail.load(std::memory_order_relaxed) != NULL) {
+        return false;
+    }
+    Node* node = take_node();
+    node->next.store(NULL, std::memory_order_relaxed);
+    Node* expected = NULL;
+    if (!tail.compare_exchange_strong(expected, node, std::memory_order_acquire, std::memory_order_relaxed)) {
+        give_node(node);
+        return false;
+    }
+    holder = node;
+    return true;
+}
+
+inline uint64_t McsLock::lock_counting_spins() {
+    Node* node = take_node();
+    node->next.store(NULL, std::memory_order_relaxed);
+    node->state.store(WAITING, std::memory_order_relaxed);
+    Node* prev = tail.exchange(node, std::memory_order_acq_rel);
+    uint64_t spins = 0;
+    if (prev != NULL) {
+        prev->next.store(node, std::memory_order_release);
+        // Our own line, nobody else reads it, so plain pauses until it's been a while.
+        uint32_t state;
+        while ((state = node->state.load(std::memory_order_acquire)) != GRANTED) {
+            if (++spins < LockBackoff::YIELD_AFTER) {
+                cpu_relax();
+            } else if (state == SLEEPING ||
+                       node->state.compare_exchange_weak(state, SLEEPING, std::memory_order_relaxed)) {
+                node->state.wait(SLEEPING, std::memory_order_acquire);
+            }
+        }
+    }
+    holder = node;
+    return spins;
+}
+
+inline void McsLock::unlock() {
+    Node* node = holder;
+    Node* next = node->next.load(std::memory_order_acquire);
+    if (next == NULL) {
+        Node* expected = node;
+        if (tail.compare_exchange_strong(expected, NULL, std::memory_order_release, std::memory_order_relaxed)) {
+            give_node(node);
+            return;
+        }
+        // Somebody swapped themselves in as the tail and is about to link up behind us.
+        while ((next = node->next.load(std::memory_order_acquire)) == NULL) {
+            cpu_relax();
+        }
+    }
+    give_node(node);
+    if (next->state.exchange(GRANTED, std::memory_order_release) == SLEEPING) {
+        next->state.notify_one();
+    }
+}
+
+// Spin-then-sleep lock, Drepper's three state futex mutex on std::atomic::wait. 0 is free, 1 held, 2 held with
+// somebody possibly asleep, only then does unlock pay for the wake-up.
+struct FutexLock {
+    static constexpr uint64_t SPIN_LIMIT = 64;
+
+    std::atomic<uint32_t> state{0};
+
+    void lock() {
+        lock_counting_spins();
+    }
+    bool try_lock() {
+        uint32_t expected = 0;
+        return state.compare_exchange_strong(expected, 1, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+    /// Spins and sleeps both count.
+    uint64_t lock_counting_spins() {
+        uint64_t spins = 0;
+        for (; spins < SPIN_LIMIT; ++spins) {
+            if (state.load(std::memory_order_relaxed) == 0 && try_lock()) {
+                return spins;
+            }
+            cpu_relax();
+        }
+        while (state.exchange(2, std::memory_order_acquire) != 0) {
+            state.wait(2, std::memory_order_relaxed);
+            spins++;
+        }
+        return spins;
+    }
+    void unlock() {
+        if (state.exchange(0, std::memory_order_release) == 2) {
+            state.notify_one();
+        }
+    }
+};
+
+// For bitmaps that synchronize themselves, nothing to do.
+struct NoLock {
+    void lock() {
+    }
+    void unlock() {
+    }
+};
+
+#endif // LOCK_POLICIES_H
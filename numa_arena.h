@@ -0,0 +1,280 @@
+#ifndef NUMA_ARENA_H
+#define NUMA_ARENA_H
+
+// One sub-arena per NUMA node, allocations served from the caller's node.
+//
+// A single ArenaLockFreeHint on a 2-socket box means every thread on both sockets CASes the same words array, so the
+// bitmap cache lines keep crossing the interconnect, and the pages themselves land wherever first touch put them.
+// Here every node gets its own arena whose region is mbind'ed to that node (ArenaOptions::numa), a thread allocates
+// from the arena of the node it is running on and only goes to the other nodes, nearest first, when its own is full.
+// free() finds the owning arena from the pointer alone, the sub-arenas are separate mappings so address ranges don't
+// overlap.
+//
+// Topology comes from sysfs (/sys/devices/system/node), the current node from sched_getcpu, which is a vDSO call and
+// cheap enough to do on every allocation. Anywhere that isn't Linux, or when sysfs isn't readable, this degrades to a
+// single node holding the whole capacity.
+//
+// Only nodes with memory (has_memory) get an arena, binding to a memoryless node fails with EINVAL. The CPUs of a
+// memoryless node allocate from the memory node nearest to it by the distance table. A memory-only node (a CXL
+// expander, say) that isn't the nearest memory of any CPU gets no arena either: it's the far tier, and an equal share
+// of the capacity there would put that share of the data behind the slowest link for every thread.
+
+#include "arena_allocator.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+struct NumaTopology {
+    // Ids of the nodes that get an arena, ascending: nodes with memory that are the local memory of some CPU.
+    std::vector<int> nodes;
+    // cpu -> index into nodes, -1 for cpus we didn't see.
+    std::vector<int> cpu_to_node_index;
+    // For every node index the node indices to try in order: itself, then the others by distance.
+    std::vector<std::vector<size_t>> fallback_order;
+
+    static NumaTopology detect();
+    static std::vector<int> parse_list(const std::string& list);
+    static std::vector<int> read_list(const std::string& path);
+    size_t current_node_index() const;
+};
+
+/// Parses the sysfs list format, e.g. "0-3,8,10-11".
+inline std::vector<int> NumaTopology::parse_list(const std::string& list) {
+    std::vector<int> values;
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int value = first; value <= last; ++value) {
+            values.push_back(value);
+        }
+    }
+    return values;
+}
+
+/// The list in a sysfs file, empty if it can't be read or parsed.
+inline std::vector<int> NumaTopology::read_list(const std::string& path) {
+    std::string list;
+    std::ifstream file(path);
+    if (!file || !std::getline(file, list)) {
+        return {};
+    }
+    try {
+        return parse_list(list);
+    } catch (const std::exception&) {
+        return {};
+    }
+}
+
+inline NumaTopology NumaTopology::detect() {
+    NumaTopology topology;
+    const std::string root = "/sys/devices/system/node/";
+
+    std::vector<int> online = read_list(root + "online");
+    std::vector<int> with_memory = read_list(root + "has_memory");
+    if (with_memory.empty()) {
+        with_memory = online; // kernels without has_memory
+    }
+    if (online.empty() || with_memory.empty()) {
+        // No NUMA info, treat the machine as one node.
+        topology.nodes.push_back(0);
+        topology.fallback_order.push_back({0});
+        return topology;
+    }
+
+    // Per online node its cpus and its distance row, one distance per online node, same order as `online`.
+    std::vector<std::vector<int>> cpus(online.size());
+    std::vector<std::vector<int>> distances(online.size());
+    for (size_t i = 0; i < online.size(); ++i) {
+        std::string node_dir = root + "node" + std::to_string(online[i]) + "/";
+        cpus[i] = read_list(node_dir + "cpulist");
+        std::ifstream distance_file(node_dir + "distance");
+        int distance;
+        while (distance_file >> distance) {
+            distances[i].push_back(distance);
+        }
+    }
+    auto online_index = [&](int node) -> size_t {
+        return static_cast<size_t>(std::lower_bound(online.begin(), online.end(), node) - online.begin());
+    };
+    // Distance between two nodes, INT_MAX when the table doesn't say.
+    auto distance = [&](int from, int to) {
+        size_t row = online_index(from);
+        size_t column = online_index(to);
+        if (row >= online.size() || distances[row].size() != online.size() || column >= online.size()) {
+            return INT_MAX;
+        }
+        return distances[row][column];
+    };
+    // The memory node a node's CPUs allocate from: itself if it has memory, otherwise the nearest one that has.
+    auto home_of = [&](int node) {
+        if (std::binary_search(with_memory.begin(), with_memory.end(), node)) {
+            return node;
+        }
+        int home = with_memory.front();
+        for (int candidate : with_memory) {
+            if (distance(node, candidate) < distance(node, home)) {
+                home = candidate;
+            }
+        }
+        return home;
+    };
+
+    for (size_t i = 0; i < online.size(); ++i) {
+        if (!cpus[i].empty()) {
+            topology.nodes.push_back(home_of(online[i]));
+        }
+    }
+    if (topology.nodes.empty()) {
+        topology.nodes = with_memory; // no cpulists to go by
+    }
+    std::sort(topology.nodes.begin(), topology.nodes.end());
+    topology.nodes.erase(std::unique(topology.nodes.begin(), topology.nodes.end()), topology.nodes.end());
+    auto node_index = [&](int node) {
+        return static_cast<int>(std::lower_bound(topology.nodes.begin(), topology.nodes.end(), node) -
+                                topology.nodes.begin());
+    };
+
+    for (size_t i = 0; i < online.size(); ++i) {
+        int index = node_index(home_of(online[i]));
+        for (int cpu : cpus[i]) {
+            if (static_cast<size_t>(cpu) >= topology.cpu_to_node_index.size()) {
+                topology.cpu_to_node_index.resize(cpu + 1, -1);
+            }
+            topology.cpu_to_node_index[cpu] = index;
+        }
+    }
+
+    for (size_t i = 0; i < topology.nodes.size(); ++i) {
+        std::vector<size_t> order(topology.nodes.size());
+        for (size_t j = 0; j < order.size(); ++j) {
+            order[j] = j;
+        }
+        // Nodes without usable distances all come out INT_MAX, the stable sort keeps them in node order.
+        int from = topology.nodes[i];
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            if (a == i || b == i) {
+                return a == i && b != i;
+            }
+            return distance(from, topology.nodes[a]) < distance(from, topology.nodes[b]);
+        });
+        topology.fallback_order.push_back(std::move(order));
+    }
+    return topology;
+}
+
+inline size_t NumaTopology::current_node_index() const {
+#if defined(__linux__)
+    int cpu = sched_getcpu();
+    if (cpu >= 0 && static_cast<size_t>(cpu) < cpu_to_node_index.size() && cpu_to_node_index[cpu] >= 0) {
+        return static_cast<size_t>(cpu_to_node_index[cpu]);
+    }
+#endif
+    return 0;
+}
+
+template <typename ArenaT = ArenaLockFreeHint>
+struct NumaArena {
+    // Sub-arena address ranges sorted by base for free().
+    struct Range {
+        char* begin;
+        char* end;
+        ArenaT* arena;
+    };
+
+    NumaTopology topology;
+    // Indexed like topology.nodes.
+    std::vector<std::unique_ptr<ArenaT>> arenas;
+    std::vector<Range> ranges;
+
+    /// `capacity` is split evenly across topology.nodes, every sub-arena is bound to its node unless `options` already
+    /// asks for a NUMA policy of its own. All of those nodes have memory, see NumaTopology.
+    NumaArena(size_t capacity, size_t page_size, const ArenaOptions& options = ArenaOptions());
+    NumaArena(const NumaArena&) = delete;
+    NumaArena& operator=(const NumaArena&) = delete;
+
+    char* allocate(size_t size);
+    void free(char* ptr, size_t size);
+    ArenaT* arena_of(char* ptr) const;
+    size_t num_nodes() const {
+        return arenas.size();
+    }
+    int64_t total_slots_in_use() const;
+};
+
+template <typename ArenaT>
+NumaArena<ArenaT>::NumaArena(size_t capacity, size_t page_size, const ArenaOptions& options)
+    : topology(NumaTopology::detect()) {
+    size_t per_node = (capacity + topology.nodes.size() - 1) / topology.nodes.size();
+    for (int node : topology.nodes) {
+        ArenaOptions node_options = options;
+        if (topology.nodes.size() > 1 && node_options.numa == NumaPolicy::None) {
+            node_options.numa = NumaPolicy::Bind;
+            node_options.numa_node = node;
+        }
+        arenas.push_back(std::make_unique<ArenaT>(per_node, page_size, node_options));
+        ArenaT* arena = arenas.back().get();
+        ranges.push_back(Range{arena->base, arena->base + arena->capacity, arena});
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) { return a.begin < b.begin; });
+}
+
+/// Local node first, the rest nearest first once the local one is full.
+template <typename ArenaT>
+inline char* NumaArena<ArenaT>::allocate(size_t size) {
+    for (size_t node_idx : topology.fallback_order[topology.current_node_index()]) {
+        char* ptr = arenas[node_idx]->allocate(size);
+        if (ptr != NULL) {
+            return ptr;
+        }
+    }
+    return NULL;
+}
+
+/// Sub-arena whose region contains ptr, NULL if none does.
+template <typename ArenaT>
+inline ArenaT* NumaArena<ArenaT>::arena_of(char* ptr) const {
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), ptr,
+                               [](char* p, const Range& range) { return p < range.begin; });
+    if (it == ranges.begin()) {
+        return NULL;
+    }
+    --it;
+    return ptr < it->end ? it->arena : NULL;
+}
+
+/// Goes back to whichever node's arena owns ptr, regardless of the node the caller is on now.
+template <typename ArenaT>
+inline void NumaArena<ArenaT>::free(char* ptr, size_t size) {
+    ArenaT* arena = arena_of(ptr);
+    if (arena == NULL) {
+        return;
+    }
+    arena->free(ptr, size);
+}
+
+template <typename ArenaT>
+inline int64_t NumaArena<ArenaT>::total_slots_in_use() const {
+    int64_t total = 0;
+    for (const auto& arena : arenas) {
+        total += arena->slots_in_use.load();
+    }
+    return total;
+}
+
+#endif // NUMA_ARENA_H
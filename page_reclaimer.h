@@ -0,0 +1,158 @@
+#ifndef PAGE_RECLAIMER_H
+#define PAGE_RECLAIMER_H
+
+// Giving the pages of long-idle free slots back to the kernel.
+//
+// Once a slot has been written its page stays resident, freeing the slot doesn't change that, so RSS only ever climbs
+// to the high-water mark. With many pools per host that adds up. The pieces:
+//   - PageReclaimState, kept by an arena built with ArenaOptions::reclaim != None. One entry per bitmap word holding
+//     the epoch of the last free into that word, i.e. "this word's pages may be dirty and resident since then".
+//     CLEAN means no pages to give back (never used or already reclaimed), PARKED means the reclaimer holds the word.
+//     RELEASING is PARKED while the madvise is still running: nobody may unpark the word yet, or the late
+//     MADV_DONTNEED would zero the data of whoever got its slots.
+//   - BasicArena::reclaim_idle(): finds fully free words whose last free is old enough, parks them (Bitmap::park_word,
+//     every slot looks allocated so nobody can allocate from them meanwhile) and madvises their slots away, adjacent
+//     words coalesced into one extent. The madvise happens outside any bitmap lock.
+//   - Parked words stay out of circulation while anything else is free, so allocation keeps using resident slots and
+//     only unparks (= takes the page fault) when it would fail otherwise.
+//   - PageReclaimer, a background thread that advances the epoch every period and calls reclaim_idle. Without it the
+//     same thing can be driven incrementally, call tick() + reclaim_idle() from wherever is convenient.
+// A word is 64 slots, 256 KB worth of 4 KB pages, so even single-word extents are decent madvise sizes.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+struct PageReclaimState {
+    static constexpr uint32_t CLEAN = 0;
+    static constexpr uint32_t PARKED = UINT32_MAX;
+    static constexpr uint32_t RELEASING = UINT32_MAX - 1;
+
+    size_t num_words;
+    std::unique_ptr<std::atomic<uint32_t>[]> word_state;
+    // Starts at 1 so a free never looks CLEAN.
+    std::atomic<uint32_t> epoch;
+    std::atomic<size_t> parked_words;
+
+    explicit PageReclaimState(size_t num_words)
+        : num_words(num_words), word_state(new std::atomic<uint32_t>[num_words]), epoch(1), parked_words(0) {
+        for (size_t i = 0; i < num_words; ++i) {
+            word_state[i].store(CLEAN, std::memory_order_relaxed);
+        }
+    }
+
+    /// Free path: the word's pages are now (possibly) dirty as of this epoch. Only writes when the value changes so a
+    /// busy word doesn't keep dirtying the state line, and never overwrites PARKED or RELEASING.
+    void note_free(size_t word_idx) {
+        uint32_t now = epoch.load(std::memory_order_relaxed);
+        uint32_t seen = word_state[word_idx].load(std::memory_order_relaxed);
+        while (seen != now && seen < RELEASING) {
+            if (word_state[word_idx].compare_exchange_weak(seen, now, std::memory_order_relaxed)) {
+                return;
+            }
+        }
+    }
+
+    /// Whether the word was last freed into at least min_idle_epochs ago and may still hold resident pages.
+    bool is_idle(size_t word_idx, uint32_t min_idle_epochs) const {
+        uint32_t seen = word_state[word_idx].load(std::memory_order_relaxed);
+        return seen != CLEAN && seen < RELEASING && epoch.load(std::memory_order_relaxed) - seen >= min_idle_epochs;
+    }
+
+    /// Whether the reclaimer holds the word, parked or still being released. Its slots look allocated but hold nothing.
+    bool is_parked(size_t word_idx) const {
+        return word_state[word_idx].load(std::memory_order_relaxed) >= RELEASING;
+    }
+
+    void tick() {
+        uint32_t next = epoch.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (next >= RELEASING) {
+            // Wrapped after 2^32 ticks, skip the reserved values. Words freed into long ago just look recent once.
+            epoch.store(1, std::memory_order_relaxed);
+        }
+    }
+};
+
+/// Background reclaimer for one arena. Every `period` it advances the arena's epoch and reclaims the words that have
+/// been idle for at least `idle_time`. The arena has to be built with ArenaOptions::reclaim != None and outlive this.
+template <typename ArenaT>
+struct PageReclaimer {
+    ArenaT* arena;
+    std::chrono::milliseconds period;
+    uint32_t idle_epochs;
+    std::atomic<uint64_t> bytes_reclaimed;
+    std::atomic<uint64_t> passes;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+    std::thread worker;
+
+    PageReclaimer(ArenaT* arena, std::chrono::milliseconds idle_time, std::chrono::milliseconds period);
+    ~PageReclaimer();
+    PageReclaimer(const PageReclaimer&) = delete;
+    PageReclaimer& operator=(const PageReclaimer&) = delete;
+
+    size_t run_once();
+    void stop();
+};
+
+template <typename ArenaT>
+PageReclaimer<ArenaT>::PageReclaimer(ArenaT* arena, std::chrono::milliseconds idle_time,
+                                     std::chrono::milliseconds period)
+    : arena(arena), period(period), bytes_reclaimed(0), passes(0), stopping(false) {
+    if (arena->reclaim == NULL) {
+        throw std::invalid_argument("arena was built without ArenaOptions::reclaim");
+    }
+    if (period.count() <= 0) {
+        throw std::invalid_argument("period must be positive");
+    }
+    // Idle for idle_time means at least that many whole periods without a free.
+    idle_epochs = static_cast<uint32_t>((idle_time.count() + period.count() - 1) / period.count());
+    if (idle_epochs == 0) {
+        idle_epochs = 1;
+    }
+    worker = std::thread([this]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wake.wait_for(lock, this->period, [this]() { return stopping; })) {
+            lock.unlock();
+            run_once();
+            lock.lock();
+        }
+    });
+}
+
+template <typename ArenaT>
+PageReclaimer<ArenaT>::~PageReclaimer() {
+    stop();
+}
+
+/// One pass, what the background thread does every period. Returns the bytes given back.
+template <typename ArenaT>
+inline size_t PageReclaimer<ArenaT>::run_once() {
+    arena->reclaim->tick();
+    size_t bytes = arena->reclaim_idle(idle_epochs);
+    bytes_reclaimed.fetch_add(bytes, std::memory_order_relaxed);
+    passes.fetch_add(1, std::memory_order_relaxed);
+    return bytes;
+}
+
+template <typename ArenaT>
+inline void PageReclaimer<ArenaT>::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+#endif // PAGE_RECLAIMER_H
@@ -0,0 +1,342 @@
+#ifndef PERSISTENT_ARENA_H
+#define PERSISTENT_ARENA_H
+
+// An arena whose slots live in a file (or memfd) instead of anonymous memory, so a restarted process gets its working
+// set back by mapping the file again rather than re-reading every page from storage.
+//
+// File layout:
+//   [header | bitmap words | generations (if slot_handles)]  padded to data_offset
+//   [slot data, num_slots * slot_size]
+// The data part is mapped MAP_SHARED (arena_map_file_region) and the arena on top of it is a regular borrowed-region
+// arena, nothing on the allocation path changes. The header part is mapped on its own and only written at open and at
+// shutdown: the live bitmap stays in ordinary memory where it's fast, and a persisted copy of it is only as good as
+// the last clean shutdown.
+//
+// Hence the clean_shutdown flag. shutdown() writes the bitmap (and generations) into the header, msyncs the data and
+// then sets the flag. Opening clears it again before handing the arena out. On the next open:
+//   - flag set: the saved bitmap is exact, trust it. Restart costs a scan of the bitmap words and nothing else, the
+//     slot pages are wherever the kernel left them (still in the page cache after a plain restart, always in memory
+//     for a memfd handed over across exec).
+//   - flag clear: we crashed or were killed, the saved bitmap is from an older run. With a rebuild callback every slot
+//     is shown to it and the ones it says are live are marked allocated, that's for callers who can tell from the page
+//     contents (a buffer pool page header with its page id, say). Without one the arena starts out empty.
+// Opening a file with a different slot size or slot count throws rather than guessing.
+//
+// Caveats: shutdown() needs the arena quiescent, it snapshots the bitmap without any synchronization. Page reclaim
+// works but on a shared mapping MADV_DONTNEED only drops our mapping of the pages, the file (and the page cache)
+// keeps them.
+
+#include "arena_allocator.h"
+
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct PersistentArenaHeader {
+    static constexpr uint64_t MAGIC = 0x3130504e45524141ULL; // "AARENP01" read as bytes
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t HAS_GENERATIONS = 1;
+
+    uint64_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint64_t slot_size;
+    uint64_t num_slots;
+    uint64_t data_offset;
+    // Written last by shutdown() and cleared first by open, so it's only ever set over a consistent snapshot.
+    uint32_t clean_shutdown;
+    uint32_t reserved;
+    uint64_t clean_restarts;
+};
+
+// How the arena came up.
+enum class PersistentOpen {
+    Created,  // new or empty file
+    Restored, // clean shutdown, bitmap taken from the header
+    Rebuilt,  // unclean shutdown, bitmap rebuilt by the callback
+    Reset,    // unclean shutdown and no callback, every slot free
+};
+
+template <typename ArenaT = ArenaLockFreeHint>
+struct PersistentArena {
+    using BitmapType = typename ArenaT::BitmapType;
+    // Called once per slot after an unclean shutdown, returns whether the slot holds something live.
+    using RebuildFn = std::function<bool(size_t slot_idx, const char* data)>;
+
+    int fd;
+    size_t slot_size;
+    size_t num_slots;
+    size_t num_words;
+    bool with_generations;
+    char* header_base;
+    size_t header_bytes;
+    ArenaRegion data_region;
+    std::unique_ptr<ArenaT> arena;
+    PersistentOpen opened;
+    double open_ms;
+    bool shut_down;
+
+    /// Opens (creating if needed) the file at path. capacity and slot_size are only used to size a new file and
+    /// checked against an existing one. Throws std::invalid_argument on a geometry mismatch, std::runtime_error when
+    /// the file can't be opened, grown or mapped or isn't an arena file.
+    PersistentArena(const char* path, size_t capacity, size_t slot_size, const RebuildFn& rebuild = RebuildFn(),
+                    const ArenaOptions& options = ArenaOptions());
+    /// Same over an fd the caller already has, typically a memfd_create one that survives exec. The fd is dup'd.
+    PersistentArena(int fd, size_t capacity, size_t slot_size, const RebuildFn& rebuild = RebuildFn(),
+                    const ArenaOptions& options = ArenaOptions());
+    ~PersistentArena();
+    PersistentArena(const PersistentArena&) = delete;
+    PersistentArena& operator=(const PersistentArena&) = delete;
+
+    char* allocate(size_t size) {
+        return arena->allocate(size);
+    }
+    void free(char* ptr, size_t size) {
+        arena->free(ptr, size);
+    }
+    int shutdown();
+
+    PersistentArenaHeader* header() const {
+        return reinterpret_cast<PersistentArenaHeader*>(header_base);
+    }
+    uint64_t* saved_words() const {
+        return reinterpret_cast<uint64_t*>(header_base + sizeof(PersistentArenaHeader));
+    }
+    uint8_t* saved_generations() const {
+        return reinterpret_cast<uint8_t*>(saved_words() + num_words);
+    }
+
+    void open(size_t capacity, const RebuildFn& rebuild, const ArenaOptions& options);
+    void restore_words(const uint64_t* words);
+    void close_mappings();
+    static uint64_t word_value(uint64_t word) {
+        return word;
+    }
+    static uint64_t word_value(const std::atomic<uint64_t>& word) {
+        return word.load(std::memory_order_acquire);
+    }
+};
+
+template <typename ArenaT>
+PersistentArena<ArenaT>::PersistentArena(const char* path, size_t capacity, size_t slot_size,
+                                         const RebuildFn& rebuild, const ArenaOptions& options)
+    : fd(::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)), slot_size(slot_size), header_base(NULL),
+      header_bytes(0), data_region{NULL, 0, PageBacking::Default}, shut_down(false) {
+    if (fd < 0) {
+        throw std::runtime_error("opening the arena file failed");
+    }
+    open(capacity, rebuild, options);
+}
+
+template <typename ArenaT>
+PersistentArena<ArenaT>::PersistentArena(int fd, size_t capacity, size_t slot_size, const RebuildFn& rebuild,
+                                         const ArenaOptions& options)
+    : fd(fcntl(fd, F_DUPFD_CLOEXEC, 0)), slot_size(slot_size), header_base(NULL), header_bytes(0),
+      data_region{NULL, 0, PageBacking::Default}, shut_down(false) {
+    if (this->fd < 0) {
+        throw std::runtime_error("dup of the arena fd failed");
+    }
+    open(capacity, rebuild, options);
+}
+
+template <typename ArenaT>
+PersistentArena<ArenaT>::~PersistentArena() {
+    shutdown();
+    close_mappings();
+}
+
+template <typename ArenaT>
+void PersistentArena<ArenaT>::close_mappings() {
+    arena.reset();
+    if (data_region.base != NULL) {
+        arena_unmap_region(data_region);
+    }
+    if (header_base != NULL) {
+        munmap(header_base, header_bytes);
+    }
+    close(fd);
+}
+
+template <typename ArenaT>
+void PersistentArena<ArenaT>::open(size_t capacity, const RebuildFn& rebuild, const ArenaOptions& options) {
+    auto start = std::chrono::steady_clock::now();
+    if (slot_size == 0) {
+        close(fd);
+        throw std::invalid_argument("slot_size must be non-zero");
+    }
+    num_slots = arena_slot_count(capacity, slot_size);
+    num_words = num_slots / BitmapType::WORD_LENGTH;
+    with_generations = options.slot_handles;
+
+    // Header and data both start on a page boundary, a THP boundary for the data if it wants huge pages.
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t data_alignment = options.pages == PageBacking::Default ? page : 2ULL << 20;
+    size_t header_used =
+        sizeof(PersistentArenaHeader) + num_words * sizeof(uint64_t) + (with_generations ? num_slots : 0);
+    header_bytes = (header_used + page - 1) / page * page;
+    size_t data_offset = (header_bytes + data_alignment - 1) / data_alignment * data_alignment;
+    size_t data_bytes = (num_slots * slot_size + page - 1) / page * page;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("fstat of the arena file failed");
+    }
+    bool fresh = st.st_size == 0;
+    if (!fresh) {
+        PersistentArenaHeader existing;
+        if (pread(fd, &existing, sizeof(existing), 0) != static_cast<ssize_t>(sizeof(existing)) ||
+            existing.magic != PersistentArenaHeader::MAGIC || existing.version != PersistentArenaHeader::VERSION) {
+            close(fd);
+            throw std::runtime_error("not an arena file");
+        }
+        if (existing.slot_size != slot_size || existing.num_slots != num_slots ||
+            ((existing.flags & PersistentArenaHeader::HAS_GENERATIONS) != 0) != with_generations) {
+            close(fd);
+            throw std::invalid_argument("arena file was created with a different slot size, capacity or handles");
+        }
+        // Keep whatever data offset the file was made with, the page backing may have changed since.
+        data_offset = existing.data_offset;
+    }
+    if (static_cast<size_t>(st.st_size) < data_offset + data_bytes &&
+        ftruncate(fd, static_cast<off_t>(data_offset + data_bytes)) != 0) {
+        close(fd);
+        throw std::runtime_error("growing the arena file failed");
+    }
+
+    void* mapped_header = mmap(NULL, header_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped_header == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("mmap of the arena file header failed");
+    }
+    header_base = static_cast<char*>(mapped_header);
+    try {
+        data_region = arena_map_file_region(fd, data_offset, data_bytes, options);
+        ArenaRegion slots = data_region;
+        slots.mapped_bytes = num_slots * slot_size;
+        arena = std::make_unique<ArenaT>(slots, slot_size, options);
+    } catch (...) {
+        close_mappings();
+        throw;
+    }
+
+    PersistentArenaHeader* hdr = header();
+    if (fresh) {
+        std::memset(hdr, 0, sizeof(*hdr));
+        hdr->magic = PersistentArenaHeader::MAGIC;
+        hdr->version = PersistentArenaHeader::VERSION;
+        hdr->flags = with_generations ? PersistentArenaHeader::HAS_GENERATIONS : 0;
+        hdr->slot_size = slot_size;
+        hdr->num_slots = num_slots;
+        hdr->data_offset = data_offset;
+        opened = PersistentOpen::Created;
+    } else if (hdr->clean_shutdown != 0) {
+        restore_words(saved_words());
+        if (with_generations) {
+            for (size_t i = 0; i < num_slots; ++i) {
+                arena->generations[i].store(saved_generations()[i], std::memory_order_relaxed);
+            }
+        }
+        hdr->clean_restarts++;
+        opened = PersistentOpen::Restored;
+    } else if (rebuild) {
+        std::unique_ptr<uint64_t[]> words(new uint64_t[num_words]);
+        for (size_t word_idx = 0; word_idx < num_words; ++word_idx) {
+            uint64_t word = BitmapType::FULLY_FREE;
+            for (uint32_t bit_idx = 0; bit_idx < BitmapType::WORD_LENGTH; ++bit_idx) {
+                size_t slot_idx = (word_idx << BitmapType::WORD_SHIFT) | bit_idx;
+                if (rebuild(slot_idx, arena->base + arena->slot_offset(slot_idx))) {
+                    word &= ~(1ULL << bit_idx);
+                }
+            }
+            words[word_idx] = word;
+        }
+        restore_words(words.get());
+        if (with_generations) {
+            // The saved generations are stale. One past them for every free slot at least keeps handles to those from
+            // the last run from resolving.
+            for (size_t i = 0; i < num_slots; ++i) {
+                bool free = (words[i >> BitmapType::WORD_SHIFT] >> (i & BitmapType::WORD_MASK)) & 1;
+                arena->generations[i].store(static_cast<uint8_t>(saved_generations()[i] + (free ? 1 : 0)),
+                                            std::memory_order_relaxed);
+            }
+        }
+        opened = PersistentOpen::Rebuilt;
+    } else {
+        opened = PersistentOpen::Reset;
+    }
+
+    // From here on a crash has to look like one.
+    hdr->clean_shutdown = 0;
+    if (msync(header_base, header_bytes, MS_SYNC) != 0) {
+        std::perror("msync failed");
+    }
+    auto end = std::chrono::steady_clock::now();
+    open_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+}
+
+/// Loads a saved bitmap into the fresh (all free) arena bitmap: park every word that has anything allocated, then
+/// release the bits that were free. Works the same on every bitmap flavour.
+template <typename ArenaT>
+void PersistentArena<ArenaT>::restore_words(const uint64_t* words) {
+    int64_t in_use = 0;
+    for (size_t word_idx = 0; word_idx < num_words; ++word_idx) {
+        uint64_t word = words[word_idx];
+        if (word == BitmapType::FULLY_FREE) {
+            continue;
+        }
+        arena->bitmap->park_word(word_idx);
+        if (word != BitmapType::FULLY_ALLOCATED) {
+            arena->bitmap->release_bits(word_idx, word);
+        }
+        in_use += BitmapType::WORD_LENGTH - std::popcount(word);
+    }
+    arena->slots_in_use.add(in_use);
+}
+
+/// Saves the bitmap, flushes the data and marks the file clean. The arena has to be quiescent, later allocations
+/// aren't persisted. 0 on success, -1 if an msync failed (the file then stays marked unclean), 1 if it was already
+/// shut down. The destructor calls this too.
+template <typename ArenaT>
+int PersistentArena<ArenaT>::shutdown() {
+    if (shut_down) {
+        return 1;
+    }
+    shut_down = true;
+    uint64_t* words = saved_words();
+    for (size_t word_idx = 0; word_idx < num_words; ++word_idx) {
+        bool parked = arena->reclaim != NULL && arena->reclaim->is_parked(word_idx);
+        // Parked words look allocated but hold nothing.
+        words[word_idx] = parked ? BitmapType::FULLY_FREE : word_value(arena->bitmap->words[word_idx]);
+    }
+    if (with_generations) {
+        for (size_t i = 0; i < num_slots; ++i) {
+            saved_generations()[i] = arena->generations[i].load(std::memory_order_relaxed);
+        }
+    }
+    // Data and bitmap first, the flag only once they're on disk.
+    if (msync(data_region.base, data_region.mapped_bytes, MS_SYNC) != 0 ||
+        msync(header_base, header_bytes, MS_SYNC) != 0) {
+        std::perror("msync failed");
+        return -1;
+    }
+    header()->clean_shutdown = 1;
+    if (msync(header_base, header_bytes, MS_SYNC) != 0) {
+        std::perror("msync failed");
+        return -1;
+    }
+    return 0;
+}
+
+#endif // PERSISTENT_ARENA_H
@@ -0,0 +1,161 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+// Where in the bitmap a single-slot allocation lands, and how to tell how fragmented a bitmap has become.
+//
+// Default is what the bitmaps always did: the word the hint (or the summary search from word 0) lands on, highest free
+// bit first. Cheap, but after a while of allocating and freeing the live slots are spread over the whole words array,
+// which keeps every huge page of the arena resident, leaves no long runs for allocate_many and no fully free words for
+// the page reclaimer. The other policies spend a bit more per allocation to keep things together:
+//   - AddressOrdered: the lowest free slot of the whole bitmap. Live slots pile up at the start, everything past them
+//     stays free in long runs.
+//   - FullestWord: of the next PLACEMENT_WINDOW words with room, the one with the fewest free slots. Fills the holes in
+//     partially used words before touching free ones.
+//   - BestFit: of the same window, the word with the shortest free run, taking its lowest slot. Leaves long runs alone
+//     for allocate_many.
+// The window is a sample, not a global search, keeping an exact "fullest word" index up to date would cost more on
+// every free than this saves. Runs are only looked at inside one word here, allocate_many still finds runs across word
+// boundaries.
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+enum class Placement {
+    Default,
+    AddressOrdered,
+    FullestWord,
+    BestFit,
+};
+
+inline constexpr size_t PLACEMENT_WINDOW = 8;
+
+/// Length of the shortest run of free (set) bits in word, which must be non-zero, and in first_bit where it starts.
+inline uint32_t shortest_free_run(uint64_t word, uint32_t& first_bit) {
+    uint32_t best_len = 65;
+    while (word != 0) {
+        uint32_t start = static_cast<uint32_t>(std::countr_zero(word));
+        uint32_t len = static_cast<uint32_t>(std::countr_one(word >> start));
+        if (len < best_len) {
+            best_len = len;
+            first_bit = start;
+            if (len == 1) {
+                break;
+            }
+        }
+        if (start + len >= 64) {
+            break;
+        }
+        word &= ~0ULL << (start + len);
+    }
+    return best_len;
+}
+
+/// The slot a non-Default placement would hand out next. find_next(word_idx) is the bitmap's summary search (first
+/// word at or after word_idx with room, SIZE_MAX if none), load_word(word_idx) the word's current value. The search
+/// starts at start_word and wraps once if nothing is found from there. Returns -1 if it saw no free slot.
+template <typename FindNext, typename LoadWord>
+inline int64_t placement_pick(Placement placement, size_t start_word, FindNext&& find_next, LoadWord&& load_word) {
+    size_t window = placement == Placement::AddressOrdered ? 1 : PLACEMENT_WINDOW;
+    size_t best_word = SIZE_MAX;
+    uint32_t best_bit = 0;
+    uint32_t best_score = UINT32_MAX;
+
+    size_t word_idx = find_next(start_word);
+    if (word_idx == SIZE_MAX && start_word != 0) {
+        word_idx = find_next(0);
+    }
+    for (size_t seen = 0; word_idx != SIZE_MAX && seen < window; ++seen) {
+        uint64_t word = load_word(word_idx);
+        if (word != 0) {
+            uint32_t bit = static_cast<uint32_t>(std::countr_zero(word));
+            uint32_t score = 0;
+            if (placement == Placement::FullestWord) {
+                score = static_cast<uint32_t>(std::popcount(word));
+            } else if (placement == Placement::BestFit) {
+                score = shortest_free_run(word, bit);
+            }
+            if (score < best_score) {
+                best_score = score;
+                best_word = word_idx;
+                best_bit = bit;
+                if (score <= 1) {
+                    break; // nothing in the window can beat a single free slot
+                }
+            }
+        }
+        word_idx = find_next(word_idx + 1);
+    }
+    return best_word == SIZE_MAX ? -1 : static_cast<int64_t>((best_word << 6) | best_bit);
+}
+
+// Snapshot of how the free slots of a bitmap are laid out. Parked words (see page_reclaimer.h) count as full.
+struct FragmentationStats {
+    size_t free_slots = 0;
+    // Longest run of free slots, across word boundaries, the biggest allocate_many that can succeed right now.
+    size_t largest_free_run = 0;
+    size_t free_runs = 0;
+    size_t full_words = 0;
+    size_t partial_words = 0;
+    size_t empty_words = 0;
+    // Words with any slot in use over the fewest words those slots could fit in. 1.0 is perfectly packed, higher means
+    // the live slots are smeared over that many times more cache lines and pages than needed.
+    double dispersion = 0;
+    // 1 - largest_free_run / free_slots. 0 when all free space is one run, close to 1 when it's all small holes.
+    double external_fragmentation = 0;
+};
+
+/// Walks num_words words through load_word(word_idx). Racy on a bitmap others are changing, fine for statistics.
+template <typename LoadWord>
+inline FragmentationStats measure_fragmentation(size_t num_words, LoadWord&& load_word) {
+    constexpr size_t WORD_LENGTH = 64;
+    FragmentationStats stats;
+    size_t current_run = 0;
+    for (size_t word_idx = 0; word_idx < num_words; ++word_idx) {
+        uint64_t word = load_word(word_idx);
+        size_t free_bits = static_cast<size_t>(std::popcount(word));
+        stats.free_slots += free_bits;
+        if (free_bits == 0) {
+            stats.full_words++;
+        } else if (free_bits == WORD_LENGTH) {
+            stats.empty_words++;
+        } else {
+            stats.partial_words++;
+        }
+        // Runs: every 0 -> 1 transition starts one, the carry joins a run ending at bit 63 with one starting at bit 0.
+        uint64_t run_starts = word & ~(word << 1);
+        if (current_run > 0 && (word & 1)) {
+            run_starts &= ~1ULL;
+        }
+        stats.free_runs += static_cast<size_t>(std::popcount(run_starts));
+        if (word == UINT64_MAX) {
+            current_run += WORD_LENGTH;
+            continue;
+        }
+        current_run += static_cast<size_t>(std::countr_one(word));
+        stats.largest_free_run = std::max(stats.largest_free_run, current_run);
+        // Runs strictly inside the word.
+        uint64_t inner = word & ~((1ULL << std::countr_one(word)) - 1);
+        while (inner != 0) {
+            uint32_t start = static_cast<uint32_t>(std::countr_zero(inner));
+            uint32_t len = static_cast<uint32_t>(std::countr_one(inner >> start));
+            if (start + len >= WORD_LENGTH) {
+                break; // runs into the next word, carried below
+            }
+            stats.largest_free_run = std::max<size_t>(stats.largest_free_run, len);
+            inner &= ~0ULL << (start + len);
+        }
+        current_run = static_cast<size_t>(std::countl_one(word));
+    }
+    stats.largest_free_run = std::max(stats.largest_free_run, current_run);
+
+    size_t used_slots = num_words * WORD_LENGTH - stats.free_slots;
+    size_t min_words = (used_slots + WORD_LENGTH - 1) / WORD_LENGTH;
+    stats.dispersion = min_words == 0 ? 1.0 : static_cast<double>(stats.full_words + stats.partial_words) / min_words;
+    stats.external_fragmentation =
+        stats.free_slots == 0 ? 0.0 : 1.0 - static_cast<double>(stats.largest_free_run) / stats.free_slots;
+    return stats;
+}
+
+#endif // PLACEMENT_H
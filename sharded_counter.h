@@ -0,0 +1,90 @@
+#ifndef SHARDED_COUNTER_H
+#define SHARDED_COUNTER_H
+
+// Scalable usage counter, the same idea as the kernel's percpu_counter.
+//
+// A single std::atomic bumped by every allocate and free is one cache line every core keeps stealing from every other
+// core. Here every thread adds into its own shard (one cache line each, threads are spread over the shards round robin)
+// and a shard only folds its value into the shared central count once it has drifted by BATCH. So:
+//   - add()/sub() touch a line that is almost always already exclusive to the calling core.
+//   - load_approx() reads just the central count, off by at most num_shards * (BATCH - 1).
+//   - load() sums the central count and every shard, exact whenever no update is in flight.
+// 64-bit all the way, so unlike the int16 counter this replaced it doesn't wrap on arenas with more than 32767 slots.
+
+#include "word_layout.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+struct ShardedCounter {
+    static constexpr int64_t BATCH = 32;
+    static constexpr size_t MAX_SHARDS = 64;
+
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        std::atomic<int64_t> value{0};
+    };
+
+    size_t shard_mask;
+    std::unique_ptr<Shard[]> shards;
+    // Only written when a shard folds, kept away from the read-mostly fields above.
+    alignas(CACHE_LINE_SIZE) std::atomic<int64_t> central;
+
+    /// num_shards 0 means one per hardware thread, always rounded up to a power of two and capped at MAX_SHARDS.
+    explicit ShardedCounter(size_t num_shards = 0);
+    ShardedCounter(const ShardedCounter&) = delete;
+    ShardedCounter& operator=(const ShardedCounter&) = delete;
+
+    void add(int64_t delta);
+    void sub(int64_t delta) {
+        add(-delta);
+    }
+    int64_t load() const;
+    int64_t load_approx() const {
+        return central.load(std::memory_order_relaxed);
+    }
+    size_t num_shards() const {
+        return shard_mask + 1;
+    }
+    /// Shard index of the calling thread, handed out round robin the first time a thread touches any counter.
+    static size_t thread_slot();
+};
+
+inline ShardedCounter::ShardedCounter(size_t num_shards) : central(0) {
+    if (num_shards == 0) {
+        num_shards = std::max(1u, std::thread::hardware_concurrency());
+    }
+    num_shards = std::bit_ceil(std::min(num_shards, MAX_SHARDS));
+    shard_mask = num_shards - 1;
+    shards = std::make_unique<Shard[]>(num_shards);
+}
+
+inline size_t ShardedCounter::thread_slot() {
+    static std::atomic<size_t> next_slot{0};
+    thread_local size_t slot = next_slot.fetch_add(1, std::memory_order_relaxed);
+    return slot;
+}
+
+inline void ShardedCounter::add(int64_t delta) {
+    Shard& shard = shards[thread_slot() & shard_mask];
+    int64_t now = shard.value.fetch_add(delta, std::memory_order_relaxed) + delta;
+    if (now >= BATCH || now <= -BATCH) {
+        // Take whatever the shard holds right now, a thread racing on the same shard can't lose its delta this way.
+        int64_t moved = shard.value.exchange(0, std::memory_order_relaxed);
+        central.fetch_add(moved, std::memory_order_relaxed);
+    }
+}
+
+inline int64_t ShardedCounter::load() const {
+    int64_t total = central.load(std::memory_order_relaxed);
+    for (size_t i = 0; i <= shard_mask; ++i) {
+        total += shards[i].value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+#endif // SHARDED_COUNTER_H
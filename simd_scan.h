@@ -0,0 +1,155 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+// Vectorized "find the first word that isn't X" kernel for the plain (non-atomic) bitmaps.
+//
+// The summary index already answers "which word has a free slot" for single slot allocations, but there are still
+// linear walks over the words array: the contiguous run search skipping over fully allocated stretches, and anything
+// looking for fully free or not fully free words. Those are a textbook fit for SIMD, compare 2/4/8 words against the
+// same value per instruction and only drop to scalar code inside the block that has a hit.
+//
+// Dispatch:
+//   - AVX-512F when the compiler targets it (-mavx512f / -march=native on a machine that has it), 8 words per compare.
+//   - Otherwise on x86-64 picked at runtime: AVX2 (4 words) if the CPU has it, SSE2 (2 words) which every x86-64 has.
+//     SSE2 has no 64-bit compare, two equal 32-bit halves is the same thing for an equality test.
+//   - NEON on arm64 (Apple Silicon included), 2 words per compare, NEON is always there on aarch64.
+//   - Scalar everywhere else, or when ARENA_SCAN_SCALAR is defined (handy to compare against).
+// The atomic bitmaps don't use this, vector loads over std::atomic words aren't something we get to do legally.
+
+#include <cstddef>
+#include <cstdint>
+
+#if !defined(ARENA_SCAN_SCALAR)
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define ARENA_SCAN_X86 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ARENA_SCAN_NEON 1
+#endif
+#endif
+
+/// Reference version, also what every vector kernel falls back to for the tail and for locating the hit in a block.
+/// Returns the index of the first word in [begin, end) that is != value, end if there is none.
+inline size_t scan_first_not_equal_scalar(const uint64_t* words, size_t begin, size_t end, uint64_t value) {
+    for (size_t i = begin; i < end; ++i) {
+        if (words[i] != value) {
+            return i;
+        }
+    }
+    return end;
+}
+
+#if defined(ARENA_SCAN_X86)
+
+#if defined(__AVX512F__)
+inline size_t scan_first_not_equal_avx512(const uint64_t* words, size_t begin, size_t end, uint64_t value) {
+    const __m512i needle = _mm512_set1_epi64(static_cast<long long>(value));
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m512i block = _mm512_loadu_si512(reinterpret_cast<const void*>(words + i));
+        __mmask8 differs = _mm512_cmpneq_epu64_mask(block, needle);
+        if (differs != 0) {
+            return i + static_cast<size_t>(__builtin_ctz(differs));
+        }
+    }
+    return scan_first_not_equal_scalar(words, i, end, value);
+}
+#endif
+
+__attribute__((target("avx2"))) inline size_t scan_first_not_equal_avx2(const uint64_t* words, size_t begin,
+                                                                         size_t end, uint64_t value) {
+    const __m256i needle = _mm256_set1_epi64x(static_cast<long long>(value));
+    size_t i = begin;
+    // Two vectors per iteration, near-full arenas are long stretches of the same value so keep the loads flowing.
+    for (; i + 8 <= end; i += 8) {
+        __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+        __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i + 4));
+        __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi64(lo, needle), _mm256_cmpeq_epi64(hi, needle));
+        if (static_cast<uint32_t>(_mm256_movemask_epi8(eq)) != 0xFFFFFFFFu) {
+            break;
+        }
+    }
+    for (; i + 4 <= end; i += 4) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+        int equal_lanes = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(block, needle)));
+        if (equal_lanes != 0xF) {
+            return i + static_cast<size_t>(__builtin_ctz(~equal_lanes & 0xF));
+        }
+    }
+    return scan_first_not_equal_scalar(words, i, end, value);
+}
+
+inline size_t scan_first_not_equal_sse2(const uint64_t* words, size_t begin, size_t end, uint64_t value) {
+    const __m128i needle = _mm_set1_epi64x(static_cast<long long>(value));
+    size_t i = begin;
+    for (; i + 2 <= end; i += 2) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(block, needle)) != 0xFFFF) {
+            return words[i] != value ? i : i + 1;
+        }
+    }
+    return scan_first_not_equal_scalar(words, i, end, value);
+}
+
+using ScanKernel = size_t (*)(const uint64_t*, size_t, size_t, uint64_t);
+
+/// Resolved once per process, the first time any bitmap scans.
+inline ScanKernel select_scan_kernel() {
+#if defined(__AVX512F__)
+    return scan_first_not_equal_avx512;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return scan_first_not_equal_avx2;
+    }
+    return scan_first_not_equal_sse2;
+#endif
+}
+
+inline const ScanKernel scan_kernel = select_scan_kernel();
+
+#elif defined(ARENA_SCAN_NEON)
+
+inline size_t scan_first_not_equal_neon(const uint64_t* words, size_t begin, size_t end, uint64_t value) {
+    const uint64x2_t needle = vdupq_n_u64(value);
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        uint64x2_t eq = vandq_u64(vceqq_u64(vld1q_u64(words + i), needle), vceqq_u64(vld1q_u64(words + i + 2), needle));
+        // All lanes equal <=> the minimum 32-bit lane is still all ones.
+        if (vminvq_u32(vreinterpretq_u32_u64(eq)) != 0xFFFFFFFFu) {
+            break;
+        }
+    }
+    return scan_first_not_equal_scalar(words, i, end, value);
+}
+
+#endif
+
+/// Returns the index of the first word in [begin, end) that is != value, end if there is none.
+inline size_t scan_first_not_equal(const uint64_t* words, size_t begin, size_t end, uint64_t value) {
+#if defined(ARENA_SCAN_X86)
+    return scan_kernel(words, begin, end, value);
+#elif defined(ARENA_SCAN_NEON)
+    return scan_first_not_equal_neon(words, begin, end, value);
+#else
+    return scan_first_not_equal_scalar(words, begin, end, value);
+#endif
+}
+
+/// Name of the kernel scan_first_not_equal ends up using, for the benchmark output.
+inline const char* scan_kernel_name() {
+#if defined(ARENA_SCAN_X86)
+#if defined(__AVX512F__)
+    return "avx512";
+#else
+    return scan_kernel == scan_first_not_equal_avx2 ? "avx2" : "sse2";
+#endif
+#elif defined(ARENA_SCAN_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+#endif // SIMD_SCAN_H
@@ -0,0 +1,358 @@
+#ifndef SIZE_CLASS_ARENA_H
+#define SIZE_CLASS_ARENA_H
+
+// Several slot sizes behind one allocator: a fixed-slot arena per page class (4K/8K/16K/64K by default) plus slabs
+// for small objects, carved out of whole slots of the smallest class.
+//
+// Dispatch and free are both O(1):
+//   - Every class size is a power of two, so std::bit_width(size - 1) is the log2 of the smallest class that fits and
+//     one table lookup turns it into the class.
+//   - All classes live in one reservation (arena_reserve_region), class i at base + i * class_span, the slab area right
+//     after the last page class. free() gets the class from the address with one division, the caller doesn't pass a
+//     size and can't get it wrong.
+// Small objects (MIN_OBJECT_SIZE up to half the smallest page class, powers of two): every slab is one slot of the
+// slab arena holding objects of a single size, with a free bit per object kept out of line in slab_bits. Slabs with
+// free objects sit on their object class's partial list, which the class lock protects. A slab whose last object is
+// freed goes straight back to the slab arena. Frees into a slab that isn't handed out right now, of a pointer that
+// isn't at the start of an object and double frees are ignored and counted in the slab arena's stats, like the arenas
+// do.
+
+#include "arena_allocator.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+template <typename ArenaT = ArenaLockFreeHint>
+struct SizeClassArena {
+    static constexpr size_t MIN_OBJECT_SIZE = 16;
+    static constexpr uint32_t MIN_OBJECT_SHIFT = 4;
+    // Dispatch table entries: a page class index, SMALL | object class, or NO_CLASS.
+    static constexpr uint8_t SMALL = 0x80;
+    static constexpr uint8_t NO_CLASS = 0xFF;
+    static constexpr uint32_t NO_SLAB = UINT32_MAX;
+
+    struct SlabInfo {
+        // Written under the class lock, but free_small reads them before it knows which lock that is, so those two
+        // go through atomic_ref.
+        uint32_t object_class;
+        uint32_t free_objects;
+        // Partial list links, NO_SLAB terminated. listed says whether the slab is on the list at all.
+        uint32_t prev;
+        uint32_t next;
+        bool listed;
+        // Carved into objects, false while the slab sits free in the slab arena.
+        bool live;
+    };
+
+    struct ObjectClass {
+        std::mutex lock;
+        uint32_t object_shift;
+        uint32_t objects_per_slab;
+        uint32_t partial_head = NO_SLAB;
+    };
+
+    ArenaRegion reservation;
+    size_t class_span;
+    // Ascending slot sizes, each its own arena over its slice of the reservation.
+    std::vector<std::unique_ptr<ArenaT>> classes;
+    // Slots of the smallest page class size, each one a slab. NULL when small objects are turned off.
+    std::unique_ptr<ArenaT> slabs;
+    size_t slab_bytes;
+    size_t words_per_slab;
+    std::unique_ptr<SlabInfo[]> slab_info;
+    // words_per_slab free bits (1 = free) per slab, indexed like the slab arena's slots.
+    std::unique_ptr<uint64_t[]> slab_bits;
+    std::unique_ptr<ObjectClass[]> object_classes;
+    size_t num_object_classes;
+    // Indexed by std::bit_width(size - 1).
+    std::array<uint8_t, 65> dispatch;
+
+    /// slot_sizes must be powers of two, capacity_per_class bytes go to every page class. small_object_capacity bytes
+    /// of slabs back the small object classes, 0 turns them off (small requests then get a whole smallest-class slot).
+    explicit SizeClassArena(const std::vector<size_t>& slot_sizes = {4096, 8192, 16384, 65536},
+                            size_t capacity_per_class = 64 * 1024 * 1024, size_t small_object_capacity = 0,
+                            const ArenaOptions& options = ArenaOptions());
+    ~SizeClassArena();
+    SizeClassArena(const SizeClassArena&) = delete;
+    SizeClassArena& operator=(const SizeClassArena&) = delete;
+
+    char* allocate(size_t size);
+    void free(char* ptr);
+    /// Usable size of the block at ptr, 0 for pointers we didn't hand out.
+    size_t size_of(char* ptr) const;
+    size_t largest_class() const {
+        return classes.back()->slot_size;
+    }
+
+    char* allocate_small(uint32_t object_class);
+    void free_small(char* ptr);
+    void unlink_slab(ObjectClass& object_class, uint32_t slab_idx);
+};
+
+template <typename ArenaT>
+SizeClassArena<ArenaT>::SizeClassArena(const std::vector<size_t>& slot_sizes, size_t capacity_per_class,
+                                       size_t small_object_capacity, const ArenaOptions& options)
+    : num_object_classes(0) {
+    if (slot_sizes.empty()) {
+        throw std::invalid_argument("at least one size class is needed");
+    }
+    for (size_t i = 0; i < slot_sizes.size(); ++i) {
+        if (!std::has_single_bit(slot_sizes[i]) || (i > 0 && slot_sizes[i] <= slot_sizes[i - 1])) {
+            throw std::invalid_argument("slot sizes must be ascending powers of two");
+        }
+    }
+    if (slot_sizes.size() >= SMALL) {
+        throw std::invalid_argument("too many size classes");
+    }
+
+    // Every slice as big as the biggest class needs, rounded to 2 MB so THP can back all of them.
+    constexpr size_t SPAN_ALIGNMENT = 2ULL << 20;
+    std::vector<size_t> class_bytes;
+    for (size_t slot_size : slot_sizes) {
+        class_bytes.push_back(arena_slot_count(capacity_per_class, slot_size) * slot_size);
+    }
+    slab_bytes = slot_sizes.front();
+    if (small_object_capacity != 0) {
+        class_bytes.push_back(arena_slot_count(small_object_capacity, slab_bytes) * slab_bytes);
+    }
+    class_span = *std::max_element(class_bytes.begin(), class_bytes.end());
+    class_span = (class_span + SPAN_ALIGNMENT - 1) / SPAN_ALIGNMENT * SPAN_ALIGNMENT;
+
+    reservation = arena_reserve_region(class_span * class_bytes.size(), options);
+    try {
+        for (size_t i = 0; i < class_bytes.size(); ++i) {
+            ArenaRegion piece = arena_commit_region(reservation, i * class_span, class_bytes[i], options);
+            if (piece.base == NULL) {
+                throw std::runtime_error("committing a size class failed");
+            }
+            if (i < slot_sizes.size()) {
+                classes.push_back(std::make_unique<ArenaT>(piece, slot_sizes[i], options));
+            } else {
+                slabs = std::make_unique<ArenaT>(piece, slab_bytes, options);
+            }
+        }
+    } catch (...) {
+        classes.clear();
+        slabs.reset();
+        arena_unmap_region(reservation);
+        throw;
+    }
+
+    dispatch.fill(NO_CLASS);
+    size_t next_class = 0;
+    for (uint32_t width = 0; width < dispatch.size() && next_class < slot_sizes.size(); ++width) {
+        while (next_class < slot_sizes.size() && (1ULL << width) > slot_sizes[next_class]) {
+            next_class++;
+        }
+        if (next_class < slot_sizes.size()) {
+            dispatch[width] = static_cast<uint8_t>(next_class);
+        }
+    }
+
+    if (slabs != NULL) {
+        uint32_t slab_shift = static_cast<uint32_t>(std::countr_zero(slab_bytes));
+        num_object_classes = slab_shift > MIN_OBJECT_SHIFT ? slab_shift - MIN_OBJECT_SHIFT : 0;
+        object_classes = std::make_unique<ObjectClass[]>(num_object_classes);
+        for (uint32_t k = 0; k < num_object_classes; ++k) {
+            object_classes[k].object_shift = MIN_OBJECT_SHIFT + k;
+            object_classes[k].objects_per_slab = static_cast<uint32_t>(slab_bytes >> (MIN_OBJECT_SHIFT + k));
+        }
+        for (uint32_t width = 0; width < MIN_OBJECT_SHIFT + num_object_classes; ++width) {
+            uint32_t k = width > MIN_OBJECT_SHIFT ? width - MIN_OBJECT_SHIFT : 0;
+            dispatch[width] = static_cast<uint8_t>(SMALL | k);
+        }
+        size_t num_slabs = slabs->bitmap->num_slots;
+        words_per_slab = (slab_bytes / MIN_OBJECT_SIZE + 63) / 64;
+        slab_info = std::make_unique<SlabInfo[]>(num_slabs);
+        slab_bits = std::make_unique<uint64_t[]>(num_slabs * words_per_slab);
+    }
+}
+
+template <typename ArenaT>
+SizeClassArena<ArenaT>::~SizeClassArena() {
+    // Borrowed regions, the arenas go before the reservation does.
+    classes.clear();
+    slabs.reset();
+    arena_unmap_region(reservation);
+}
+
+/// O(1) dispatch on the size, NULL for anything bigger than the largest class or when the class is full.
+template <typename ArenaT>
+char* SizeClassArena<ArenaT>::allocate(size_t size) {
+    if (size == 0) {
+        size = 1;
+    }
+    if (size > largest_class()) {
+        return NULL;
+    }
+    uint8_t size_class = dispatch[std::bit_width(size - 1)];
+    if (size_class & SMALL) {
+        return allocate_small(size_class & ~SMALL);
+    }
+    ArenaT* arena = classes[size_class].get();
+    return arena->allocate(arena->slot_size);
+}
+
+template <typename ArenaT>
+void SizeClassArena<ArenaT>::free(char* ptr) {
+    if (ptr < reservation.base) {
+        return;
+    }
+    size_t class_idx = static_cast<size_t>(ptr - reservation.base) / class_span;
+    if (class_idx < classes.size()) {
+        classes[class_idx]->free(ptr, classes[class_idx]->slot_size);
+    } else if (class_idx == classes.size() && slabs != NULL) {
+        free_small(ptr);
+    }
+}
+
+template <typename ArenaT>
+size_t SizeClassArena<ArenaT>::size_of(char* ptr) const {
+    if (ptr < reservation.base) {
+        return 0;
+    }
+    size_t class_idx = static_cast<size_t>(ptr - reservation.base) / class_span;
+    if (class_idx < classes.size()) {
+        return classes[class_idx]->slot_size;
+    }
+    if (class_idx == classes.size() && slabs != NULL) {
+        size_t slab_idx = static_cast<size_t>(ptr - slabs->base) / slab_bytes;
+        if (slab_idx < slabs->bitmap->num_slots && std::atomic_ref<bool>(slab_info[slab_idx].live).load()) {
+            uint32_t object_class = std::atomic_ref<uint32_t>(slab_info[slab_idx].object_class).load();
+            return size_t(1) << object_classes[object_class].object_shift;
+        }
+    }
+    return 0;
+}
+
+template <typename ArenaT>
+char* SizeClassArena<ArenaT>::allocate_small(uint32_t object_class) {
+    ObjectClass& oc = object_classes[object_class];
+    std::lock_guard<std::mutex> lock(oc.lock);
+
+    if (oc.partial_head == NO_SLAB) {
+        char* slab = slabs->allocate(slab_bytes);
+        if (slab == NULL) {
+            return NULL;
+        }
+        uint32_t slab_idx = static_cast<uint32_t>(static_cast<size_t>(slab - slabs->base) / slab_bytes);
+        uint64_t* bits = &slab_bits[slab_idx * words_per_slab];
+        for (size_t w = 0; w < words_per_slab; ++w) {
+            size_t first = w * 64;
+            size_t in_word = first >= oc.objects_per_slab ? 0 : std::min<size_t>(64, oc.objects_per_slab - first);
+            bits[w] = in_word == 64 ? UINT64_MAX : (1ULL << in_word) - 1;
+        }
+        SlabInfo& info = slab_info[slab_idx];
+        info.free_objects = oc.objects_per_slab;
+        info.prev = NO_SLAB;
+        info.next = NO_SLAB;
+        info.listed = true;
+        std::atomic_ref<uint32_t>(info.object_class).store(object_class, std::memory_order_relaxed);
+        std::atomic_ref<bool>(info.live).store(true, std::memory_order_release);
+        oc.partial_head = slab_idx;
+    }
+
+    uint32_t slab_idx = oc.partial_head;
+    SlabInfo& info = slab_info[slab_idx];
+    uint64_t* bits = &slab_bits[slab_idx * words_per_slab];
+    size_t w = 0;
+    while (bits[w] == 0) {
+        w++;
+    }
+    uint32_t bit = static_cast<uint32_t>(std::countr_zero(bits[w]));
+    bits[w] &= bits[w] - 1;
+    if (--info.free_objects == 0) {
+        unlink_slab(oc, slab_idx);
+    }
+    size_t object_idx = w * 64 + bit;
+    return slabs->base + slab_idx * slab_bytes + (object_idx << oc.object_shift);
+}
+
+/// Frees that can't be right, a slab that isn't live, a pointer into the middle of an object, are dropped before any
+/// bit is touched. The class is read without its lock, so it's checked again once the lock is held: the slab may have
+/// gone back to the slab arena and on to another class meanwhile.
+template <typename ArenaT>
+void SizeClassArena<ArenaT>::free_small(char* ptr) {
+    // The size isn't known until the class is, 0 until then.
+    auto invalid = [&](const char* why, size_t size = 0) {
+        slabs->debug.on_invalid_free(ptr, size, why);
+        slabs->stats.add(ArenaCounter::InvalidFrees);
+    };
+    size_t offset = static_cast<size_t>(ptr - slabs->base);
+    size_t slab_idx = offset / slab_bytes;
+    if (slab_idx >= slabs->bitmap->num_slots) {
+        invalid("outside the slab area");
+        return;
+    }
+    SlabInfo& info = slab_info[slab_idx];
+    if (!std::atomic_ref<bool>(info.live).load(std::memory_order_acquire)) {
+        invalid("slab isn't handed out");
+        return;
+    }
+    uint32_t object_class = std::atomic_ref<uint32_t>(info.object_class).load(std::memory_order_relaxed);
+    ObjectClass& oc = object_classes[object_class];
+    size_t slab_offset = offset - slab_idx * slab_bytes;
+    if ((slab_offset & ((size_t(1) << oc.object_shift) - 1)) != 0) {
+        invalid("not at the start of an object", size_t(1) << oc.object_shift);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(oc.lock);
+    if (!std::atomic_ref<bool>(info.live).load(std::memory_order_relaxed) ||
+        std::atomic_ref<uint32_t>(info.object_class).load(std::memory_order_relaxed) != object_class) {
+        invalid("slab isn't handed out");
+        return;
+    }
+
+    size_t object_idx = slab_offset >> oc.object_shift;
+    uint64_t* word = &slab_bits[slab_idx * words_per_slab + object_idx / 64];
+    uint64_t bit = 1ULL << (object_idx % 64);
+    if (*word & bit) {
+        slabs->stats.add(ArenaCounter::DoubleFrees);
+        return; // same as the arenas: ignore it
+    }
+    *word |= bit;
+    info.free_objects++;
+
+    if (info.free_objects == oc.objects_per_slab) {
+        if (info.listed) {
+            unlink_slab(oc, static_cast<uint32_t>(slab_idx));
+        }
+        std::atomic_ref<bool>(info.live).store(false, std::memory_order_relaxed);
+        slabs->free(slabs->base + slab_idx * slab_bytes, slab_bytes);
+    } else if (!info.listed) {
+        info.prev = NO_SLAB;
+        info.next = oc.partial_head;
+        if (oc.partial_head != NO_SLAB) {
+            slab_info[oc.partial_head].prev = static_cast<uint32_t>(slab_idx);
+        }
+        oc.partial_head = static_cast<uint32_t>(slab_idx);
+        info.listed = true;
+    }
+}
+
+/// Takes a slab off its class's partial list. Caller holds the class lock.
+template <typename ArenaT>
+void SizeClassArena<ArenaT>::unlink_slab(ObjectClass& oc, uint32_t slab_idx) {
+    SlabInfo& info = slab_info[slab_idx];
+    if (info.prev != NO_SLAB) {
+        slab_info[info.prev].next = info.next;
+    } else {
+        oc.partial_head = info.next;
+    }
+    if (info.next != NO_SLAB) {
+        slab_info[info.next].prev = info.prev;
+    }
+    info.prev = NO_SLAB;
+    info.next = NO_SLAB;
+    info.listed = false;
+}
+
+#endif // SIZE_CLASS_ARENA_H
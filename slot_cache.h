@@ -0,0 +1,156 @@
+#ifndef SLOT_CACHE_H
+#define SLOT_CACHE_H
+
+// Per-thread magazine of free slots that sits in front of ArenaLockFreeHint.
+//
+// Every ArenaLockFreeHint::allocate/free does a CAS (or fetch_or) on a shared bitmap word and a fetch_add on the shared
+// allocation_hint, so under load those cache lines keep bouncing between cores. The idea here is the same one tcmalloc
+// uses for its per-CPU caches: each thread keeps a small stack of slots it owns and only goes back to the bitmap when
+// the stack runs dry or overflows, and when it does it moves whole 64-bit words at a time.
+//
+// A SlotCache is owned by exactly one thread, nothing in here is synchronized. Either keep one on the worker's stack or
+// make it thread_local; the destructor drains whatever is left back to the arena, which doubles as the thread exit path.
+// The cache must be destroyed (or drained) before the arena it points to.
+
+#include "arena_allocator.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct SlotCache {
+    static constexpr uint32_t DEFAULT_CAPACITY = 256;
+    // Refills hand back up to a whole word, so the cache has to be able to hold at least that much.
+    static constexpr uint32_t MIN_CAPACITY = BitmapLockFreeHint::WORD_LENGTH;
+
+    ArenaLockFreeHint* arena;
+    uint32_t capacity;
+    // LIFO so the most recently freed (and most likely still cache hot) slot is handed out first.
+    std::vector<uint32_t> slots;
+    uint64_t refills;
+    uint64_t flushes;
+
+    explicit SlotCache(ArenaLockFreeHint* arena, uint32_t capacity = DEFAULT_CAPACITY);
+    ~SlotCache();
+    SlotCache(const SlotCache&) = delete;
+    SlotCache& operator=(const SlotCache&) = delete;
+
+    char* allocate(size_t size);
+    void free(char* ptr, size_t size);
+    void drain();
+
+private:
+    bool refill();
+    void flush(size_t count);
+};
+
+inline SlotCache::SlotCache(ArenaLockFreeHint* arena, uint32_t capacity)
+    : arena(arena), capacity(std::max(capacity, MIN_CAPACITY)), refills(0), flushes(0) {
+    slots.reserve(this->capacity);
+}
+
+inline SlotCache::~SlotCache() {
+    drain();
+}
+
+/// Pulls one word worth of free slots out of the bitmap. Cached slots count as in use as far as the arena is
+/// concerned, that way slots_in_use is only touched once per batch instead of once per call.
+inline bool SlotCache::refill() {
+    auto [word_idx, mask] = arena->bitmap->claim_word();
+    if (mask == BitmapLockFreeHint::FULLY_ALLOCATED && arena->unpark_words(1) != 0) {
+        std::tie(word_idx, mask) = arena->bitmap->claim_word();
+    }
+    if (mask == BitmapLockFreeHint::FULLY_ALLOCATED) {
+        return false;
+    }
+    int claimed = std::popcount(mask);
+    // Push low bits first so the highest free bit ends up on top, same order allocate_one would have handed them out.
+    while (mask != 0) {
+        uint32_t bit_idx = static_cast<uint32_t>(std::countr_zero(mask));
+        mask &= mask - 1;
+        slots.push_back(static_cast<uint32_t>(arena->bitmap->get_slot_index_from_word_and_bit_index(word_idx, bit_idx)));
+    }
+    arena->slots_in_use.add(claimed);
+    refills++;
+    return true;
+}
+
+/// Returns the `count` oldest slots (bottom of the stack) to the bitmap, one fetch_or per word they live in.
+inline void SlotCache::flush(size_t count) {
+    count = std::min(count, slots.size());
+    if (count == 0) {
+        return;
+    }
+    // Sort the batch so slots that share a word are adjacent and can be released together.
+    std::sort(slots.begin(), slots.begin() + count);
+
+    size_t released = 0;
+    size_t i = 0;
+    while (i < count) {
+        auto [word_idx, bit_idx] = arena->bitmap->get_word_and_bit_index_from_slot_index(slots[i]);
+        uint64_t mask = 0;
+        while (i < count && (slots[i] >> BitmapLockFreeHint::WORD_SHIFT) == word_idx) {
+            mask |= 1ULL << (slots[i] & BitmapLockFreeHint::WORD_MASK);
+            ++i;
+        }
+        uint64_t double_freed = arena->bitmap->release_bits(word_idx, mask);
+        released += std::popcount(mask & ~double_freed);
+        if (arena->reclaim != NULL) {
+            arena->reclaim->note_free(word_idx);
+        }
+    }
+    slots.erase(slots.begin(), slots.begin() + count);
+    arena->slots_in_use.sub(static_cast<int64_t>(released));
+    flushes++;
+}
+
+inline char* SlotCache::allocate(size_t size) {
+    if (size == 0 || size > arena->slot_size) {
+        return NULL; // single-slot only, same as the arena
+    }
+    if (slots.empty() && !refill()) {
+        return NULL;
+    }
+    uint32_t slot_idx = slots.back();
+    slots.pop_back();
+    arena->debug.on_allocate(slot_idx, 1);
+    return arena->base + arena->slot_size * slot_idx;
+}
+
+inline void SlotCache::free(char* ptr, size_t size) {
+    if (ptr == NULL || size == 0 || size > arena->slot_size) {
+        return;
+    }
+    if (ptr < arena->base || ptr >= arena->base + arena->capacity) {
+        arena->debug.on_invalid_free(ptr, size, "outside the arena");
+        return;
+    }
+    ptrdiff_t offset = ptr - arena->base;
+    if (static_cast<size_t>(offset) % arena->slot_size != 0) {
+        arena->debug.on_invalid_free(ptr, size, "not at the start of a slot");
+        return;
+    }
+    // Note: double frees are not caught here, the bitmap bit is 0 for both cached and handed out slots so there is
+    // nothing cheap to check against. Only a slot freed twice while it is still in the bitmap gets dropped on flush.
+    // ARENA_DEBUG builds do catch them, in on_free below.
+    if (slots.size() >= capacity) {
+        // Keep the hot half, give the cold half back.
+        flush(capacity / 2);
+    }
+    uint32_t slot_idx = static_cast<uint32_t>(static_cast<size_t>(offset) / arena->slot_size);
+    arena->debug.on_free(slot_idx, 1);
+    if (arena->generations != NULL) {
+        // Freed as far as handles are concerned even though the bitmap doesn't know yet.
+        arena->generations[slot_idx].fetch_add(1, std::memory_order_relaxed);
+    }
+    slots.push_back(slot_idx);
+}
+
+/// Gives every cached slot back to the arena. Call on thread exit if the cache isn't destroyed then.
+inline void SlotCache::drain() {
+    flush(slots.size());
+}
+
+#endif // SLOT_CACHE_H
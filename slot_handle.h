@@ -0,0 +1,39 @@
+#ifndef SLOT_HANDLE_H
+#define SLOT_HANDLE_H
+
+// A 4-byte reference to one slot: 24 bits of slot index and 8 bits of generation.
+//
+// Page tables that hold millions of these save half the space of a char* (plus whatever remembers the size) and the
+// arena frees a handle without the range check and offset / slot_size division a pointer needs. Every free of a slot
+// bumps its generation, so a handle kept around after its slot was freed (and maybe handed out again) no longer
+// matches and resolve() / free_handle() reject it. 8 bits means a stale handle only goes unnoticed if the slot went
+// through exactly a multiple of 256 frees in between, cheap insurance rather than a guarantee.
+
+#include <cstdint>
+
+struct SlotHandle {
+    static constexpr uint32_t INDEX_BITS = 24;
+    static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+    // Arenas with handles have fewer than INDEX_MASK slots, so this never names a real slot.
+    static constexpr uint32_t INVALID = UINT32_MAX;
+
+    uint32_t value = INVALID;
+
+    static SlotHandle make(uint32_t slot_idx, uint8_t generation) {
+        return SlotHandle{(static_cast<uint32_t>(generation) << INDEX_BITS) | slot_idx};
+    }
+    uint32_t index() const {
+        return value & INDEX_MASK;
+    }
+    uint8_t generation() const {
+        return static_cast<uint8_t>(value >> INDEX_BITS);
+    }
+    bool valid() const {
+        return value != INVALID;
+    }
+    bool operator==(const SlotHandle& other) const = default;
+};
+
+static_assert(sizeof(SlotHandle) == 4, "handles are meant to be stored by the million");
+
+#endif // SLOT_HANDLE_H
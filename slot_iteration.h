@@ -0,0 +1,148 @@
+#ifndef SLOT_ITERATION_H
+#define SLOT_ITERATION_H
+
+// Enumerating the live slots of an arena, for checkpointers and anything else that has to visit every allocated page.
+//
+// The bitmap already knows which slots are taken, so there is no need to track pointers on the side. The arena first
+// copies its words into a BitmapSnapshot, inverted so a set bit is a live slot (parked words and debug guard slots
+// cleared, they're not data), then walks the copy:
+//   - zero words (nothing live) cost one load and a compare, a word with live slots one countr_zero per slot, so the
+//     walk scales with the live slots plus words / 64, not with the arena's bytes.
+//   - the page of the next live slot is prefetched while the visitor works on the current one.
+//   - the parallel walk cuts the words into ranges holding about the same number of live slots, one per thread.
+//
+// Copying first means the visitor runs without holding the bitmap lock, and allocations and frees carry on meanwhile.
+// Slots allocated after the copy aren't visited, slots freed after it still are, so a checkpointer has to cope with a
+// slot going away under it (or quiesce the writers it cares about). A slot is visited once per slot, multi-slot runs
+// show up as their individual slots, the bitmap doesn't remember where runs start.
+//
+// The copy itself: the plain bitmap is copied once under the arena lock, which is a point-in-time snapshot. The
+// lock-free and striped bitmaps are copied word by word with atomic loads (or per-stripe locks), collected twice (and
+// again, up to `attempts` times) until two passes match. A match means nothing changed between the two passes, barring
+// a word that changed and changed back, so the copy is what the bitmap held at that moment: `consistent`. Under heavy
+// churn the passes may never match, then the last pass is returned with consistent false, every word of it still a
+// value the word really had.
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+struct BitmapSnapshot {
+    static constexpr uint32_t DEFAULT_ATTEMPTS = 4;
+
+    // One word per bitmap word, 1 = live slot (the bitmap's own words have 1 = free).
+    std::vector<uint64_t> live;
+    bool consistent = false;
+    uint32_t passes = 0;
+
+    size_t live_slots() const {
+        size_t count = 0;
+        for (uint64_t word : live) {
+            count += static_cast<size_t>(std::popcount(word));
+        }
+        return count;
+    }
+};
+
+/// Fills out with num_words words from load_word(word_idx), collecting until two passes agree or `attempts` extra
+/// passes have been made. Returns whether two passes agreed.
+template <typename LoadWord>
+inline bool collect_words(size_t num_words, LoadWord&& load_word, BitmapSnapshot& out, uint32_t attempts) {
+    out.live.resize(num_words);
+    for (size_t word_idx = 0; word_idx < num_words; ++word_idx) {
+        out.live[word_idx] = load_word(word_idx);
+    }
+    out.passes = 1;
+    for (uint32_t attempt = 0; attempt < attempts; ++attempt) {
+        bool same = true;
+        for (size_t word_idx = 0; word_idx < num_words; ++word_idx) {
+            uint64_t word = load_word(word_idx);
+            same &= word == out.live[word_idx];
+            out.live[word_idx] = word;
+        }
+        out.passes++;
+        if (same) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Calls visit(slot_idx, ptr) for every live slot of words [begin_word, end_word) of the snapshot, ptr_of(slot_idx)
+/// giving the slot's address. Returns the slots visited.
+template <typename PtrOf, typename Visit>
+inline size_t walk_live_slots(const BitmapSnapshot& snapshot, size_t begin_word, size_t end_word, PtrOf&& ptr_of,
+                              Visit&& visit) {
+    constexpr size_t WORD_SHIFT = 6;
+    size_t visited = 0;
+    // One slot behind the bit walk, so the next slot's prefetch is in flight while visit() works on this one.
+    size_t pending = SIZE_MAX;
+    for (size_t word_idx = begin_word; word_idx < end_word; ++word_idx) {
+        uint64_t mask = snapshot.live[word_idx];
+        while (mask != 0) {
+            size_t slot_idx = (word_idx << WORD_SHIFT) | static_cast<size_t>(std::countr_zero(mask));
+            mask &= mask - 1;
+            __builtin_prefetch(ptr_of(slot_idx), 0, 1);
+            if (pending != SIZE_MAX) {
+                visit(pending, ptr_of(pending));
+                visited++;
+            }
+            pending = slot_idx;
+        }
+    }
+    if (pending != SIZE_MAX) {
+        visit(pending, ptr_of(pending));
+        visited++;
+    }
+    return visited;
+}
+
+/// walk_live_slots over `threads` threads (0 = one per hardware thread), each getting a contiguous word range with
+/// about the same number of live slots. visit has to be safe to call from several threads at once.
+template <typename PtrOf, typename Visit>
+inline size_t walk_live_slots_parallel(const BitmapSnapshot& snapshot, unsigned threads, PtrOf&& ptr_of,
+                                       Visit&& visit) {
+    // Below this a thread costs more to start than its share of the walk saves.
+    constexpr size_t MIN_SLOTS_PER_THREAD = 4096;
+
+    size_t live = snapshot.live_slots();
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(1, live / MIN_SLOTS_PER_THREAD)));
+    size_t num_words = snapshot.live.size();
+    if (threads <= 1) {
+        return walk_live_slots(snapshot, 0, num_words, ptr_of, visit);
+    }
+
+    // Cut where the running count of live slots crosses each thread's share.
+    std::vector<size_t> cuts(1, 0);
+    size_t seen = 0;
+    for (size_t word_idx = 0; word_idx < num_words && cuts.size() < threads; ++word_idx) {
+        seen += static_cast<size_t>(std::popcount(snapshot.live[word_idx]));
+        if (seen >= live * cuts.size() / threads) {
+            cuts.push_back(word_idx + 1);
+        }
+    }
+    cuts.push_back(num_words);
+
+    std::vector<size_t> visited(cuts.size() - 1, 0);
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < visited.size(); ++t) {
+        workers.emplace_back([&, t] { visited[t] = walk_live_slots(snapshot, cuts[t], cuts[t + 1], ptr_of, visit); });
+    }
+    visited[0] = walk_live_slots(snapshot, cuts[0], cuts[1], ptr_of, visit);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    size_t total = 0;
+    for (size_t count : visited) {
+        total += count;
+    }
+    return total;
+}
+
+#endif // SLOT_ITERATION_H
@@ -0,0 +1,273 @@
+#ifndef STRIPED_BITMAP_H
+#define STRIPED_BITMAP_H
+
+// Striped bitmap for the lock based arenas.
+//
+// Arena and ArenaNoHint push every allocate and free of the whole region through one lock, so past a couple of threads
+// they mostly measure how fast that lock's cache line can move between cores. The lock-free bitmaps don't have that
+// problem, but multi-slot runs and the placement policies are a lot easier to get right under a lock. So this keeps
+// the plain bitmaps and cuts the region up instead: num_stripes Bitmaps (or BitmapNoHints), each over its own range of
+// words with its own lock, hint and summary. Every thread has a home stripe (ShardedCounter::thread_slot(), round
+// robin) and only goes to the others when its home has nothing left, skipping the ones whose free count says they
+// can't help without taking their lock.
+//
+// What changes compared to one big bitmap:
+//   - a run can't cross a stripe boundary, allocate_many fails for runs longer than a stripe (free_many of a range
+//     that crosses one is invalid, no allocation ever does)
+//   - placement policies and hints apply per stripe, AddressOrdered means lowest address in the stripe it came from
+//   - `words` is a read-only view that takes the stripe lock for every read, it's there for the whole-bitmap readers
+//     (fragmentation_stats, PersistentArena), not for hot paths
+// Global slot and word indices are what they'd be in one bitmap, stripe s just owns words [s * stripe_words, ...).
+
+#include "arena_stats.h"
+#include "bitmap.h"
+#include "placement.h"
+#include "sharded_counter.h"
+#include "word_layout.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+template <typename Inner, typename Lock>
+struct StripedBitmap {
+    static constexpr std::uint32_t WORD_SHIFT = Inner::WORD_SHIFT;
+    static constexpr std::uint32_t WORD_LENGTH = Inner::WORD_LENGTH;
+    static constexpr std::uint32_t WORD_MASK = Inner::WORD_MASK;
+    static constexpr std::uint64_t FULLY_ALLOCATED = Inner::FULLY_ALLOCATED;
+    static constexpr std::uint64_t FULLY_FREE = Inner::FULLY_FREE;
+
+    struct alignas(CACHE_LINE_SIZE) Stripe {
+        Lock lock;
+        // Free slots in this stripe, written under the lock, read without it to skip stripes that can't help.
+        std::atomic<uint32_t> free_slots;
+        uint32_t first_slot;
+        size_t first_word;
+        Inner bitmap;
+
+        Stripe(size_t first_word, uint32_t num_slots)
+            : free_slots(num_slots), first_slot(static_cast<uint32_t>(first_word * WORD_LENGTH)),
+              first_word(first_word), bitmap(num_slots) {
+        }
+        void add_free(int64_t delta) {
+            free_slots.store(static_cast<uint32_t>(free_slots.load(std::memory_order_relaxed) + delta),
+                             std::memory_order_relaxed);
+        }
+    };
+
+    // bitmap->words[word_idx] for the code that walks all of them.
+    struct WordsView {
+        const StripedBitmap* owner;
+        uint64_t operator[](size_t word_idx) const {
+            return owner->word(word_idx);
+        }
+    };
+
+    uint32_t num_slots;
+    size_t stripe_words; // every stripe but maybe the last has this many words
+    uint32_t stripe_slots;
+    std::vector<std::unique_ptr<Stripe>> stripes;
+    WordsView words;
+    // The arena's counters, so the stripe locks show up in its lock stats.
+    ArenaStatsType* stats;
+
+    /// num_stripes 0 means one per hardware thread, never more than there are words.
+    StripedBitmap(uint32_t num_slots, size_t num_stripes, ArenaStatsType& stats);
+
+    std::pair<size_t, uint32_t> get_word_and_bit_index_from_slot_index(uint32_t slot_idx) const;
+    size_t get_slot_index_from_word_and_bit_index(size_t word_idx, uint32_t bit_idx) const;
+    int allocate_one();
+    int allocate_many(uint32_t num_slots);
+    int free_slot(uint32_t slot_idx);
+    int free_many(uint32_t slot_idx, uint32_t num_slots);
+    template <typename Emit>
+    uint32_t allocate_batch(uint32_t count, Emit&& emit);
+    uint64_t release_bits(size_t word_idx, uint64_t mask);
+    bool park_word(size_t word_idx);
+    void set_placement(Placement placement);
+    uint64_t word(size_t word_idx) const;
+
+    size_t home_stripe() const;
+    Stripe& stripe_of_word(size_t word_idx) const;
+    template <typename Claim>
+    int claim(uint32_t needed, Claim&& claim_in);
+};
+
+template <typename Inner, typename Lock>
+StripedBitmap<Inner, Lock>::StripedBitmap(uint32_t num_slots, size_t num_stripes, ArenaStatsType& stats)
+    : num_slots(num_slots), words{this}, stats(&stats) {
+    if (num_slots == 0 || num_slots % WORD_LENGTH != 0) {
+        throw std::invalid_argument("number of slots must be a non-zero multiple of 64");
+    }
+    size_t num_words = num_slots / WORD_LENGTH;
+    if (num_stripes == 0) {
+        num_stripes = std::max(1u, std::thread::hardware_concurrency());
+    }
+    num_stripes = std::min(num_stripes, num_words);
+    stripe_words = (num_words + num_stripes - 1) / num_stripes;
+    stripe_slots = static_cast<uint32_t>(stripe_words * WORD_LENGTH);
+    for (size_t first_word = 0; first_word < num_words; first_word += stripe_words) {
+        size_t words_here = std::min(stripe_words, num_words - first_word);
+        stripes.push_back(std::make_unique<Stripe>(first_word, static_cast<uint32_t>(words_here * WORD_LENGTH)));
+    }
+}
+
+template <typename Inner, typename Lock>
+inline std::pair<size_t, uint32_t>
+StripedBitmap<Inner, Lock>::get_word_and_bit_index_from_slot_index(uint32_t slot_idx) const {
+    return {slot_idx >> WORD_SHIFT, slot_idx & WORD_MASK};
+}
+
+template <typename Inner, typename Lock>
+inline size_t StripedBitmap<Inner, Lock>::get_slot_index_from_word_and_bit_index(size_t word_idx,
+                                                                                 uint32_t bit_idx) const {
+    return word_idx << WORD_SHIFT | bit_idx;
+}
+
+template <typename Inner, typename Lock>
+inline size_t StripedBitmap<Inner, Lock>::home_stripe() const {
+    return ShardedCounter::thread_slot() % stripes.size();
+}
+
+template <typename Inner, typename Lock>
+inline typename StripedBitmap<Inner, Lock>::Stripe& StripedBitmap<Inner, Lock>::stripe_of_word(size_t word_idx) const {
+    return *stripes[word_idx / stripe_words];
+}
+
+/// Home stripe first, then the others in order. claim_in(bitmap) returns a stripe local index or -1, returns the global
+/// one.
+template <typename Inner, typename Lock>
+template <typename Claim>
+inline int StripedBitmap<Inner, Lock>::claim(uint32_t needed, Claim&& claim_in) {
+    size_t stripe_idx = home_stripe();
+    for (size_t tried = 0; tried < stripes.size(); ++tried) {
+        Stripe& stripe = *stripes[stripe_idx];
+        if (++stripe_idx == stripes.size()) {
+            stripe_idx = 0;
+        }
+        if (stripe.free_slots.load(std::memory_order_relaxed) < needed) {
+            continue;
+        }
+        StatsLockGuard<Lock, ArenaStatsType> lock(stripe.lock, *stats);
+        int local_idx = claim_in(stripe.bitmap);
+        if (local_idx != -1) {
+            stripe.add_free(-static_cast<int64_t>(needed));
+            return static_cast<int>(stripe.first_slot) + local_idx;
+        }
+    }
+    return -1;
+}
+
+template <typename Inner, typename Lock>
+inline int StripedBitmap<Inner, Lock>::allocate_one() {
+    return claim(1, [](Inner& bitmap) { return bitmap.allocate_one(); });
+}
+
+/// Contiguous run inside one stripe, -1 if no stripe has one that long (always for runs longer than a stripe).
+template <typename Inner, typename Lock>
+inline int StripedBitmap<Inner, Lock>::allocate_many(uint32_t num_slots) {
+    if (num_slots == 0 || num_slots > stripe_slots) {
+        return -1;
+    }
+    return claim(num_slots, [num_slots](Inner& bitmap) { return bitmap.allocate_many(num_slots); });
+}
+
+/// Same return codes as Bitmap::free_slot.
+template <typename Inner, typename Lock>
+inline int StripedBitmap<Inner, Lock>::free_slot(uint32_t slot_idx) {
+    if (slot_idx >= num_slots) {
+        return -1;
+    }
+    Stripe& stripe = stripe_of_word(slot_idx >> WORD_SHIFT);
+    StatsLockGuard<Lock, ArenaStatsType> lock(stripe.lock, *stats);
+    int rc = stripe.bitmap.free_slot(slot_idx - stripe.first_slot);
+    if (rc == 0) {
+        stripe.add_free(1);
+    }
+    return rc;
+}
+
+/// Same return codes as Bitmap::free_many, a range crossing a stripe boundary is out of bounds.
+template <typename Inner, typename Lock>
+inline int StripedBitmap<Inner, Lock>::free_many(uint32_t slot_idx, uint32_t num_slots) {
+    if (num_slots == 0 || slot_idx >= this->num_slots || num_slots > this->num_slots - slot_idx) {
+        return -1;
+    }
+    Stripe& stripe = stripe_of_word(slot_idx >> WORD_SHIFT);
+    uint32_t local_idx = slot_idx - stripe.first_slot;
+    if (num_slots > stripe.bitmap.num_slots - local_idx) {
+        return -1;
+    }
+    StatsLockGuard<Lock, ArenaStatsType> lock(stripe.lock, *stats);
+    int rc = stripe.bitmap.free_many(local_idx, num_slots);
+    if (rc == 0) {
+        stripe.add_free(num_slots);
+    }
+    return rc;
+}
+
+/// Home stripe first, then whatever the others have, one lock hold per stripe. emit gets global word indices.
+template <typename Inner, typename Lock>
+template <typename Emit>
+inline uint32_t StripedBitmap<Inner, Lock>::allocate_batch(uint32_t count, Emit&& emit) {
+    uint32_t taken = 0;
+    size_t stripe_idx = home_stripe();
+    for (size_t tried = 0; tried < stripes.size() && taken < count; ++tried) {
+        Stripe& stripe = *stripes[stripe_idx];
+        if (++stripe_idx == stripes.size()) {
+            stripe_idx = 0;
+        }
+        if (stripe.free_slots.load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+        StatsLockGuard<Lock, ArenaStatsType> lock(stripe.lock, *stats);
+        uint32_t got = stripe.bitmap.allocate_batch(
+            count - taken, [&](size_t word_idx, uint64_t mask) { emit(stripe.first_word + word_idx, mask); });
+        stripe.add_free(-static_cast<int64_t>(got));
+        taken += got;
+    }
+    return taken;
+}
+
+template <typename Inner, typename Lock>
+inline uint64_t StripedBitmap<Inner, Lock>::release_bits(size_t word_idx, uint64_t mask) {
+    Stripe& stripe = stripe_of_word(word_idx);
+    StatsLockGuard<Lock, ArenaStatsType> lock(stripe.lock, *stats);
+    uint64_t already_free = stripe.bitmap.release_bits(word_idx - stripe.first_word, mask);
+    stripe.add_free(std::popcount(mask & ~already_free));
+    return already_free;
+}
+
+template <typename Inner, typename Lock>
+inline bool StripedBitmap<Inner, Lock>::park_word(size_t word_idx) {
+    Stripe& stripe = stripe_of_word(word_idx);
+    StatsLockGuard<Lock, ArenaStatsType> lock(stripe.lock, *stats);
+    if (!stripe.bitmap.park_word(word_idx - stripe.first_word)) {
+        return false;
+    }
+    stripe.add_free(-static_cast<int64_t>(WORD_LENGTH));
+    return true;
+}
+
+/// Every stripe gets the same policy. Before the bitmap is used, like the placement field of the other bitmaps.
+template <typename Inner, typename Lock>
+void StripedBitmap<Inner, Lock>::set_placement(Placement placement) {
+    for (std::unique_ptr<Stripe>& stripe : stripes) {
+        stripe->bitmap.placement = placement;
+    }
+}
+
+template <typename Inner, typename Lock>
+inline uint64_t StripedBitmap<Inner, Lock>::word(size_t word_idx) const {
+    Stripe& stripe = stripe_of_word(word_idx);
+    StatsLockGuard<Lock, ArenaStatsType> lock(stripe.lock, *stats);
+    return stripe.bitmap.words[word_idx - stripe.first_word];
+}
+
+#endif // STRIPED_BITMAP_H
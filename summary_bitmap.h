@@ -0,0 +1,261 @@
+#ifndef SUMMARY_BITMAP_H
+#define SUMMARY_BITMAP_H
+
+// Summary index over the slot bitmaps: one bit per bitmap word, 1 meaning "this word still has a free slot".
+//
+// Scanning the words array one word at a time is fine while the arena is mostly empty, but once it fills up finding
+// the last few free slots means walking most of the array. Stacking summaries on top of each other (a 64-ary tree,
+// every level has one bit per word of the level below) turns that into a handful of countr_zero calls: at most one
+// word per level on the way up and one on the way down. Each level is 64x smaller, so even the 2^26 words a uint32_t
+// slot index can address only need 5 levels, and a few GB worth of 4 KB pages needs 3.
+//
+// Same 1 == free convention as the bitmaps, so the bit we keep is just `word != FULLY_ALLOCATED`.
+//
+// Both find_next()s tally the summary words they load, plus the bitmap word they hand back, into the ARENA_STATS
+// scan counter (see arena_stats.h). Without ARENA_STATS that's a no-op.
+
+#include "arena_stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct SummaryBitmap {
+    static constexpr std::uint32_t WORD_SHIFT = 6;
+    static constexpr std::uint32_t WORD_MASK = 63;
+    static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+    size_t num_bits;
+    // levels[0] has one bit per tracked word, every level above has one bit per word of the level below it. The last
+    // level is always a single word.
+    std::vector<std::vector<uint64_t>> levels;
+
+    SummaryBitmap(size_t num_bits, bool all_set);
+
+    void set(size_t idx);
+    void clear(size_t idx);
+    bool test(size_t idx) const;
+    size_t find_next(size_t from) const;
+    size_t bits_in_level(size_t level) const;
+};
+
+inline SummaryBitmap::SummaryBitmap(size_t num_bits, bool all_set) : num_bits(num_bits) {
+    size_t bits = num_bits;
+    do {
+        size_t num_words = (bits + WORD_MASK) >> WORD_SHIFT;
+        std::vector<uint64_t> level(num_words, 0);
+        if (all_set) {
+            for (size_t i = 0; i < bits; ++i) {
+                level[i >> WORD_SHIFT] |= 1ULL << (i & WORD_MASK);
+            }
+        }
+        levels.push_back(std::move(level));
+        bits = num_words;
+    } while (bits > 1);
+}
+
+/// Number of meaningful bits in a level, the tail of the last word of every level stays 0.
+inline size_t SummaryBitmap::bits_in_level(size_t level) const {
+    return level == 0 ? num_bits : levels[level - 1].size();
+}
+
+/// Marks idx as having free slots. Only the first bit set in a word has to be propagated to the level above.
+inline void SummaryBitmap::set(size_t idx) {
+    for (auto& level : levels) {
+        uint64_t& word = level[idx >> WORD_SHIFT];
+        bool was_empty = word == 0;
+        word |= 1ULL << (idx & WORD_MASK);
+        if (!was_empty) {
+            return;
+        }
+        idx >>= WORD_SHIFT;
+    }
+}
+
+/// Marks idx as full. Only a word that becomes empty has to be propagated to the level above.
+inline void SummaryBitmap::clear(size_t idx) {
+    for (auto& level : levels) {
+        uint64_t& word = level[idx >> WORD_SHIFT];
+        word &= ~(1ULL << (idx & WORD_MASK));
+        if (word != 0) {
+            return;
+        }
+        idx >>= WORD_SHIFT;
+    }
+}
+
+inline bool SummaryBitmap::test(size_t idx) const {
+    return (levels[0][idx >> WORD_SHIFT] >> (idx & WORD_MASK)) & 1ULL;
+}
+
+/// Returns the first set index >= from, NOT_FOUND if there is none.
+/// Climb while the rest of the current word is empty, then descend taking the lowest set bit on every level.
+inline size_t SummaryBitmap::find_next(size_t from) const {
+    if (from >= num_bits) {
+        return NOT_FOUND;
+    }
+    size_t idx = from;
+    size_t level = 0;
+    uint64_t touched = 1;
+    for (;; ++touched) {
+        size_t word_idx = idx >> WORD_SHIFT;
+        uint64_t word = levels[level][word_idx] & (~0ULL << (idx & WORD_MASK));
+        if (word != 0) {
+            idx = (word_idx << WORD_SHIFT) | static_cast<size_t>(std::countr_zero(word));
+            break;
+        }
+        // Nothing left in this word, continue right after it one level up.
+        if (++level == levels.size() || word_idx + 1 >= bits_in_level(level)) {
+            arena_stats_count_scan(touched);
+            return NOT_FOUND;
+        }
+        idx = word_idx + 1;
+    }
+    arena_stats_count_scan(touched + level + 1);
+    while (level > 0) {
+        --level;
+        idx = (idx << WORD_SHIFT) | static_cast<size_t>(std::countr_zero(levels[level][idx]));
+    }
+    return idx;
+}
+
+// Lock-free flavour for the lock-free bitmaps.
+//
+// Here the summary is only a hint that errs on the side of "has free slots": a set bit may point at a word that has
+// been filled up since, the search then repairs that bit and carries on. What must never happen is a 0 bit over a word
+// that has free slots, that would hide the slot forever. Two rules keep that from happening:
+//   - Whoever moves a bitmap word from FULLY_ALLOCATED to something else (free_slot, release, rollback) calls set().
+//   - Whoever moves a word to FULLY_ALLOCATED calls clear_if_empty(), which clears the bit and then re-reads the word,
+//     setting the bit again if a free raced in between. The same dance happens between summary levels.
+// Either the re-read sees the racing free, or the racing free's set() comes after our clear, so the bit ends up set.
+struct SummaryBitmapLockFree {
+    static constexpr std::uint32_t WORD_SHIFT = 6;
+    static constexpr std::uint32_t WORD_MASK = 63;
+    static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+    size_t num_bits;
+    std::vector<std::unique_ptr<std::atomic<uint64_t>[]>> levels;
+    std::vector<size_t> level_words;
+
+    SummaryBitmapLockFree(size_t num_bits, bool all_set);
+
+    void set(size_t idx);
+    void clear_if_empty(size_t idx, const std::atomic<uint64_t>& word);
+    size_t find_next(size_t from);
+    size_t bits_in_level(size_t level) const;
+
+private:
+    void set_at(size_t level, size_t idx);
+    void clear_at(size_t level, size_t idx);
+};
+
+inline SummaryBitmapLockFree::SummaryBitmapLockFree(size_t num_bits, bool all_set) : num_bits(num_bits) {
+    size_t bits = num_bits;
+    do {
+        size_t num_words = (bits + WORD_MASK) >> WORD_SHIFT;
+        auto level = std::make_unique<std::atomic<uint64_t>[]>(num_words);
+        for (size_t i = 0; i < num_words; ++i) {
+            size_t bits_here = std::min<size_t>(bits - (i << WORD_SHIFT), WORD_MASK + 1);
+            uint64_t value = !all_set ? 0 : bits_here == WORD_MASK + 1 ? ~0ULL : (1ULL << bits_here) - 1;
+            level[i].store(value, std::memory_order_relaxed);
+        }
+        levels.push_back(std::move(level));
+        level_words.push_back(num_words);
+        bits = num_words;
+    } while (bits > 1);
+}
+
+inline size_t SummaryBitmapLockFree::bits_in_level(size_t level) const {
+    return level == 0 ? num_bits : level_words[level - 1];
+}
+
+/// Call after a bitmap word went from FULLY_ALLOCATED to having free slots.
+inline void SummaryBitmapLockFree::set(size_t idx) {
+    set_at(0, idx);
+}
+
+/// Call after a bitmap word became FULLY_ALLOCATED. Re-checks the word itself after clearing, see above.
+inline void SummaryBitmapLockFree::clear_if_empty(size_t idx, const std::atomic<uint64_t>& word) {
+    clear_at(0, idx);
+    if (word.load() != 0) {
+        set_at(0, idx);
+    }
+}
+
+inline void SummaryBitmapLockFree::set_at(size_t level, size_t idx) {
+    for (; level < levels.size(); ++level) {
+        uint64_t old = levels[level][idx >> WORD_SHIFT].fetch_or(1ULL << (idx & WORD_MASK));
+        if (old != 0) {
+            return;
+        }
+        idx >>= WORD_SHIFT;
+    }
+}
+
+inline void SummaryBitmapLockFree::clear_at(size_t level, size_t idx) {
+    size_t word_idx = idx >> WORD_SHIFT;
+    uint64_t bit = 1ULL << (idx & WORD_MASK);
+    uint64_t now = levels[level][word_idx].fetch_and(~bit) & ~bit;
+    if (now != 0 || level + 1 == levels.size()) {
+        return;
+    }
+    clear_at(level + 1, word_idx);
+    if (levels[level][word_idx].load() != 0) {
+        set_at(level + 1, word_idx);
+    }
+}
+
+/// Returns a candidate index >= from whose bit was set when we looked, NOT_FOUND if there is none.
+/// The caller still has to check the bitmap word itself. Stale upper level bits found on the way down get repaired and
+/// the search resumes after the empty subtree.
+inline size_t SummaryBitmapLockFree::find_next(size_t from) {
+    uint64_t touched = 0;
+    while (from < num_bits) {
+        size_t idx = from;
+        size_t level = 0;
+        for (;;) {
+            touched++;
+            size_t word_idx = idx >> WORD_SHIFT;
+            uint64_t word = levels[level][word_idx].load(std::memory_order_acquire) & (~0ULL << (idx & WORD_MASK));
+            if (word != 0) {
+                idx = (word_idx << WORD_SHIFT) | static_cast<size_t>(std::countr_zero(word));
+                break;
+            }
+            if (++level == levels.size() || word_idx + 1 >= bits_in_level(level)) {
+                arena_stats_count_scan(touched);
+                return NOT_FOUND;
+            }
+            idx = word_idx + 1;
+        }
+
+        bool stale = false;
+        while (level > 0) {
+            --level;
+            touched++;
+            uint64_t word = levels[level][idx].load(std::memory_order_acquire);
+            if (word == 0) {
+                // The bit above said there is something below, there isn't (anymore). Fix it up and skip the subtree.
+                clear_at(level + 1, idx);
+                if (levels[level][idx].load() != 0) {
+                    set_at(level + 1, idx);
+                }
+                from = (idx + 1) << (WORD_SHIFT * (level + 1));
+                stale = true;
+                break;
+            }
+            idx = (idx << WORD_SHIFT) | static_cast<size_t>(std::countr_zero(word));
+        }
+        if (!stale) {
+            arena_stats_count_scan(touched + 1);
+            return idx;
+        }
+    }
+    arena_stats_count_scan(touched);
+    return NOT_FOUND;
+}
+
+#endif // SUMMARY_BITMAP_H
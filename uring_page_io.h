@@ -0,0 +1,473 @@
+#ifndef URING_PAGE_IO_H
+#define URING_PAGE_IO_H
+
+// Page I/O for the buffer pool through io_uring, reading and writing straight into arena slots.
+//
+// Arena slots never move, are slot_size aligned inside a page aligned mmap region, which is everything io_uring
+// (and O_DIRECT) want from a buffer:
+//   - IoUring::register_buffers registers the whole arena region as fixed buffers (IORING_REGISTER_BUFFERS, in 1 GB
+//     pieces, the kernel's limit per buffer). Reads and writes into it then go out as READ_FIXED / WRITE_FIXED and the
+//     kernel doesn't pin and unpin the pages on every I/O. When registration fails (RLIMIT_MEMLOCK on older kernels)
+//     everything still works with plain READ / WRITE. Registering pins the region and charges it to RLIMIT_MEMLOCK
+//     once per registration, so the store registers it on its first ring only and clones that buffer table into the
+//     others (IORING_REGISTER_CLONE_BUFFERS, 6.12+), same pages, pinned and charged once. Kernels without cloning
+//     leave the other rings on plain READ / WRITE unless register_region is asked to pin per ring, N times the cost.
+//     The registration outlives the mapping it was made for, unregister_region before the pool goes away.
+//   - UringPageStore turns a file of slot_size pages into a PageIO. The batch callbacks (prefetch_pages, flush_all)
+//     queue the whole batch and submit it with one io_uring_enter, the single page ones submit and wait for one.
+//   - O_DIRECT skips the page cache, the buffer pool is the cache. Needs slot_size to be a multiple of the device's
+//     logical block size, 512 is checked here, 4K devices need 4K slots.
+// No liburing, the ring is set up with the raw syscalls, the way apply_numa_policy does mbind. A ring is not thread
+// safe, the store keeps a few rings each behind its own mutex and picks one by the calling thread's slot.
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+
+#define ARENA_URING 1
+
+#include "arena_allocator.h"
+#include "buffer_pool.h"
+#include "sharded_counter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <memory>
+#include <mutex>
+#include <sched.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+struct IoUring {
+    static constexpr size_t MAX_FIXED_BUFFER = 1ULL << 30;
+
+    int ring_fd;
+    unsigned sq_entries;
+    unsigned cq_entries;
+    char* sq_ring;
+    size_t sq_ring_bytes;
+    char* cq_ring;
+    size_t cq_ring_bytes;
+    io_uring_sqe* sqes;
+    size_t sqes_bytes;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    io_uring_cqe* cqes;
+    // Registered fixed buffer range, base NULL if none.
+    char* fixed_base;
+    size_t fixed_bytes;
+    // Queued but not submitted, and submitted but not reaped. Together they never exceed cq_entries, so the
+    // completion queue can't overflow.
+    unsigned queued;
+    unsigned in_flight;
+
+    static bool available();
+
+    explicit IoUring(unsigned entries = 256);
+    ~IoUring();
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    bool register_buffers(char* base, size_t bytes);
+    bool clone_buffers(const IoUring& source);
+    void unregister_buffers();
+    bool queue_read(int fd, char* buf, uint32_t len, uint64_t offset, uint64_t user_data);
+    bool queue_write(int fd, const char* buf, uint32_t len, uint64_t offset, uint64_t user_data);
+    int submit(unsigned wait_for = 0);
+    template <typename OnComplete>
+    unsigned reap(OnComplete&& on_complete);
+    unsigned discard_queued();
+    template <typename OnComplete>
+    void drain(OnComplete&& on_complete);
+
+    bool queue(uint8_t opcode, uint8_t fixed_opcode, int fd, const char* buf, uint32_t len, uint64_t offset,
+               uint64_t user_data);
+};
+
+/// Whether this kernel lets us set up a ring at all: false for ENOSYS (too old, or compiled out) and EPERM / EACCES
+/// (kernel.io_uring_disabled, seccomp in containers), the cases where constructing an IoUring is bound to throw.
+inline bool IoUring::available() {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, 1, &params));
+    if (fd < 0) {
+        return errno != ENOSYS && errno != EPERM && errno != EACCES;
+    }
+    close(fd);
+    return true;
+}
+
+inline IoUring::IoUring(unsigned entries)
+    : sq_ring(NULL), cq_ring(NULL), sqes(NULL), fixed_base(NULL), fixed_bytes(0), queued(0), in_flight(0) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (ring_fd < 0) {
+        throw std::runtime_error("io_uring_setup failed");
+    }
+    sq_entries = params.sq_entries;
+    cq_entries = params.cq_entries;
+    sq_ring_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        sq_ring_bytes = cq_ring_bytes = std::max(sq_ring_bytes, cq_ring_bytes);
+    }
+
+    void* sq = mmap(NULL, sq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                    IORING_OFF_SQ_RING);
+    void* cq = single_mmap ? sq
+                           : mmap(NULL, cq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                                  IORING_OFF_CQ_RING);
+    sqes_bytes = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqe_array = mmap(NULL, sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                           IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqe_array == MAP_FAILED) {
+        for (void* mapping : {sq, cq, sqe_array}) {
+            if (mapping != MAP_FAILED && (mapping != cq || !single_mmap)) {
+                munmap(mapping, mapping == sqe_array ? sqes_bytes : mapping == sq ? sq_ring_bytes : cq_ring_bytes);
+            }
+        }
+        close(ring_fd);
+        throw std::runtime_error("mmap of the io_uring rings failed");
+    }
+    sq_ring = static_cast<char*>(sq);
+    cq_ring = static_cast<char*>(cq);
+    sqes = static_cast<io_uring_sqe*>(sqe_array);
+
+    sq_head = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.array);
+    cq_head = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq_ring + params.cq_off.cqes);
+}
+
+inline IoUring::~IoUring() {
+    munmap(sqes, sqes_bytes);
+    if (cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_bytes);
+    }
+    munmap(sq_ring, sq_ring_bytes);
+    close(ring_fd); // also drops the buffer registration
+}
+
+/// Registers [base, base + bytes) as fixed buffers, one per GB. false if the kernel said no, I/O then just doesn't
+/// use the fixed opcodes.
+inline bool IoUring::register_buffers(char* base, size_t bytes) {
+    std::vector<iovec> buffers;
+    for (size_t offset = 0; offset < bytes; offset += MAX_FIXED_BUFFER) {
+        buffers.push_back(iovec{base + offset, std::min(MAX_FIXED_BUFFER, bytes - offset)});
+    }
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS, buffers.data(),
+                static_cast<unsigned>(buffers.size())) != 0) {
+        return false;
+    }
+    fixed_base = base;
+    fixed_bytes = bytes;
+    return true;
+}
+
+/// Shares source's registered buffers with this ring, nothing is pinned or charged to RLIMIT_MEMLOCK again. false if
+/// source has none or the kernel can't clone (before 6.12). The headers may predate cloning, hence the local struct,
+/// struct io_uring_clone_buffers: all zero but src_fd clones the whole table.
+inline bool IoUring::clone_buffers(const IoUring& source) {
+    constexpr unsigned REGISTER_CLONE_BUFFERS = 30; // IORING_REGISTER_CLONE_BUFFERS
+    struct {
+        uint32_t src_fd;
+        uint32_t flags;
+        uint32_t src_off;
+        uint32_t dst_off;
+        uint32_t nr;
+        uint32_t pad[3];
+    } clone = {};
+    if (source.fixed_base == NULL) {
+        return false;
+    }
+    clone.src_fd = static_cast<uint32_t>(source.ring_fd);
+    if (syscall(__NR_io_uring_register, ring_fd, REGISTER_CLONE_BUFFERS, &clone, 1) != 0) {
+        return false;
+    }
+    fixed_base = source.fixed_base;
+    fixed_bytes = source.fixed_bytes;
+    return true;
+}
+
+/// Drops the fixed buffers, I/O goes back to plain READ / WRITE. Has to happen before the registered memory is
+/// unmapped: the registration keeps the old pages pinned, and a new mapping at the same address would have its fixed
+/// reads land in those instead.
+inline void IoUring::unregister_buffers() {
+    if (fixed_base != NULL) {
+        syscall(__NR_io_uring_register, ring_fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+        fixed_base = NULL;
+        fixed_bytes = 0;
+    }
+}
+
+/// Fills the next SQE. false when the rings are full, submit and reap first.
+inline bool IoUring::queue(uint8_t opcode, uint8_t fixed_opcode, int fd, const char* buf, uint32_t len,
+                           uint64_t offset, uint64_t user_data) {
+    if (queued + in_flight >= cq_entries) {
+        return false;
+    }
+    unsigned tail = *sq_tail;
+    if (tail - std::atomic_ref<unsigned>(*sq_head).load(std::memory_order_acquire) >= sq_entries) {
+        return false;
+    }
+    unsigned idx = tail & *sq_mask;
+    io_uring_sqe& sqe = sqes[idx];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(buf);
+    sqe.len = len;
+    sqe.off = offset;
+    sqe.user_data = user_data;
+    // A read or write fully inside one registered buffer uses it, buffers are MAX_FIXED_BUFFER apart.
+    if (fixed_base != NULL && buf >= fixed_base && buf + len <= fixed_base + fixed_bytes &&
+        static_cast<size_t>(buf - fixed_base) / MAX_FIXED_BUFFER ==
+            static_cast<size_t>(buf + len - 1 - fixed_base) / MAX_FIXED_BUFFER) {
+        sqe.opcode = fixed_opcode;
+        sqe.buf_index = static_cast<uint16_t>(static_cast<size_t>(buf - fixed_base) / MAX_FIXED_BUFFER);
+    } else {
+        sqe.opcode = opcode;
+    }
+    sq_array[idx] = idx;
+    std::atomic_ref<unsigned>(*sq_tail).store(tail + 1, std::memory_order_release);
+    queued++;
+    return true;
+}
+
+inline bool IoUring::queue_read(int fd, char* buf, uint32_t len, uint64_t offset, uint64_t user_data) {
+    return queue(IORING_OP_READ, IORING_OP_READ_FIXED, fd, buf, len, offset, user_data);
+}
+
+inline bool IoUring::queue_write(int fd, const char* buf, uint32_t len, uint64_t offset, uint64_t user_data) {
+    return queue(IORING_OP_WRITE, IORING_OP_WRITE_FIXED, fd, buf, len, offset, user_data);
+}
+
+/// Submits everything queued with one io_uring_enter and waits until at least wait_for completions are there.
+/// Returns the number submitted, -errno on failure.
+inline int IoUring::submit(unsigned wait_for) {
+    unsigned flags = wait_for != 0 ? IORING_ENTER_GETEVENTS : 0;
+    for (;;) {
+        long rc = syscall(__NR_io_uring_enter, ring_fd, queued, wait_for, flags, NULL, 0);
+        if (rc >= 0) {
+            queued -= static_cast<unsigned>(rc);
+            in_flight += static_cast<unsigned>(rc);
+            return static_cast<int>(rc);
+        }
+        if (errno != EINTR) {
+            return -errno;
+        }
+    }
+}
+
+/// Hands every available completion to on_complete(user_data, res), returns how many.
+template <typename OnComplete>
+unsigned IoUring::reap(OnComplete&& on_complete) {
+    unsigned head = *cq_head;
+    unsigned tail = std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire);
+    unsigned reaped = 0;
+    for (; head != tail; ++head, ++reaped) {
+        const io_uring_cqe& cqe = cqes[head & *cq_mask];
+        on_complete(cqe.user_data, cqe.res);
+    }
+    std::atomic_ref<unsigned>(*cq_head).store(head, std::memory_order_release);
+    in_flight -= reaped;
+    return reaped;
+}
+
+/// Takes back the SQEs that were queued but not submitted, returns how many. Only this thread (holding the ring) ever
+/// touches the tail and the kernel only looks at the SQ inside io_uring_enter, so rewinding the tail is all it takes.
+inline unsigned IoUring::discard_queued() {
+    unsigned discarded = queued;
+    std::atomic_ref<unsigned>(*sq_tail).store(*sq_tail - discarded, std::memory_order_release);
+    queued = 0;
+    return discarded;
+}
+
+/// Waits for everything in flight and reaps it, so nothing is still writing into the buffers when this returns and no
+/// stale completion is left for the next batch. Retries a failing wait, giving up would leave I/O running into memory
+/// the caller is about to reuse.
+template <typename OnComplete>
+void IoUring::drain(OnComplete&& on_complete) {
+    for (reap(on_complete); in_flight != 0; reap(on_complete)) {
+        long rc = syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (rc < 0 && errno != EINTR) {
+            sched_yield();
+        }
+    }
+}
+
+struct UringPageStore {
+    int fd;
+    size_t page_size;
+    bool direct;
+    std::vector<std::unique_ptr<IoUring>> rings;
+    std::unique_ptr<std::mutex[]> ring_locks;
+    // Failed or short writes and failed reads, including the ones a failed submit never sent. Reads past the end of
+    // the file aren't errors, they come back zeroed.
+    std::atomic<uint64_t> io_errors;
+
+    /// Opens (creating if needed) the page file. direct asks for O_DIRECT. Throws std::invalid_argument when
+    /// page_size can't work with O_DIRECT, std::runtime_error when the file or the rings can't be set up.
+    UringPageStore(const char* path, size_t page_size, bool direct, size_t num_rings = 4, unsigned ring_entries = 256);
+    ~UringPageStore();
+    UringPageStore(const UringPageStore&) = delete;
+    UringPageStore& operator=(const UringPageStore&) = delete;
+
+    size_t register_region(const ArenaRegion& region, bool pin_per_ring = false);
+    void unregister_region();
+    bool read_pages(const uint64_t* page_ids, char* const* data, size_t n);
+    bool write_pages(const uint64_t* page_ids, const char* const* data, size_t n);
+    PageIO page_io();
+
+    template <typename QueueOne>
+    bool run_batch(size_t n, bool is_read, char* const* read_data, QueueOne&& queue_one);
+};
+
+inline UringPageStore::UringPageStore(const char* path, size_t page_size, bool direct, size_t num_rings,
+                                      unsigned ring_entries)
+    : page_size(page_size), direct(direct), io_errors(0) {
+    constexpr size_t LOGICAL_BLOCK_SIZE = 512;
+    if (page_size == 0 || page_size > UINT32_MAX || (direct && page_size % LOGICAL_BLOCK_SIZE != 0)) {
+        throw std::invalid_argument("page_size must be a non-zero multiple of the logical block size");
+    }
+    fd = open(path, O_RDWR | O_CREAT | (direct ? O_DIRECT : 0), 0644);
+    if (fd < 0) {
+        throw std::runtime_error("opening the page file failed");
+    }
+    try {
+        for (size_t i = 0; i < std::max<size_t>(1, num_rings); ++i) {
+            rings.push_back(std::make_unique<IoUring>(ring_entries));
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    ring_locks = std::make_unique<std::mutex[]>(rings.size());
+}
+
+inline UringPageStore::~UringPageStore() {
+    rings.clear();
+    close(fd);
+}
+
+/// Registers the region with the first ring and clones it into the others, returns how many rings ended up with it.
+/// Where cloning isn't supported pin_per_ring registers it with every ring instead, which pins the region and charges
+/// RLIMIT_MEMLOCK once per ring: a multi-GB pool on 4 rings needs 4 times its size of locked memory.
+/// Replaces whatever was registered before. A pool that goes away before the store has to unregister_region() first.
+inline size_t UringPageStore::register_region(const ArenaRegion& region, bool pin_per_ring) {
+    unregister_region();
+    {
+        std::lock_guard<std::mutex> lock(ring_locks[0]);
+        if (!rings[0]->register_buffers(region.base, region.mapped_bytes)) {
+            return 0;
+        }
+    }
+    size_t registered = 1;
+    for (size_t i = 1; i < rings.size(); ++i) {
+        std::lock_guard<std::mutex> lock(ring_locks[i]);
+        bool ok = rings[i]->clone_buffers(*rings[0]) ||
+                  (pin_per_ring && rings[i]->register_buffers(region.base, region.mapped_bytes));
+        registered += ok ? 1 : 0;
+    }
+    return registered;
+}
+
+inline void UringPageStore::unregister_region() {
+    for (size_t i = 0; i < rings.size(); ++i) {
+        std::lock_guard<std::mutex> lock(ring_locks[i]);
+        rings[i]->unregister_buffers();
+    }
+}
+
+/// Queues the whole batch on one ring, submitting whenever the ring fills up, and waits for all of it. user_data is
+/// the index into the batch. false if any page failed, failed reads come back zeroed. When a submit fails the rest of
+/// the batch isn't sent: what was queued is taken back, what was already submitted is waited for, so the ring is empty
+/// again for the next batch and no read lands in a frame after this returns.
+template <typename QueueOne>
+bool UringPageStore::run_batch(size_t n, bool is_read, char* const* read_data, QueueOne&& queue_one) {
+    size_t ring_idx = ShardedCounter::thread_slot() % rings.size();
+    std::lock_guard<std::mutex> lock(ring_locks[ring_idx]);
+    IoUring& ring = *rings[ring_idx];
+
+    uint64_t errors = 0;
+    auto on_complete = [&](uint64_t i, int32_t res) {
+        if (res < 0 || (!is_read && static_cast<size_t>(res) != page_size)) {
+            errors++;
+            res = 0;
+        }
+        if (is_read && static_cast<size_t>(res) < page_size) {
+            // Past the end of the file (or failed): a new page.
+            std::memset(read_data[i] + res, 0, page_size - static_cast<size_t>(res));
+        }
+    };
+    size_t next = 0;
+    while (next < n || ring.queued + ring.in_flight != 0) {
+        while (next < n && queue_one(ring, next)) {
+            next++;
+        }
+        int rc = ring.submit(next < n ? 1 : ring.queued + ring.in_flight);
+        if (rc < 0) {
+            // Batch entries are queued in order, so the ones taken back are the last ones queued.
+            next -= ring.discard_queued();
+            ring.drain(on_complete);
+            errors += n - next;
+            for (size_t i = next; is_read && i < n; ++i) {
+                std::memset(read_data[i], 0, page_size);
+            }
+            break;
+        }
+        ring.reap(on_complete);
+    }
+    if (errors != 0) {
+        io_errors.fetch_add(errors, std::memory_order_relaxed);
+    }
+    return errors == 0;
+}
+
+inline bool UringPageStore::read_pages(const uint64_t* page_ids, char* const* data, size_t n) {
+    return run_batch(n, true, data, [&](IoUring& ring, size_t i) {
+        return ring.queue_read(fd, data[i], static_cast<uint32_t>(page_size), page_ids[i] * page_size, i);
+    });
+}
+
+inline bool UringPageStore::write_pages(const uint64_t* page_ids, const char* const* data, size_t n) {
+    return run_batch(n, false, NULL, [&](IoUring& ring, size_t i) {
+        return ring.queue_write(fd, data[i], static_cast<uint32_t>(page_size), page_ids[i] * page_size, i);
+    });
+}
+
+/// PageIO for a BufferPool whose page size matches. The store has to outlive the pool.
+inline PageIO UringPageStore::page_io() {
+    PageIO io;
+    io.read_page = [this](uint64_t page_id, char* data) { return read_pages(&page_id, &data, 1); };
+    io.write_page = [this](uint64_t page_id, const char* data) { write_pages(&page_id, &data, 1); };
+    io.read_pages = [this](const uint64_t* page_ids, char* const* data, size_t n) {
+        return read_pages(page_ids, data, n);
+    };
+    io.write_pages = [this](const uint64_t* page_ids, const char* const* data, size_t n) {
+        write_pages(page_ids, data, n);
+    };
+    return io;
+}
+
+#endif // __linux__ && <linux/io_uring.h>
+
+#endif // URING_PAGE_IO_H
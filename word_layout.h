@@ -0,0 +1,108 @@
+#ifndef WORD_LAYOUT_H
+#define WORD_LAYOUT_H
+
+// How the lock-free bitmaps lay their atomic words out in memory.
+//
+// Eight std::atomic<uint64_t> fit in a 64-byte cache line, so with the plain array layout eight neighbouring words
+// share a line. BitmapLockFreeHint spreads threads over consecutive words (every allocate_one bumps the hint by one),
+// which is exactly the pattern that makes threads working on *different* words still fight over the same line.
+//
+//   - DenseWords:       the plain array, eight words per line. Smallest and best for scans, the default.
+//   - PaddedWords:      one word per line. No word ever shares a line, at 8x the memory.
+//   - InterleavedWords: same memory as dense, but the words of every 64-word block are transposed so that logical
+//                       words i and i + 1 live on different lines. Words i and i + 8 share a line instead, which the
+//                       hint only gets to much later.
+// Every layout hands out std::atomic<uint64_t>& by logical word index, the bitmaps don't care which one they have.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+// GCC warns that the value depends on -mtune, which is fine here: it only sizes padding, nothing is persisted or shared
+// across builds.
+#if defined(__cpp_lib_hardware_interference_size)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+#endif
+inline constexpr size_t CACHE_LINE_SIZE = std::hardware_destructive_interference_size;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#else
+inline constexpr size_t CACHE_LINE_SIZE = 64;
+#endif
+
+struct DenseWords {
+    static constexpr const char* NAME = "dense";
+
+    std::unique_ptr<std::atomic<uint64_t>[]> storage;
+
+    explicit DenseWords(size_t num_words) : storage(new std::atomic<uint64_t>[num_words]) {
+    }
+
+    std::atomic<uint64_t>& operator[](size_t word_idx) {
+        return storage[word_idx];
+    }
+    const std::atomic<uint64_t>& operator[](size_t word_idx) const {
+        return storage[word_idx];
+    }
+};
+
+struct PaddedWords {
+    static constexpr const char* NAME = "padded";
+
+    struct alignas(CACHE_LINE_SIZE) Line {
+        std::atomic<uint64_t> word;
+    };
+    std::unique_ptr<Line[]> lines;
+
+    explicit PaddedWords(size_t num_words) : lines(new Line[num_words]) {
+    }
+
+    std::atomic<uint64_t>& operator[](size_t word_idx) {
+        return lines[word_idx].word;
+    }
+    const std::atomic<uint64_t>& operator[](size_t word_idx) const {
+        return lines[word_idx].word;
+    }
+};
+
+struct InterleavedWords {
+    static constexpr const char* NAME = "interleaved";
+    static constexpr size_t WORDS_PER_LINE = CACHE_LINE_SIZE / sizeof(uint64_t);
+    static_assert(WORDS_PER_LINE == 8 || WORDS_PER_LINE == 16, "the transpose below assumes 64 or 128 byte lines");
+    // The transpose works on square blocks, WORDS_PER_LINE lines of WORDS_PER_LINE words.
+    static constexpr size_t BLOCK_WORDS = WORDS_PER_LINE * WORDS_PER_LINE;
+    static constexpr uint32_t LINE_SHIFT = WORDS_PER_LINE == 8 ? 3 : 4;
+
+    struct alignas(CACHE_LINE_SIZE) Line {
+        std::atomic<uint64_t> words[WORDS_PER_LINE];
+    };
+    std::unique_ptr<Line[]> lines;
+
+    explicit InterleavedWords(size_t num_words)
+        : lines(new Line[(num_words + BLOCK_WORDS - 1) / BLOCK_WORDS * WORDS_PER_LINE]) {
+    }
+
+    /// Swaps the line and position bits inside a block: word i goes to line i % WORDS_PER_LINE of its block.
+    static size_t physical_index(size_t word_idx) {
+        size_t in_block = word_idx & (BLOCK_WORDS - 1);
+        size_t line = in_block & (WORDS_PER_LINE - 1);
+        size_t position = in_block >> LINE_SHIFT;
+        return (word_idx & ~(BLOCK_WORDS - 1)) | (line << LINE_SHIFT) | position;
+    }
+
+    std::atomic<uint64_t>& operator[](size_t word_idx) {
+        size_t physical = physical_index(word_idx);
+        return lines[physical >> LINE_SHIFT].words[physical & (WORDS_PER_LINE - 1)];
+    }
+    const std::atomic<uint64_t>& operator[](size_t word_idx) const {
+        size_t physical = physical_index(word_idx);
+        return lines[physical >> LINE_SHIFT].words[physical & (WORDS_PER_LINE - 1)];
+    }
+};
+
+#endif // WORD_LAYOUT_H